@@ -46,6 +46,7 @@
 
 /* POSIX Header files */
 #include <pthread.h>
+#include <semaphore.h>
 
 /* Driver Header files */
 #include <ti/drivers/ADC.h>
@@ -55,11 +56,24 @@
 /* Driver configuration */
 #include "ti_drivers_config.h"
 
+/* load cell decimation chain, loadcell_dsp.c/.h from the network terminal project */
+#include "loadcell_dsp.h"
+
 /* ADC sample count */
 #define ADC_SAMPLE_COUNT  (10)
 
 #define THREADSTACKSIZE   (768)
 
+/* load cell oversampling, output rate is LC_PAIR_RATE_HZ / (2 << LC_LOG2_DECIM) = 62.5 Hz by default */
+#define LC_PAIR_PERIOD_US   (500)       /* one ADC_0/ADC_1 conversion pair every 500 us (2 kHz) */
+#define LC_LOG2_DECIM       (4)         /* CIC decimation R = 16 */
+#define LC_OUT_BITS         (24)        /* 16 or 24 */
+#define LC_PRINT_EVERY      (32)        /* print one output in this many when not dumping */
+
+/* define to print every raw difference and output for util/loadcell_dsp.py to check, the UART can't keep up
+ * with a 2 kHz pair rate so raise LC_PAIR_PERIOD_US while dumping */
+//#define LOADCELL_DSP_DUMP
+
 /* ADC conversion result variables */
 uint16_t adcValue0;
 uint16_t adcValue1;  //derek
@@ -72,6 +86,21 @@ uint32_t adcValue2MicroVolt;  //derek
 
 static Display_Handle display;
 
+/* posted by the timer callback once per conversion pair */
+static sem_t lcSampleSem;
+static volatile uint32_t lcTicks;
+static loadcell_dsp_t lcDsp;
+
+/*
+ *  ======== lcTimerCallback ========
+ *  Paces the load cell conversions, the conversions themselves run in threadFxn0.
+ */
+static void lcTimerCallback(Timer_Handle handle, int_fast16_t status)
+{
+    lcTicks++;
+    sem_post(&lcSampleSem);
+}
+
 /*
  *  ======== threadFxn0 ========
  *  Open an ADC instance and get a sampling result from a one-shot conversion.
@@ -80,20 +109,13 @@ void *threadFxn0(void *arg0)
 {
     ADC_Handle   adc0;
     ADC_Handle   adc1;
-    ADC_Handle   adc2;
     ADC_Params   params;
     int_fast16_t res0;
     int_fast16_t res1;
-    int_fast16_t res2;
-
-
-    //Jonah added variables
-    time_t time_new, time_old;
 
     ADC_Params_init(&params);
     adc0 = ADC_open(CONFIG_ADC_0, &params);  //derek
     adc1 = ADC_open(CONFIG_ADC_1, &params);  //derek
-    adc2 = ADC_open(CONFIG_ADC_2, &params);  //derek
 
     if (adc0 == NULL) {
         Display_printf(display, 0, 0, "Error initializing CONFIG_ADC_0\n");
@@ -105,20 +127,28 @@ void *threadFxn0(void *arg0)
             Display_printf(display, 0, 0, "Error initializing CONFIG_ADC_1\n");
             while (1);
         }
-    if (adc0 == NULL) {
-            Display_printf(display, 0, 0, "Error initializing CONFIG_ADC_2\n");
-            while (1);
-        }
 
     ////////////////////////////////////////////////////////////////////////////
     //JONAH ADDED START
+    if (sem_init(&lcSampleSem, 0, 0) != 0) {
+        Display_printf(display, 0, 0, "Error creating lcSampleSem\n");
+        while (1);
+    }
+
+    if (loadcell_dsp_init(&lcDsp, LC_LOG2_DECIM, LC_OUT_BITS) != 0) {
+        Display_printf(display, 0, 0, "Invalid load cell decimation settings\n");
+        while (1);
+    }
+
+    /* the timer paces the oversampled conversions and its tick count doubles as the sample clock */
     Timer_init();
     Timer_Handle    handle;
     Timer_Params    timer_params;
     Timer_Params_init(&timer_params);
     timer_params.periodUnits = Timer_PERIOD_US;
-    timer_params.period = 10000000;
-    timer_params.timerMode  = Timer_FREE_RUNNING;
+    timer_params.period = LC_PAIR_PERIOD_US;
+    timer_params.timerMode  = Timer_CONTINUOUS_CALLBACK;
+    timer_params.timerCallback = lcTimerCallback;
     handle = Timer_open(CONFIG_TIMER_0, &timer_params);
     if(handle == NULL){
         Display_printf(display, 0, 0, "Error opening timer handle");
@@ -135,37 +165,41 @@ void *threadFxn0(void *arg0)
         while (1);
     }
 
-    uint32_t timer_clock;
-    //ADCTimerEnable(ADC_BASE);
-    //unsigned long timer_value;
-    int i = 10;
+    int32_t diff;
+    int32_t lcOut;
+    uint32_t lcOutCount = 0;
     while(1){
-        usleep(800000);
+        sem_wait(&lcSampleSem);
 
         res0 = ADC_convert(adc0, &adcValue0);
         res1 = ADC_convert(adc1, &adcValue1);  //derek
-        res2 = ADC_convert(adc2, &adcValue2);  //derek
-        //time_old = time_new;S
-        //time_new = clock();
 
-        if (res0 == ADC_STATUS_SUCCESS || res1 == ADC_STATUS_SUCCESS || res2 == ADC_STATUS_SUCCESS) {
+        if (res0 != ADC_STATUS_SUCCESS || res1 != ADC_STATUS_SUCCESS) {
+            Display_printf(display, 0, 0, "CONFIG_ADC_0/1 convert failed\n");
+            continue;
+        }
 
-            adcValue0MicroVolt = ADC_convertRawToMicroVolts(adc0, adcValue0);
-            adcValue1MicroVolt = ADC_convertRawToMicroVolts(adc1, adcValue1);
-            adcValue2MicroVolt = ADC_convertRawToMicroVolts(adc2, adcValue2);
+        /* both channels share the same reference and gain, so the raw code difference is proportional to the
+         * microvolt difference and keeps the decimation chain in integer arithmetic */
+        diff = (int32_t)adcValue1 - (int32_t)adcValue0;
+#ifdef LOADCELL_DSP_DUMP
+        Display_printf(display, 0, 0, "raw,%d", diff);
+#endif
 
-            timer_clock = Timer_getCount(handle);
+        if (!loadcell_dsp_push(&lcDsp, diff, &lcOut)) {
+            continue;
+        }
 
-            Display_printf(display, 0, 0, "Difference %d, CONFIG_ADC_0 %d uV, CONFIG_ADC_1 %d uV, clock = %u\n",
-                           adcValue1MicroVolt-adcValue0MicroVolt,adcValue0MicroVolt, adcValue1MicroVolt, (unsigned int)(timer_clock));
+        lcOutCount++;
 
+#ifdef LOADCELL_DSP_DUMP
+        Display_printf(display, 0, 0, "out,%d", lcOut);
+#else
+        if (lcOutCount % LC_PRINT_EVERY == 0) {
+            Display_printf(display, 0, 0, "Load cell %d (1/%d code), tick = %u\n",
+                           lcOut, 1 << (LC_OUT_BITS - LC_INPUT_BITS), (unsigned int)lcTicks);
         }
-        else {
-            Display_printf(display, 0, 0, "CONFIG_ADC_0 convert failed\n");
-        }
-        if(i == 0){
-            break;
-        }
+#endif
     }
     //JONAH ADDED END
 
@@ -187,7 +221,6 @@ void *threadFxn0(void *arg0)
 
     ADC_close(adc0);
     ADC_close(adc1);
-    ADC_close(adc2);
 
     return (NULL);
 }
@@ -0,0 +1,74 @@
+import struct
+import sys
+import zlib
+
+# make sure these match boot_profile.h in the cc3220sf network terminal code
+BOOT_PROFILE_FILE = 'boot_profile.bin'
+BOOT_PROFILE_MAGIC = 0x46525042
+BOOT_PROFILE_VERSION = 1
+BOOT_PROFILE_SIZE = 128
+BOOT_FLAG_HEADLESS = 0x01
+
+ROLES = {
+    'terminal': 0,
+    'beacon_sync': 1,
+    'tx_accel': 2,  # same as event_loop_beacons on the board
+    'event_loop_beacons': 3,
+    'track_multi_ap': 4,
+    'stream_accel': 5,
+    'stream_events': 6,
+    'stream_sensors': 7,
+    'event_loop_connected': 8,
+}
+
+# sensor ids from sensor.h
+SENSORS = {
+    'accel': 0,
+    'loadcell': 1,
+    'rtc': 2,
+}
+
+
+def make_boot_profile(role='beacon_sync', headless=True, sensors=('accel',), channel=11, beacon_mac=None,
+                      sample_period_us=0, upload_interval_ms=30000, ssid='jonah_ap', key='12345678'):
+    """
+    Builds the binary boot profile read by boot_profile_load() on the board.
+
+    :param role: (str) one of ROLES
+    :param headless: (bool) skip the banner and command menu on boot
+    :param sensors: (iterable) names from SENSORS to sample
+    :param channel: (int) transceiver mode channel
+    :param beacon_mac: (str) 'aa:bb:cc:dd:ee:ff' source address of the beacons to keep, None keeps the built in one
+    :param sample_period_us: (int) sampling period of the sensors, a multiple of 250, 0 for each sensor's default
+    :param upload_interval_ms: (int) time between uploads in test_time_beac_sync()
+    :param ssid: (str) AP to connect to for uploads
+    :param key: (str) WPA2 key of that AP
+    :return: (bytes) BOOT_PROFILE_SIZE bytes
+    """
+    mac = bytes(6) if beacon_mac is None else bytes(int(b, 16) for b in beacon_mac.split(':'))
+    ssid = ssid.encode()
+    key = key.encode()
+    if len(mac) != 6 or len(ssid) > 32 or len(key) > 64:
+        raise ValueError('bad MAC, SSID or key length')
+
+    sensor_mask = 0
+    for name in sensors:
+        sensor_mask |= 1 << SENSORS[name]
+
+    body = struct.pack('<IBBBBB6sBII33s65sH', BOOT_PROFILE_MAGIC, BOOT_PROFILE_VERSION, ROLES[role],
+                       BOOT_FLAG_HEADLESS if headless else 0, sensor_mask, channel, mac, 0,
+                       sample_period_us, upload_interval_ms, ssid, key, 0)
+    profile = body + struct.pack('<I', zlib.crc32(body))
+    assert len(profile) == BOOT_PROFILE_SIZE
+    return profile
+
+
+if __name__ == "__main__":
+    # usage: python boot_profile.py <role> [beacon mac] [out file]
+    # flash the output to the board's file system as boot_profile.bin with Uniflash
+    args = sys.argv[1:]
+    out = args[2] if len(args) > 2 else BOOT_PROFILE_FILE
+    with open(out, 'wb') as f:
+        f.write(make_boot_profile(role=args[0] if len(args) > 0 else 'beacon_sync',
+                                  beacon_mac=args[1] if len(args) > 1 else None))
+    print(f'wrote {out}')
@@ -0,0 +1,62 @@
+import ast
+import re
+import socket
+import struct
+
+# uploads.bin, one record per upload: host time (s), board IPv4 address, payload length, then the payload exactly as
+# received by recv_upload()
+CAPTURE_FILE = "uploads.bin"
+CAPTURE_RECORD = '<d4sI'
+
+CONNECTION_LINE = re.compile(r"\*\*\* connection from \('([\d.]+)', (\d+)\) \*\*\*")
+
+
+def append_capture(path, host_time, client_address, data):
+    """
+    :param path: (str) capture file, created when it does not exist
+    :param host_time: (float) time.time() when the upload was received
+    :param client_address: (tuple) (ip, port) from accept()
+    :param data: (bytes) the upload
+    """
+    with open(path, 'ab') as f:
+        f.write(struct.pack(CAPTURE_RECORD, host_time, socket.inet_aton(client_address[0]), len(data)))
+        f.write(data)
+
+
+def read_capture(path):
+    """
+    :param path: (str) capture file written by append_capture()
+    :return: (generator) of (host_time, client_address, data), client_address is (ip, 0)
+    """
+    size = struct.calcsize(CAPTURE_RECORD)
+    with open(path, 'rb') as f:
+        while True:
+            header = f.read(size)
+            if len(header) < size:
+                return
+            host_time, ip, length = struct.unpack(CAPTURE_RECORD, header)
+            data = f.read(length)
+            if len(data) < length:
+                return
+            yield host_time, (socket.inet_ntoa(ip), 0), data
+
+
+def read_laptop_log(path):
+    """
+    Uploads logged by system_integration.linux(), the bytes repr line that follows each "*** connection from ... ***"
+    line. laptop.log has no timestamps, host_time is None.
+
+    :param path: (str) laptop.log of an experiment
+    :return: (generator) of (None, client_address, data)
+    """
+    client_address = None
+    with open(path) as f:
+        for line in f:
+            m = CONNECTION_LINE.search(line)
+            if m:
+                client_address = (m.group(1), int(m.group(2)))
+                continue
+            line = line.strip()
+            if client_address is not None and (line.startswith("b'") or line.startswith('b"')):
+                yield None, client_address, ast.literal_eval(line)
+                client_address = None
@@ -0,0 +1,208 @@
+import struct
+
+from board_communication.boot_profile import SENSORS
+from board_communication.perf_counters import decode_perf_snapshot
+
+# make sure these match cmd_proto.h in the cc3220sf network terminal code
+CMD_MAGIC = 0x4443
+CMD_HEADER = struct.Struct('<HBBHH')  # magic, opcode, status, request id, args length
+CMD_TLV_HEADER = struct.Struct('<BH')  # type, length
+CMD_MAX_FRAME = 512
+CMD_RESPONSE = 0x80
+
+# in CMD_OPCODES order, opcode 0 is unused
+OPCODES = {
+    'TIME_START': 1,
+    'TIME_PROBE': 2,
+    'CAPTURE_START': 3,
+    'CAPTURE_STOP': 4,
+    'SET_RATES': 5,
+    'SET_UPLOAD': 6,
+    'GET_COUNTERS': 7,
+}
+
+# name -> (type, struct format of the value), None for raw bytes
+TLV_TYPES = {
+    'TIME_SEC': (0x01, '<I'),
+    'TIME_NSEC': (0x02, '<I'),
+    'LOCAL_US': (0x03, '<I'),
+    'SAMPLE_PERIOD_US': (0x04, '<I'),
+    'SENSORS': (0x05, '<B'),
+    'UPLOAD_INTERVAL_MS': (0x06, '<I'),
+    'PERSIST': (0x07, '<B'),
+    'PERF': (0x08, None),
+}
+TLV_NAMES = {tlv_type: name for name, (tlv_type, _) in TLV_TYPES.items()}
+
+STATUS = {
+    0: 'OK',
+    1: 'BAD_OPCODE',
+    2: 'BAD_ARGS',
+    3: 'BAD_STATE',
+    4: 'FAILED',
+}
+
+
+class CmdError(Exception):
+    def __init__(self, opcode, status):
+        super().__init__(f'{opcode} failed on the board: {STATUS.get(status, status)}')
+        self.opcode = opcode
+        self.status = status
+
+
+def encode_request(opcode, request_id, args=None):
+    """
+    Builds one request frame.
+
+    :param opcode: (str) one of OPCODES
+    :param request_id: (int) echoed by the board in its response, 0-65535
+    :param args: (dict) TLV_TYPES name -> value, an int for the typed ones and bytes for the raw ones
+    :return: (bytes) the frame
+    """
+    body = b''
+    for name, value in (args or {}).items():
+        tlv_type, fmt = TLV_TYPES[name]
+        value = bytes(value) if fmt is None else struct.pack(fmt, value)
+        body += CMD_TLV_HEADER.pack(tlv_type, len(value)) + value
+    if CMD_HEADER.size + len(body) > CMD_MAX_FRAME:
+        raise ValueError(f'{opcode} request is longer than {CMD_MAX_FRAME} bytes')
+    return CMD_HEADER.pack(CMD_MAGIC, OPCODES[opcode], 0, request_id & 0xFFFF, len(body)) + body
+
+
+def decode_frame(data):
+    """
+    Decodes the frame at the start of data.
+
+    :param data: (bytes) received bytes, may hold a partial frame or more than one
+    :return: (tuple) ((opcode, status, request id, args dict), frame length) with args keyed by TLV_TYPES name and
+             unknown types dropped, or None if data doesn't hold a whole frame yet
+    """
+    if len(data) < CMD_HEADER.size:
+        return None
+    magic, opcode, status, request_id, args_len = CMD_HEADER.unpack_from(data)
+    if magic != CMD_MAGIC:
+        raise ValueError(f'not a command frame (magic {magic:#x})')
+    frame_len = CMD_HEADER.size + args_len
+    if len(data) < frame_len:
+        return None
+
+    args = {}
+    pos = CMD_HEADER.size
+    while pos + CMD_TLV_HEADER.size <= frame_len:
+        tlv_type, length = CMD_TLV_HEADER.unpack_from(data, pos)
+        pos += CMD_TLV_HEADER.size
+        if pos + length > frame_len:
+            raise ValueError('command argument runs past the end of the frame')
+        name = TLV_NAMES.get(tlv_type)
+        if name is not None:
+            fmt = TLV_TYPES[name][1]
+            value = bytes(data[pos:pos + length])
+            args[name] = value if fmt is None else struct.unpack(fmt, value)[0]
+        pos += length
+    return (opcode, status, request_id, args), frame_len
+
+
+def recv_frame(connection, pending=b''):
+    """
+    Reads one whole frame from a TCP connection.
+
+    :param connection: (socket) connected to the board
+    :param pending: (bytes) bytes already read past the previous frame
+    :return: (tuple) (decoded frame as returned by decode_frame, bytes read past this frame)
+    """
+    data = pending
+    while True:
+        decoded = decode_frame(data)
+        if decoded is not None:
+            frame, frame_len = decoded
+            return frame, data[frame_len:]
+        chunk = connection.recv(CMD_MAX_FRAME)
+        if not chunk:
+            raise ConnectionError('board closed the control connection')
+        data += chunk
+
+
+class CmdClient:
+    """
+    Typed commands on a board's control connection, one request in flight at a time.
+    """
+    def __init__(self, connection):
+        self.connection = connection
+        self.next_id = 1
+        self.pending = b''
+
+    def request(self, opcode, args=None):
+        """
+        :param opcode: (str) one of OPCODES
+        :param args: (dict) see encode_request
+        :return: (dict) the response arguments
+        """
+        request_id = self.next_id
+        self.next_id = (self.next_id + 1) & 0xFFFF
+        self.connection.sendall(encode_request(opcode, request_id, args))
+
+        (resp_opcode, status, resp_id, resp_args), self.pending = recv_frame(self.connection, self.pending)
+        if resp_opcode != OPCODES[opcode] | CMD_RESPONSE or resp_id != request_id:
+            raise ValueError(f'response {resp_opcode:#x}/{resp_id} does not answer {opcode}/{request_id}')
+        if status != 0:
+            raise CmdError(opcode, status)
+        return resp_args
+
+    def time_start(self):
+        """
+        Starts the board's time reference for time_probe, was "start_counting".
+
+        :return: (tuple) (sec, nsec) board time of the reference
+        """
+        args = self.request('TIME_START')
+        return args['TIME_SEC'], args['TIME_NSEC']
+
+    def time_probe(self):
+        """
+        Was "get_time".
+
+        :return: (tuple) (sec, nsec, local_us) time since time_start and the board's local clock in us
+        """
+        args = self.request('TIME_PROBE')
+        return args['TIME_SEC'], args['TIME_NSEC'], args['LOCAL_US']
+
+    def capture_start(self):
+        self.request('CAPTURE_START')
+
+    def capture_stop(self):
+        self.request('CAPTURE_STOP')
+
+    def set_rates(self, sample_period_us=None, sensors=None, persist=False):
+        """
+        :param sample_period_us: (int) sampling period of the sensors, a multiple of 250, 0 for each sensor's
+                                 default, None leaves it
+        :param sensors: (iterable) names from SENSORS to sample from the next capture_start, None leaves them
+        :param persist: (bool) also write the board's boot profile
+        :return: (tuple) (sample_period_us, sensor names) in use
+        """
+        args = {}
+        if sample_period_us is not None:
+            args['SAMPLE_PERIOD_US'] = sample_period_us
+        if sensors is not None:
+            args['SENSORS'] = sum(1 << SENSORS[name] for name in set(sensors))
+        if persist:
+            args['PERSIST'] = 1
+        args = self.request('SET_RATES', args)
+        return args['SAMPLE_PERIOD_US'], [name for name, i in SENSORS.items() if args['SENSORS'] & (1 << i)]
+
+    def set_upload_schedule(self, interval_ms, persist=False):
+        """
+        :param interval_ms: (int) time between uploads in test_time_beac_sync()
+        :param persist: (bool) also write the board's boot profile
+        :return: (int) interval in use
+        """
+        args = {'UPLOAD_INTERVAL_MS': interval_ms}
+        if persist:
+            args['PERSIST'] = 1
+        return self.request('SET_UPLOAD', args)['UPLOAD_INTERVAL_MS']
+
+    def query_counters(self):
+        """
+        :return: (dict) perf snapshot, see decode_perf_snapshot
+        """
+        return decode_perf_snapshot(self.request('GET_COUNTERS')['PERF'].hex())
@@ -3,11 +3,45 @@ import sys
 from windows_ap import WindowsSoftAP
 from util import util
 from server import Server
-from util.pylive import live_plotter_xy
+from util.pylive import DecimatingLivePlot
+from board_communication.perf_counters import format_hist
 import time
 import numpy as np
 import scapy.all as scapy
 
+# console words for the binary control commands, anything else only goes out as a text message in UDP mode
+TYPED_COMMANDS = {
+    'start_counting': 'time_start',
+    'get_time': 'time_probe',
+    'capture_start': 'capture_start',
+    'capture_stop': 'capture_stop',
+    'counters': 'query_counters',
+}
+
+
+def parse_typed_command(msg):
+    """
+    Maps a console line to a control command: the TYPED_COMMANDS words, "rates <sample_period_us> [accel,loadcell,...]"
+    and "upload <interval_ms>", add "persist" to the last two to keep the setting across reboots.
+
+    :param msg: (str) console line
+    :return: (tuple) (CmdClient method, kwargs), or None for a text message
+    :raises ValueError: when the number argument of "rates" or "upload" is not a number
+    """
+    words = msg.split()
+    persist = 'persist' in words
+    words = [w for w in words if w != 'persist']
+    if len(words) == 1 and words[0] in TYPED_COMMANDS:
+        return TYPED_COMMANDS[words[0]], {}
+    if len(words) in (2, 3) and words[0] == 'rates':
+        kwargs = {'sample_period_us': int(words[1]), 'persist': persist}
+        if len(words) == 3:
+            kwargs['sensors'] = words[2].split(',')
+        return 'set_rates', kwargs
+    if len(words) == 2 and words[0] == 'upload':
+        return 'set_upload_schedule', {'interval_ms': int(words[1]), 'persist': persist}
+    return None
+
 
 def main():
     # setup and start windows "hostednetwork" soft AP
@@ -35,10 +69,24 @@ def main():
         # ap.stop_ap()
         return 0
 
+    # boards in event_loop_connected() stream their accelerometer next to the control connection
+    server.start_upload_receiver()
+
     while True:
         msg = input('Enter msg to send to all boards: ')
-
-        if not udp:
+        try:
+            typed = parse_typed_command(msg)
+        except ValueError as e:
+            print(f'not sent: {e}')
+            continue
+
+        if typed is not None:
+            server.send_cmd_to_all_boards(typed[0], **typed[1])
+        elif not udp:
+            # the board closes the control connection on anything that is not a command frame
+            if msg != 'exit':
+                print(f'not sent: "{msg}" is not one of {", ".join(TYPED_COMMANDS)}, rates or upload')
+                continue
             server.send_msg_to_all_boards_tcp(msg)
         else:
             server.send_msg_to_all_boards_udp(msg)
@@ -46,11 +94,21 @@ def main():
         if msg == 'exit':
             # make sure to send "exit" msg to send_msg_to_all_boards() before exiting so that all child threads are
             # closed as well
+            for i, board_ip in enumerate(server.boards):
+                stats = server.boards[board_ip]["stream_stats"]
+                print(f'[board {i}] uploaded datagrams={stats["datagrams"]} samples={stats["samples"]} '
+                      f'lost={stats["lost"]} reordered={stats["reordered"]}')
+                if stats["perf"] is not None:
+                    print(f'[board {i}] sample period jitter (us): {format_hist(stats["perf"]["SAMPLE_JITTER_US"])}')
+                loadcell = server.boards[board_ip]["loadcell_stats"]
+                if loadcell["datagrams"]:
+                    print(f'[board {i}] load cell datagrams={loadcell["datagrams"]} samples={loadcell["samples"]} '
+                          f'lost={loadcell["lost"]}')
             return 0
 
         for i, board_ip in enumerate(server.boards):
             print(i, board_ip)
-            if not udp:
+            if typed is not None or not udp:
                 print(f'[board {i}] response from board with ip {board_ip}:'
                       f'\n{server.boards[board_ip]["last_response"]}')
             else:
@@ -64,62 +122,35 @@ def main():
     For plotting data stream
     """
 
-    retval = server.wait_for_all_boards_to_connect(task='send_data')
+    retval = server.wait_for_all_boards_to_connect(task='stream_udp')
 
     if retval < 0:
         # ap.stop_ap()
         return 0
 
-    max_period = 50
-    x_vecs = []
-    y_vecs = []
     y_labels = []
     y_ranges = []
     for i in range(len(server.boards)):
-        y_labels.extend([f'accel. x\nboard {i}', f'accel. y\nboard {i}',
+        y_labels.append([f'accel. x\nboard {i}', f'accel. y\nboard {i}',
                          f'accel. z\nboard {i}', f'accel. magnitude\nboard {i}'])
         y_ranges.extend([(-12, 12), (-12, 12), (-12, 12), (0, 12)])  # x, y, z, magnitude
-        for _ in range(4):
-            x_vecs.append(np.zeros(max_period))
-            y_vecs.append(np.zeros(max_period))
-    lines = []
-    update_period = 0.1
 
-    while True:
-        for i, board_ip in enumerate(server.boards):
-            if len(server.boards[board_ip]["stream_data"]) > 0:
-                # idx, x, y, z, magnitude = server.boards[board_ip]["stream_data"].popleft()    # FIFO board reading
-                idx, x, y, z, magnitude = server.boards[board_ip]["stream_data"].pop()  # LIFO board reading
-                x = x / 1000
-                y = y / 1000
-                z = z / 1000
-                magnitude = magnitude / 1000
-                x_vecs[4 * i] = np.append(x_vecs[4 * i][1:], idx)
-                x_vecs[4 * i + 1] = np.append(x_vecs[4 * i + 1][1:], idx)
-                x_vecs[4 * i + 2] = np.append(x_vecs[4 * i + 2][1:], idx)
-                x_vecs[4 * i + 3] = np.append(x_vecs[4 * i + 3][1:], idx)
-
-                y_vecs[4 * i] = np.append(y_vecs[4 * i][1:], x)
-                y_vecs[4 * i + 1] = np.append(y_vecs[4 * i + 1][1:], y)
-                y_vecs[4 * i + 2] = np.append(y_vecs[4 * i + 2][1:], z)
-                y_vecs[4 * i + 3] = np.append(y_vecs[4 * i + 3][1:], magnitude)
-            else:
-                x_vecs[4 * i] = np.append(x_vecs[4 * i][1:], 0)
-                x_vecs[4 * i + 1] = np.append(x_vecs[4 * i + 1][1:], 0)
-                x_vecs[4 * i + 2] = np.append(x_vecs[4 * i + 2][1:], 0)
-                x_vecs[4 * i + 3] = np.append(x_vecs[4 * i + 3][1:], 0)
-
-                y_vecs[4 * i] = np.append(y_vecs[4 * i][1:], 0)
-                y_vecs[4 * i + 1] = np.append(y_vecs[4 * i + 1][1:], 0)
-                y_vecs[4 * i + 2] = np.append(y_vecs[4 * i + 2][1:], 0)
-                y_vecs[4 * i + 3] = np.append(y_vecs[4 * i + 3][1:], 0)
-
-        lines = live_plotter_xy(x_vecs, y_vecs, lines, 4 * len(server.boards), x_label='board time (i)',
-                                y_labels=y_labels,
-                                title='Board Accelerometer G-Forces vs. Board Time',
-                                pause_time=update_period,
-                                dynamic_y=False,
-                                y_ranges=y_ranges)
+    # receive threads write straight into each board's ring, the plot pulls decimated views at a fixed frame rate
+    plot = DecimatingLivePlot([server.boards[board_ip]["ring"] for board_ip in server.boards], y_labels,
+                              window_s=5.0, fps=20, x_label='board time (s)',
+                              title='Board Accelerometer G-Forces vs. Board Time',
+                              y_ranges=y_ranges)
+    plot.run(stop_flag=server.exit_flag)
+
+    for i, board_ip in enumerate(server.boards):
+        stats = server.boards[board_ip]["stream_stats"]
+        print(f'[board {i}] datagrams={stats["datagrams"]} samples={stats["samples"]} lost={stats["lost"]} '
+              f'reordered={stats["reordered"]} duplicates={stats["duplicates"]} resets={stats["resets"]} '
+              f'events={stats["events"]} heartbeats={stats["heartbeats"]}')
+        if stats["perf"] is not None:
+            print(f'[board {i}] sample period jitter (us): {format_hist(stats["perf"]["SAMPLE_JITTER_US"])}')
+    server.exit_flag.set()
+    return 0
 
 
 if __name__ == "__main__":
@@ -0,0 +1,121 @@
+import re
+
+# make sure these match lz_compress.h in the cc3220sf network terminal code
+LZ_MIN_MATCH = 3
+LZ_MAX_MATCH = LZ_MIN_MATCH + 15
+LZ_MAX_OFFSET = 4095
+LZ_HASH_BITS = 10
+
+# "lz,<uncompressed length>|" at the start of a record, the compressed stream follows it
+LZ_FRAME = re.compile(rb"(?:^|(?<=\|))lz,(\d+)\|")
+# a chunk sent right after another compressed chunk follows its end of stream marker, with no "|" in between
+LZ_NEXT_FRAME = re.compile(rb"lz,(\d+)\|")
+
+
+def lz_decompress(data, pos=0):
+    """
+    :param data: (bytes) holding a compressed stream at pos
+    :param pos: (int) where the stream starts
+    :return: (tuple) (uncompressed bytes, position right after the end of stream marker)
+    :raises IndexError: when data ends before the end of stream marker
+    :raises ValueError: when the stream is damaged, or cut short in a way that reads as damaged
+    """
+    out = bytearray()
+    while True:
+        ctrl = data[pos]
+        pos += 1
+        for item in range(8):
+            if ctrl & (1 << item):
+                offset = ((data[pos] >> 4) << 8) | data[pos + 1]
+                length = (data[pos] & 0x0F) + LZ_MIN_MATCH
+                pos += 2
+                if offset == 0:
+                    return bytes(out), pos
+                start = len(out) - offset
+                if start < 0:
+                    raise ValueError(f"lz offset {offset} before the start of the output")
+                if offset >= length:
+                    out += out[start:start + length]
+                else:
+                    for i in range(length):
+                        out.append(out[start + i])
+            else:
+                out.append(data[pos])
+                pos += 1
+
+
+def lz_compress(data):
+    """
+    Same output as lz_compress() on the board, for benchmarks and tests.
+
+    :param data: (bytes) at most 65535 bytes
+    :return: (bytes) the compressed stream
+    """
+    table = {}
+    out = bytearray()
+    pos = 0
+    item = 0
+    ctrl_pos = 0
+    n = len(data)
+
+    def lz_hash(p):
+        return ((((data[p] << 16) | (data[p + 1] << 8) | data[p + 2]) * 2654435761) & 0xFFFFFFFF) >> (32 - LZ_HASH_BITS)
+
+    while True:
+        if item == 0:
+            ctrl_pos = len(out)
+            out.append(0)
+        if pos >= n:
+            out[ctrl_pos] |= 1 << item
+            out += b"\x00\x00"
+            return bytes(out)
+
+        best_len = 0
+        offset = 0
+        if pos + LZ_MIN_MATCH <= n:
+            h = lz_hash(pos)
+            cand = table.get(h)
+            table[h] = pos
+            if cand is not None and pos - cand <= LZ_MAX_OFFSET:
+                max_len = min(n - pos, LZ_MAX_MATCH)
+                while best_len < max_len and data[cand + best_len] == data[pos + best_len]:
+                    best_len += 1
+                offset = pos - cand
+
+        if best_len >= LZ_MIN_MATCH:
+            out[ctrl_pos] |= 1 << item
+            out.append(((offset >> 8) << 4) | (best_len - LZ_MIN_MATCH))
+            out.append(offset & 0xFF)
+            for i in range(1, best_len):
+                if pos + i + LZ_MIN_MATCH > n:
+                    break
+                table[lz_hash(pos + i)] = pos + i
+            pos += best_len
+        else:
+            out.append(data[pos])
+            pos += 1
+        item = (item + 1) & 7
+
+
+def expand_upload(data):
+    """
+    Replaces every compressed chunk of an upload with its text.
+
+    :param data: (bytes) an upload as received
+    :return: (bytes) the upload with plain text records only
+    :raises IndexError, ValueError: when a compressed chunk is cut short or damaged
+    """
+    if b"lz," not in data:
+        return data
+    out = b""
+    pos = 0
+    m = LZ_FRAME.search(data, pos)
+    while True:
+        if m is None:
+            return out + data[pos:]
+        text, end = lz_decompress(data, m.end())
+        if len(text) != int(m.group(1)):
+            raise ValueError(f"lz chunk expanded to {len(text)} bytes instead of {m.group(1).decode()}")
+        out += data[pos:m.start()] + text
+        pos = end
+        m = LZ_NEXT_FRAME.match(data, pos) or LZ_FRAME.search(data, pos)
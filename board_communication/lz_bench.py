@@ -0,0 +1,58 @@
+import os
+import sys
+import time
+
+from board_communication.lz import lz_compress, lz_decompress
+
+# make sure this matches NUM_READINGS in ap_connection.h in the cc3220sf network terminal code
+NUM_READINGS = 1000
+
+
+def board_payloads(path):
+    """
+    Rebuilds the upload chunks a board sent from its <ip>.txt file, the stored fields are the text the board sent.
+
+    :param path: (str) board file written by system_integration
+    :return: (generator) of bytes, one "seq,<n>,<n>|<beacon_ts>,<local_ts>|..." chunk per NUM_READINGS readings
+    """
+    with open(path) as f:
+        f.readline()
+        lines = [line.strip() for line in f if line.strip()]
+    for seq, start in enumerate(range(0, len(lines), NUM_READINGS), 1):
+        records = "".join(",".join(line.split(",")[:2]) + "|" for line in lines[start:start + NUM_READINGS])
+        yield f"seq,{seq},{seq}|{records}".encode()
+
+
+def bench_folder(folder):
+    """
+    :param folder: (str) timestamp_data, or one experiment in it
+    :return: (tuple) (raw bytes, compressed bytes, chunks)
+    """
+    raw = packed = chunks = 0
+    for root, _, files in os.walk(folder):
+        for name in sorted(files):
+            if not name.endswith(".txt"):
+                continue
+            for payload in board_payloads(os.path.join(root, name)):
+                stream = lz_compress(payload)
+                if lz_decompress(stream)[0] != payload:
+                    raise ValueError(f"round trip failed for {os.path.join(root, name)}")
+                raw += len(payload)
+                packed += len(stream) + len(f"lz,{len(payload)}|")
+                chunks += 1
+    return raw, packed, chunks
+
+
+if __name__ == "__main__":
+    # usage: python -m board_communication.lz_bench [timestamp_data folder]
+    # compression ratio of lz_compress() on recorded payloads; the node prints its cycles per KB after every
+    # compressed upload ("[nnaji msg] lz: ..."), which is the MCU side of the benchmark
+    folder = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(__file__), "timestamp_data")
+    t0 = time.perf_counter()
+    raw, packed, chunks = bench_folder(folder)
+    elapsed = time.perf_counter() - t0
+    if chunks == 0:
+        print(f"no board files in {folder}")
+        sys.exit(1)
+    print(f"{chunks} chunks, {raw} -> {packed} bytes, ratio {raw / packed:.2f}, saves {100 * (1 - packed / raw):.1f} %")
+    print(f"host reference implementation: {elapsed:.2f} s, round trip checked")
@@ -0,0 +1,150 @@
+import heapq
+import os
+import sys
+import numpy as np
+
+from board_communication.parse_and_plot import transform_axis
+
+# samples per chunk handed out by the readers and by merge_streams()
+MERGE_CHUNK_SIZE = 4096
+
+
+def merge_streams(streams, chunk_size=MERGE_CHUNK_SIZE):
+    """
+    Heap based k-way merge of per board streams that are already on the beacon time axis. Each stream is consumed one
+    chunk at a time, so memory stays at about one chunk per board plus one output chunk no matter how long the
+    recordings are, and a whole fleet is merged in a single pass.
+
+    The heap holds the time of the next sample of every board. Instead of popping one sample at a time, the board at
+    the top hands out its whole run of samples up to the next board's head time, which is most of a chunk when boards
+    are sampled at different rates.
+
+    :param streams: (list) one iterable per board, yielding (t, y) chunks with t (np.ndarray) non decreasing within
+                    and across chunks, and y (np.ndarray) of shape (n,) or (n, channels), the same for every board
+    :param chunk_size: (int) samples per output chunk, the last one may be shorter
+    :return: (generator) of (t, board, y) chunks in global time order, board is the index of the stream in streams;
+             samples with equal times come out in board order
+    """
+    iters = [iter(s) for s in streams]
+    pending = [None] * len(iters)
+    heap = []
+
+    def refill(board):
+        # next non empty chunk of a board, None when it is exhausted
+        for t, y in iters[board]:
+            if len(t) != 0:
+                return np.asarray(t, dtype=np.float64), np.asarray(y)
+        return None
+
+    for board in range(len(iters)):
+        pending[board] = refill(board)
+        if pending[board] is not None:
+            heapq.heappush(heap, (pending[board][0][0], board, 0))
+
+    out_t, out_board, out_y = [], [], []
+    out_len = 0
+
+    while heap:
+        _, board, pos = heapq.heappop(heap)
+        t, y = pending[board]
+
+        # everything of this board that is not later than the next board's head (ties go to the lower board index)
+        if heap:
+            next_t, next_board, _ = heap[0]
+            side = 'right' if board < next_board else 'left'
+            end = max(pos + 1, int(np.searchsorted(t, next_t, side=side)))
+        else:
+            end = len(t)
+        end = min(end, pos + chunk_size - out_len)
+
+        out_t.append(t[pos:end])
+        out_board.append(np.full(end - pos, board, dtype=np.int16))
+        out_y.append(y[pos:end])
+        out_len += end - pos
+
+        if end == len(t):
+            pending[board] = refill(board)
+            if pending[board] is not None:
+                heapq.heappush(heap, (pending[board][0][0], board, 0))
+        else:
+            heapq.heappush(heap, (t[end], board, end))
+
+        if out_len >= chunk_size:
+            yield np.concatenate(out_t), np.concatenate(out_board), np.concatenate(out_y)
+            out_t, out_board, out_y = [], [], []
+            out_len = 0
+
+    if out_len:
+        yield np.concatenate(out_t), np.concatenate(out_board), np.concatenate(out_y)
+
+
+def board_chunks(board_data, chunk_size=MERGE_CHUNK_SIZE):
+    """
+    Maps one board's readings onto the beacon time axis and hands them out in chunks for merge_streams().
+
+    :param board_data: (dict) {"adc": [...], "local_ts": [...], "beacon_ts": [...]} and optionally "gap": [...],
+                       as built by system_integration.assemble_data_for_plot()
+    :param chunk_size: (int) samples per chunk
+    :return: (generator) of (t, y) chunks, y holds the adc readings
+    """
+    t, _ = transform_axis(board_data["local_ts"], board_data["beacon_ts"], board_data.get("gap"))
+    y = np.array([float(v) for v in board_data["adc"]])
+    if len(t) != len(y):
+        raise ValueError(f'{len(t)} timestamps for {len(y)} readings')
+
+    # the board's own order, transform_axis keeps it monotonic unless its clock stepped backwards
+    order = np.argsort(t, kind='stable')
+    t, y = t[order], y[order]
+    for i in range(0, len(t), chunk_size):
+        yield t[i:i + chunk_size], y[i:i + chunk_size]
+
+
+def merge_boards(readings, chunk_size=MERGE_CHUNK_SIZE):
+    """
+    :param readings: (dict) board name -> board_data dict as taken by board_chunks()
+    :param chunk_size: (int) samples per output chunk
+    :return: (tuple) (list of board names indexed by the board column, generator from merge_streams())
+    """
+    names = list(readings.keys())
+    return names, merge_streams([board_chunks(readings[name], chunk_size) for name in names], chunk_size)
+
+
+def timestamp_file_chunks(path, chunk_size=MERGE_CHUNK_SIZE):
+    """
+    Reads a <ip>.txt file written by system_integration.store_data() a chunk at a time.
+
+    :param path: (str) file with a "beacon_timestamp,local_timestamp[,beacons_lost_before]" header
+    :param chunk_size: (int) rows per chunk
+    :return: (generator) of (beacon_ts, local_ts) chunks
+    """
+    with open(path) as f:
+        f.readline()
+        while True:
+            rows = []
+            for line in f:
+                line = line.strip()
+                if line:
+                    rows.append([float(v) for v in line.split(',')[:2]])
+                if len(rows) == chunk_size:
+                    break
+            if not rows:
+                return
+            rows = np.array(rows)
+            yield rows[:, 0], rows[:, 1]
+            if len(rows) < chunk_size:
+                return
+
+
+if __name__ == "__main__":
+    # usage: python -m board_communication.merge <experiment folder> [out file]
+    # merges the beacon and local timestamps of every board in the folder into one beacon ordered csv
+    folder = sys.argv[1]
+    out = sys.argv[2] if len(sys.argv) > 2 else os.path.join(folder, "merged.csv")
+    files = sorted(f for f in os.listdir(folder) if f.endswith(".txt"))
+
+    with open(out, 'w') as f:
+        f.write("beacon_timestamp,board,local_timestamp")
+        for t, board, y in merge_streams([timestamp_file_chunks(os.path.join(folder, name)) for name in files]):
+            for i in range(len(t)):
+                f.write(f'\n{t[i]:.0f},{files[board[i]][:-4]},{y[i]:.0f}')
+    print(f'merged {len(files)} boards into {out}')
@@ -47,23 +47,27 @@ def parser(board_data, timestamp):
 def plot_tcp_data(wrist_mod_data, base_mod_data):
     # wrist_mod_data and base_mod_data are both dicts of the form
     # {"adc":[array of adc readings], "loacl_ts":[array of local_ts], "beacon_ts": [array of beacon ts]}
+    # and optionally "gap": [array of beacons lost before each reading]
     # the length of the 3 arrays is the same within the dict, but might be different between dicts
+    # for more than two boards, or to get one time ordered stream, use merge.merge_boards()
 
     # transform board local_ts axis to beacon_ts axis
-    wrist_x_axis = transform_axis(wrist_mod_data["local_ts"], wrist_mod_data["beacon_ts"])
-    base_x_axis = transform_axis(base_mod_data["local_ts"], wrist_mod_data["beacon_ts"])
+    wrist_x_axis, wrist_x_err = transform_axis(wrist_mod_data["local_ts"], wrist_mod_data["beacon_ts"],
+                                               wrist_mod_data.get("gap"))
+    base_x_axis, base_x_err = transform_axis(base_mod_data["local_ts"], base_mod_data["beacon_ts"],
+                                             base_mod_data.get("gap"))
 
-    # chop off some of adc readings to make sure y axis is the same length
-    wrist_y_axis = wrist_mod_data["adc"][:len(wrist_x_axis)]
-    base_y_axis = base_mod_data["adc"][:len(base_x_axis)]
+    # transform_axis() places every reading, so the y axes already match
+    wrist_y_axis = np.array([float(x) for x in wrist_mod_data["adc"]])
+    base_y_axis = np.array([float(x) for x in base_mod_data["adc"]])
 
     # normalize y axis
-    wrist_y_axis = normalize(np.array(wrist_y_axis).reshape(-1, 1), axis=0, norm='max')
-    base_y_axis = normalize(np.array(base_y_axis).reshape(-1, 1), axis=0, norm='max')
+    wrist_y_axis = normalize(wrist_y_axis.reshape(-1, 1), axis=0, norm='max')
+    base_y_axis = normalize(base_y_axis.reshape(-1, 1), axis=0, norm='max')
 
-
-    plt.plot(wrist_x_axis, wrist_y_axis, label="wrist")
-    plt.plot(base_x_axis, base_y_axis, label="base")
+    # horizontal error bars show how far each reading's place on the beacon axis can be off
+    plt.errorbar(wrist_x_axis, wrist_y_axis.ravel(), xerr=wrist_x_err, label="wrist", capsize=2)
+    plt.errorbar(base_x_axis, base_y_axis.ravel(), xerr=base_x_err, label="base", capsize=2)
     plt.xlabel("Beacon Timestamp")
     plt.ylabel("Relative ADC readings")
     plt.legend()
@@ -73,69 +77,90 @@ def plot_tcp_data(wrist_mod_data, base_mod_data):
 
     return 1
 
-def transform_axis(local_ts, beacon_ts):
+def transform_axis(local_ts, beacon_ts, gaps=None):
     # takes in 2 arrays of the same length, and transforms the local_ts onto the beacon_ts
-    # returns an array that is the transformed local_ts onto the beacon_ts
-    # ***Note*** some of the end of the local
+    # returns a tuple (transformed local_ts, error bar of each transformed value), both the length of local_ts
+    #
+    # between two consecutive beacons the local clock is interpolated linearly like before, but across lost
+    # beacons the end point can't be trusted to have progressed linearly, so readings there (and after the last
+    # beacon) are extrapolated from the beacon before them with the estimated skew, and their error bar grows
+    # with the time since that beacon
+    # gaps: optional array of the same length, number of beacons lost right before each reading ("gap,<n>|"
+    # records from the board), when missing a beacon step of more than 1.5 intervals counts as a gap
 
     # make sure inputs are floats
-    local_ts = [float(x) for x in local_ts]
-    beacon_ts = [float(x) for x in beacon_ts]
-
-    # array to return
-    transformed_x_axis = []
-
-    # array of tuples (index of unique beacon, value of unique beacon)
-    beacon_tuples = []
-
-    last_beacon_value = -1
-    for i in range(len(beacon_ts)):
-        current_beacon_value = beacon_ts[i]
-
-        #not a unique beacon
-        if current_beacon_value == last_beacon_value:
+    local_ts = np.array([float(x) for x in local_ts])
+    beacon_ts = np.array([float(x) for x in beacon_ts])
+    n = len(local_ts)
+
+    # index of the first reading of each unique beacon
+    anchors = [i for i in range(n) if i == 0 or beacon_ts[i] != beacon_ts[i-1]]
+    if len(anchors) < 2:
+        return beacon_ts, np.zeros(n)
+
+    d_local = np.diff(local_ts[anchors])
+    d_beacon = np.diff(beacon_ts[anchors])
+    if gaps is not None:
+        lost = np.array([float(gaps[i]) > 0 for i in anchors[1:]])
+    else:
+        lost = d_beacon > 1.5 * np.median(d_beacon)
+
+    # skew (beacon time per local time) and its spread from the segments without lost beacons
+    good = ~lost & (d_local > 0)
+    if np.any(good):
+        rates = d_beacon[good] / d_local[good]
+        skew = np.median(rates)
+        skew_err = np.std(rates)
+        # each step holds the timing noise of two beacons
+        jitter = np.std(d_beacon[good] - skew * d_local[good]) / np.sqrt(2)
+    else:
+        skew = np.sum(d_beacon) / np.sum(d_local)
+        skew_err = 0.0
+        jitter = 0.0
+
+    transformed_x_axis = np.empty(n)
+    error = np.empty(n)
+
+    for k in range(len(anchors)):
+        start = anchors[k]
+        end = anchors[k+1] if k + 1 < len(anchors) else n
+        dt = local_ts[start:end] - local_ts[start]
+
+        if k + 1 < len(anchors) and not lost[k]:
+            transformed_x_axis[start:end] = beacon_ts[start] + dt / d_local[k] * d_beacon[k]
+            error[start:end] = jitter
             continue
-        beacon_tuples.append((i, current_beacon_value))
-        last_beacon_value = current_beacon_value
-
-
-
-    for k in range(1, len(beacon_tuples)):
-        start_tuple = beacon_tuples[k-1]
-        end_tuple = beacon_tuples[k]
-        start_beac_index, start_beac_value = start_tuple
-        end_beac_index, end_beac_value = end_tuple
-
-        for i in range(start_beac_index, end_beac_index):
-            transformed_value = (local_ts[i] - local_ts[start_beac_index])/(local_ts[end_beac_index] - local_ts[start_beac_index])
-            transformed_value *= (end_beac_value - start_beac_value)
-            transformed_value += start_beac_value
-            transformed_x_axis.append(transformed_value)
 
-    transformed_x_axis.append(end_beac_value)
+        transformed_x_axis[start:end] = beacon_ts[start] + skew * dt
+        error[start:end] = jitter + skew_err * dt
+        if k + 1 < len(anchors):
+            # what the extrapolation missed the next beacon by bounds the error too
+            miss = abs(beacon_ts[end] - (beacon_ts[start] + skew * d_local[k]))
+            error[start:end] = np.maximum(error[start:end], miss * dt / d_local[k])
 
-    return transformed_x_axis
+    return transformed_x_axis, error
 
 
-# timestamp = 100
-array1 = [(1, 1), (3, 2), (6, 3), (10, 7)]
-array2 = [(3, 2), (4, 3), (5, 4), (9, 14)]
+if __name__ == "__main__":
+    # timestamp = 100
+    array1 = [(1, 1), (3, 2), (6, 3), (10, 7)]
+    array2 = [(3, 2), (4, 3), (5, 4), (9, 14)]
 
-my_data = [array1, array2]
-t_stamp = 100
+    my_data = [array1, array2]
+    t_stamp = 100
 
-#parser(my_data, t_stamp)
+    #parser(my_data, t_stamp)
 
-local_ts = [11358, 12566, 13470, 14470, 15470, 16420]
-beacon_ts = [0, 0, 1, 1, 2, 2]
-adc = [800, 800, 800, 900, 800, 800]
+    local_ts = [11358, 12566, 13470, 14470, 15470, 16420]
+    beacon_ts = [0, 0, 1, 1, 2, 2]
+    adc = [800, 800, 800, 900, 800, 800]
 
-wrist = {"adc": adc, "local_ts" : local_ts, "beacon_ts": beacon_ts}
+    wrist = {"adc": adc, "local_ts" : local_ts, "beacon_ts": beacon_ts}
 
-local_ts = [1158, 1266, 1479, 1579, 1629]
-beacon_ts = [0, 0, 1, 2, 2]
-adc = [80, 80, 80, 95, 85]
+    local_ts = [1158, 1266, 1479, 1579, 1629]
+    beacon_ts = [0, 0, 1, 2, 2]
+    adc = [80, 80, 80, 95, 85]
 
-base = {"adc": adc, "local_ts" : local_ts, "beacon_ts": beacon_ts}
+    base = {"adc": adc, "local_ts" : local_ts, "beacon_ts": beacon_ts}
 
-plot_tcp_data(wrist, base)
+    plot_tcp_data(wrist, base)
@@ -0,0 +1,103 @@
+import csv
+import os
+import struct
+import sys
+import time
+
+# make sure these match perf_counters.h in the cc3220sf network terminal code
+PERF_MAGIC = 0x4650
+PERF_VERSION = 4
+PERF_COUNTERS = ['BEACONS_RX', 'BEACONS_MISSED', 'RECV_EAGAIN', 'QUEUE_OVERFLOWS', 'CONNECT_ATTEMPTS',
+                 'CONNECT_FAILURES', 'SEND_RETRIES', 'BYTES_SENT', 'UPLOADS', 'SAMPLES_DROPPED',
+                 'PHASE_STEPS', 'PHASE_OUTLIERS']
+PERF_HISTOGRAMS = ['UPLOAD_MS', 'CONNECT_MS', 'SAMPLE_JITTER_US', 'PHASE_ERROR_US']
+PERF_HIST_BUCKETS = 16
+PERF_HEADER = '<HBBBBHII'
+
+
+def decode_perf_snapshot(hex_str):
+    """
+    Decodes the snapshot the board appends to its uploads as "perf,<hex>|".
+
+    :param hex_str: (str) the hex part of the record
+    :return: (dict) uptime_ms, free_heap, one entry per counter and a list of bucket counts per histogram
+    """
+    raw = bytes.fromhex(hex_str.strip())
+    magic, version, n_counters, n_hists, n_buckets, _, uptime_ms, free_heap = struct.unpack_from(PERF_HEADER, raw)
+    if magic != PERF_MAGIC or version != PERF_VERSION:
+        raise ValueError(f'not a perf snapshot (magic {magic:#x}, version {version})')
+    if n_counters != len(PERF_COUNTERS) or n_hists != len(PERF_HISTOGRAMS) or n_buckets != PERF_HIST_BUCKETS:
+        raise ValueError('perf snapshot layout does not match PERF_COUNTERS / PERF_HISTOGRAMS')
+
+    values = struct.unpack_from(f'<{n_counters + n_hists * n_buckets}I', raw, struct.calcsize(PERF_HEADER))
+    snapshot = {'uptime_ms': uptime_ms, 'free_heap': free_heap}
+    for i, name in enumerate(PERF_COUNTERS):
+        snapshot[name] = values[i]
+    for i, name in enumerate(PERF_HISTOGRAMS):
+        start = n_counters + i * n_buckets
+        snapshot[name] = list(values[start:start + n_buckets])
+    return snapshot
+
+
+def hist_bucket_range(bucket):
+    # bucket 0 counts 0, bucket n counts [2^(n-1), 2^n), the last bucket is open ended
+    if bucket == 0:
+        return 0, 0
+    if bucket == PERF_HIST_BUCKETS - 1:
+        return 1 << (bucket - 1), None
+    return 1 << (bucket - 1), (1 << bucket) - 1
+
+
+def format_hist(buckets):
+    """
+    :param buckets: (list) bucket counts of one histogram from decode_perf_snapshot()
+    :return: (str) the non-empty buckets as "low-high: count", e.g. "0-0: 12, 2-3: 40, 512-...: 1"
+    """
+    parts = []
+    for b, count in enumerate(buckets):
+        if count:
+            low, high = hist_bucket_range(b)
+            parts.append(f'{low}-{high if high is not None else "..."}: {count}')
+    return ', '.join(parts) if parts else 'empty'
+
+
+def append_perf_csv(path, snapshot):
+    """
+    Appends one snapshot as a row of a per board time series, with the host time it was received.
+
+    :param path: (str) csv file, the header is written when it does not exist yet
+    :param snapshot: (dict) from decode_perf_snapshot()
+    """
+    fields = ['host_time', 'uptime_ms', 'free_heap'] + PERF_COUNTERS
+    for name in PERF_HISTOGRAMS:
+        fields += [f'{name}_{b}' for b in range(PERF_HIST_BUCKETS)]
+
+    row = {'host_time': time.time()}
+    for key, value in snapshot.items():
+        if key in PERF_HISTOGRAMS:
+            for b, count in enumerate(value):
+                row[f'{key}_{b}'] = count
+        else:
+            row[key] = value
+
+    new_file = not os.path.exists(path)
+    with open(path, 'a', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        if new_file:
+            writer.writeheader()
+        writer.writerow(row)
+
+
+if __name__ == "__main__":
+    # usage: python perf_counters.py <hex snapshot>
+    # prints a snapshot copied from laptop.log
+    snap = decode_perf_snapshot(sys.argv[1])
+    for key, value in snap.items():
+        if key in PERF_HISTOGRAMS:
+            print(key)
+            for b, count in enumerate(value):
+                if count:
+                    low, high = hist_bucket_range(b)
+                    print(f'\t{low} - {high if high is not None else "..."}: {count}')
+        else:
+            print(f'{key}: {value}')
@@ -0,0 +1,124 @@
+import logging
+import os
+import sys
+import time
+import numpy as np
+
+import board_communication.system_integration as system_integration
+from board_communication.capture import CAPTURE_FILE, read_capture, read_laptop_log
+from board_communication.merge import MERGE_CHUNK_SIZE, merge_streams
+from board_communication.parse_and_plot import transform_axis
+from board_communication.upload_ack import AckTracker
+
+
+def read_uploads(path):
+    """
+    :param path: (str) an uploads.bin capture, a laptop.log, or an experiment folder holding either
+    :return: (generator) of (host_time, client_address, data), host_time is None for laptop.log
+    """
+    if os.path.isdir(path):
+        capture = os.path.join(path, CAPTURE_FILE)
+        path = capture if os.path.exists(capture) else os.path.join(path, "laptop.log")
+    if path.endswith(".log"):
+        return read_laptop_log(path)
+    return read_capture(path)
+
+
+def replay_uploads(uploads, out_folder, speed=0.0):
+    """
+    Drives recorded uploads through system_integration.ingest_upload(), the same parse, dedup and store path as a live
+    experiment, into out_folder.
+
+    :param uploads: (iterable) of (host_time, client_address, data), from read_uploads()
+    :param out_folder: (str) where the board files go, it is created
+    :param speed: (float) N for N times real time, 0 for as fast as possible; uploads without host_time are never
+                  paced
+    :return: (dict) uploads, bytes and seconds spent ingesting
+    """
+    os.makedirs(out_folder, exist_ok=True)
+    system_integration.ROOT_FOLDER = out_folder
+    # one log line per reading would be most of the time spent
+    system_integration.logger = logging.getLogger("replay")
+    system_integration.logger.setLevel(logging.WARNING)
+
+    acks = AckTracker()
+    stats = {"uploads": 0, "bytes": 0, "ingest_s": 0.0}
+    first_time = None
+    start = time.perf_counter()
+
+    for host_time, client_address, data in uploads:
+        if speed > 0 and host_time is not None:
+            if first_time is None:
+                first_time = host_time
+            wait = (host_time - first_time) / speed - (time.perf_counter() - start)
+            if wait > 0:
+                time.sleep(wait)
+
+        t0 = time.perf_counter()
+        system_integration.ingest_upload(data, client_address, acks)
+        stats["ingest_s"] += time.perf_counter() - t0
+        stats["uploads"] += 1
+        stats["bytes"] += len(data)
+
+    return stats
+
+
+def align_folder(folder):
+    """
+    Aligns every board file in the folder onto the beacon timeline and merges them into merged.csv, like
+    merge.py does for a live experiment, but with the aligned time in the first column.
+
+    :param folder: (str) folder with <ip>.txt board files
+    :return: (dict) readings, seconds spent loading and aligning, and seconds spent merging and writing
+    """
+    files = sorted(f for f in os.listdir(folder) if f.endswith(".txt"))
+    stats = {"readings": 0, "align_s": 0.0, "merge_s": 0.0}
+
+    t0 = time.perf_counter()
+    aligned = []
+    for name in files:
+        rows = np.loadtxt(os.path.join(folder, name), delimiter=',', skiprows=1, ndmin=2)
+        if len(rows) == 0:
+            aligned.append((np.zeros(0), np.zeros(0)))
+            continue
+        gaps = rows[:, 2] if rows.shape[1] > 2 else None
+        axis, _ = transform_axis(rows[:, 1], rows[:, 0], gaps)
+        # the board's own order, transform_axis keeps it monotonic unless its clock stepped backwards
+        order = np.argsort(axis, kind='stable')
+        aligned.append((axis[order], rows[order, 1]))
+        stats["readings"] += len(rows)
+    stats["align_s"] = time.perf_counter() - t0
+
+    def chunks(t, y):
+        for i in range(0, len(t), MERGE_CHUNK_SIZE):
+            yield t[i:i + MERGE_CHUNK_SIZE], y[i:i + MERGE_CHUNK_SIZE]
+
+    t0 = time.perf_counter()
+    with open(os.path.join(folder, "merged.csv"), 'w') as f:
+        f.write("aligned_timestamp,board,local_timestamp")
+        for t, board, y in merge_streams([chunks(t, y) for t, y in aligned]):
+            for i in range(len(t)):
+                f.write(f'\n{t[i]:.0f},{files[board[i]][:-4]},{y[i]:.0f}')
+    stats["merge_s"] = time.perf_counter() - t0
+
+    return stats
+
+
+if __name__ == "__main__":
+    # usage: python -m board_communication.replay <uploads.bin | laptop.log | experiment folder> [out folder] [speed]
+    # speed is N for N times real time, 0 (the default) for as fast as possible; laptop.log has no arrival times
+    # and always replays as fast as possible
+    source = sys.argv[1]
+    out = sys.argv[2] if len(sys.argv) > 2 else os.path.join(os.getcwd(), "timestamp_data",
+                                                              "replay_" + time.strftime("%Y-%m-%d_%H;%M;%S"))
+    speed = float(sys.argv[3]) if len(sys.argv) > 3 else 0.0
+
+    ingest = replay_uploads(read_uploads(source), out, speed)
+    align = align_folder(out)
+
+    print(f'replayed {ingest["uploads"]} uploads, {ingest["bytes"] / 1e6:.2f} MB, into {out}')
+    print(f'parse + store: {ingest["ingest_s"]:.3f} s, {ingest["bytes"] / 1e6 / max(ingest["ingest_s"], 1e-9):.2f} MB/s, '
+          f'{ingest["uploads"] / max(ingest["ingest_s"], 1e-9):.0f} uploads/s')
+    print(f'align: {align["align_s"]:.3f} s, {align["readings"] / max(align["align_s"], 1e-9):.0f} readings/s, '
+          f'{align["readings"]} readings')
+    print(f'merge: {align["merge_s"]:.3f} s, {align["readings"] / max(align["merge_s"], 1e-9):.0f} readings/s')
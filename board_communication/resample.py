@@ -0,0 +1,207 @@
+import sys
+from fractions import Fraction
+from itertools import chain
+import numpy as np
+from scipy.signal import firwin
+
+from board_communication.merge import board_chunks, MERGE_CHUNK_SIZE
+
+# beacon time is the AP's TSF, in microseconds
+TIME_UNIT = 1e-6
+# kaiser window beta of the anti-aliasing filter, about 50 dB stopband
+KAISER_BETA = 5.0
+# filter half length in input samples, scaled up by the decimation factor when downsampling
+HALF_TAPS = 8
+
+
+class PolyphaseResampler:
+    """
+    Streams one aligned board signal onto a uniform time grid. The irregular beacon time positions are first
+    interpolated onto the board's native uniform grid, then converted to the target rate by a rational up / down
+    polyphase filter (a windowed sinc from firwin, split into its up phases). Every output sample is one row of a
+    vectorized gather of the input window times the filter phase it falls on, and only the filter's history is kept
+    between chunks, so sessions of any length go through with bounded memory.
+
+    Both grids start at t0, so boards resampled with the same t0 and target rate line up sample for sample.
+    """
+
+    def __init__(self, native_rate, target_rate, t0, time_unit=TIME_UNIT, half_taps=HALF_TAPS, beta=KAISER_BETA):
+        """
+        :param native_rate: (float) the board's nominal sample rate in Hz, e.g. 1000 for the wrist, 100 for the base
+        :param target_rate: (float) output rate in Hz
+        :param t0: (float) time of the first output sample, in time_unit
+        :param time_unit: (float) seconds per unit of t
+        :param half_taps: (int) filter half length in input samples before scaling for decimation
+        :param beta: (float) kaiser window beta
+        """
+        ratio = (Fraction(target_rate).limit_denominator(1000) / Fraction(native_rate).limit_denominator(1000))
+        ratio = ratio.limit_denominator(1000)
+        self.up = ratio.numerator
+        self.down = ratio.denominator
+        self.native_period = 1.0 / (native_rate * time_unit)
+        self.target_period = self.native_period * self.down / self.up
+        self.t0 = float(t0)
+
+        # prototype low pass at the lower of the two Nyquist rates, centered at half * up
+        self.half = half_taps * max(1, -(-self.down // self.up))
+        if max(self.up, self.down) == 1:
+            # same rate, the native grid interpolation already did the work
+            h = np.zeros(2 * self.half + 1)
+            h[self.half] = 1.0
+        else:
+            h = firwin(2 * self.half * self.up + 1, 1.0 / max(self.up, self.down), window=('kaiser', beta)) * self.up
+
+        # phases[r, j] weights input sample b - half + j for an output at upsampled index b * up + r
+        taps = 2 * self.half + 1
+        k = np.arange(self.up)[:, None] + (2 * self.half - np.arange(taps))[None, :] * self.up
+        self.phases = np.where(k < len(h), h[np.minimum(k, len(h) - 1)], 0.0)
+
+        # native grid samples not yet consumed, buf[0] is native sample buf_start
+        self.buf = np.zeros(0)
+        self.buf_start = -self.half
+        self.next_native = 0
+        self.next_out = 0
+        self.last_t = None
+        self.last_y = None
+
+    def _to_native_grid(self, t, y):
+        # linear interpolation onto t0 + n * native_period for every n up to the last input time
+        t = np.asarray(t, dtype=np.float64)
+        y = np.asarray(y, dtype=np.float64)
+        if self.last_t is not None:
+            t = np.concatenate(([self.last_t], t))
+            y = np.concatenate(([self.last_y], y))
+        self.last_t, self.last_y = t[-1], y[-1]
+
+        end = int(np.floor((t[-1] - self.t0) / self.native_period))
+        if end < self.next_native:
+            return np.zeros(0)
+        grid = self.t0 + np.arange(self.next_native, end + 1) * self.native_period
+        self.next_native = end + 1
+        # before the first sample np.interp holds the first value, which is also how the filter edge is padded
+        return np.interp(grid, t, y)
+
+    def _filter(self, final=False):
+        last = self.buf_start + len(self.buf) - 1
+        if final:
+            # pad the tail with the last value so every input sample gets its outputs
+            self.buf = np.concatenate((self.buf, np.full(self.half, self.buf[-1] if len(self.buf) else 0.0)))
+            last_needed = last
+        else:
+            last_needed = last - self.half
+
+        # outputs whose whole window is in the buffer
+        end_out = (last_needed * self.up) // self.down if last_needed >= 0 else -1
+        if final:
+            end_out = min(end_out, ((last + 1) * self.up - 1) // self.down)
+        if end_out < self.next_out:
+            return np.zeros(0), np.zeros(0)
+
+        m = np.arange(self.next_out, end_out + 1)
+        u = m * self.down
+        b = u // self.up
+        r = u % self.up
+        window = (b - self.half - self.buf_start)[:, None] + np.arange(2 * self.half + 1)[None, :]
+        y = np.sum(self.buf[window] * self.phases[r], axis=1)
+        t = self.t0 + m * self.target_period
+
+        self.next_out = end_out + 1
+        keep = (self.next_out * self.down) // self.up - self.half
+        self.buf = self.buf[keep - self.buf_start:]
+        self.buf_start = keep
+        return t, y
+
+    def process(self, t, y):
+        """
+        :param t: (np.ndarray) aligned sample times, non decreasing, in time_unit
+        :param y: (np.ndarray) sample values
+        :return: (tuple) (t, y) np.ndarrays of the output samples that are complete so far
+        """
+        if len(t) == 0:
+            return np.zeros(0), np.zeros(0)
+        native = self._to_native_grid(t, y)
+        if len(native) == 0:
+            return np.zeros(0), np.zeros(0)
+        if self.buf_start == -self.half and len(self.buf) == 0:
+            # the filter edge before t0 is padded with the first value
+            native = np.concatenate((np.full(self.half, native[0]), native))
+        self.buf = np.concatenate((self.buf, native))
+        return self._filter()
+
+    def flush(self):
+        """
+        :return: (tuple) (t, y) the remaining output samples up to the last input sample
+        """
+        return self._filter(final=True)
+
+
+def resample_stream(chunks, native_rate, target_rate, t0, **kwargs):
+    """
+    :param chunks: (iterable) (t, y) chunks of one aligned board stream, like merge.board_chunks() yields
+    :return: (generator) of (t, y) chunks on the uniform grid t0 + n / target_rate
+    """
+    resampler = PolyphaseResampler(native_rate, target_rate, t0, **kwargs)
+    for t, y in chunks:
+        out = resampler.process(t, y)
+        if len(out[0]):
+            yield out
+    out = resampler.flush()
+    if len(out[0]):
+        yield out
+
+
+def resample_boards(readings, native_rates, target_rate, chunk_size=MERGE_CHUNK_SIZE, **kwargs):
+    """
+    Resamples every board onto one common uniform grid and cuts them to the span all of them cover, so the arrays can
+    be compared and normalized sample for sample.
+
+    :param readings: (dict) board name -> board_data dict as taken by merge.board_chunks()
+    :param native_rates: (dict) board name -> native sample rate in Hz, e.g. {"wrist": 1000, "base": 100}
+    :param target_rate: (float) common output rate in Hz
+    :return: (tuple) (t, dict board name -> y), all of the same length as t
+    """
+    streams = {}
+    for name in readings:
+        chunks = board_chunks(readings[name], chunk_size)
+        first = next(chunks)
+        streams[name] = (first, chunks)
+
+    # the common grid starts at the earliest sample, boards that start later are cut below
+    t0 = min(first[0][0] for first, _ in streams.values())
+
+    out = {}
+    for name, (first, chunks) in streams.items():
+        parts = list(resample_stream(chain([first], chunks), native_rates[name], target_rate, t0, **kwargs))
+        t = np.concatenate([p[0] for p in parts]) if parts else np.zeros(0)
+        y = np.concatenate([p[1] for p in parts]) if parts else np.zeros(0)
+        out[name] = (t, y, first[0][0])
+
+    start = max(np.searchsorted(t, first_t) for t, _, first_t in out.values())
+    length = min(len(t) for t, _, _ in out.values()) - start
+    if length <= 0:
+        return np.zeros(0), {name: np.zeros(0) for name in out}
+    t = next(iter(out.values()))[0][start:start + length]
+    return t, {name: y[start:start + length] for name, (_, y, _) in out.items()}
+
+
+if __name__ == "__main__":
+    # usage: python -m board_communication.resample <native rate> <target rate> [seconds]
+    # resamples a synthetic jittered tone and prints how far it is from the ideal one
+    native = float(sys.argv[1]) if len(sys.argv) > 1 else 1000
+    target = float(sys.argv[2]) if len(sys.argv) > 2 else 250
+    seconds = float(sys.argv[3]) if len(sys.argv) > 3 else 10
+    rng = np.random.default_rng(0)
+    t_in = np.arange(0, seconds / TIME_UNIT, 1 / (native * TIME_UNIT))
+    t_in = t_in + rng.normal(0, 0.05 / (native * TIME_UNIT), len(t_in))
+    t_in.sort()
+    freq = min(native, target) / 10
+    y_in = np.sin(2 * np.pi * freq * t_in * TIME_UNIT)
+
+    chunks = ((t_in[i:i + 777], y_in[i:i + 777]) for i in range(0, len(t_in), 777))
+    parts = list(resample_stream(chunks, native, target, 0.0))
+    t_out = np.concatenate([p[0] for p in parts])
+    y_out = np.concatenate([p[1] for p in parts])
+    ideal = np.sin(2 * np.pi * freq * t_out * TIME_UNIT)
+    inner = slice(int(target), -int(target))
+    print(f'{len(t_in)} samples at {native} Hz -> {len(t_out)} at {target} Hz, '
+          f'rms error {np.sqrt(np.mean((y_out[inner] - ideal[inner]) ** 2)):.4f}')
@@ -1,10 +1,13 @@
 import socket
 from util import util
+from util.ring_buffer import SampleRing
 import threading
 import time
-from collections import deque
-import math
 import struct
+import numpy as np
+
+from board_communication.cmd_client import CmdClient, CmdError
+from board_communication.perf_counters import PERF_MAGIC, decode_perf_snapshot
 
 # make sure this matches the ENTRY_PORT global macro in the cc3220sf ap_connection.c code as well
 ENTRY_PORT = 10000
@@ -12,11 +15,36 @@ MAX_BOARDS = 2
 MAX_BIND_RETRIES = 5
 MESSAGE_SIZE = 50
 
+# make sure this matches EVENT_UPLOAD_PORT in the cc3220sf ap_connection.c code as well, event_loop_connected() sends
+# its accelerometer datagrams there from every board
+EVENT_UPLOAD_PORT = 10013
+
 MULTICAST_GROUP_IP = "224.10.10.10"
 MULTICAST_GROUP_PORT = 10007
 MULTICAST_TTL = struct.pack('b', 12)
 
-# global shared vars for multi-threading communication
+# make sure these match the ACCEL_STREAM_* macros in the cc3220sf accel_stream.h code as well
+STREAM_MAGIC = 0x5354
+STREAM_VERSION = 1
+STREAM_HEADER = struct.Struct('<HBBIIHH')  # magic, version, flags, seq, base_ts_us, period_us, count
+STREAM_MAX_DGRAM = 1400
+STREAM_RECV_TIMEOUT = 0.5
+STREAM_REORDER_WINDOW = 256
+STREAM_FLAG_EVENT = 0x01
+STREAM_FLAG_START = 0x02
+STREAM_FLAG_END = 0x04
+STREAM_FLAG_HEARTBEAT = 0x08
+# load cell datagrams, same header, packed 16 or 24 bit loadcell_dsp outputs with LOADCELL_INPUT_BITS - 1 integer bits
+LOADCELL_STREAM_MAGIC = 0x434C
+LOADCELL_INPUT_BITS = 13
+LOADCELL_RING_CAPACITY = 60000
+
+# samples kept per board for live plotting, channels are accel x, y, z and magnitude
+RING_CAPACITY = 600000
+RING_CHANNELS = 4
+
+# global shared vars for multi-threading communication, str_to_send is a text message or a (CmdClient method,
+# kwargs) command
 str_to_send = None
 thread_tasks_done = None
 using_udp = None
@@ -35,6 +63,8 @@ class Server:
         self.entry_socket = None
         self.broadcast_address = None
         self.broadcast_socket = None
+        self.upload_socket = None
+        self.upload_thread = None
         self.start_flag = threading.Event()
         self.end_flag = threading.Event()
         self.exit_flag = threading.Event()
@@ -93,7 +123,10 @@ class Server:
         return 0
 
     def add_board(self, ipv4, task='test_time_sync'):
-        socket_this_side = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if task == 'stream_udp':
+            socket_this_side = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        else:
+            socket_this_side = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         socket_address = (self.ipv4, self.last_used_port + 1)
 
         not_bound = True
@@ -102,7 +135,8 @@ class Server:
             try:
                 socket_this_side.bind(socket_address)
 
-                socket_this_side.listen(1)  # Listen for incoming connections
+                if task != 'stream_udp':
+                    socket_this_side.listen(1)  # Listen for incoming connections
 
                 not_bound = False
             except Exception:
@@ -119,7 +153,10 @@ class Server:
                              "socket_this_side": socket_this_side,
                              "port_this_side": socket_address[1],
                              "last_response": None,
-                             "stream_data": deque()}
+                             "ring": SampleRing(RING_CAPACITY, RING_CHANNELS),
+                             "stream_stats": new_stream_stats(),
+                             "loadcell_ring": SampleRing(LOADCELL_RING_CAPACITY, 1),
+                             "loadcell_stats": new_stream_stats()}
         if task == 'test_time_sync':
             thread = threading.Thread(target=wait_to_send_msgs,
                                       args=(socket_this_side, self.boards[ipv4],
@@ -127,6 +164,9 @@ class Server:
         elif task == 'send_data':
             thread = threading.Thread(target=wait_and_plot_incoming_accel_data,
                                       args=(socket_this_side, self.boards[ipv4], self.exit_flag))
+        elif task == 'stream_udp':
+            thread = threading.Thread(target=wait_for_udp_accel_stream,
+                                      args=(socket_this_side, self.boards[ipv4], self.exit_flag))
 
         thread.start()
         self.boards[ipv4]['thread'] = thread
@@ -162,6 +202,16 @@ class Server:
 
         return 0
 
+    def send_cmd_to_all_boards(self, command, **kwargs):
+        """
+        Runs one typed command of the binary control protocol on every board, each board's result or CmdError ends up
+        in its 'last_response'.
+
+        :param command: (str) CmdClient method, e.g. 'time_probe' or 'set_rates'
+        :param kwargs: arguments of that method
+        """
+        return self.send_msg_to_all_boards_tcp((command, kwargs))
+
     def send_msg_to_all_boards_udp(self, msg):
         global str_to_send, thread_tasks_done, using_udp
 
@@ -254,6 +304,18 @@ class Server:
 
         return 0
 
+    def start_upload_receiver(self):
+        """
+        Receives the accelerometer datagrams of boards in event_loop_connected() on EVENT_UPLOAD_PORT, each board's go
+        to its own ring and stream_stats. Call once the boards are connected.
+        """
+        self.upload_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.upload_socket.bind((self.ipv4, EVENT_UPLOAD_PORT))
+        self.upload_thread = threading.Thread(target=wait_for_udp_uploads,
+                                              args=(self.upload_socket, self.boards, self.exit_flag))
+        self.upload_thread.start()
+        return self.upload_socket
+
     def get_board_socket(self, ipv4):
         if ipv4 in self.boards:
             return self.boards[ipv4]['socket_this_side']
@@ -274,6 +336,7 @@ def wait_to_send_msgs(sock, coms_dict, start_flag, end_flag, exit_flag, broadcas
     while not exit_flag.is_set():
         # Wait for a connection
         connection, client_address = sock.accept()
+        client = CmdClient(connection)
         try:
             while not exit_flag.is_set():
                 start_flag.wait()
@@ -281,16 +344,25 @@ def wait_to_send_msgs(sock, coms_dict, start_flag, end_flag, exit_flag, broadcas
                     return 0
 
                 if not using_udp:
-                    my_msg = bytes(str_to_send, encoding='utf-8')
-                    connection.sendall(my_msg)
+                    # the control connection only carries cmd_proto frames, the board drops the connection on
+                    # anything else, so text never goes out on it
+                    if isinstance(str_to_send, tuple):
+                        command, kwargs = str_to_send
+                        try:
+                            coms_dict['last_response'] = getattr(client, command)(**kwargs)
+                        except (CmdError, ValueError, OSError) as e:
+                            # OSError covers a board that closed the connection, later commands fail the same way
+                            coms_dict['last_response'] = e
+                    else:
+                        coms_dict['last_response'] = ValueError(f'{str_to_send!r} is not a control command')
+                    thread_tasks_done += 1
+                    end_flag.wait()
+                    continue
 
                 # wait for any response
                 data = None
                 while not data:
-                    if not using_udp:
-                        data = connection.recv(MESSAGE_SIZE)
-                    else:
-                        data, server = broadcast_socket.recvfrom(MESSAGE_SIZE)
+                    data, server = broadcast_socket.recvfrom(MESSAGE_SIZE)
 
                     if data:
                         coms_dict['last_response'] = util.strip_end_bytes(data)
@@ -309,7 +381,9 @@ def wait_to_send_msgs(sock, coms_dict, start_flag, end_flag, exit_flag, broadcas
 
 
 def wait_and_plot_incoming_accel_data(sock, coms_dict, exit_flag):
-    max_buffer_size = 600000
+    ring = coms_dict['ring']
+    row = np.zeros((1, RING_CHANNELS), dtype=np.float32)
+    idx = np.zeros(1)
     while not exit_flag.is_set():
         # Wait for a connection
         connection, client_address = sock.accept()
@@ -318,15 +392,222 @@ def wait_and_plot_incoming_accel_data(sock, coms_dict, exit_flag):
                 data = connection.recv(60)
                 if data:
                     i, x, y, z = util.strip_end_bytes(data).split(',')
-                    i = int(i)
-                    x = float(x)
-                    y = float(y)
-                    z = float(z)
-                    magnitude = math.sqrt(x ** 2 + y ** 2 + z ** 2)
-                    coms_dict['stream_data'].append((i, x, y, z, magnitude))
-                    if len(coms_dict['stream_data']) >= max_buffer_size:
-                        coms_dict['stream_data'].popleft()
+                    idx[0] = int(i)
+                    row[0, :3] = (float(x) / 1000, float(y) / 1000, float(z) / 1000)
+                    row[0, 3] = np.sqrt(np.dot(row[0, :3], row[0, :3]))
+                    ring.write(idx, row)
         finally:
             # Clean up the connection
             connection.close()
     return 0
+
+def new_stream_stats():
+    return {"datagrams": 0,
+            "samples": 0,
+            "lost": 0,
+            "reordered": 0,
+            "duplicates": 0,
+            "malformed": 0,
+            "events": 0,
+            "heartbeats": 0,
+            "resets": 0,
+            "next_seq": None,
+            "missing": set(),
+            "perf": None}
+
+
+def parse_stream_datagram(data):
+    """
+    Decodes one batched accelerometer datagram sent by stream_accel_udp() on the board
+
+    :param data: (bytes) raw datagram
+    :return: (tuple) (seq, flags, timestamps_us, xyz) where timestamps_us is an int64 array of length count and xyz is
+             an int16 array of shape (count, 3), or None if the datagram is malformed
+    """
+    if len(data) < STREAM_HEADER.size:
+        return None
+
+    magic, version, flags, seq, base_ts_us, period_us, count = STREAM_HEADER.unpack_from(data)
+    if magic != STREAM_MAGIC or version != STREAM_VERSION or len(data) < STREAM_HEADER.size + 6 * count:
+        return None
+
+    xyz = np.frombuffer(data, dtype='<i2', count=3 * count, offset=STREAM_HEADER.size).reshape(count, 3)
+    timestamps_us = base_ts_us + period_us * np.arange(count, dtype=np.int64)
+    return seq, flags, timestamps_us, xyz
+
+
+def parse_loadcell_datagram(data):
+    """
+    Decodes one load cell datagram sent by stream_sensors_sink() on the board
+
+    :param data: (bytes) raw datagram
+    :return: (tuple) (seq, timestamps_us, values, out_bits) where timestamps_us is an int64 array, values an int64
+             array of the decimated outputs as loadcell_dsp_push() computed them, and out_bits 16 or 24, or None if
+             the datagram is malformed
+    """
+    if len(data) < STREAM_HEADER.size:
+        return None
+
+    magic, version, flags, seq, base_ts_us, period_us, count = STREAM_HEADER.unpack_from(data)
+    if magic != LOADCELL_STREAM_MAGIC or version != STREAM_VERSION or count == 0:
+        return None
+    size = (len(data) - STREAM_HEADER.size) // count
+    if size not in (2, 3) or STREAM_HEADER.size + size * count != len(data):
+        return None
+
+    raw = np.frombuffer(data, dtype=np.uint8, count=size * count, offset=STREAM_HEADER.size).reshape(count, size)
+    values = np.zeros(count, dtype=np.int64)
+    for i in range(size):
+        values |= raw[:, i].astype(np.int64) << (8 * i)
+    sign = 1 << (8 * size - 1)
+    values = (values ^ sign) - sign
+    timestamps_us = base_ts_us + period_us * np.arange(count, dtype=np.int64)
+    return seq, timestamps_us, values, 8 * size
+
+
+def account_stream_seq(stats, seq):
+    """
+    Updates loss/reorder counters for a received sequence number. Sequence numbers that skip ahead are counted as lost
+    right away and remembered in a bounded window; if one of them shows up later it is moved from lost to reordered.
+    A jump back by more than the window is a board that rebooted and restarted its sequence, the stream starts over
+    from it instead of dropping everything as duplicates.
+
+    :param stats: (dict) counters created by new_stream_stats()
+    :param seq: (int) sequence number of the received datagram
+    :return: (bool) False if the datagram is a duplicate and should be dropped
+    """
+    expected = stats["next_seq"]
+    if expected is None or seq == expected:
+        stats["next_seq"] = seq + 1
+    elif seq > expected:
+        stats["lost"] += seq - expected
+        stats["missing"].update(range(max(expected, seq - STREAM_REORDER_WINDOW), seq))
+        stats["next_seq"] = seq + 1
+    elif expected - seq > STREAM_REORDER_WINDOW:
+        stats["resets"] += 1
+        stats["missing"] = set()
+        stats["next_seq"] = seq + 1
+    elif seq in stats["missing"]:
+        stats["missing"].discard(seq)
+        stats["lost"] -= 1
+        stats["reordered"] += 1
+    else:
+        stats["duplicates"] += 1
+        return False
+
+    # keep the reorder window bounded so a long outage can't grow the set forever
+    if len(stats["missing"]) > STREAM_REORDER_WINDOW:
+        horizon = stats["next_seq"] - STREAM_REORDER_WINDOW
+        stats["missing"] = {s for s in stats["missing"] if s >= horizon}
+    return True
+
+
+def ingest_stream_datagram(coms_dict, data, rows):
+    """
+    Accounts one batched accelerometer datagram and writes its samples into coms_dict['ring'] as (seconds,
+    [x, y, z, magnitude] in g). The perf snapshot the board sends every few seconds on the same socket is kept in
+    coms_dict['stream_stats']['perf'], its SAMPLE_JITTER_US histogram shows the sample period while uploading.
+
+    :param coms_dict: (dict) the board's entry in Server.boards
+    :param data: (bytes) the datagram
+    :param rows: (np.ndarray) float32 scratch of shape (STREAM_MAX_DGRAM // 6, RING_CHANNELS)
+    """
+    stats = coms_dict['stream_stats']
+    if len(data) >= 2 and struct.unpack_from('<H', data)[0] == LOADCELL_STREAM_MAGIC:
+        ingest_loadcell_datagram(coms_dict, data)
+        return
+    if len(data) >= 2 and struct.unpack_from('<H', data)[0] == PERF_MAGIC:
+        try:
+            stats["perf"] = decode_perf_snapshot(data.hex())
+        except (ValueError, struct.error):
+            stats["malformed"] += 1
+        return
+
+    parsed = parse_stream_datagram(data)
+    if parsed is None:
+        stats["malformed"] += 1
+        return
+
+    seq, flags, timestamps_us, xyz = parsed
+    if not account_stream_seq(stats, seq):
+        return
+
+    stats["datagrams"] += 1
+    stats["samples"] += len(xyz)
+    # boards running stream_accel_events_udp() only send windows around activity plus idle heartbeats
+    if flags & STREAM_FLAG_START:
+        stats["events"] += 1
+    if flags & STREAM_FLAG_HEARTBEAT:
+        stats["heartbeats"] += 1
+
+    n = len(xyz)
+    batch = rows[:n]
+    np.multiply(xyz, 1 / 1000, out=batch[:, :3], casting='unsafe')
+    np.sqrt(np.einsum('ij,ij->i', batch[:, :3], batch[:, :3]), out=batch[:, 3])
+    coms_dict['ring'].write(timestamps_us / 1e6, batch)
+
+
+def ingest_loadcell_datagram(coms_dict, data):
+    """
+    Accounts one load cell datagram in coms_dict['loadcell_stats'], its sequence numbers count on their own, and
+    writes its samples into coms_dict['loadcell_ring'] as (seconds, [differential reading in ADC codes]).
+
+    :param coms_dict: (dict) the board's entry in Server.boards
+    :param data: (bytes) the datagram
+    """
+    stats = coms_dict['loadcell_stats']
+    parsed = parse_loadcell_datagram(data)
+    if parsed is None:
+        stats["malformed"] += 1
+        return
+
+    seq, timestamps_us, values, out_bits = parsed
+    if not account_stream_seq(stats, seq):
+        return
+
+    stats["datagrams"] += 1
+    stats["samples"] += len(values)
+    codes = (values / (1 << (out_bits - LOADCELL_INPUT_BITS))).astype(np.float32)
+    coms_dict['loadcell_ring'].write(timestamps_us / 1e6, codes[:, None])
+
+
+def wait_for_udp_accel_stream(sock, coms_dict, exit_flag):
+    """
+    Receives batched accelerometer datagrams from one board, see ingest_stream_datagram. Never blocks longer than
+    STREAM_RECV_TIMEOUT so exit_flag is honoured.
+    """
+    rows = np.empty((STREAM_MAX_DGRAM // 6, RING_CHANNELS), dtype=np.float32)
+    sock.settimeout(STREAM_RECV_TIMEOUT)
+    while not exit_flag.is_set():
+        try:
+            data, client_address = sock.recvfrom(STREAM_MAX_DGRAM)
+        except socket.timeout:
+            continue
+
+        if client_address[0] != coms_dict['ipv4']:
+            continue
+        ingest_stream_datagram(coms_dict, data, rows)
+    sock.close()
+    return 0
+
+
+def wait_for_udp_uploads(sock, boards, exit_flag):
+    """
+    Receives the datagrams every board in event_loop_connected() sends to EVENT_UPLOAD_PORT and hands each to its
+    board by source address, datagrams from unknown addresses are dropped.
+
+    :param boards: (dict) Server.boards
+    """
+    rows = np.empty((STREAM_MAX_DGRAM // 6, RING_CHANNELS), dtype=np.float32)
+    sock.settimeout(STREAM_RECV_TIMEOUT)
+    while not exit_flag.is_set():
+        try:
+            data, client_address = sock.recvfrom(STREAM_MAX_DGRAM)
+        except socket.timeout:
+            continue
+
+        coms_dict = boards.get(client_address[0])
+        if coms_dict is not None:
+            ingest_stream_datagram(coms_dict, data, rows)
+    sock.close()
+    return 0
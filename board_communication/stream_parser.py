@@ -0,0 +1,190 @@
+import re
+import warnings
+from collections import Counter
+import numpy as np
+
+# readings with this value in either timestamp are dropped, the board sends it for an empty slot
+INVALID_TS = 3200171710
+
+# every record that does not start with a digit: "seq,<n>,<oldest>", "gap,<n>", "perf,<hex>", "end"
+CONTROL_RECORD = re.compile(rb"([a-z]+)(?:,([^|]*))?\|")
+
+
+def new_batch(seq=None, oldest=None):
+    return {"seq": seq, "oldest": oldest, "beacon_ts": [], "local_ts": [], "gap": [], "values": [], "perf": [],
+            "end": False}
+
+
+class StreamParser:
+    """
+    Incremental parser for the "|"-separated records boards upload. Feed it raw bytes as they come off the socket; a
+    record cut by a recv boundary waits in the parser until the rest of it arrives.
+
+    Readings are "<beacon_ts>,<local_ts>[,<value>...]|": timestamps only from test_time_beac_sync(),
+    one value (load cell) from the base module, three (accel x, y, z) from the wrist module. Runs of readings are
+    converted with one np.fromstring() call instead of record by record.
+
+    Output is a list of batches, a new one starts at every "seq" record. A batch is a dict:
+        seq, oldest     from the "seq,<n>,<oldest>|" record, None for boards without sequence numbers
+        beacon_ts       np.ndarray int64
+        local_ts        np.ndarray int64
+        gap             np.ndarray int64, beacons lost right before each reading ("gap,<n>|")
+        values          np.ndarray float64, shape (readings, values per reading)
+        perf            list of the hex strings of "perf,<hex>|" records
+        end             True once "end|" closed the upload
+    """
+
+    def __init__(self):
+        self.tail = b""
+        self.gap = 0
+        self.batch = new_batch()
+        self.done = []
+        self.errors = 0
+
+    def feed(self, data):
+        """
+        :param data: (bytes) the next bytes received, any length
+        :return: (list) batches completed by these bytes, see finish() for the last one
+        """
+        buf = self.tail + data
+        end = buf.rfind(b"|") + 1
+        self.tail = buf[end:]
+
+        pos = 0
+        for m in CONTROL_RECORD.finditer(buf, 0, end):
+            # only records that start right after a separator are control records
+            if m.start() != 0 and buf[m.start() - 1:m.start()] != b"|":
+                continue
+            self._readings(buf[pos:m.start()])
+            self._control(m.group(1), m.group(2))
+            pos = m.end()
+        self._readings(buf[pos:end])
+
+        done = self.done
+        self.done = []
+        return done
+
+    def finish(self):
+        """
+        :return: (list) the batch still open, when it holds anything
+        """
+        batch = self._close()
+        self.tail = b""
+        return [batch] if batch is not None else []
+
+    def _close(self):
+        batch = self.batch
+        self.batch = new_batch()
+        if batch["seq"] is None and not batch["beacon_ts"] and not batch["perf"]:
+            return None
+        # runs of a different reading width than most of the batch are dropped, their values can't be stacked
+        widths = Counter()
+        for values in batch["values"]:
+            widths[values.shape[1]] += len(values)
+        if len(widths) > 1:
+            width = widths.most_common(1)[0][0]
+            keep = [i for i, values in enumerate(batch["values"]) if values.shape[1] == width]
+            self.errors += sum(len(values) for values in batch["values"]) - widths[width]
+            for key in ("beacon_ts", "local_ts", "gap", "values"):
+                batch[key] = [batch[key][i] for i in keep]
+        for key in ("beacon_ts", "local_ts", "gap"):
+            batch[key] = np.concatenate(batch[key]) if batch[key] else np.zeros(0, dtype=np.int64)
+        batch["values"] = np.concatenate(batch["values"]) if batch["values"] else np.zeros((0, 0))
+        return batch
+
+    def _control(self, kind, value):
+        if kind == b"seq":
+            batch = self._close()
+            if batch is not None:
+                self.done.append(batch)
+            fields = value.split(b",") if value else []
+            try:
+                self.batch["seq"] = int(fields[0])
+                self.batch["oldest"] = int(fields[1]) if len(fields) > 1 else int(fields[0])
+            except (IndexError, ValueError):
+                self.errors += 1
+        elif kind == b"gap":
+            try:
+                self.gap += int(value)
+            except (TypeError, ValueError):
+                self.errors += 1
+        elif kind == b"perf":
+            self.batch["perf"].append(value.decode(errors="replace"))
+        elif kind == b"end":
+            self.batch["end"] = True
+            batch = self._close()
+            if batch is not None:
+                self.done.append(batch)
+        else:
+            self.errors += 1
+
+    def _readings(self, run):
+        """
+        Converts a run of "<beacon_ts>,<local_ts>[,<value>...]|" records.
+        """
+        if not run.strip(b"|"):
+            return
+        records = run.strip(b"|").split(b"|")
+        # the most common width with both timestamps, a truncated record doesn't decide it
+        widths = Counter(record.count(b",") + 1 for record in records if record.count(b",") >= 1)
+        if not widths:
+            self.errors += len(records)
+            return
+        n_fields = widths.most_common(1)[0][0]
+        with warnings.catch_warnings():
+            # a damaged record stops np.fromstring() early, with a warning or a ValueError depending on the numpy
+            # version, the length check below catches the short result
+            warnings.simplefilter("ignore", DeprecationWarning)
+            try:
+                vals = np.fromstring(run.replace(b"|", b",").decode(errors="replace"), sep=",")
+            except ValueError:
+                vals = np.zeros(0)
+        if len(vals) == len(records) * n_fields and n_fields >= 2 and b"||" not in run.strip(b"|"):
+            rows = vals.reshape(len(records), n_fields)
+        else:
+            # mixed field counts or a damaged record, fall back to one record at a time and drop the bad ones
+            rows = []
+            for record in records:
+                if not record:
+                    continue
+                fields = record.split(b",")
+                try:
+                    row = [float(v) for v in fields]
+                except ValueError:
+                    self.errors += 1
+                    continue
+                if len(row) != n_fields or len(row) < 2:
+                    self.errors += 1
+                    continue
+                rows.append(row)
+            rows = np.array(rows).reshape(-1, n_fields)
+
+        gaps = np.zeros(len(rows), dtype=np.int64)
+        if len(rows) and self.gap:
+            gaps[0] = self.gap
+            self.gap = 0
+
+        keep = (rows[:, 0] != INVALID_TS) & (rows[:, 1] != INVALID_TS)
+        if not np.all(keep):
+            # only the first reading of a run can carry a gap, a dropped one hands it on to the next
+            carry = gaps[0] if not keep[0] else 0
+            rows = rows[keep]
+            gaps = gaps[keep]
+            if len(gaps):
+                gaps[0] += carry
+            else:
+                self.gap += carry
+
+        self.batch["beacon_ts"].append(rows[:, 0].astype(np.int64))
+        self.batch["local_ts"].append(rows[:, 1].astype(np.int64))
+        self.batch["gap"].append(gaps)
+        self.batch["values"].append(rows[:, 2:])
+
+
+def parse_upload(data):
+    """
+    :param data: (bytes) one complete upload
+    :return: (list) every batch in it, see StreamParser
+    """
+    parser = StreamParser()
+    return parser.feed(data) + parser.finish()
@@ -0,0 +1,231 @@
+import csv
+import sys
+import numpy as np
+
+from board_communication.lz import expand_upload
+from board_communication.parse_and_plot import transform_axis
+from board_communication.replay import read_uploads
+from board_communication.resample import TIME_UNIT, resample_boards
+from board_communication.stream_parser import parse_upload
+from board_communication.system_integration import assemble_data_for_plot
+from board_communication.upload_ack import AckTracker
+
+# analysis windows, in seconds
+WINDOW_S = 2.0
+HOP_S = 0.5
+MAX_LAG_S = 0.1
+# a window is only used when both boards see an event in it
+MIN_STD = 0.05
+MIN_CORR = 0.5
+# and only when the whole event is inside it: an event cut by the window edge is cut at a different place on each
+# board, which pulls the correlation peak by up to the lag itself, so at most EDGE_ENERGY of the window's energy may
+# lie within EDGE_S of either end
+EDGE_S = 0.25
+EDGE_ENERGY = 0.05
+
+
+def xcorr_lags(a, b, max_lag):
+    """
+    FFT cross-correlation of matching windows, all windows at once.
+
+    :param a: (np.ndarray) windows of the reference board, shape (n_windows, window)
+    :param b: (np.ndarray) the same windows of the other board
+    :param max_lag: (int) largest lag searched, in samples
+    :return: (tuple) (lag, corr) np.ndarrays of shape (n_windows,); lag is in samples with sub-sample resolution from
+             a parabola through the peak and its neighbours, positive when b is late; corr is the normalized peak
+    """
+    a = a - a.mean(axis=1, keepdims=True)
+    b = b - b.mean(axis=1, keepdims=True)
+    n = 1 << int(np.ceil(np.log2(a.shape[1] + max_lag + 1)))
+
+    # r[k] = sum a[i] * b[i + k], negative lags wrap to the end
+    r = np.fft.irfft(np.conj(np.fft.rfft(a, n)) * np.fft.rfft(b, n), n)
+    r = np.concatenate((r[:, n - max_lag:], r[:, :max_lag + 1]), axis=1)
+    r /= np.sqrt(np.sum(a * a, axis=1) * np.sum(b * b, axis=1))[:, None] + 1e-12
+
+    rows = np.arange(len(r))
+    peak = np.argmax(r, axis=1)
+    inner = np.clip(peak, 1, r.shape[1] - 2)
+    left = r[rows, inner - 1]
+    mid = r[rows, inner]
+    right = r[rows, inner + 1]
+    denom = left - 2 * mid + right
+    offset = np.where((peak == inner) & (denom < 0), 0.5 * (left - right) / np.where(denom < 0, denom, -1), 0.0)
+
+    return peak + offset - max_lag, r[rows, peak]
+
+
+def contained(windows, edge, max_fraction=EDGE_ENERGY):
+    """
+    :param windows: (np.ndarray) shape (n_windows, window)
+    :param edge: (int) samples at each end
+    :param max_fraction: (float) largest share of a window's energy allowed in its edges
+    :return: (np.ndarray) bool per window, True when its activity lies inside, away from both edges
+    """
+    e = windows - windows.mean(axis=1, keepdims=True)
+    e = e * e
+    return e[:, :edge].sum(axis=1) + e[:, -edge:].sum(axis=1) <= max_fraction * e.sum(axis=1)
+
+
+def lag_over_time(t, a, b, rate, window_s=WINDOW_S, hop_s=HOP_S, max_lag_s=MAX_LAG_S, min_std=MIN_STD,
+                  min_corr=MIN_CORR, edge_s=EDGE_S):
+    """
+    Residual sync error between two boards over a whole experiment. The signals are cut into overlapping windows, the
+    windows where both boards are active and the activity lies wholly inside the window are cross correlated, and the
+    lag of each one is reported.
+
+    :param t: (np.ndarray) common uniform time grid, from resample.resample_boards()
+    :param a: (np.ndarray) reference board signal on t
+    :param b: (np.ndarray) other board signal on t
+    :param rate: (float) sample rate of the grid in Hz
+    :return: (tuple) (t_center, lag_s, corr) np.ndarrays, one entry per usable window
+    """
+    window = int(round(window_s * rate))
+    hop = int(round(hop_s * rate))
+    max_lag = int(round(max_lag_s * rate))
+    edge = max(int(round(edge_s * rate)), max_lag)
+    if len(t) < window or window <= 2 * edge:
+        return np.zeros(0), np.zeros(0), np.zeros(0)
+
+    # normalize each board over the whole run, so min_std is relative to the board's own range
+    a = (a - np.mean(a)) / (np.max(np.abs(a - np.mean(a))) + 1e-12)
+    b = (b - np.mean(b)) / (np.max(np.abs(b - np.mean(b))) + 1e-12)
+
+    starts = np.arange(0, len(t) - window + 1, hop)
+    idx = starts[:, None] + np.arange(window)[None, :]
+    wa = a[idx]
+    wb = b[idx]
+    active = (wa.std(axis=1) >= min_std) & (wb.std(axis=1) >= min_std)
+    active &= contained(wa, edge) & contained(wb, edge)
+    if not np.any(active):
+        return np.zeros(0), np.zeros(0), np.zeros(0)
+
+    lag, corr = xcorr_lags(wa[active], wb[active], max_lag)
+    keep = corr >= min_corr
+    centers = t[starts[active] + window // 2]
+    return centers[keep], lag[keep] / rate, corr[keep]
+
+
+def check_boards(readings, native_rates, rate, reference=None):
+    """
+    :param readings: (dict) board name -> board_data dict, as for resample.resample_boards()
+    :param native_rates: (dict) board name -> native sample rate in Hz
+    :param rate: (float) common analysis rate in Hz
+    :param reference: (str) board the others are compared against, the first one by default
+    :return: (dict) board name -> (t_center, lag_s, corr) for every board but the reference
+    """
+    t, signals = resample_boards(readings, native_rates, rate)
+    names = list(signals.keys())
+    reference = names[0] if reference is None else reference
+    return {name: lag_over_time(t, signals[reference], signals[name], rate) for name in names if name != reference}
+
+
+def write_lag_csv(path, lags):
+    """
+    :param path: (str) output csv
+    :param lags: (dict) from check_boards()
+    """
+    with open(path, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(['board', 'beacon_ts', 'lag_ms', 'corr'])
+        for name, (t, lag, corr) in lags.items():
+            for i in range(len(t)):
+                writer.writerow([name, f'{t[i]:.0f}', f'{lag[i] * 1000:.3f}', f'{corr[i]:.3f}'])
+
+
+def summarize(lags):
+    for name, (t, lag, corr) in lags.items():
+        if len(lag) == 0:
+            print(f'{name}: no shared events')
+            continue
+        print(f'{name}: {len(lag)} windows, lag median {np.median(lag) * 1000:.2f} ms, '
+              f'p95 |lag| {np.percentile(np.abs(lag), 95) * 1000:.2f} ms, '
+              f'drift {np.polyfit(t * 1e-6, lag * 1000, 1)[0] if len(lag) > 1 else 0:.3f} ms/s')
+
+
+def load_recording(path):
+    """
+    Every board's readings from a recorded experiment, re-sent chunks counted once like a live experiment does.
+
+    :param path: (str) an uploads.bin capture, a laptop.log, or an experiment folder holding either
+    :return: (tuple) (readings, native_rates) for check_boards(), keyed by board IP; the native rate is estimated from
+             the median spacing of the board's readings on the beacon axis
+    """
+    acks = AckTracker()
+    batches = {}
+    for _, client_address, data in read_uploads(path):
+        ip = client_address[0]
+        try:
+            parsed = parse_upload(expand_upload(data))
+        except (IndexError, ValueError):
+            continue
+        for batch in parsed:
+            seq = batch["seq"]
+            if seq is not None and not acks.is_new(ip, seq, batch["oldest"]):
+                continue
+            if seq is not None:
+                acks.stored(ip, seq)
+            batches.setdefault(ip, []).append(batch)
+
+    readings = {}
+    native_rates = {}
+    for ip, board_batches in batches.items():
+        _, board_data = assemble_data_for_plot(board_batches)
+        if len(board_data["adc"]) < 2:
+            continue
+        t, _ = transform_axis(board_data["local_ts"], board_data["beacon_ts"], board_data["gap"])
+        spacing = np.median(np.diff(np.sort(t)))
+        if spacing <= 0:
+            continue
+        readings[ip] = board_data
+        native_rates[ip] = 1 / (spacing * TIME_UNIT)
+    return readings, native_rates
+
+
+def synthetic_pair(true_lag, drift, seed=0):
+    """
+    A wrist / base pair with a tap on the base every 3 s, felt by the wrist; the base is late by true_lag plus a lag
+    that grows by drift seconds per second.
+
+    :return: (tuple) (readings, native_rates) for check_boards()
+    """
+    rng = np.random.default_rng(seed)
+    tw = np.arange(0, 60, 0.001)
+    tb = np.arange(0, 60, 0.01)
+
+    def taps(t):
+        y = np.zeros_like(t)
+        for c in np.arange(1.5, 60, 3.0):
+            y += np.exp(-((t - c) / 0.05) ** 2) * np.sin(2 * np.pi * 4 * (t - c))
+        return y
+
+    wrist = {"local_ts": tw * 1000, "beacon_ts": tw * 1e6, "adc": taps(tw) + rng.normal(0, 0.02, len(tw))}
+    base = {"local_ts": tb * 1000, "beacon_ts": tb * 1e6,
+            "adc": taps(tb - true_lag - drift * tb) + rng.normal(0, 0.02, len(tb))}
+    return {"wrist": wrist, "base": base}, {"wrist": 1000, "base": 100}
+
+
+if __name__ == "__main__":
+    # usage: python -m board_communication.sync_check <uploads.bin | laptop.log | experiment folder> [rate] [out csv]
+    #        python -m board_communication.sync_check --synthetic [true lag in ms] [out csv]
+    # the first checks a recorded experiment on a common grid of rate Hz (500 by default), the second a synthetic
+    # pair with a known lag and a 0.1 ms/s drift, where it also prints the error against the true lag
+    if len(sys.argv) > 1 and sys.argv[1] == "--synthetic":
+        true_lag = float(sys.argv[2]) / 1000 if len(sys.argv) > 2 else 0.0123
+        out = sys.argv[3] if len(sys.argv) > 3 else None
+        lags = check_boards(*synthetic_pair(true_lag, 0.0001), 500)
+        t, lag, _ = lags["base"]
+        err = (lag - true_lag - 0.0001 * t * 1e-6) * 1000
+        if len(err):
+            print(f'error against the true lag: mean {err.mean():.3f} ms, max |error| {np.abs(err).max():.3f} ms')
+    else:
+        readings, native_rates = load_recording(sys.argv[1])
+        out = sys.argv[3] if len(sys.argv) > 3 else None
+        if len(readings) < 2:
+            sys.exit(f'{sys.argv[1]}: need readings from two boards, found {len(readings)}')
+        for name, native in native_rates.items():
+            print(f'{name}: {len(readings[name]["adc"])} readings at about {native:.1f} Hz')
+        lags = check_boards(readings, native_rates, float(sys.argv[2]) if len(sys.argv) > 2 else 500)
+    summarize(lags)
+    if out is not None:
+        write_lag_csv(out, lags)
@@ -4,14 +4,21 @@ import os
 from PyAccessPoint import pyaccesspoint
 import datetime
 import logging
-import math
+import numpy as np
 from board_communication.parse_and_plot import plot_tcp_data
+from board_communication.perf_counters import decode_perf_snapshot, append_perf_csv
+from board_communication.upload_ack import AckTracker, recv_upload
+from board_communication.stream_parser import parse_upload
+from board_communication.lz import expand_upload
+from board_communication.capture import CAPTURE_FILE, append_capture
 
 WINDOWS = True
 ENTRY_PORT = 10000
 
 #whether or not to save experiment
 SAVE = False
+# keep every raw upload in <experiment>/uploads.bin, with its arrival time, for replay.py
+CAPTURE = True
 
 ROOT_FOLDER = ""
 
@@ -51,11 +58,31 @@ def create_files(uid):
     board_file = os.path.join(os.getcwd(), "timestamp_data", ROOT_FOLDER, filename)
     if not os.path.exists(board_file):
         f = open(board_file, 'a')
-        f.write("beacon_timestamp,local_timestamp")
+        f.write("beacon_timestamp,local_timestamp,beacons_lost_before")
         f.close()
     return board_file
 
 
+def store_perf(uid, hex_str):
+    # uid: client IP address
+    # every upload carries "perf,<hex>|", keep them as a time series per board
+    ip_last3 = uid.split(".")[-1]
+    perf_file = os.path.join(ROOT_FOLDER, "perf_" + ip_last3 + ".csv")
+    append_perf_csv(perf_file, decode_perf_snapshot(hex_str))
+
+
+def sync_files(uid):
+    # uid: client IP address
+    # forces the board's files to disk, an upload is only acknowledged after this
+    ip_last3 = uid.split(".")[-1]
+    for filename in (ip_last3 + ".txt", "perf_" + ip_last3 + ".csv"):
+        path = os.path.join(ROOT_FOLDER, filename)
+        if os.path.exists(path):
+            fd = os.open(path, os.O_RDWR)
+            os.fsync(fd)
+            os.close(fd)
+
+
 def setup_ap():
     access_point = pyaccesspoint.AccessPoint()
     access_point.start()
@@ -72,6 +99,7 @@ def linux(plot = True):
     global ENTRY_PORT
 
     readings = {"wrist":{}, "base":{}}
+    acks = AckTracker()
 
     try:
         ap = setup_ap()
@@ -91,17 +119,18 @@ def linux(plot = True):
             connection, client_address = entry_socket.accept()
 
             logger.info(f'*** connection from {client_address} ***')
-            data = connection.recv(100000)
-            for i in range(10):
-                data += connection.recv(10000000)
-
+            data = recv_upload(connection)
             logger.info(data)
+            if CAPTURE:
+                append_capture(os.path.join(ROOT_FOLDER, CAPTURE_FILE), time.time(), client_address, data)
+
+            ack, batches = ingest_upload(data, client_address, acks)
+            connection.sendall(ack)
+            connection.close()
+
             if plot:
-                name, data = assemble_data_for_plot(data)
+                name, data = assemble_data_for_plot(batches)
                 readings[name] = data
-
-            else:
-                parse_mcu_msg(data, client_address)
     except Exception as e:
         logger.info(e)
 
@@ -109,59 +138,75 @@ def linux(plot = True):
 
 
 
-def assemble_data_for_plot(data):
+def ingest_upload(data, client_address, acks):
+    # stores one upload from recv_upload(), replay.py drives this too
+    # client_address is a tuple (connected_ip_address, connected_socket), acks an upload_ack.AckTracker
+    # returns a tuple (ack to send back, list of the stream_parser batches that were new)
+
+    # every chunk carries "seq,<n>,<oldest>|", re-sent chunks that were already stored are skipped
+    new_batches = []
+    try:
+        text = expand_upload(data)
+    except (IndexError, ValueError) as e:
+        # nothing of it is acknowledged, the board sends it again
+        logger.info(f"damaged compressed upload from {client_address[0]}: {e}")
+        text = b""
+    try:
+        batches = parse_upload(text)
+    except (IndexError, ValueError) as e:
+        logger.info(f"unreadable upload from {client_address[0]}: {e}")
+        batches = []
+    for batch in batches:
+        seq = batch["seq"]
+        if seq is not None and not acks.is_new(client_address[0], seq, batch["oldest"]):
+            logger.info(f"upload {seq} from {client_address[0]} was already stored")
+            continue
+        parse_mcu_msg([batch], client_address)
+        if seq is not None:
+            acks.stored(client_address[0], seq)
+        new_batches.append(batch)
+
+    # the board keeps every upload until it is acknowledged, so only ack what is on disk
+    sync_files(client_address[0])
+    return acks.ack(client_address[0]), new_batches
+
+
+def assemble_data_for_plot(data, uid=None):
     # from wrist module, readings will be in the format:
     # "|<beacon_ts>,<local_ts>,<accel_x>,<accel_y>,<accel_z>|"
     # from base module, readings will be in the format:
     # "|<beacon_ts>,<local_ts>,<load_cell>|"
+    # both also send one "|perf,<hex snapshot>|" record, stored with store_perf() when uid is given, and
+    # "|gap,<beacons lost>|" before a reading that follows lost beacons
+    # data is the raw upload (bytes) or a list of stream_parser batches
     # uid is a tuple (connected_ip_address, connected_socket)
-    # returns a tuple ("wrist" or "base", dictionary (created below))
+    # returns a tuple ("wrist" or "base", dictionary (created below)), readings without values are left out
 
+    batches = parse_upload(data) if isinstance(data, bytes) else data
     base_data = False
-    dict = {"adc":[], "local_ts": [], "beacon_ts": []}
-    data = str(data)
-    data = data.replace("b'", "")
-    data = data.replace("'", "")
-    data = data.split("|")
-    try:
-        for reading in data:
-            reading = reading.split(",")
-            if len(reading) < 2:
-                continue
-            beacon_ts = reading[0]
-            local_ts = reading[1]
-            if int(beacon_ts) == 3200171710 or int(local_ts) == 3200171710:
-                continue
-            if len(reading) == 3:  # from the base module
-                load_cell = reading[3]
-                dict["beacon_ts"].append(beacon_ts)
-                dict["local_ts"].append(local_ts)
-                dict["adc"].append(load_cell)
-                base_data = True
-            elif len(reading) == 5: #from the wrist module
-                x = reading[3]
-                y = reading[4]
-                z = reading[5]
-                accel = math.sqrt(math.pow(x, 2) + math.pow(y, 2) + math.pow(z, 2))
-                dict["beacon_ts"].append(beacon_ts)
-                dict["local_ts"].append(local_ts)
-                dict["adc"].append(accel)
-    except Exception as e:
-        logger.info("Unexpected data format, exception:")
-        logger.info(e)
-
-    if len(dict["beacon_ts"]) == len(dict["local_ts"]) == len(dict["adc"]):
-        name = ""
-        if base_data:
-            name = "base"
+    dict = {"adc": [], "local_ts": [], "beacon_ts": [], "gap": []}
+    for batch in batches:
+        if uid is not None:
+            for hex_str in batch["perf"]:
+                store_perf(uid[0], hex_str)
+        values = batch["values"]
+        if values.shape[1] == 1:  # from the base module
+            adc = values[:, 0]
+            base_data = True
+        elif values.shape[1] == 3:  # from the wrist module
+            adc = np.sqrt(np.sum(values ** 2, axis=1))
         else:
-            name = "wrist"
-        return name, dict
-    else:
-        print("Lengths of the arrays are unequal")
-        exit(-1)
+            continue
+        dict["beacon_ts"].append(batch["beacon_ts"])
+        dict["local_ts"].append(batch["local_ts"])
+        dict["adc"].append(adc)
+        dict["gap"].append(batch["gap"])
 
+    for key in dict:
+        dict[key] = np.concatenate(dict[key]) if dict[key] else np.zeros(0)
 
+    name = "base" if base_data else "wrist"
+    return name, dict
 
 
 def parse_mcu_msg(data, uid):
@@ -169,37 +214,39 @@ def parse_mcu_msg(data, uid):
     # "|<beacon_ts>,<local_ts>,<accel_x>,<accel_y>,<accel_z>|"
     # from base module, readings will be in the format:
     # "|<beacon_ts>,<local_ts>,<load_cell>|"
+    # both also send one "|perf,<hex snapshot>|" record, and "|gap,<beacons lost>|" before a reading that
+    # follows lost beacons
+    # data is the raw upload (bytes) or a list of stream_parser batches
     # uid is a tuple (connected_ip_address, connected_socket)
 
     ip_addr = uid[0]
-    data = str(data)
-    data = data.replace("b'", "")
-    data = data.replace("'", "")
-    data = data.split("|")
-    try:
-        for reading in data:
-            reading = reading.split(",")
-            if len(reading)<2:
-                continue
-            beacon_ts = reading[0]
-            local_ts = reading[1]
-            if int(beacon_ts) == 3200171710 or int (local_ts) == 3200171710:
-                continue
-            if len(reading) == 3:   # from the base module
-                load_cell = reading[3]
-            logger.info("Recieved from board {}:\n\tBeacon timestamp:\t{}\n\tLocal timestamp:\t{}".format(ip_addr, beacon_ts,
-                                                                                                    local_ts))
-            store_data(ip_addr, beacon_ts, local_ts)
-    except Exception as e:
-        logger.info("Unexpected data format, exception:")
-        logger.info(e)
+    batches = parse_upload(data) if isinstance(data, bytes) else data
+    for batch in batches:
+        for hex_str in batch["perf"]:
+            try:
+                store_perf(ip_addr, hex_str)
+            except ValueError as e:
+                logger.info("Unexpected perf record, exception:")
+                logger.info(e)
+        if len(batch["beacon_ts"]) == 0:
+            continue
+        lost = int(np.sum(batch["gap"]))
+        if lost:
+            logger.info("Board {} lost {} beacons".format(ip_addr, lost))
+        logger.info("Recieved {} readings from board {}, beacon timestamps {} to {}".format(
+            len(batch["beacon_ts"]), ip_addr, batch["beacon_ts"][0], batch["beacon_ts"][-1]))
+        store_readings(ip_addr, batch["beacon_ts"], batch["local_ts"], batch["gap"])
+
+
+def store_readings(uid, beacon_ts, local_ts, lost):
+    # one write per batch of readings instead of opening the file per reading
+    board_file = create_files(uid)
+    with open(board_file, 'a') as f:
+        f.write(''.join(f'\n{b},{l},{g}' for b, l, g in zip(beacon_ts.tolist(), local_ts.tolist(), lost.tolist())))
 
 
-def store_data(uid, beacon_timestamp, local_time):
-    board_file = create_files(uid)
-    f = open(os.path.join(os.getcwd(), "timestamp_data", board_file), 'a')
-    f.write('\n' + str(beacon_timestamp) + ',' + str(local_time))
-    f.close()
+def store_data(uid, beacon_timestamp, local_time, lost=0):
+    store_readings(uid, np.array([beacon_timestamp]), np.array([local_time]), np.array([lost]))
 
 
 
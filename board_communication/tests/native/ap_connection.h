@@ -0,0 +1,20 @@
+/*
+ * ap_connection.h
+ *
+ *  Stands in for the cc3220sf network terminal's ap_connection.h in the native test builds. The tests pass
+ *  MAX_TX_PACKET_SIZE in from the real header.
+ */
+
+#ifndef AP_CONNECTION_H_
+#define AP_CONNECTION_H_
+
+#include <stdint.h>
+
+#ifndef MAX_TX_PACKET_SIZE
+#error "build with -DMAX_TX_PACKET_SIZE taken from the firmware's ap_connection.h"
+#endif
+
+#define AP_SSID     "test_ap"
+#define AP_KEY      "test_key"
+
+#endif
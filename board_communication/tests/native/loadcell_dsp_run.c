@@ -0,0 +1,74 @@
+/*
+ * loadcell_dsp_run.c
+ *
+ *  Feeds the raw (ADC_1 - ADC_0) differences read from stdin, one per line, through loadcell_dsp_push() and
+ *  prints every output on its own line, for the tests to compare with util/loadcell_dsp.py.
+ *
+ *  With "dgram" as the third argument the outputs go through loadcell_dsp_pack() into load cell datagrams
+ *  the way stream_sensors_sink() builds them, input i taken at i * INPUT_PERIOD_US, and every datagram is
+ *  printed as one line of hex.
+ *
+ *  usage: loadcell_dsp_run <log2_decim> <out_bits> [dgram] < differences
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loadcell_dsp.h"
+#include "accel_stream.h"
+
+#define INPUT_PERIOD_US 500
+
+static void print_dgram(accel_stream_t * s)
+{
+    int32_t len = accel_stream_finish(s);
+    int32_t i;
+
+    for(i=0;i<len;i++)
+        printf("%02x", s->buf[i]);
+    printf("\n");
+}
+
+int main(int argc, char ** argv)
+{
+    static accel_stream_t stream;
+    loadcell_dsp_t dsp;
+    uint8_t packed[4];
+    uint32_t ts_us = 0;
+    int32_t size;
+    int32_t dgram;
+    long diff;
+    int32_t out;
+
+    if(argc < 3 || loadcell_dsp_init(&dsp, (uint8_t)atoi(argv[1]), (uint8_t)atoi(argv[2])) != 0)
+    {
+        printf("bad settings\n");
+        return 1;
+    }
+    dgram = (argc > 3 && strcmp(argv[3], "dgram") == 0);
+    size = loadcell_dsp_pack(0, (uint8_t)atoi(argv[2]), packed);
+    accel_stream_init_format(&stream, LOADCELL_STREAM_MAGIC, (uint8_t)size,
+                             (uint16_t)(INPUT_PERIOD_US * dsp.cic_decim * 2));
+
+    while(scanf("%ld", &diff) == 1)
+    {
+        if(loadcell_dsp_push(&dsp, (int32_t)diff, &out))
+        {
+            if(!dgram)
+                printf("%d\n", (int)out);
+            else
+            {
+                loadcell_dsp_pack(out, (uint8_t)atoi(argv[2]), packed);
+                if(accel_stream_add_raw(&stream, ts_us, packed))
+                    print_dgram(&stream);
+            }
+        }
+        ts_us += INPUT_PERIOD_US;
+    }
+
+    if(dgram && stream.count > 0)
+        print_dgram(&stream);
+
+    return 0;
+}
@@ -0,0 +1,13 @@
+/*
+ * network_terminal.h
+ *
+ *  Stands in for the cc3220sf network terminal's network_terminal.h in the native test builds, which copy the
+ *  firmware sources under test next to this directory's headers.
+ */
+
+#ifndef __NETWORK_TERMINAL_H__
+#define __NETWORK_TERMINAL_H__
+
+#include "simplelink_host.h"
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * simplelink_host.c
+ *
+ *  Simulated serial flash behind the SimpleLink file system stand-in, see simplelink_host.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "simplelink_host.h"
+
+typedef struct
+{
+    char name[40];
+    uint8_t * data;
+    uint32_t max_size;
+    uint32_t len;
+    uint8_t used;
+    uint8_t open;
+    uint8_t writing;
+}sim_file_t;
+
+typedef struct
+{
+    char name[40];
+    uint32_t cycles;
+}sim_wear_t;
+
+static sim_file_t simFiles[SIM_FLASH_FILES];
+static sim_wear_t simWear[SIM_FLASH_FILES];     /* by file name, kept when the file is deleted */
+static uint8_t simFailOpen = 0;
+static int32_t simPowerBytes = -1;              /* bytes written before the power goes, -1 for never */
+jmp_buf * simPowerJmp = NULL;
+
+static sim_file_t * sim_find(const char * name)
+{
+    uint32_t i;
+
+    for(i=0;i<SIM_FLASH_FILES;i++)
+        if(simFiles[i].used && strcmp(simFiles[i].name, name) == 0)
+            return &simFiles[i];
+
+    return NULL;
+}
+
+static sim_wear_t * sim_wear(const char * name)
+{
+    uint32_t i;
+
+    for(i=0;i<SIM_FLASH_FILES && simWear[i].name[0] != 0;i++)
+        if(strcmp(simWear[i].name, name) == 0)
+            return &simWear[i];
+    if(i == SIM_FLASH_FILES)
+        return NULL;
+    strncpy(simWear[i].name, name, sizeof(simWear[i].name) - 1);
+
+    return &simWear[i];
+}
+
+static uint32_t sim_allocated()
+{
+    uint32_t total = 0;
+    uint32_t i;
+
+    for(i=0;i<SIM_FLASH_FILES;i++)
+        if(simFiles[i].used)
+            total += simFiles[i].max_size;
+
+    return total;
+}
+
+static sim_file_t * sim_handle(_i32 fd)
+{
+    if(fd < 1 || fd > SIM_FLASH_FILES || !simFiles[fd - 1].used || !simFiles[fd - 1].open)
+        return NULL;
+
+    return &simFiles[fd - 1];
+}
+
+static void sim_power_cut()
+{
+    uint32_t i;
+
+    simPowerBytes = -1;
+    for(i=0;i<SIM_FLASH_FILES;i++)
+    {
+        simFiles[i].open = 0;
+        simFiles[i].writing = 0;
+    }
+    if(simPowerJmp != NULL)
+        longjmp(*simPowerJmp, 1);
+}
+
+_i32 sl_FsOpen(const _u8 * pFileName, const _u32 AccessModeAndMaxSize, _u32 * pToken)
+{
+    const char * name = (const char *)pFileName;
+    sim_file_t * f = sim_find(name);
+    uint32_t max_size = SL_FS_CREATE_MAX_SIZE(AccessModeAndMaxSize);
+    uint32_t i;
+
+    *pToken = 0;
+    if(simFailOpen)
+    {
+        simFailOpen = 0;
+        return SL_ERROR_FS_DEVICE_ERROR;
+    }
+
+    if(!(AccessModeAndMaxSize & (SL_FS_CREATE | SL_FS_WRITE)))
+    {
+        if(f == NULL)
+            return SL_ERROR_FS_FILE_NOT_EXISTS;
+        f->open = 1;
+        f->writing = 0;
+        return (_i32)(f - simFiles) + 1;
+    }
+
+    if(f == NULL)
+    {
+        if(!(AccessModeAndMaxSize & SL_FS_CREATE))
+            return SL_ERROR_FS_FILE_NOT_EXISTS;
+        if(sim_allocated() + max_size > SIM_FLASH_CAPACITY)
+            return SL_ERROR_FS_NO_AVAILABLE_BLOCKS;
+        for(i=0;i<SIM_FLASH_FILES && simFiles[i].used;i++);
+        if(i == SIM_FLASH_FILES)
+            return SL_ERROR_FS_NO_AVAILABLE_BLOCKS;
+
+        f = &simFiles[i];
+        memset(f, 0, sizeof(*f));
+        strncpy(f->name, name, sizeof(f->name) - 1);
+        f->data = calloc(max_size ? max_size : 1, 1);
+        f->max_size = max_size;
+        f->used = 1;
+    }
+    else if(AccessModeAndMaxSize & SL_FS_OVERWRITE)
+    {
+        f->len = 0;
+    }
+
+    if(sim_wear(name) != NULL)
+        sim_wear(name)->cycles++;
+    f->open = 1;
+    f->writing = 1;
+
+    return (_i32)(f - simFiles) + 1;
+}
+
+_i32 sl_FsRead(const _i32 FileHdl, _u32 Offset, _u8 * pData, _u32 Len)
+{
+    sim_file_t * f = sim_handle(FileHdl);
+
+    if(f == NULL)
+        return SL_ERROR_FS_INVALID_HANDLE;
+    if(Offset >= f->len)
+        return SL_ERROR_FS_OFFSET_OUT_OF_RANGE;
+    if(Len > f->len - Offset)
+        Len = f->len - Offset;
+    memcpy(pData, &f->data[Offset], Len);
+
+    return (_i32)Len;
+}
+
+_i32 sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8 * pData, _u32 Len)
+{
+    sim_file_t * f = sim_handle(FileHdl);
+    uint32_t n = Len;
+
+    if(f == NULL || !f->writing)
+        return SL_ERROR_FS_INVALID_HANDLE;
+    if(Offset + Len > f->max_size)
+        return SL_ERROR_FS_OFFSET_OUT_OF_RANGE;
+
+    if(simPowerBytes >= 0 && (uint32_t)simPowerBytes < Len)
+        n = (uint32_t)simPowerBytes;
+
+    memcpy(&f->data[Offset], pData, n);
+    if(Offset + n > f->len)
+        f->len = Offset + n;
+
+    if(n < Len)
+        sim_power_cut();
+    if(simPowerBytes >= 0)
+        simPowerBytes -= (int32_t)n;
+
+    return (_i32)Len;
+}
+
+_i16 sl_FsClose(const _i32 FileHdl, const _u8 * pCeritificateFileName, const _u8 * pSignature, const _u32 SignatureLen)
+{
+    sim_file_t * f = sim_handle(FileHdl);
+
+    (void)pCeritificateFileName;
+    (void)pSignature;
+    (void)SignatureLen;
+    if(f == NULL)
+        return SL_ERROR_FS_INVALID_HANDLE;
+    f->open = 0;
+    f->writing = 0;
+
+    return 0;
+}
+
+_i16 sl_FsDel(const _u8 * pFileName, const _u32 Token)
+{
+    sim_file_t * f = sim_find((const char *)pFileName);
+
+    (void)Token;
+    if(f == NULL)
+        return SL_ERROR_FS_FILE_NOT_EXISTS;
+    free(f->data);
+    memset(f, 0, sizeof(*f));
+
+    return 0;
+}
+
+void sim_flash_erase_all()
+{
+    uint32_t i;
+
+    for(i=0;i<SIM_FLASH_FILES;i++)
+        if(simFiles[i].used)
+            free(simFiles[i].data);
+    memset(simFiles, 0, sizeof(simFiles));
+    memset(simWear, 0, sizeof(simWear));
+    simFailOpen = 0;
+    simPowerBytes = -1;
+}
+
+void sim_flash_fail_next_open()
+{
+    simFailOpen = 1;
+}
+
+/* the power goes after bytes more bytes were written, -1 for never */
+void sim_flash_cut_power_after(int32_t bytes)
+{
+    simPowerBytes = bytes;
+}
+
+/* program/erase cycles of the file name since sim_flash_erase_all(), deleted and created again included */
+uint32_t sim_flash_cycles(const char * name)
+{
+    sim_wear_t * w = sim_wear(name);
+
+    return (w == NULL) ? 0 : w->cycles;
+}
+
+/* bytes stored in the file, -1 when it does not exist */
+int32_t sim_flash_size(const char * name)
+{
+    sim_file_t * f = sim_find(name);
+
+    return (f == NULL) ? -1 : (int32_t)f->len;
+}
+
+void sim_flash_flip(const char * name, uint32_t offset)
+{
+    sim_file_t * f = sim_find(name);
+
+    if(f != NULL && offset < f->len)
+        f->data[offset] ^= 0x01;
+}
+
+/* files left open, a leak of a handle in the code under test */
+uint32_t sim_flash_open_files()
+{
+    uint32_t open = 0;
+    uint32_t i;
+
+    for(i=0;i<SIM_FLASH_FILES;i++)
+        if(simFiles[i].used && simFiles[i].open)
+            open++;
+
+    return open;
+}
@@ -0,0 +1,84 @@
+/*
+ * simplelink_host.h
+ *
+ *  Host stand-in for the part of the SimpleLink API the flash code of the cc3220sf network terminal uses
+ *  (sl_FsOpen/Read/Write/Close/Del), backed by a simulated serial flash in memory, so spill_log.c and
+ *  boot_profile.c build and run natively in the tests.
+ *
+ *  Like the real file system a file gets its maximum size when it is created, SL_FS_OVERWRITE drops the old
+ *  content, and writes past the maximum size or beyond the flash capacity fail. Every file opened for writing
+ *  is counted as one program/erase cycle of its blocks. The tests can make an open fail, or cut the power
+ *  after a number of bytes: the write stops half way, nothing after it is stored, and sim_flash_power_cut()
+ *  jumps to the test's jmp_buf the way the CPU would stop.
+ */
+
+#ifndef SIMPLELINK_HOST_H_
+#define SIMPLELINK_HOST_H_
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef uint8_t _u8;
+typedef int16_t _i16;
+typedef uint16_t _u16;
+typedef int32_t _i32;
+typedef uint32_t _u32;
+
+#define SL_FS_READ                  0x00000000
+#define SL_FS_WRITE                 0x10000000
+#define SL_FS_CREATE                0x20000000
+#define SL_FS_OVERWRITE             0x40000000
+#define SL_FS_CREATE_MAX_SIZE(n)    ((_u32)(n) & 0x00FFFFFF)
+
+#define SL_ERROR_FS_FILE_NOT_EXISTS         (-11)
+#define SL_ERROR_FS_NO_AVAILABLE_BLOCKS     (-10253)
+#define SL_ERROR_FS_OFFSET_OUT_OF_RANGE     (-10266)
+#define SL_ERROR_FS_INVALID_HANDLE          (-10248)
+#define SL_ERROR_FS_DEVICE_ERROR            (-10287)
+
+#define DEVICE_ERROR                "Device error"
+
+#ifndef SIM_VERBOSE
+/* prints nothing, but the arguments are still used and checked against the format */
+static inline __attribute__((format(printf, 1, 2))) int sim_uart_discard(const char * fmt, ...)
+{
+    (void)fmt;
+    return 0;
+}
+#define UART_PRINT                  sim_uart_discard
+#else
+#define UART_PRINT                  printf
+#endif
+
+_i32 sl_FsOpen(const _u8 * pFileName, const _u32 AccessModeAndMaxSize, _u32 * pToken);
+
+_i32 sl_FsRead(const _i32 FileHdl, _u32 Offset, _u8 * pData, _u32 Len);
+
+_i32 sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8 * pData, _u32 Len);
+
+_i16 sl_FsClose(const _i32 FileHdl, const _u8 * pCeritificateFileName, const _u8 * pSignature, const _u32 SignatureLen);
+
+_i16 sl_FsDel(const _u8 * pFileName, const _u32 Token);
+
+/* simulated flash */
+#define SIM_FLASH_FILES             32
+#define SIM_FLASH_CAPACITY          (512 * 1024)
+
+extern jmp_buf * simPowerJmp;
+
+void sim_flash_erase_all();
+
+void sim_flash_fail_next_open();
+
+void sim_flash_cut_power_after(int32_t bytes);
+
+uint32_t sim_flash_cycles(const char * name);
+
+int32_t sim_flash_size(const char * name);
+
+void sim_flash_flip(const char * name, uint32_t offset);
+
+uint32_t sim_flash_open_files();
+
+#endif /* SIMPLELINK_HOST_H_ */
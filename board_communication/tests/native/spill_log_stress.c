@@ -0,0 +1,330 @@
+/*
+ * spill_log_stress.c
+ *
+ *  Stress test of the cc3220sf spill log (spill_log.c) on the simulated flash of simplelink_host.c. Runs a
+ *  seeded random mix of spills, replays, selective and contiguous acks, resets, failed opens, power cuts half
+ *  way through a segment and flipped payload bits against a model of what the log must still hold, and
+ *  checks that:
+ *      - a replay always returns the oldest pending segment with its exact payload,
+ *      - a segment is only lost when every slot holds unacknowledged data (then the oldest goes),
+ *      - a half written or corrupt segment is never replayed,
+ *      - sequence numbers keep increasing across resets,
+ *      - the slots share the erase cycles, and no file handle is left open.
+ *  Prints "ok" and exits with 0, or prints the failed check and exits with 1.
+ *
+ *  usage: spill_log_stress [operations] [seed]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "simplelink_host.h"
+#include "spill_log.h"
+
+#define CHECK(cond)                                                                         \
+    do                                                                                      \
+    {                                                                                       \
+        if(!(cond))                                                                         \
+        {                                                                                   \
+            printf("spill_log_stress.c:%d: check failed: %s (op %u)\n", __LINE__, #cond, op); \
+            exit(1);                                                                        \
+        }                                                                                   \
+    }while(0)
+
+static uint32_t modelSeq[SPILL_SEGMENTS];       /* segments the log must hold, 0 for none */
+static uint8_t data[MAX_TX_PACKET_SIZE];
+static uint8_t readBack[MAX_TX_PACKET_SIZE];
+static uint32_t rng = 1;
+static uint32_t op = 0;
+
+static uint32_t next_rand()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+
+    return rng;
+}
+
+/* payload of an upload, made up from its sequence number so it can be checked without keeping it */
+static uint32_t payload_len(uint32_t seq)
+{
+    uint32_t h = seq * 2654435761u;
+
+    return ((h >> 8) % 16 == 0) ? MAX_TX_PACKET_SIZE : 1 + (h >> 12) % 4000;
+}
+
+static uint8_t payload_byte(uint32_t seq, uint32_t i)
+{
+    return (uint8_t)(seq * 31 + i * 7 + (i >> 8));
+}
+
+static void make_payload(uint32_t seq)
+{
+    uint32_t i;
+
+    for(i=0;i<payload_len(seq);i++)
+        data[i] = payload_byte(seq, i);
+}
+
+static uint32_t model_pending()
+{
+    uint32_t n = 0;
+    uint32_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+        if(modelSeq[i] != 0)
+            n++;
+
+    return n;
+}
+
+/* index of the lowest sequence number above after in the model, -1 when there is none */
+static int32_t model_oldest(uint32_t after)
+{
+    int32_t oldest = -1;
+    uint32_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+        if(modelSeq[i] > after && (oldest < 0 || modelSeq[i] < modelSeq[oldest]))
+            oldest = i;
+
+    return oldest;
+}
+
+static void model_add(uint32_t seq)
+{
+    uint32_t i;
+
+    for(i=0;i<SPILL_SEGMENTS && modelSeq[i] != 0;i++);
+    if(i == SPILL_SEGMENTS)
+        i = model_oldest(0);
+    modelSeq[i] = seq;
+}
+
+static void model_remove(uint32_t seq)
+{
+    uint32_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+        if(modelSeq[i] == seq)
+            modelSeq[i] = 0;
+}
+
+/* what the upload path does on a connection: replay up to SPILL_REPLAY_MAX segments, oldest first */
+static void replay(uint32_t max, uint32_t * sent, uint32_t * count)
+{
+    uint32_t after = 0;
+    uint32_t seq;
+    int32_t len;
+    int32_t want;
+    uint32_t i;
+
+    *count = 0;
+    while(*count < max)
+    {
+        len = spill_log_peek(after, readBack, sizeof(readBack), &seq);
+        CHECK(len >= 0);
+        want = model_oldest(after);
+        if(len == 0)
+        {
+            CHECK(want < 0);
+            break;
+        }
+        CHECK(want >= 0 && seq == modelSeq[want]);
+        CHECK((uint32_t)len == payload_len(seq));
+        for(i=0;i<(uint32_t)len;i++)
+            CHECK(readBack[i] == payload_byte(seq, i));
+
+        sent[(*count)++] = seq;
+        after = seq;
+    }
+    CHECK(sim_flash_open_files() == 0);
+}
+
+/* drops whatever corrupt segments are left, so the log and the model agree on the pending count again */
+static void replay_all()
+{
+    uint32_t sent[SPILL_SEGMENTS];
+    uint32_t count;
+
+    replay(SPILL_SEGMENTS, sent, &count);
+    CHECK(count == model_pending());
+    CHECK(spill_log_pending() == model_pending());
+}
+
+static void reset()
+{
+    spill_log_init();
+    CHECK(sim_flash_open_files() == 0);
+}
+
+/* a free slot is used before the oldest unacknowledged segment is overwritten */
+static void test_selective_ack_frees_a_slot()
+{
+    uint32_t first = 0;
+    uint32_t seq;
+    uint32_t acked;
+    uint32_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+    {
+        seq = spill_log_next_seq();
+        if(i == 0)
+            first = seq;
+        make_payload(seq);
+        CHECK(spill_log_append(seq, data, payload_len(seq)) == 0);
+        model_add(seq);
+    }
+    CHECK(spill_log_pending() == SPILL_SEGMENTS);
+
+    acked = first + 3;
+    spill_log_ack(0, &acked, 1);
+    model_remove(acked);
+
+    seq = spill_log_next_seq();
+    make_payload(seq);
+    CHECK(spill_log_append(seq, data, payload_len(seq)) == 0);
+    model_add(seq);
+
+    CHECK(model_oldest(0) >= 0 && modelSeq[model_oldest(0)] == first);
+    replay_all();
+}
+
+static void stress(uint32_t ops)
+{
+    jmp_buf power;
+    uint32_t sent[SPILL_REPLAY_MAX];
+    uint32_t selective[4];
+    uint8_t header[SPILL_HEADER_SIZE];
+    volatile uint32_t lastSeq = 0;                  /* survives the longjmp of a power cut */
+    uint32_t token;
+    uint32_t count;
+    uint32_t seq;
+    uint32_t r;
+    uint32_t slot;
+    int32_t fd;
+    char name[16];
+    uint32_t i;
+
+    simPowerJmp = &power;
+    for(op=0;op<ops;op++)
+    {
+        r = next_rand() % 100;
+        if(r < 45)
+        {
+            /* the AP is out of reach: the upload is spilled */
+            seq = spill_log_next_seq();
+            CHECK(seq > lastSeq);
+            lastSeq = seq;
+            make_payload(seq);
+            r = next_rand() % 100;
+            if(r < 3)
+            {
+                sim_flash_fail_next_open();
+                CHECK(spill_log_append(seq, data, payload_len(seq)) < 0);
+            }
+            else if(r < 8)
+            {
+                /* the segment is written half way when the power goes; the slot it took is lost as well */
+                if(setjmp(power) == 0)
+                {
+                    sim_flash_cut_power_after(next_rand() % (SPILL_HEADER_SIZE + payload_len(seq)));
+                    spill_log_append(seq, data, payload_len(seq));
+                    CHECK(0);
+                }
+                if(model_pending() == SPILL_SEGMENTS)
+                    model_remove(modelSeq[model_oldest(0)]);
+                reset();
+                replay_all();
+            }
+            else
+            {
+                CHECK(spill_log_append(seq, data, payload_len(seq)) == 0);
+                model_add(seq);
+            }
+        }
+        else if(r < 70)
+        {
+            /* connected: replay, then the host acknowledges some of it */
+            replay(SPILL_REPLAY_MAX, sent, &count);
+            for(i=0;i<count;i++)
+            {
+                if(next_rand() % 4 != 0)
+                {
+                    spill_log_ack(0, &sent[i], 1);
+                    model_remove(sent[i]);
+                }
+            }
+        }
+        else if(r < 85)
+        {
+            /* an ack of everything up to some point plus a few out of order ones */
+            seq = (model_pending() == 0) ? 0 : modelSeq[model_oldest(0)] + next_rand() % 3;
+            count = 0;
+            for(i=0;i<SPILL_SEGMENTS && count < 4;i++)
+                if(modelSeq[i] > seq && next_rand() % 3 == 0)
+                    selective[count++] = modelSeq[i];
+            spill_log_ack(seq, selective, count);
+            for(i=0;i<SPILL_SEGMENTS;i++)
+                if(modelSeq[i] != 0 && modelSeq[i] <= seq)
+                    modelSeq[i] = 0;
+            for(i=0;i<count;i++)
+                model_remove(selective[i]);
+        }
+        else if(r < 93)
+        {
+            reset();
+        }
+        else
+        {
+            /* a flipped payload bit, the segment must be dropped instead of replayed */
+            slot = next_rand() % SPILL_SEGMENTS;
+            sprintf(name, "spill_%u.bin", (unsigned)slot);
+            if(sim_flash_size(name) > SPILL_HEADER_SIZE)
+            {
+                fd = sl_FsOpen((const uint8_t *)name, SL_FS_READ, &token);
+                CHECK(sl_FsRead(fd, 0, header, SPILL_HEADER_SIZE) == SPILL_HEADER_SIZE);
+                sl_FsClose(fd, NULL, NULL, 0);
+                sim_flash_flip(name, SPILL_HEADER_SIZE + next_rand() % (sim_flash_size(name) - SPILL_HEADER_SIZE));
+                model_remove(header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24));
+                replay_all();
+            }
+        }
+        CHECK(spill_log_pending() == model_pending());
+        CHECK(sim_flash_open_files() == 0);
+    }
+    simPowerJmp = NULL;
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t ops = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 20000;
+    uint32_t cycles;
+    uint32_t least = 0xFFFFFFFF;
+    uint32_t most = 0;
+    char name[16];
+    uint32_t i;
+
+    rng = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+    if(rng == 0)
+        rng = 1;
+
+    sim_flash_erase_all();
+    reset();
+    test_selective_ack_frees_a_slot();
+    stress(ops);
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+    {
+        sprintf(name, "spill_%u.bin", (unsigned)i);
+        cycles = sim_flash_cycles(name);
+        least = (cycles < least) ? cycles : least;
+        most = (cycles > most) ? cycles : most;
+    }
+    printf("erase cycles per slot: %u to %u\n", (unsigned)least, (unsigned)most);
+    CHECK(most <= least + least / 4 + 8);
+
+    printf("ok\n");
+    return 0;
+}
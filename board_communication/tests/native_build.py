@@ -0,0 +1,57 @@
+import os
+import re
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+REPO = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+FIRMWARE = os.path.join(REPO, 'ccs_workspace', 'network_terminal_CC3220SF_LAUNCHXL_tirtos_ccs')
+NATIVE = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'native')
+
+
+def firmware_define(header, name):
+    """
+    :param header: (str) file name in the firmware directory
+    :param name: (str) macro defined there with a plain number
+    :return: (int) its value
+    """
+    with open(os.path.join(FIRMWARE, header)) as f:
+        return int(re.search(rf'#define\s+{name}\s+\(?(\d+)', f.read()).group(1))
+
+
+class NativeTest(unittest.TestCase):
+    """
+    Builds firmware sources natively against the stand-in headers in native/. The firmware files are copied
+    into a temporary directory first, so their quoted includes of the app headers find the stand-ins.
+    """
+    def setUp(self):
+        self.cc = shutil.which('cc') or shutil.which('gcc')
+        if self.cc is None:
+            self.skipTest('no C compiler')
+        self.build_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, self.build_dir)
+
+    def build(self, firmware_files, native_files, defines=None, source_dir=FIRMWARE):
+        """
+        :param firmware_files: (list) file names in the firmware directory, the .c ones are compiled
+        :param native_files: (list) .c file names in native/
+        :param defines: (dict) name -> value passed with -D
+        :param source_dir: (str) directory the firmware files are in, the network terminal by default
+        :return: (str) path of the program
+        """
+        for name in firmware_files:
+            shutil.copy(os.path.join(source_dir, name), self.build_dir)
+        sources = [os.path.join(self.build_dir, name) for name in firmware_files if name.endswith('.c')]
+        sources += [os.path.join(NATIVE, name) for name in native_files]
+        program = os.path.join(self.build_dir, 'test')
+        args = [self.cc, '-O1', '-Wall', '-Wextra', '-Werror', '-I', NATIVE, '-I', self.build_dir, '-o', program] + sources
+        args += [f'-D{name}={value}' for name, value in (defines or {}).items()]
+        result = subprocess.run(args, capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return program
+
+    def run_program(self, program, *args):
+        result = subprocess.run([program] + [str(a) for a in args], capture_output=True, text=True, timeout=300)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        return result.stdout
@@ -0,0 +1,59 @@
+import socket
+import threading
+import time
+import unittest
+
+import board_communication.server as server
+
+
+class TestControlConsole(unittest.TestCase):
+    def setUp(self):
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.bind(('127.0.0.1', 0))
+        self.listener.listen(1)
+        self.start_flag = threading.Event()
+        self.end_flag = threading.Event()
+        self.exit_flag = threading.Event()
+        self.coms_dict = {'last_response': None}
+        self.thread = threading.Thread(target=server.wait_to_send_msgs,
+                                       args=(self.listener, self.coms_dict, self.start_flag, self.end_flag,
+                                             self.exit_flag, None), daemon=True)
+        self.thread.start()
+        # the board's end of the control connection
+        self.board = socket.create_connection(self.listener.getsockname())
+        self.addCleanup(self.board.close)
+        self.addCleanup(self.listener.close)
+        self.addCleanup(self.exit_flag.set)
+        self.addCleanup(self.start_flag.set)
+
+    def send(self, msg):
+        # what Server.send_msg_to_all_boards_tcp() does for one board
+        server.str_to_send = msg
+        server.thread_tasks_done = 0
+        server.using_udp = False
+        self.end_flag.clear()
+        self.start_flag.set()
+        deadline = time.time() + 5
+        while server.thread_tasks_done != 1:
+            self.assertLess(time.time(), deadline, 'the console never got an answer')
+            time.sleep(0.01)
+        self.start_flag.clear()
+        self.end_flag.set()
+        return self.coms_dict['last_response']
+
+    def test_text_is_not_sent_over_tcp(self):
+        response = self.send('hello')
+        self.assertIsInstance(response, ValueError)
+        self.board.settimeout(0.2)
+        with self.assertRaises(socket.timeout):
+            self.board.recv(64)
+
+    def test_board_closed_connection(self):
+        self.board.close()
+        self.assertIsInstance(self.send(('time_probe', {})), OSError)
+        # the console keeps working for the next command
+        self.assertIsInstance(self.send(('time_probe', {})), OSError)
+
+
+if __name__ == "__main__":
+    unittest.main()
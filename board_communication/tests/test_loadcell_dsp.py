@@ -0,0 +1,89 @@
+import subprocess
+import unittest
+
+import numpy as np
+
+from board_communication import server
+from board_communication.tests.native_build import NativeTest
+from util.loadcell_dsp import loadcell_dsp, INPUT_BITS
+
+
+class TestLoadcellDsp(NativeTest):
+    def setUp(self):
+        super().setUp()
+        self.program = self.build(['loadcell_dsp.c', 'loadcell_dsp.h', 'accel_stream.c', 'accel_stream.h'],
+                                  ['loadcell_dsp_run.c'])
+
+    def run_program_lines(self, diffs, *args):
+        result = subprocess.run([self.program] + [str(a) for a in args], capture_output=True, text=True,
+                                input='\n'.join(str(d) for d in diffs) + '\n', timeout=60)
+        self.assertEqual(result.returncode, 0, result.stdout)
+        return result.stdout.split()
+
+    def run_chain(self, diffs, log2_decim, out_bits):
+        return np.array([int(line) for line in self.run_program_lines(diffs, log2_decim, out_bits)], dtype=np.int64)
+
+    def check(self, diffs, log2_decim, out_bits):
+        board = self.run_chain(diffs, log2_decim, out_bits)
+        reference = loadcell_dsp(diffs, log2_decim=log2_decim, out_bits=out_bits)
+        self.assertEqual(len(board), len(diffs) // (2 << log2_decim))
+        np.testing.assert_array_equal(board, reference)
+        return board
+
+    def test_bit_exact(self):
+        rng = np.random.default_rng(7)
+        top = (1 << (INPUT_BITS - 1)) - 1
+        # noise over the full input range, then a slow signal with noise on it
+        noise = rng.integers(-top - 1, top + 1, 8192)
+        signal = (1500 * np.sin(np.arange(8192) / 300.0) + rng.normal(0, 40, 8192)).astype(np.int64)
+        for log2_decim in range(1, 7):
+            for out_bits in (16, 24):
+                with self.subTest(log2_decim=log2_decim, out_bits=out_bits):
+                    self.check(noise, log2_decim, out_bits)
+                    self.check(signal, log2_decim, out_bits)
+
+    def test_datagrams(self):
+        # the packed outputs the board uploads decode on the host to the same values as the python chain
+        rng = np.random.default_rng(11)
+        diffs = (1500 * np.sin(np.arange(50000) / 300.0) + rng.normal(0, 40, 50000)).astype(np.int64)
+        for log2_decim, out_bits in ((4, 16), (4, 24), (1, 24)):
+            with self.subTest(log2_decim=log2_decim, out_bits=out_bits):
+                decim = 2 << log2_decim
+                stats = server.new_stream_stats()
+                seqs, timestamps, values = [], [], []
+                for line in self.run_program_lines(diffs, log2_decim, out_bits, 'dgram'):
+                    data = bytes.fromhex(line)
+                    self.assertLessEqual(len(data), 1400)
+                    seq, ts, vals, bits = server.parse_loadcell_datagram(data)
+                    self.assertEqual(bits, out_bits)
+                    self.assertTrue(server.account_stream_seq(stats, seq))
+                    seqs.append(seq)
+                    timestamps.append(ts)
+                    values.append(vals)
+                self.assertEqual(seqs, list(range(len(seqs))))
+                self.assertGreater(len(seqs), 1)
+                values = np.concatenate(values)
+                np.testing.assert_array_equal(values, loadcell_dsp(diffs, log2_decim=log2_decim, out_bits=out_bits))
+                # output k completes on input (k + 1) * decim - 1, inputs every 500 us
+                expected = ((np.arange(len(values)) + 1) * decim - 1) * 500
+                np.testing.assert_array_equal(np.concatenate(timestamps), expected)
+
+    def test_parse_rejects_malformed(self):
+        # a length that is neither 2 nor 3 bytes per sample, and an accelerometer magic
+        header = server.STREAM_HEADER.pack(server.LOADCELL_STREAM_MAGIC, server.STREAM_VERSION, 0, 0, 0, 8000, 2)
+        self.assertIsNone(server.parse_loadcell_datagram(header + bytes(5)))
+        self.assertIsNotNone(server.parse_loadcell_datagram(header + bytes(6)))
+        header = server.STREAM_HEADER.pack(server.STREAM_MAGIC, server.STREAM_VERSION, 0, 0, 0, 8000, 2)
+        self.assertIsNone(server.parse_loadcell_datagram(header + bytes(6)))
+
+    def test_full_scale_saturates(self):
+        # full scale steps ring past the 16 bit range in the FIR, both sides clip the same way
+        top = (1 << (INPUT_BITS - 1)) - 1
+        steps = np.tile(np.repeat([top, -top - 1], 512), 4)
+        out = self.check(steps, 4, 16)
+        self.assertEqual(out.max(), (1 << 15) - 1)
+        self.assertEqual(out.min(), -(1 << 15))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,34 @@
+import unittest
+
+from board_communication.lz import lz_compress, lz_decompress, expand_upload
+
+
+def chunk(text):
+    # what send_chunk() on the board puts on the wire for a compressed chunk
+    return f"lz,{len(text)}|".encode() + lz_compress(text)
+
+
+class TestLz(unittest.TestCase):
+    def test_round_trip(self):
+        text = b"seq,1,1|" + b"".join(f"{1000 + i},{2000 + 3 * i}|".encode() for i in range(500))
+        self.assertEqual(lz_decompress(lz_compress(text))[0], text)
+
+    def test_single_chunk(self):
+        text = b"seq,1,1|100,200|101,201|"
+        self.assertEqual(expand_upload(chunk(text) + b"end|"), text + b"end|")
+
+    def test_back_to_back_chunks(self):
+        # the spill replay sends several chunks on one connection, the second follows the first's end marker
+        first = b"seq,1,1|100,200|101,201|"
+        second = b"seq,2,2|102,202|103,203|"
+        self.assertEqual(expand_upload(chunk(first) + chunk(second) + b"end|"), first + second + b"end|")
+
+    def test_plain_text_between_chunks(self):
+        first = b"seq,1,1|100,200|"
+        second = b"seq,3,3|104,204|"
+        data = chunk(first) + b"seq,2,2|102,202|" + chunk(second)
+        self.assertEqual(expand_upload(data), first + b"seq,2,2|102,202|" + second)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,71 @@
+import unittest
+
+import numpy as np
+
+from board_communication.merge import merge_streams
+
+
+def chunked(t, y, size):
+    return [(t[i:i + size], y[i:i + size]) for i in range(0, len(t), size)]
+
+
+def full_sort(boards):
+    # reference: every sample of every board, stable sorted by time with the board index breaking ties
+    t = np.concatenate([b[0] for b in boards])
+    board = np.concatenate([np.full(len(b[0]), i) for i, b in enumerate(boards)])
+    y = np.concatenate([b[1] for b in boards])
+    order = np.lexsort((board, t))
+    return t[order], board[order], y[order]
+
+
+def collect(chunks):
+    chunks = list(chunks)
+    return chunks, tuple(np.concatenate([c[i] for c in chunks]) for i in range(3))
+
+
+class TestMergeStreams(unittest.TestCase):
+    def setUp(self):
+        rng = np.random.default_rng(1)
+        # a 1 kHz wrist, a 100 Hz base and a 250 Hz board that starts late, times in us on a shared grid so some
+        # samples of different boards land on exactly the same time
+        self.boards = []
+        for period, start, n in ((1000, 0, 3000), (10000, 0, 300), (4000, 500000, 500)):
+            t = start + period * np.arange(n, dtype=np.float64)
+            self.boards.append((t, rng.normal(size=n)))
+
+    def test_global_order_across_rates(self):
+        _, (t, board, y) = collect(merge_streams([chunked(t, y, 4096) for t, y in self.boards], chunk_size=4096))
+        self.assertEqual(len(t), sum(len(b[0]) for b in self.boards))
+        self.assertTrue(np.all(np.diff(t) >= 0))
+        for i, (bt, by) in enumerate(self.boards):
+            np.testing.assert_array_equal(t[board == i], bt)
+            np.testing.assert_array_equal(y[board == i], by)
+
+    def test_ties_in_board_order(self):
+        t = np.array([0.0, 10.0, 10.0, 20.0])
+        boards = [(t, np.zeros(4)), (t, np.ones(4)), (t[1:3], np.full(2, 2.0))]
+        _, (out_t, board, _) = collect(merge_streams([[b] for b in boards], chunk_size=3))
+        np.testing.assert_array_equal(out_t, [0, 0, 10, 10, 10, 10, 10, 10, 20, 20])
+        np.testing.assert_array_equal(board, [0, 1, 0, 0, 1, 1, 2, 2, 0, 1])
+
+    def test_chunking_matches_full_sort(self):
+        expected = full_sort(self.boards)
+        for in_size in (1, 7, 128, 5000):
+            for out_size in (1, 64, 1000, 10000):
+                streams = [chunked(t, y, in_size + i) for i, (t, y) in enumerate(self.boards)]
+                chunks, got = collect(merge_streams(streams, chunk_size=out_size))
+                for g, e in zip(got, expected):
+                    np.testing.assert_array_equal(g, e)
+                self.assertTrue(all(len(c[0]) <= out_size for c in chunks))
+                self.assertTrue(all(len(c[0]) == out_size for c in chunks[:-1]))
+
+    def test_empty_chunks_and_boards(self):
+        t, y = self.boards[0]
+        stream = [(t[:0], y[:0])] + chunked(t, y, 100) + [(t[:0], y[:0])]
+        _, (out_t, board, _) = collect(merge_streams([[], stream, []], chunk_size=256))
+        np.testing.assert_array_equal(out_t, t)
+        self.assertTrue(np.all(board == 1))
+
+
+if __name__ == "__main__":
+    unittest.main()
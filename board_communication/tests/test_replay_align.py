@@ -0,0 +1,46 @@
+import os
+import tempfile
+import unittest
+
+import numpy as np
+
+from board_communication.parse_and_plot import transform_axis
+from board_communication.replay import align_folder
+
+
+class TestReplayAlign(unittest.TestCase):
+    def test_merged_csv_holds_the_aligned_axis(self):
+        with tempfile.TemporaryDirectory() as folder:
+            expected = {}
+            for board, (offset, skew) in {"10.0.0.2": (0, 1.0), "10.0.0.3": (37, 1.0001)}.items():
+                # 4 readings per 100 ms beacon, the local clock runs at its own rate and offset
+                local = offset + skew * np.arange(400) * 25000.0
+                beacon = np.floor(np.arange(400) / 4) * 100000.0
+                with open(os.path.join(folder, board + ".txt"), 'w') as f:
+                    f.write("beacon_timestamp,local_timestamp")
+                    for b, l in zip(beacon, local):
+                        f.write(f'\n{b:.0f},{l:.0f}')
+                axis, _ = transform_axis(np.round(local), beacon)
+                expected[board] = dict(zip(np.round(local), np.round(axis)))
+
+            stats = align_folder(folder)
+            self.assertEqual(stats["readings"], 800)
+
+            rows = []
+            with open(os.path.join(folder, "merged.csv")) as f:
+                self.assertEqual(f.readline().strip(), "aligned_timestamp,board,local_timestamp")
+                for line in f:
+                    t, board, local = line.strip().split(',')
+                    rows.append((float(t), board, float(local)))
+
+            self.assertEqual(len(rows), 800)
+            times = [r[0] for r in rows]
+            self.assertEqual(times, sorted(times))
+            for t, board, local in rows:
+                self.assertEqual(t, expected[board][local])
+            # readings between beacons are interpolated, not left on the beacon they arrived with
+            self.assertFalse(all(t % 100000 == 0 for t in times))
+
+
+if __name__ == '__main__':
+    unittest.main()
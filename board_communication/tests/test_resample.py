@@ -0,0 +1,68 @@
+import unittest
+
+import numpy as np
+
+from board_communication.resample import TIME_UNIT, PolyphaseResampler, resample_stream
+
+
+def tone(native, freq, seconds=10.0, jitter=0.05):
+    # a jittered board clock, like the aligned beacon time axis
+    rng = np.random.default_rng(0)
+    t = np.arange(0, seconds / TIME_UNIT, 1 / (native * TIME_UNIT))
+    t = np.sort(t + rng.normal(0, jitter / (native * TIME_UNIT), len(t)))
+    return t, np.sin(2 * np.pi * freq * t * TIME_UNIT)
+
+
+def resample(t, y, native, target, chunk=None):
+    chunks = [(t, y)] if chunk is None else [(t[i:i + chunk], y[i:i + chunk]) for i in range(0, len(t), chunk)]
+    parts = list(resample_stream(chunks, native, target, 0.0))
+    return np.concatenate([p[0] for p in parts]), np.concatenate([p[1] for p in parts])
+
+
+def inner_rms(t, y, target, freq):
+    # one second off both ends, where the filter edge is padded
+    inner = slice(int(target), -int(target))
+    if freq is None:
+        return np.sqrt(np.mean(y[inner] ** 2))
+    return np.sqrt(np.mean((y[inner] - np.sin(2 * np.pi * freq * t[inner] * TIME_UNIT)) ** 2))
+
+
+class TestPolyphaseResampler(unittest.TestCase):
+    def test_passband_tone_down(self):
+        t, y = tone(1000, 10)
+        t_out, y_out = resample(t, y, 1000, 100)
+        np.testing.assert_allclose(np.diff(t_out), 1 / (100 * TIME_UNIT))
+        self.assertAlmostEqual(len(t_out) / 100, 10, delta=0.1)
+        self.assertLess(inner_rms(t_out, y_out, 100, 10), 0.01)
+
+    def test_passband_tone_up(self):
+        t, y = tone(100, 10)
+        t_out, y_out = resample(t, y, 100, 250)
+        np.testing.assert_allclose(np.diff(t_out), 1 / (250 * TIME_UNIT))
+        self.assertLess(inner_rms(t_out, y_out, 250, 10), 0.02)
+
+    def test_out_of_band_tone_rejected(self):
+        # 310 Hz is above the 50 Hz Nyquist of the 100 Hz output, every 10th sample of it is a full scale 10 Hz alias
+        t, y = tone(1000, 310, jitter=0.0)
+        self.assertGreater(inner_rms(t[::10], y[::10], 100, None), 0.7)
+        t_out, y_out = resample(t, y, 1000, 100)
+        self.assertLess(inner_rms(t_out, y_out, 100, None), 0.01)
+
+    def test_chunks_match_whole_input(self):
+        for native, target in ((1000, 100), (100, 250), (1000, 250), (1000, 1000)):
+            t, y = tone(native, min(native, target) / 10)
+            whole = resample(t, y, native, target)
+            for chunk in (1, 13, 777):
+                parts = resample(t, y, native, target, chunk)
+                np.testing.assert_array_equal(parts[0], whole[0])
+                np.testing.assert_allclose(parts[1], whole[1], rtol=0, atol=1e-12)
+
+    def test_ratio(self):
+        r = PolyphaseResampler(1000, 250, 0.0)
+        self.assertEqual((r.up, r.down), (1, 4))
+        r = PolyphaseResampler(100, 250, 0.0)
+        self.assertEqual((r.up, r.down), (5, 2))
+
+
+if __name__ == "__main__":
+    unittest.main()
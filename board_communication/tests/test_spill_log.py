@@ -0,0 +1,17 @@
+import unittest
+
+from board_communication.tests.native_build import NativeTest, firmware_define
+
+
+class TestSpillLog(NativeTest):
+    def test_stress(self):
+        # spill_log.c and the boot_crc32() it checks segments with, on the simulated flash
+        program = self.build(['spill_log.c', 'spill_log.h', 'boot_profile.c', 'boot_profile.h'],
+                             ['simplelink_host.c', 'spill_log_stress.c'],
+                             {'MAX_TX_PACKET_SIZE': firmware_define('ap_connection.h', 'MAX_TX_PACKET_SIZE')})
+        for seed in (1, 2, 3):
+            self.assertIn('ok', self.run_program(program, 20000, seed))
+
+
+if __name__ == "__main__":
+    unittest.main()
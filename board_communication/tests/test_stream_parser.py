@@ -0,0 +1,42 @@
+import unittest
+
+import numpy as np
+
+from board_communication.stream_parser import StreamParser, parse_upload
+
+
+class TestStreamParser(unittest.TestCase):
+    def test_readings(self):
+        batches = parse_upload(b"seq,1,1|100,200,5|101,201,6|end|")
+        self.assertEqual(len(batches), 1)
+        np.testing.assert_array_equal(batches[0]["beacon_ts"], [100, 101])
+        np.testing.assert_array_equal(batches[0]["values"], [[5], [6]])
+
+    def test_split_feed(self):
+        data = b"seq,1,1|100,200|gap,2|101,201|end|"
+        parser = StreamParser()
+        batches = []
+        for i in range(len(data)):
+            batches += parser.feed(data[i:i + 1])
+        self.assertEqual(len(batches), 1)
+        np.testing.assert_array_equal(batches[0]["gap"], [0, 2])
+
+    def test_truncated_first_record(self):
+        parser = StreamParser()
+        batches = parser.feed(b"seq,1,1|100|101,201|102,202|end|") + parser.finish()
+        self.assertEqual(len(batches), 1)
+        np.testing.assert_array_equal(batches[0]["beacon_ts"], [101, 102])
+        np.testing.assert_array_equal(batches[0]["local_ts"], [201, 202])
+        self.assertEqual(parser.errors, 1)
+
+    def test_runs_of_different_widths(self):
+        parser = StreamParser()
+        batches = parser.feed(b"seq,1,1|100,200,5|gap,2|101,201|end|") + parser.finish()
+        self.assertEqual(len(batches), 1)
+        self.assertEqual(len(batches[0]["beacon_ts"]), 1)
+        self.assertEqual(len(batches[0]["gap"]), len(batches[0]["values"]))
+        self.assertEqual(parser.errors, 1)
+
+
+if __name__ == "__main__":
+    unittest.main()
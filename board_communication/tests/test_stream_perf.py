@@ -0,0 +1,61 @@
+import struct
+import unittest
+
+import numpy as np
+
+from board_communication.perf_counters import (PERF_COUNTERS, PERF_HEADER, PERF_HIST_BUCKETS, PERF_HISTOGRAMS,
+                                               PERF_MAGIC, PERF_VERSION, format_hist)
+from board_communication.server import (RING_CHANNELS, STREAM_HEADER, STREAM_MAGIC, STREAM_MAX_DGRAM, STREAM_VERSION,
+                                        ingest_stream_datagram, new_stream_stats)
+
+
+def perf_dgram(jitter):
+    # what send_perf_dgram() on the board sends, a raw perf_snapshot()
+    values = [0] * len(PERF_COUNTERS)
+    for name in PERF_HISTOGRAMS:
+        values += jitter if name == 'SAMPLE_JITTER_US' else [0] * PERF_HIST_BUCKETS
+    header = struct.pack(PERF_HEADER, PERF_MAGIC, PERF_VERSION, len(PERF_COUNTERS), len(PERF_HISTOGRAMS),
+                         PERF_HIST_BUCKETS, 0, 1234, 5678)
+    return header + struct.pack(f'<{len(values)}I', *values)
+
+
+def sample_dgram(seq, count=4):
+    header = STREAM_HEADER.pack(STREAM_MAGIC, STREAM_VERSION, 0, seq, 1000 * seq, 1000, count)
+    return header + np.arange(3 * count, dtype='<i2').tobytes()
+
+
+class RingStub:
+    def __init__(self):
+        self.samples = 0
+
+    def write(self, t, rows):
+        self.samples += len(rows)
+
+
+class TestStreamPerf(unittest.TestCase):
+    def test_perf_between_samples(self):
+        coms_dict = {'stream_stats': new_stream_stats(), 'ring': RingStub()}
+        rows = np.empty((STREAM_MAX_DGRAM // 6, RING_CHANNELS), dtype=np.float32)
+        jitter = [100, 50, 3] + [0] * (PERF_HIST_BUCKETS - 4) + [1]
+
+        ingest_stream_datagram(coms_dict, sample_dgram(0), rows)
+        ingest_stream_datagram(coms_dict, perf_dgram(jitter), rows)
+        ingest_stream_datagram(coms_dict, sample_dgram(1), rows)
+
+        stats = coms_dict['stream_stats']
+        self.assertEqual(stats['perf']['SAMPLE_JITTER_US'], jitter)
+        self.assertEqual(stats['perf']['uptime_ms'], 1234)
+        self.assertEqual((stats['datagrams'], stats['lost'], stats['malformed']), (2, 0, 0))
+        self.assertEqual(coms_dict['ring'].samples, 8)
+        self.assertEqual(format_hist(jitter), '0-0: 100, 1-1: 50, 2-3: 3, 16384-...: 1')
+
+    def test_truncated_perf(self):
+        coms_dict = {'stream_stats': new_stream_stats(), 'ring': RingStub()}
+        rows = np.empty((STREAM_MAX_DGRAM // 6, RING_CHANNELS), dtype=np.float32)
+        ingest_stream_datagram(coms_dict, perf_dgram([0] * PERF_HIST_BUCKETS)[:40], rows)
+        self.assertEqual(coms_dict['stream_stats']['malformed'], 1)
+        self.assertIsNone(coms_dict['stream_stats']['perf'])
+
+
+if __name__ == "__main__":
+    unittest.main()
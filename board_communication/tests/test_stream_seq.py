@@ -0,0 +1,40 @@
+import unittest
+
+from board_communication.server import STREAM_REORDER_WINDOW, account_stream_seq, new_stream_stats
+
+
+def feed(stats, seqs):
+    return [account_stream_seq(stats, seq) for seq in seqs]
+
+
+class TestStreamSeq(unittest.TestCase):
+    def test_loss_reorder_and_duplicates(self):
+        stats = new_stream_stats()
+        self.assertEqual(feed(stats, [0, 1, 4, 2, 2, 5]), [True, True, True, True, False, True])
+        self.assertEqual((stats['lost'], stats['reordered'], stats['duplicates'], stats['resets']), (1, 1, 1, 0))
+        self.assertEqual(stats['next_seq'], 6)
+
+    def test_reboot_restarts_the_stream(self):
+        stats = new_stream_stats()
+        last = STREAM_REORDER_WINDOW + 1000
+        feed(stats, range(last + 1))
+
+        # the board rebooted, its sequence starts at 0 again and every datagram is kept
+        self.assertEqual(feed(stats, range(10)), [True] * 10)
+        self.assertEqual(stats['resets'], 1)
+        self.assertEqual(stats['duplicates'], 0)
+        self.assertEqual(stats['next_seq'], 10)
+
+        # and is accounted like any other stream afterwards
+        self.assertEqual(feed(stats, [12, 10, 10]), [True, True, False])
+        self.assertEqual((stats['lost'], stats['reordered'], stats['duplicates']), (1, 1, 1))
+
+    def test_late_datagram_within_the_window_is_no_reset(self):
+        stats = new_stream_stats()
+        feed(stats, range(STREAM_REORDER_WINDOW + 10))
+        self.assertFalse(account_stream_seq(stats, 10))
+        self.assertEqual((stats['duplicates'], stats['resets']), (1, 0))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,57 @@
+import os
+import shutil
+import tempfile
+import unittest
+
+import numpy as np
+
+from board_communication.capture import CAPTURE_FILE, append_capture
+from board_communication.sync_check import check_boards, load_recording, synthetic_pair
+
+
+def uploads(board_data, chunk):
+    # text uploads as the board sends them, one value per reading, "seq,<n>,<oldest>|" ahead of each chunk
+    out = []
+    for seq, i in enumerate(range(0, len(board_data["adc"]), chunk), 1):
+        records = ''.join(f'{round(b)},{round(l)},{round(v * 1000)}|' for b, l, v in
+                          zip(board_data["beacon_ts"][i:i + chunk], board_data["local_ts"][i:i + chunk],
+                              board_data["adc"][i:i + chunk]))
+        out.append(f'seq,{seq},1|{records}end|'.encode())
+    return out
+
+
+class TestSyncCheck(unittest.TestCase):
+    def test_synthetic_lag(self):
+        # windows that cut an event used to be off by up to 7.5 ms here
+        for true_lag in (0.0, 0.0123, 0.05):
+            lags = check_boards(*synthetic_pair(true_lag, 0.0001), 500)
+            t, lag, _ = lags["base"]
+            err = lag - true_lag - 0.0001 * t * 1e-6
+            self.assertGreater(len(err), 20)
+            self.assertLess(np.max(np.abs(err)), 0.001)
+            self.assertLess(abs(np.mean(err)), 0.00025)
+
+    def test_recording(self):
+        folder = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, folder)
+        readings, _ = synthetic_pair(0.0123, 0.0)
+        path = os.path.join(folder, CAPTURE_FILE)
+        wrist = uploads(readings["wrist"], 5000)
+        base = uploads(readings["base"], 500)
+        # the base sends its second chunk again after a lost ack
+        for data in wrist[:6] + base[:2] + base[1:] + wrist[6:]:
+            ip = '10.0.0.2' if data in wrist else '10.0.0.3'
+            append_capture(path, 0.0, (ip, 0), data)
+
+        recorded, native_rates = load_recording(folder)
+        self.assertEqual(sorted(recorded), ['10.0.0.2', '10.0.0.3'])
+        self.assertEqual(len(recorded['10.0.0.3']['adc']), len(readings["base"]["adc"]))
+        self.assertAlmostEqual(native_rates['10.0.0.2'], 1000, delta=1)
+        self.assertAlmostEqual(native_rates['10.0.0.3'], 100, delta=0.1)
+
+        _, lag, _ = check_boards(recorded, native_rates, 500, reference='10.0.0.2')['10.0.0.3']
+        self.assertAlmostEqual(np.median(lag), 0.0123, delta=0.001)
+
+
+if __name__ == "__main__":
+    unittest.main()
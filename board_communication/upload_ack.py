@@ -0,0 +1,75 @@
+from board_communication.lz import expand_upload
+
+# make sure these match UPLOAD_SACK_MAX in ap_connection.h in the cc3220sf network terminal code
+UPLOAD_SACK_MAX = 8
+UPLOAD_END = b"end|"
+
+
+def recv_upload(connection, bufsize=65536):
+    """
+    Reads one upload, every chunk the board sends on the connection followed by "end|". Boards without sequence
+    numbers never send "end|", for them this reads until the board closes the connection. A compressed chunk can
+    end in "end|" by chance, the upload is only complete once every compressed chunk in it is.
+
+    :param connection: (socket.socket) accepted connection
+    :return: (bytes) everything received, "end|" included
+    """
+    data = b""
+    while True:
+        part = connection.recv(bufsize)
+        if not part:
+            break
+        data += part
+        if data.endswith(UPLOAD_END) and upload_complete(data):
+            break
+    return data
+
+
+def upload_complete(data):
+    try:
+        expand_upload(data)
+    except (IndexError, ValueError):
+        return False
+    return True
+
+
+class AckTracker:
+    """
+    Highest contiguous upload sequence number stored per board, plus the ones stored above it. A board numbers
+    its uploads 1, 2, ... and keeps every upload until it is acknowledged; the "oldest" field of each chunk is the
+    lowest number the board still holds, everything below it is settled (stored, or lost for good on the board),
+    so the contiguous number never waits for a range that will not come.
+    """
+
+    def __init__(self):
+        self.contiguous = {}
+        self.above = {}
+
+    def _settle(self, board, oldest):
+        self.contiguous[board] = max(self.contiguous.get(board, 0), oldest - 1)
+        above = self.above.setdefault(board, set())
+        while self.contiguous[board] + 1 in above:
+            self.contiguous[board] += 1
+        self.above[board] = {seq for seq in above if seq > self.contiguous[board]}
+
+    def is_new(self, board, seq, oldest):
+        """
+        :return: (bool) False when chunk seq was already stored, it is a re-send after a lost ack
+        """
+        self._settle(board, oldest)
+        return seq > self.contiguous[board] and seq not in self.above[board]
+
+    def stored(self, board, seq):
+        """
+        Call once the chunk is on disk.
+        """
+        self.above.setdefault(board, set()).add(seq)
+        self._settle(board, 0)
+
+    def ack(self, board):
+        """
+        :return: (bytes) "ack,<contiguous>[,<seq>...]|" for the board, the newest stored numbers above the
+                 contiguous one are listed so the board does not send them again
+        """
+        above = sorted(self.above.get(board, ()))[-UPLOAD_SACK_MAX:]
+        return ",".join(["ack", str(self.contiguous.get(board, 0))] + [str(seq) for seq in above]).encode() + b"|"
@@ -0,0 +1,94 @@
+/*
+ * accel_stream.c
+ */
+
+#include <string.h>
+
+#include "accel_stream.h"
+
+static void put_u16(uint8_t * p, uint16_t v)
+{
+    p[0] = (uint8_t)(v);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = (uint8_t)(v);
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+void accel_stream_init(accel_stream_t * s, uint16_t period_us)
+{
+    accel_stream_init_format(s, ACCEL_STREAM_MAGIC, ACCEL_STREAM_SAMPLE_SIZE, period_us);
+}
+
+/* a stream with the same header for other samples, sample_size bytes each */
+void accel_stream_init_format(accel_stream_t * s, uint16_t magic, uint8_t sample_size, uint16_t period_us)
+{
+    s->magic = magic;
+    s->sample_size = sample_size;
+    s->seq = 0;
+    s->base_ts_us = 0;
+    s->period_us = period_us;
+    s->count = 0;
+    s->flags = ACCEL_STREAM_FLAG_NONE;
+}
+
+/* returns 1 once the datagram can't take another sample, 0 otherwise */
+int32_t accel_stream_add(accel_stream_t * s, uint32_t ts_us, int16_t x, int16_t y, int16_t z)
+{
+    uint8_t sample[ACCEL_STREAM_SAMPLE_SIZE];
+
+    put_u16(&sample[0], (uint16_t)x);
+    put_u16(&sample[2], (uint16_t)y);
+    put_u16(&sample[4], (uint16_t)z);
+
+    return accel_stream_add_raw(s, ts_us, sample);
+}
+
+/* appends sample_size bytes already in wire order, returns like accel_stream_add() */
+int32_t accel_stream_add_raw(accel_stream_t * s, uint32_t ts_us, const uint8_t * sample)
+{
+    if(accel_stream_full(s))
+        return 1;
+
+    if(s->count == 0)
+        s->base_ts_us = ts_us;
+
+    memcpy(&s->buf[ACCEL_STREAM_HDR_SIZE + s->count * s->sample_size], sample, s->sample_size);
+    s->count++;
+
+    return accel_stream_full(s);
+}
+
+int32_t accel_stream_full(accel_stream_t * s)
+{
+    return (s->count >= (ACCEL_STREAM_MAX_DGRAM - ACCEL_STREAM_HDR_SIZE) / s->sample_size);
+}
+
+/*
+ * Writes the header in front of the buffered samples and returns the number of bytes
+ * to send from s->buf. The sequence number is advanced and the sample count reset
+ * so the next sample starts a new datagram.
+ */
+int32_t accel_stream_finish(accel_stream_t * s)
+{
+    int32_t len = ACCEL_STREAM_HDR_SIZE + s->count * s->sample_size;
+
+    put_u16(&s->buf[0], s->magic);
+    s->buf[2] = ACCEL_STREAM_VERSION;
+    s->buf[3] = s->flags;
+    put_u32(&s->buf[4], s->seq);
+    put_u32(&s->buf[8], s->base_ts_us);
+    put_u16(&s->buf[12], s->period_us);
+    put_u16(&s->buf[14], s->count);
+
+    s->seq++;
+    s->count = 0;
+    s->flags = ACCEL_STREAM_FLAG_NONE;
+
+    return len;
+}
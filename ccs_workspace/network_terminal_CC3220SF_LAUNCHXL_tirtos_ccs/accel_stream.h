@@ -0,0 +1,68 @@
+/*
+ * accel_stream.h
+ */
+
+#ifndef ACCEL_STREAM_H_
+#define ACCEL_STREAM_H_
+
+#include <stdint.h>
+
+/* make sure these match the STREAM_* globals in board_communication/server.py */
+#define ACCEL_STREAM_MAGIC          0x5354      /* "TS" on the wire, little endian */
+#define ACCEL_STREAM_VERSION        1
+#define ACCEL_STREAM_HDR_SIZE       16
+#define ACCEL_STREAM_SAMPLE_SIZE    6           /* int16 x, y, z */
+#define ACCEL_STREAM_MAX_DGRAM      1400        /* stays under a single 802.11 frame */
+#define ACCEL_STREAM_MAX_SAMPLES    ((ACCEL_STREAM_MAX_DGRAM - ACCEL_STREAM_HDR_SIZE) / ACCEL_STREAM_SAMPLE_SIZE)
+#define ACCEL_STREAM_PERIOD_US      1000        /* 1 kHz sampling by default */
+#define LOADCELL_STREAM_MAGIC       0x434C      /* "LC" on the wire, same header, packed loadcell_dsp outputs */
+
+/* header flags */
+#define ACCEL_STREAM_FLAG_NONE      0x00
+#define ACCEL_STREAM_FLAG_EVENT     0x01        /* samples belong to a detected event window */
+#define ACCEL_STREAM_FLAG_START     0x02        /* first datagram of an event, starts with the pre-trigger history */
+#define ACCEL_STREAM_FLAG_END       0x04        /* last datagram of an event */
+#define ACCEL_STREAM_FLAG_HEARTBEAT 0x08        /* idle keep-alive carrying only the latest sample */
+
+/*
+ * Datagram layout (all fields little endian):
+ *
+ *  offset  size  field
+ *  0       2     magic
+ *  2       1     version
+ *  3       1     flags
+ *  4       4     sequence number, incremented once per datagram
+ *  8       4     local timestamp of the first sample (us)
+ *  12      2     sample period (us), sample i was taken at base + i * period
+ *  14      2     sample count
+ *  16      6*n   samples {x, y, z}
+ *
+ *  Load cell datagrams have the same header with LOADCELL_STREAM_MAGIC, flags 0, and n samples of 2 or 3
+ *  bytes each, the signed 16 or 24 bit outputs of loadcell_dsp_pack(). Their sequence numbers count on
+ *  their own.
+ */
+typedef struct
+{
+    uint16_t magic;
+    uint8_t sample_size;
+    uint32_t seq;
+    uint32_t base_ts_us;
+    uint16_t period_us;
+    uint16_t count;
+    uint8_t flags;
+    uint8_t buf[ACCEL_STREAM_MAX_DGRAM];
+}accel_stream_t;
+
+void accel_stream_init(accel_stream_t * s, uint16_t period_us);
+
+void accel_stream_init_format(accel_stream_t * s, uint16_t magic, uint8_t sample_size, uint16_t period_us);
+
+int32_t accel_stream_add(accel_stream_t * s, uint32_t ts_us, int16_t x, int16_t y, int16_t z);
+
+int32_t accel_stream_add_raw(accel_stream_t * s, uint32_t ts_us, const uint8_t * sample);
+
+int32_t accel_stream_full(accel_stream_t * s);
+
+int32_t accel_stream_finish(accel_stream_t * s);
+
+#endif /* ACCEL_STREAM_H_ */
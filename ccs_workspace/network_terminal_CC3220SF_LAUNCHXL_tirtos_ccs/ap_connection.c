@@ -8,6 +8,7 @@
 /* Standard includes */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 /* Example Header files */
@@ -20,15 +21,34 @@
 /* custom header files */
 #include "ap_connection.h"
 #include "queue.h"
-
-
-
-//#define MAC_FILTER_ARGS           " -f S_MAC -v 5A:FB:84:5D:70:05 -e not_equals -a drop -m L1"
-#define MAC_FILTER_ARGS           " -f S_MAC -v 6a:00:e3:43:6b:63 -e not_equals -a drop -m L1"
+#include "accel_stream.h"
+#include "event_detect.h"
+#include "sensor.h"
+#include "clock_discipline.h"
+#include "beacon_sched.h"
+#include "event_loop.h"
+#include "ap_tracker.h"
+#include "rx_filter.h"
+#include "boot_profile.h"
+#include "perf_counters.h"
+#include "mem_pool.h"
+#include "spill_log.h"
+#include "lz_compress.h"
+#include "phase_lock.h"
+#include "cmd_proto.h"
+
+
+
+//#define BEACON_SRC_MAC            { 0x5A, 0xFB, 0x84, 0x5D, 0x70, 0x05 }
+#define BEACON_SRC_MAC            { 0x6a, 0x00, 0xe3, 0x43, 0x6b, 0x63 }
 
 /* for on-board accelerometer */
+#include <ti/drivers/I2C.h>
+#include <ti/drivers/dpl/HwiP.h>
 #include <ti/sail/bma2x2/bma2x2.h>
 
+extern s32 bma2x2_data_readout_template(I2C_Handle i2cHndl);
+
 typedef union
 {
     SlSockAddrIn6_t in6;       /* Socket info for Ipv6 */
@@ -37,16 +57,119 @@ typedef union
 
 uint8_t Tx_data[MAX_TX_PACKET_SIZE];
 
+accel_stream_t accel_stream;
+static accel_stream_t loadcell_stream;
+event_detect_t accel_events;
+
+/* handoff between the sensor task sink and stream_sensors_udp() */
+static sem_t sensorTxSem;
+static volatile uint8_t sensorTxBusy;
+static int32_t sensorTxLen;
+static uint8_t sensorTxBuf[ACCEL_STREAM_MAX_DGRAM];
+static uint32_t sensorTxDropped;
+static uint32_t sensorSamples[SENSOR_ID_COUNT];
+static event_loop_t * sensorTxLoop = NULL;         /* when set, full datagrams are posted to this loop */
+static uint8_t perfDgram[PERF_SNAPSHOT_SIZE];
+
+/* event loop modes */
+#define EVENT_BIT_UPLOAD            0x01
+#define EVENT_BROADCAST_PORT        10012
+#define EVENT_UPLOAD_PORT           10013       /* server.py's EVENT_UPLOAD_PORT, one receiver for every board */
+#define EVENT_STATS_PERIOD_US       5000000
+#define EVENT_READING_PERIOD_US     2000000     /* event_loop_beacons() readings when the profile has no sample period */
+#define BEACON_SYNC_CHECK_US        100000      /* how often test_time_beac_sync() checks for a due upload */
+
+typedef struct
+{
+    event_loop_t loop;
+    _i16 control_sock;
+    _i16 bcast_sock;
+    _i16 upload_sock;
+    _i16 beacon_sock;
+    SlSockAddrIn_t upload_addr;
+    uint32_t broadcasts;
+    uint32_t uploads;
+    uint32_t upload_failures;
+    uint32_t beacons;
+    uint32_t last_tsf_us;
+    uint32_t last_local_us;
+    queue_t q;
+    int32_t sample[MAX_ELEM_ARR_SIZE];          /* newest phase locked reading, from the sensor processing task */
+    volatile uint8_t sample_ready;
+    ts_capture_t * capture;                     /* test_time_beac_sync()'s readings, a MEM_POOL_CAPTURE block */
+    uint32_t beacon_interval_us;
+    uint32_t send_beac_ms;                      /* AP time of the next upload, 0 before the first beacon */
+    uint8_t upload_due;
+}node_ctx_t;
+
+static node_ctx_t node_ctx;
+
+/*
+ * Receive frame of the test commands, a MEM_POOL_NET_FRAME block taken on first use and kept. The commands,
+ * and the event loops they run, execute one at a time on the command thread, so they share it.
+ */
+static uint8_t * cmdFrame = NULL;
+
+/* the stack scan is slow, test_time_beac_sync() runs it after the first upload and then every this many */
+#define MEM_STACK_REPORT_UPLOADS    32
+
+static uint8_t * cmd_frame()
+{
+    if(cmdFrame == NULL)
+        cmdFrame = mem_pool_alloc(MEM_POOL_NET_FRAME);
+    if(cmdFrame == NULL)
+        UART_PRINT("[nnaji msg] out of pool memory for the receive frame\n\r");
+
+    return cmdFrame;
+}
+
+/* every beacon a command accepts, the one place PERF_BEACONS_RX is counted */
+static void beacon_heard()
+{
+    boot_phase_mark(BOOT_PHASE_FIRST_BEACON);
+    perf_count(PERF_BEACONS_RX);
+}
+
+static ap_tracker_t ap_tracker;
+
+/* transceiver mode RX filters, added to the NWP once and re-enabled with one call afterwards */
+static const rx_filter_rule_t beaconRules[] =           /* the source address rule is last, the boot profile may replace it */
+{
+    RX_FILTER_BEACONS_ONLY(0),
+    { RX_FILTER_FIELD_S_MAC, SL_WLAN_RX_FILTER_CMP_FUNC_NOT_EQUAL_TO, SL_WLAN_RX_FILTER_ACTION_DROP,
+      RX_FILTER_NO_PARENT, BEACON_SRC_MAC },
+};
+static const rx_filter_rule_t anyBeaconRules[] =
+{
+    RX_FILTER_BEACONS_ONLY(0),
+};
+static rx_filter_set_t beaconFilters = RX_FILTER_SET(beaconRules);
+static rx_filter_set_t anyBeaconFilters = RX_FILTER_SET(anyBeaconRules);
+
+/* beaconRules with the boot profile's AP address, what beaconFilters uses when the profile names one */
+static rx_filter_rule_t beaconProfileRules[sizeof(beaconRules) / sizeof(beaconRules[0])];
+
 
 int32_t connectToAP()
+{
+    return connect_to_ap_attempts(0);
+}
+
+/* gives up with -1 after max_attempts timed out association attempts, 0 keeps trying forever */
+int32_t connect_to_ap_attempts(uint32_t max_attempts)
 {
     int32_t ret = 0;
     ConnectCmd_t ConnectParams;
+    struct timespec start_time;
+    struct timespec cur_time;
+    uint32_t attempts = 0;
+
+    clock_gettime(CLOCK_REALTIME, &start_time);
 
     memset(&ConnectParams, 0x0, sizeof(ConnectCmd_t));
 
-    uint8_t ssid[] = AP_SSID;
-    uint8_t key[] = AP_KEY;
+    uint8_t * ssid = (uint8_t *)boot_profile_get()->ssid;
+    uint8_t * key = (uint8_t *)boot_profile_get()->key;
     SlWlanSecParams_t secParams = { .Type = SL_WLAN_SEC_TYPE_WPA_WPA2,
                                     .Key = (signed char *)key,
                                     .KeyLen = strlen((const char *)key) };
@@ -79,6 +202,7 @@ int32_t connectToAP()
     while(!connected_to_ap)
     {
         /* Connect to AP */
+        perf_count(PERF_CONNECT_ATTEMPTS);
         ret =
             sl_WlanConnect((const signed char *)(ConnectParams.ssid),
                            strlen(
@@ -102,7 +226,14 @@ int32_t connectToAP()
             {
                 UART_PRINT("\n\r[wlanconnect] : Timeout expired connecting to AP: %s\n\r",
                            ConnectParams.ssid);
+                perf_count(PERF_CONNECT_FAILURES);
                 handle_wifi_disconnection(app_CB.Status);
+                attempts++;
+                if(max_attempts != 0 && attempts >= max_attempts)
+                {
+                    sl_WlanDisconnect();
+                    return(-1);
+                }
                 continue;
             }
         }
@@ -117,6 +248,12 @@ int32_t connectToAP()
                   may be router/AP doesn't support IPv4 */
                 UART_PRINT(
                     "\n\r[wlanconnect] : Timeout expired to acquire IPv4 address.\n\r");
+                attempts++;
+                if(max_attempts != 0 && attempts >= max_attempts)
+                {
+                    sl_WlanDisconnect();
+                    return(-1);
+                }
             }
         }
 
@@ -129,6 +266,11 @@ int32_t connectToAP()
         else
         {
             connected_to_ap = 1;
+            boot_phase_mark(BOOT_PHASE_CONNECTED);
+
+            clock_gettime(CLOCK_REALTIME, &cur_time);
+            perf_hist(PERF_CONNECT_MS, (cur_time.tv_sec - start_time.tv_sec) * 1000 +
+                      (cur_time.tv_nsec - start_time.tv_nsec) / 1000000);
 
             UART_PRINT("\n\rconnectToAP() call successful, IP set to: IPv4=%d.%d.%d.%d , "
                                                 "Gateway=%d.%d.%d.%d\n\r",
@@ -299,6 +441,7 @@ uint16_t get_port_for_data_tx()
 
         if((status == SL_ERROR_BSD_EAGAIN) && (TRUE == notBlocking))
         {
+            perf_count(PERF_SEND_RETRIES);
             sleep(1);
             continue;
         }
@@ -327,6 +470,7 @@ uint16_t get_port_for_data_tx()
         status = sl_Recv(sock, &rcvd_msg_buff, bytes_to_rcv+1, 0);
         if((status == SL_ERROR_BSD_EAGAIN) && (TRUE == notBlocking))
         {
+            perf_count(PERF_RECV_EAGAIN);
             sleep(1);
             continue;
         }
@@ -508,800 +652,1551 @@ int32_t transmit_data_forever_test(uint16_t sockPort)
     return(0);
 }
 
-int32_t time_drift_test(uint16_t sockPort)
+int32_t init_accelerometer()
 {
-    int32_t sock;
-    int32_t status;
-    SlSockAddr_t        *sa;
-    int32_t addrSize;
-    sockAddr_t sAddr;
-    uint8_t notBlocking = 0;
+    I2C_Handle      i2c;
 
-    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
-    uint32_t buflen = MESSAGE_SIZE;
-    struct timespec last_time;
-    struct timespec cur_time;
-    uint8_t rcv_msg_buff[buflen];
-    uint8_t send_msg_buff[buflen];
-    uint32_t cur_time_sec = 0;
-    uint32_t cur_time_nsec = 0;
-    uint8_t counting = 0;
-    int32_t send_status;
+    /* the bus is shared with the other I2C sensors, see sensor.c */
+    i2c = sensor_i2c();
+    if(i2c == NULL)
+    {
+        UART_PRINT("Error Initializing I2C\n\r");
+        return(-1);
+    }
 
-    UART_PRINT("\n\rsockPort: %x\n\r",sockPort);
+    /* the bosch readout template leaves the bma222e in normal mode with a 1 kHz
+     * bandwidth, which is what the streaming test needs */
+    if(BMA2x2_INIT_VALUE != bma2x2_data_readout_template(i2c))
+    {
+        UART_PRINT("Error Initializing bma222e\n\r");
+        return(-1);
+    }
 
-    /* filling the TCP server socket address */
-    sAddr.in4.sin_family = SL_AF_INET;
+    return(0);
+}
 
-    /* Since this is the client's side,
-     * we must know beforehand the IP address
-     * and the port of the server wer'e trying to connect.
-     */
-    sAddr.in4.sin_port = sl_Htons((unsigned short)sockPort);
-    sAddr.in4.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
+int32_t stream_accel_udp(uint16_t sockPort)
+{
+    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
+    int32_t sock;
+    int32_t status;
+    int32_t dgram_len;
+    SlSockAddrIn_t sAddr;
+    uint32_t now_us;
+    uint32_t next_us;
+    uint32_t sent_dgrams = 0;
+    uint32_t failed_dgrams = 0;
+    uint32_t sent_bytes = 0;
 
-    sa = (SlSockAddr_t*)&sAddr.in4;
-    addrSize = sizeof(SlSockAddrIn6_t);
+    /* structure to read the accelerometer data*/
+    struct bma2x2_accel_data_temp sample_xyzt;
 
-    /* Get socket descriptor - this would be the
-     * socket descriptor for the TCP session.
-     */
-    sock = sl_Socket(sa->sa_family, SL_SOCK_STREAM, TCP_PROTOCOL_FLAGS);
-    ASSERT_ON_ERROR(sock, SL_SOCKET_ERROR);
+    UART_PRINT("\n\rsockPort: %x\n\r",sockPort);
 
-#ifdef SECURE_SOCKET
+    status = init_accelerometer();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
 
-    SlDateTime_t dateTime;
-    dateTime.tm_day = DEVICE_DATE;
-    dateTime.tm_mon = DEVICE_MONTH;
-    dateTime.tm_year = DEVICE_YEAR;
+    /* filling the UDP server socket address, the AP binds a datagram socket on the
+     * same port number it handed out in get_port_for_data_tx() */
+    sAddr.sin_family = SL_AF_INET;
+    sAddr.sin_port = sl_Htons((unsigned short)sockPort);
+    sAddr.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
 
-    sl_DeviceSet(SL_DEVICE_GENERAL, SL_DEVICE_GENERAL_DATE_TIME,
-                 sizeof(SlDateTime_t), (uint8_t *)(&dateTime));
+    sock = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
+    ASSERT_ON_ERROR(sock, SL_SOCKET_ERROR);
 
-    /* Set the following to enable Server Authentication */
-    sl_SetSockOpt(sock,SL_SOL_SOCKET,SL_SO_SECURE_FILES_CA_FILE_NAME,
-                  ROOT_CA_CERT_FILE, strlen(
-                      ROOT_CA_CERT_FILE));
+    accel_stream_init(&accel_stream, ACCEL_STREAM_PERIOD_US);
 
-#ifdef CLIENT_AUTHENTICATION
-    /* Set the following to pass Client Authentication */
-    sl_SetSockOpt(sock,SL_SOL_SOCKET,SL_SO_SECURE_FILES_PRIVATE_KEY_FILE_NAME,
-                  PRIVATE_KEY_FILE, strlen(
-                      PRIVATE_KEY_FILE));
-    sl_SetSockOpt(sock,SL_SOL_SOCKET,SL_SO_SECURE_FILES_CERTIFICATE_FILE_NAME,
-                  TRUSTED_CERT_CHAIN, strlen(
-                      TRUSTED_CERT_CHAIN));
-#endif
-#endif
+    UART_PRINT("[nnaji msg] streaming %i samples per datagram every %i us\n\r",
+               ACCEL_STREAM_MAX_SAMPLES, ACCEL_STREAM_PERIOD_US);
 
-    status = -1;
+    next_us = clock_discipline_local_us();
 
-    while(status < 0)
+    while(1)
     {
-        /* Calling 'sl_Connect' followed by server's
-         * 'sl_Accept' would start session with
-         * the TCP server. */
-        status = sl_Connect(sock, sa, addrSize);
-        if((status == SL_ERROR_BSD_EALREADY)&& (TRUE == notBlocking))
+        /* sleep until the next sample slot, deadlines advance by a fixed period so
+         * time spent reading and sending doesn't accumulate as drift */
+        now_us = clock_discipline_local_us();
+        if((int32_t)(next_us - now_us) > 0)
+            usleep(next_us - now_us);
+        next_us += ACCEL_STREAM_PERIOD_US;
+
+        if(BMA2x2_INIT_VALUE != bma2x2_read_accel_xyzt(&sample_xyzt))
         {
-            sleep(1);
+            UART_PRINT("Error reading from the accelerometer\n\r");
             continue;
         }
-        else if(status < 0)
-        {
-            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-                       SL_SOCKET_ERROR);
-            sl_Close(sock);
-            return(-1);
-        }
-        break;
-    }
+        boot_phase_mark(BOOT_PHASE_FIRST_SAMPLE);
 
-    //////////////////////////////////////////////////////
-    // wait to receive requests for system time from AP
-    //////////////////////////////////////////////////////
+        now_us = clock_discipline_local_us();
 
-    memset(rcv_msg_buff,0,strlen(rcv_msg_buff));
-    memset(send_msg_buff,0,strlen(send_msg_buff));
-    UART_PRINT("[nnaji msg] buflen: %i\n\r",buflen);
+        if(!accel_stream_add(&accel_stream, now_us, sample_xyzt.x, sample_xyzt.y, sample_xyzt.z))
+            continue;
 
-    clock_gettime(CLOCK_REALTIME,&last_time);
+        dgram_len = accel_stream_finish(&accel_stream);
 
-    while(1)
-    {
-        status = sl_Recv(sock, &rcv_msg_buff, buflen, 0);
-        if((status == SL_ERROR_BSD_EAGAIN) && (TRUE == notBlocking))
-        {
-            sleep(1);
-            continue;
-        }
-        else if(status < 0)
+        /* a lost datagram is accounted for by the host through the sequence number,
+         * so there is nothing to retry here */
+        status = sl_SendTo(sock, accel_stream.buf, dgram_len, 0,
+                           (SlSockAddr_t *)&sAddr, sizeof(SlSockAddrIn_t));
+        if(status < 0)
         {
+            failed_dgrams++;
             UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
                        SL_SOCKET_ERROR);
-            break;
-        }
-
-        if(status > 0){
-            UART_PRINT("msg from laptop: %s, strlen=%i\n\r", rcv_msg_buff, strlen(rcv_msg_buff));
-
-            if(strcmp("get_time",rcv_msg_buff) == 0 && counting)
-            {
-                clock_gettime(CLOCK_REALTIME, &cur_time);
-
-                cur_time_sec = cur_time.tv_sec - last_time.tv_sec;
-                cur_time_nsec = cur_time.tv_nsec - last_time.tv_nsec;
-
-                sprintf(send_msg_buff,"time_sec=%u,time_nsec=%u",cur_time_sec,cur_time_nsec);
-
-                send_status = sl_Send(sock, &send_msg_buff, buflen, 0);
-
-                if(send_status < 0)
-                {
-                    UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, send_status,
-                               SL_SOCKET_ERROR);
-                    break;
-                }
-            }
-            else if(strcmp("start_counting",rcv_msg_buff) == 0)
-            {
-                clock_gettime(CLOCK_REALTIME,&last_time);
-
-                UART_PRINT("[nnaji start_counting] time since clock initialization: sec=%u, nsec=%u\n\r",
-                           last_time.tv_sec, last_time.tv_nsec);
-
-                counting = 1;
-
-                strcpy(send_msg_buff,"I am starting to count");
-
-                send_status = sl_Send(sock, &send_msg_buff, buflen, 0);
-
-                if(send_status < 0)
-                {
-                    UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, send_status,
-                               SL_SOCKET_ERROR);
-                    break;
-                }
-            }
-            else
-            {
-                strcpy(send_msg_buff,"don't know what to do with this msg");
-
-                send_status = sl_Send(sock, &send_msg_buff, buflen, 0);
-
-                if(send_status < 0)
-                {
-                    UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, send_status,
-                               SL_SOCKET_ERROR);
-                    break;
-                }
-            }
+            continue;
         }
 
-        memset(rcv_msg_buff,0,strlen(rcv_msg_buff));
-        memset(send_msg_buff,0,strlen(send_msg_buff));
+        sent_dgrams++;
+        sent_bytes += status;
     }
 
-    /* Calling 'close' with the socket descriptor,
-     * once operation is finished. */
+    UART_PRINT("Sent %u datagrams (%u bytes), %u failed\n\r",
+               sent_dgrams, sent_bytes, failed_dgrams);
+
     status = sl_Close(sock);
     ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
 
     return(0);
 }
 
-int32_t tx_accelerometer(uint16_t sockPort)
+/* finishes the datagram in accel_stream with the given flags and sends it, returns the sl_SendTo status */
+static int32_t send_accel_stream(int32_t sock, SlSockAddrIn_t * sAddr, uint8_t flags)
 {
-    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
-    uint32_t buflen = MESSAGE_SIZE;
-    uint32_t channel = 11;
-    _i16 cur_channel;
-    _i16 numBytes;
-    _i16 status;
-    uint8_t Rx_frame[MAX_RX_PACKET_SIZE];
-    uint32_t i=0;
-    uint32_t j=0;
-    _u32 nonBlocking = 1;
-    uint32_t timestamp = 0;
-    uint16_t beacInterval;
-    uint32_t last_ts = 0;
-    frameInfo_t frameInfo;
-    _i16 beaconRxSock;
-    queue_t q;
-    int32_t reading[MAX_ELEM_ARR_SIZE];
-    struct timespec cur_time;
+    int32_t dgram_len;
 
-    /* for on-board accelerometer */
-    /* structure to read the accelerometer data*/
-    /* the resolution is in 8 bit*/
-    struct bma2x2_accel_data_temp sample_xyzt;
+    accel_stream.flags = flags;
+    dgram_len = accel_stream_finish(&accel_stream);
 
-    uint8_t createFilterArgs1[] = " -f FRAME_TYPE -v management -e not_equals -a drop -m L1";
-    uint8_t createFilterArgs2[] = " -f S_MAC -v 72:BC:10:69:9C:B6 -e not_equals -a drop -m L1";
-//    uint8_t createFilterArgs3[] = " -f S_MAC -v 72:BC:10:69:9C:B6 -e equals -a event -m L1";
-//    uint8_t createFilterArgs2[] = " -f S_MAC -v 58:00:e3:43:6b:63 -e not_equals -a drop -m L1";
-//    uint8_t createFilterArgs3[] = " -f S_MAC -v 58:00:e3:43:6b:63 -e equals -a event -m L1";
-    uint8_t enableFilterArgs[] = "";
+    return sl_SendTo(sock, accel_stream.buf, dgram_len, 0,
+                     (SlSockAddr_t *)sAddr, sizeof(SlSockAddrIn_t));
+}
 
-    status = cmdCreateFilterCallback(createFilterArgs1);
-    ASSERT_ON_ERROR(status, WLAN_ERROR);
+/*
+ * Same datagram stream as stream_accel_udp() but only windows around activity are sent. Every
+ * sample goes through the event detector; while idle nothing is sent apart from a one sample
+ * heartbeat every EVENT_HEARTBEAT_US. When an event starts the pre-trigger history is sent first,
+ * then live samples until the detector releases.
+ */
+int32_t stream_accel_events_udp(uint16_t sockPort)
+{
+    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
+    int32_t sock;
+    int32_t status;
+    int32_t state;
+    SlSockAddrIn_t sAddr;
+    uint32_t now_us;
+    uint32_t next_us;
+    uint32_t last_heartbeat_us;
+    uint8_t event_flags = ACCEL_STREAM_FLAG_NONE;
+    event_sample_t hist_sample;
+    uint32_t events = 0;
+    uint32_t sampled = 0;
+    uint32_t sent_samples = 0;
+    uint32_t failed_dgrams = 0;
 
-    status = cmdCreateFilterCallback(createFilterArgs2);
-    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    /* structure to read the accelerometer data*/
+    struct bma2x2_accel_data_temp sample_xyzt;
 
-//    status = cmdCreateFilterCallback(createFilterArgs3);
-//    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    UART_PRINT("\n\rsockPort: %x\n\r",sockPort);
 
-    status = cmdEnableFilterCallback(enableFilterArgs);
-    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    status = init_accelerometer();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
 
-    memset(Rx_frame, 0, MAX_RX_PACKET_SIZE);
+    sAddr.sin_family = SL_AF_INET;
+    sAddr.sin_port = sl_Htons((unsigned short)sockPort);
+    sAddr.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
 
-    UART_PRINT("[nnaji msg] buflen: %i\n\r", buflen);
+    sock = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
+    ASSERT_ON_ERROR(sock, SL_SOCKET_ERROR);
 
-    /* To use transceiver mode, the device must be set in STA role, be disconnected, and have disabled
-        previous connection policies that might try to automatically connect to an AP. */
-    status = sl_WlanPolicySet(SL_WLAN_POLICY_CONNECTION, SL_WLAN_CONNECTION_POLICY(0, 0, 0, 0), NULL, 0);
-    if( status )
-    {
-        UART_PRINT("[line:%d, error:%d]\n\r", __LINE__, status);
-        return(-1);
-    }
+    accel_stream_init(&accel_stream, ACCEL_STREAM_PERIOD_US);
+    event_detect_init(&accel_events);
 
-    beaconRxSock = sl_Socket(SL_AF_RF, SL_SOCK_DGRAM, channel);
-    ASSERT_ON_ERROR(beaconRxSock, SL_SOCKET_ERROR);
+    UART_PRINT("[nnaji msg] streaming events only, %i pre-trigger and %i post-trigger samples\n\r",
+               EVENT_PRETRIG_SAMPLES, EVENT_POSTTRIG_SAMPLES);
 
-    status = sl_SetSockOpt(beaconRxSock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonBlocking, sizeof(nonBlocking));
-    if(status < 0)
-    {
-        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-                   SL_SOCKET_ERROR);
-        sl_Close(beaconRxSock);
-        return(-1);
-    }
+    next_us = clock_discipline_local_us();
+    last_heartbeat_us = next_us;
 
-    initQueue(&q);
     while(1)
     {
-        numBytes = sl_Recv(beaconRxSock, &Rx_frame, MAX_RX_PACKET_SIZE, 0);
-        if(numBytes != SL_ERROR_BSD_EAGAIN)
-        {
-            if(numBytes < 0)
-            {
-                UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
-                           SL_SOCKET_ERROR);
-                break;
-            }
-
-            parse_beacon_frame(Rx_frame, &frameInfo, 0);
-            last_ts = frameInfo.timestamp;
-        }
-
-        reading[0] = last_ts;
-
-        clock_gettime(CLOCK_REALTIME, &cur_time);
-        reading[1] = (int32_t) (cur_time.tv_sec * 1000 + cur_time.tv_nsec / 1000000);
+        now_us = clock_discipline_local_us();
+        if((int32_t)(next_us - now_us) > 0)
+            usleep(next_us - now_us);
+        next_us += ACCEL_STREAM_PERIOD_US;
 
-        /*reads the accelerometer data in 8 bit resolution*/
-        /*There are different API for reading out the accelerometer data in
-         * 10,14,12 bit resolution*/
         if(BMA2x2_INIT_VALUE != bma2x2_read_accel_xyzt(&sample_xyzt))
         {
             UART_PRINT("Error reading from the accelerometer\n\r");
+            continue;
         }
+        boot_phase_mark(BOOT_PHASE_FIRST_SAMPLE);
 
-        reading[2] = (int32_t) sample_xyzt.x;
-        reading[3] = (int32_t) sample_xyzt.y;
-        reading[4] = (int32_t) sample_xyzt.z;
+        now_us = clock_discipline_local_us();
+        sampled++;
 
-        if(qFull(&q))
-            deque(&q);
-        enque(&q, reading);
+        state = event_detect_push(&accel_events, now_us, sample_xyzt.x, sample_xyzt.y, sample_xyzt.z);
+        status = 0;
 
-//        UART_PRINT("most recent reading: {%u, %u, %i, %i, %i}\n\r", reading[0], reading[1], reading[2], reading[3], reading[4]);
-//        UART_PRINT("q contents:\n\r");
-//        for(i=0;i<q.size;i++)
-//            UART_PRINT("%i: {%u, %u, %i, %i, %i}\n\r", i, q.arr[qIndex(&q,i)][0], q.arr[qIndex(&q,i)][1],
-//                       q.arr[qIndex(&q,i)][2], q.arr[qIndex(&q,i)][3], q.arr[qIndex(&q,i)][4]);
+        switch(state)
+        {
+        case EVENT_IDLE:
+            if((now_us - last_heartbeat_us) < EVENT_HEARTBEAT_US)
+                break;
+            last_heartbeat_us = now_us;
+            accel_stream_add(&accel_stream, now_us, sample_xyzt.x, sample_xyzt.y, sample_xyzt.z);
+            status = send_accel_stream(sock, &sAddr, ACCEL_STREAM_FLAG_HEARTBEAT);
+            sent_samples++;
+            break;
 
-        memset(Tx_data, 0, MAX_TX_PACKET_SIZE);
-        q_to_string(&q, Tx_data);
-        UART_PRINT("%s\n\rlength: %i\n\r", Tx_data, strlen(Tx_data));
+        case EVENT_START:
+            /* the triggering sample is the newest entry of the history */
+            events++;
+            event_flags = ACCEL_STREAM_FLAG_EVENT | ACCEL_STREAM_FLAG_START;
+            while(event_detect_pop_history(&accel_events, &hist_sample))
+            {
+                sent_samples++;
+                if(!accel_stream_add(&accel_stream, hist_sample.ts_us, hist_sample.x, hist_sample.y, hist_sample.z))
+                    continue;
+                status = send_accel_stream(sock, &sAddr, event_flags);
+                event_flags = ACCEL_STREAM_FLAG_EVENT;
+                if(status < 0)
+                    break;
+            }
+            break;
 
-        UART_PRINT("\n\r");
-        sleep(2);
+        case EVENT_ACTIVE:
+            sent_samples++;
+            if(accel_stream_add(&accel_stream, now_us, sample_xyzt.x, sample_xyzt.y, sample_xyzt.z))
+            {
+                status = send_accel_stream(sock, &sAddr, event_flags);
+                event_flags = ACCEL_STREAM_FLAG_EVENT;
+            }
+            break;
+
+        case EVENT_END:
+            /* flush whatever is buffered, even a short datagram, so the event closes promptly */
+            sent_samples++;
+            accel_stream_add(&accel_stream, now_us, sample_xyzt.x, sample_xyzt.y, sample_xyzt.z);
+            status = send_accel_stream(sock, &sAddr, event_flags | ACCEL_STREAM_FLAG_END);
+            last_heartbeat_us = now_us;
+            UART_PRINT("[nnaji msg] event %u: %u samples, %u of %u samples sent so far\n\r",
+                       events, accel_events.event_samples, sent_samples, sampled);
+            break;
+        }
+
+        if(status < 0)
+        {
+            failed_dgrams++;
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
+                       SL_SOCKET_ERROR);
+        }
     }
 
-    /* Calling 'close' with the socket descriptor,
-    * once operation is finished. */
-    status = sl_Close(beaconRxSock);
+    UART_PRINT("Sent %u of %u samples in %u events, %u datagrams failed\n\r",
+               sent_samples, sampled, events, failed_dgrams);
+
+    status = sl_Close(sock);
     ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
 
     return(0);
 }
 
-int32_t test_time_beac_sync()
+/*
+ * Finishes the datagram in stream and copies it to sensorTxBuf for stream_sensors_udp() or the upload post
+ * handler to send. If the previous datagram hasn't gone out yet the new one is dropped, the host sees it as
+ * a lost sequence.
+ */
+static void sensor_tx_queue(accel_stream_t * stream)
 {
-    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
-    uint32_t channel = 11;
-    int32_t timestamps[2][NUM_READINGS];
-    int current_ts_index = 0;
-    _i16 cur_channel;
-    _i16 numBytes;
-    _i16 status;
-    int32_t sent_bytes;
-    int32_t bytes_to_send;
-    int32_t buflen;
-    uint32_t i=0;
-    uint32_t j=0;
-    _u32 nonBlocking = 1;
-    uint32_t timestamp = 0;
-    uint16_t beacInterval;
-    frameInfo_t frameInfo;
-    _i16 beaconRxSock;
-    int32_t reading[MAX_ELEM_ARR_SIZE];
-    struct timespec cur_time;
-    uint32_t last_beac_ts = 0;
-    int32_t counter = 0;
-    uint8_t Rx_frame[MAX_RX_PACKET_SIZE];
-    uint32_t send_beac_ts = 0;
-    uint32_t send_interval = 30000;
+    int32_t len = accel_stream_finish(stream);
 
-    sockAddr_t sAddr;
-    uint16_t entry_port = ENTRY_PORT;
-    SlSockAddr_t * sa;
-    int32_t tcp_sock;
-    int32_t addrSize;
-    //int32_t no_bytes_count = 1000;
+    if(sensorTxBusy)
+    {
+        sensorTxDropped++;
+        return;
+    }
+    memcpy(sensorTxBuf, stream->buf, len);
+    sensorTxLen = len;
+    sensorTxBusy = 1;
+    if(sensorTxLoop != NULL)
+        event_loop_post(sensorTxLoop, EVENT_BIT_UPLOAD);
+    else
+        sem_post(&sensorTxSem);
+}
 
-    /* filling the TCP server socket address */
-    sAddr.in4.sin_family = SL_AF_INET;
+/*
+ * Sink, runs in the sensor processing task. Accelerometer samples are packed into accel_stream and the load
+ * cell's decimated outputs into loadcell_stream, each full datagram is queued for sending, so the sensor
+ * tasks never block on the network. A load cell sample is stamped with the time its input is centered on.
+ */
+static void stream_sensors_sink(const sensor_driver_t * sensor, uint32_t ts_us, const uint8_t * buf, int32_t count)
+{
+    int32_t i;
+    uint32_t period_us;
+    const sensor_accel_sample_t * accel;
+    const sensor_loadcell_sample_t * loadcell;
 
-    /* Since this is the client's side,
-     * we must know beforehand the IP address
-     * and the port of the server wer'e trying to connect.
-     */
-    sAddr.in4.sin_port = sl_Htons((unsigned short)entry_port);
-    sAddr.in4.sin_addr.s_addr = 0;
+    if(sensor->id < sizeof(sensorSamples) / sizeof(sensorSamples[0]))
+        sensorSamples[sensor->id] += count;
 
-    sa = (SlSockAddr_t*)&sAddr.in4;
-    addrSize = sizeof(SlSockAddrIn6_t);
+    if(sensor->id == SENSOR_ID_LOADCELL)
+    {
+        loadcell = (const sensor_loadcell_sample_t *)buf;
+        ts_us -= sensor_loadcell_delay_us();
+        period_us = sensor_period(sensor) * SENSOR_LOADCELL_DECIM;
+        for(i=0;i<count;i++)
+        {
+            if(accel_stream_add_raw(&loadcell_stream, ts_us - (count - 1 - i) * period_us, loadcell[i].value))
+                sensor_tx_queue(&loadcell_stream);
+        }
+        return;
+    }
+
+    if(sensor->id != SENSOR_ID_ACCEL)
+        return;
 
-    beaconRxSock = enter_tranceiver_mode(1);
+    accel = (const sensor_accel_sample_t *)buf;
+    period_us = sensor_period(sensor);
+    for(i=0;i<count;i++)
+    {
+        if(accel_stream_add(&accel_stream, ts_us - (count - 1 - i) * period_us,
+                            accel[i].x, accel[i].y, accel[i].z))
+            sensor_tx_queue(&accel_stream);
+    }
+}
+
+/*
+ * Starts new accelerometer and load cell streams at the periods in use, which the datagram header carries
+ * in 16 bits, so longer periods can't be streamed.
+ */
+static int32_t sensor_stream_reset()
+{
+    uint32_t accel_period_us = sensor_period(&sensor_bma222e);
+    uint32_t loadcell_period_us = sensor_period(&sensor_loadcell) * SENSOR_LOADCELL_DECIM;
+
+    if(accel_period_us > 0xFFFF || loadcell_period_us > 0xFFFF)
+    {
+        UART_PRINT("[nnaji msg] accelerometer period %u us or load cell output period %u us is too long to "
+                   "stream\n\r", accel_period_us, loadcell_period_us);
+        return(-1);
+    }
+
+    accel_stream_init(&accel_stream, accel_period_us);
+    accel_stream_init_format(&loadcell_stream, LOADCELL_STREAM_MAGIC, sizeof(sensor_loadcell_sample_t),
+                             loadcell_period_us);
+    sensorTxBusy = 0;
+    sensorTxDropped = 0;
+
+    return(0);
+}
+
+/*
+ * Sends a perf_snapshot() on a sensor upload socket. It starts with PERF_MAGIC instead of ACCEL_STREAM_MAGIC,
+ * so the host tells it from the sample datagrams and gets the SAMPLE_JITTER_US histogram taken while uploading.
+ */
+static int32_t send_perf_dgram(int32_t sock, const SlSockAddrIn_t * addr)
+{
+    int32_t len = perf_snapshot(perfDgram, sizeof(perfDgram));
+
+    if(len < 0)
+        return(-1);
+
+    return sl_SendTo(sock, perfDgram, len, 0, (SlSockAddr_t *)addr, sizeof(SlSockAddrIn_t));
+}
+
+/*
+ * Samples every sensor in the mask from the shared sensor task and streams the accelerometer with the
+ * stream_accel_udp() datagram format, the decimated load cell in LOADCELL_STREAM_MAGIC datagrams, and a
+ * perf snapshot every EVENT_STATS_PERIOD_US. The RTC is only counted here.
+ */
+int32_t stream_sensors_udp(uint16_t sockPort)
+{
+    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
+    int32_t sock;
+    int32_t status;
+    SlSockAddrIn_t sAddr;
+    uint32_t now_us;
+    uint32_t next_perf_us;
+    uint32_t sent_dgrams = 0;
+    uint32_t failed_dgrams = 0;
+
+    UART_PRINT("\n\rsockPort: %x\n\r",sockPort);
+
+    sAddr.sin_family = SL_AF_INET;
+    sAddr.sin_port = sl_Htons((unsigned short)sockPort);
+    sAddr.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
+
+    sock = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
+    ASSERT_ON_ERROR(sock, SL_SOCKET_ERROR);
+
+    status = sensor_init_all();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+
+    status = sensor_stream_reset();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+    memset(sensorSamples, 0, sizeof(sensorSamples));
+    sem_init(&sensorTxSem, 0, 0);
+
+    status = sensor_start_task(stream_sensors_sink);
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+
+    next_perf_us = clock_discipline_local_us() + EVENT_STATS_PERIOD_US;
 
     while(1)
     {
-//        if(no_bytes_count == 1000){
-//            UART_PRINT("1000 loops with no bytes found\n");
-//            no_bytes_count = 0;
-//        }
-//        else{
-//            no_bytes_count += 1;
-//        }
-        //UART_PRINT("start of loop\n");
-        //sleep(1);
-        numBytes = sl_Recv(beaconRxSock, &Rx_frame, MAX_RX_PACKET_SIZE, 0);
+        sem_wait(&sensorTxSem);
 
-        if(numBytes != SL_ERROR_BSD_EAGAIN)
+        /* the jitter histogram goes out between the datagrams it was measured against */
+        now_us = clock_discipline_local_us();
+        if((int32_t)(now_us - next_perf_us) >= 0)
         {
-            //UART_PRINT("num_bytes: %d\n\r", numBytes);
-            if(numBytes < 0)
-            {
-                UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
-                           SL_SOCKET_ERROR);
-                break;
-            }
-            //UART_PRINT("Beacon recieved \n\r");
-            clock_gettime(CLOCK_REALTIME, &cur_time);
-            parse_beacon_frame(Rx_frame, &frameInfo, 0);
+            next_perf_us = now_us + EVENT_STATS_PERIOD_US;
+            if(send_perf_dgram(sock, &sAddr) < 0)
+                failed_dgrams++;
         }
-        else
-            continue;
 
-        if(last_beac_ts == frameInfo.timestamp)
+        status = sl_SendTo(sock, sensorTxBuf, sensorTxLen, 0,
+                           (SlSockAddr_t *)&sAddr, sizeof(SlSockAddrIn_t));
+        sensorTxBusy = 0;
+        if(status < 0)
+        {
+            failed_dgrams++;
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
+                       SL_SOCKET_ERROR);
             continue;
+        }
+
+        if((++sent_dgrams % 256) == 0)
+        {
+            UART_PRINT("[nnaji msg] accel %u, loadcell %u, rtc %u samples, %u dropped, %u overruns, "
+                       "%u reads dropped\n\r", sensorSamples[SENSOR_ID_ACCEL], sensorSamples[SENSOR_ID_LOADCELL],
+                       sensorSamples[SENSOR_ID_RTC], sensorTxDropped, sensor_overruns(), sensor_dropped());
+        }
+    }
+
+    sensor_stop_task();
+
+    UART_PRINT("Sent %u datagrams, %u failed\n\r", sent_dgrams, failed_dgrams);
+
+    status = sl_Close(sock);
+    ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
+
+    return(0);
+}
+
+/*
+ * ======== control commands ========
+ * The binary commands of cmd_proto.h, served on the TCP control connection of event_loop_connected(). One
+ * handler per opcode in nodeCmds, cmd_dispatch() indexes it with the opcode.
+ */
+
+typedef struct
+{
+    struct timespec last_time;                  /* TIME_START reference */
+    uint8_t counting;
+    uint8_t capturing;
+    event_loop_t * loop;                        /* event_loop_connected()'s loop, NULL when capture commands can't run */
+    uint32_t rx_len;
+    uint8_t rx[CMD_MAX_FRAME];
+    uint8_t tx[CMD_MAX_FRAME];                  /* holds a GET_COUNTERS response, PERF_SNAPSHOT_SIZE + 11 bytes */
+}cmd_session_t;
+
+static cmd_session_t controlSession;
+
+static int32_t send_all(int32_t sock, uint8_t * buf, int32_t len);
+
+static uint8_t cmd_time_start(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    cmd_session_t * s = (cmd_session_t *)ctx;
+
+    clock_gettime(CLOCK_REALTIME, &s->last_time);
+    s->counting = 1;
+
+    UART_PRINT("[nnaji start_counting] time since clock initialization: sec=%u, nsec=%u\n\r",
+               (uint32_t)s->last_time.tv_sec, (uint32_t)s->last_time.tv_nsec);
+
+    cmd_reply_u32(reply, CMD_TLV_TIME_SEC, (uint32_t)s->last_time.tv_sec);
+    cmd_reply_u32(reply, CMD_TLV_TIME_NSEC, (uint32_t)s->last_time.tv_nsec);
+
+    return CMD_STATUS_OK;
+}
+
+/* time since TIME_START, and the local clock in us for comparing with the sensor timestamps */
+static uint8_t cmd_time_probe(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    cmd_session_t * s = (cmd_session_t *)ctx;
+    struct timespec cur_time;
+    uint32_t sec;
+    int32_t nsec;
+
+    clock_gettime(CLOCK_REALTIME, &cur_time);
+    if(!s->counting)
+        return CMD_STATUS_BAD_STATE;
+
+    sec = (uint32_t)(cur_time.tv_sec - s->last_time.tv_sec);
+    nsec = (int32_t)(cur_time.tv_nsec - s->last_time.tv_nsec);
+    if(nsec < 0)
+    {
+        sec--;
+        nsec += 1000000000;
+    }
+
+    cmd_reply_u32(reply, CMD_TLV_TIME_SEC, sec);
+    cmd_reply_u32(reply, CMD_TLV_TIME_NSEC, (uint32_t)nsec);
+    cmd_reply_u32(reply, CMD_TLV_LOCAL_US, clock_discipline_local_us());
+
+    return CMD_STATUS_OK;
+}
+
+/* starts the sensor task with the current sensor mask, the datagrams go out from the session's loop */
+static uint8_t cmd_capture_start(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    cmd_session_t * s = (cmd_session_t *)ctx;
+
+    if(s->loop == NULL)
+        return CMD_STATUS_BAD_STATE;
+    if(s->capturing)
+        return CMD_STATUS_OK;
+
+    if(sensor_init_all() != 0)
+        return CMD_STATUS_FAILED;
+
+    if(sensor_stream_reset() != 0)
+        return CMD_STATUS_BAD_STATE;
+    sensorTxLoop = s->loop;
+    if(sensor_start_task(stream_sensors_sink) != 0)
+    {
+        sensorTxLoop = NULL;
+        return CMD_STATUS_FAILED;
+    }
+    s->capturing = 1;
+
+    return CMD_STATUS_OK;
+}
+
+static uint8_t cmd_capture_stop(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    cmd_session_t * s = (cmd_session_t *)ctx;
+
+    if(s->loop == NULL)
+        return CMD_STATUS_BAD_STATE;
+
+    if(s->capturing)
+    {
+        sensor_stop_task();
+        sensorTxLoop = NULL;
+        s->capturing = 0;
+    }
+
+    return CMD_STATUS_OK;
+}
+
+/* saves the boot profile when the request asks for it, the new values are used either way */
+static uint8_t cmd_persist(const cmd_request_t * req)
+{
+    uint8_t persist = 0;
+
+    cmd_arg_u8(req, CMD_TLV_PERSIST, &persist);
+    if(persist && boot_profile_save() != 0)
+        return CMD_STATUS_FAILED;
+
+    return CMD_STATUS_OK;
+}
+
+/*
+ * The sample period is the sampling period of every sensor in the mask, 0 for the drivers' defaults, and
+ * event_loop_beacons()' reading period. The stream modes take both when they start, so neither can change
+ * while capturing. Every argument is checked before any is applied, a refused request leaves the profile as
+ * it was.
+ */
+static uint8_t cmd_set_rates(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    cmd_session_t * s = (cmd_session_t *)ctx;
+    uint32_t sample_period_us;
+    uint8_t sensors;
+    uint8_t has_period;
+    uint8_t has_sensors;
+
+    has_period = (cmd_arg_u32(req, CMD_TLV_SAMPLE_PERIOD_US, &sample_period_us) == 0);
+    has_sensors = (cmd_arg_u8(req, CMD_TLV_SENSORS, &sensors) == 0);
+
+    if(has_period && sample_period_us % SENSOR_TICK_US != 0)
+        return CMD_STATUS_BAD_ARGS;
+    if((has_period || has_sensors) && s->capturing)
+        return CMD_STATUS_BAD_STATE;
+
+    if(has_period)
+        boot_profile_set_sample_period(sample_period_us);
+    if(has_sensors)
+    {
+        boot_profile_set_sensors(sensors);
+        sensor_set_mask(sensors);
+    }
+    sensor_set_period(boot_profile_get()->sensors, boot_profile_get()->sample_period_us);
+
+    cmd_reply_u32(reply, CMD_TLV_SAMPLE_PERIOD_US, boot_profile_get()->sample_period_us);
+    cmd_reply_u8(reply, CMD_TLV_SENSORS, boot_profile_get()->sensors);
+
+    return cmd_persist(req);
+}
+
+/* the interval test_time_beac_sync() uploads on */
+static uint8_t cmd_set_upload(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    uint32_t interval_ms;
+
+    if(cmd_arg_u32(req, CMD_TLV_UPLOAD_INTERVAL_MS, &interval_ms) != 0 || interval_ms == 0)
+        return CMD_STATUS_BAD_ARGS;
+    boot_profile_set_upload_interval(interval_ms);
+
+    cmd_reply_u32(reply, CMD_TLV_UPLOAD_INTERVAL_MS, boot_profile_get()->upload_interval_ms);
+
+    return cmd_persist(req);
+}
+
+static uint8_t cmd_get_counters(void * ctx, const cmd_request_t * req, cmd_reply_t * reply)
+{
+    uint8_t * p = cmd_reply_reserve(reply, CMD_TLV_PERF, PERF_SNAPSHOT_SIZE);
+
+    if(p == NULL || perf_snapshot(p, PERF_SNAPSHOT_SIZE) < 0)
+        return CMD_STATUS_FAILED;
 
+    return CMD_STATUS_OK;
+}
 
+static const cmd_handler_fn nodeCmds[CMD_OP_COUNT] =
+{
+    [CMD_OP_TIME_START]     = cmd_time_start,
+    [CMD_OP_TIME_PROBE]     = cmd_time_probe,
+    [CMD_OP_CAPTURE_START]  = cmd_capture_start,
+    [CMD_OP_CAPTURE_STOP]   = cmd_capture_stop,
+    [CMD_OP_SET_RATES]      = cmd_set_rates,
+    [CMD_OP_SET_UPLOAD]     = cmd_set_upload,
+    [CMD_OP_GET_COUNTERS]   = cmd_get_counters,
+};
+
+static void cmd_session_init(cmd_session_t * s, event_loop_t * loop)
+{
+    s->counting = 0;
+    s->capturing = 0;
+    s->loop = loop;
+    s->rx_len = 0;
+}
 
-        timestamps[0][current_ts_index] = (int32_t) frameInfo.timestamp;
-        timestamps[1][current_ts_index] = (int32_t) (cur_time.tv_sec * 1000 + cur_time.tv_nsec / 1000000);
-        current_ts_index = (current_ts_index + 1) % NUM_READINGS;
+/*
+ * Reads what the socket has and answers every complete request in it. Returns the bytes read, 0 when the
+ * host closed the connection, SL_ERROR_BSD_EAGAIN when nothing was there, or a negative error, also when the
+ * stream is out of step or a response couldn't be sent, after which the connection has to be closed.
+ */
+static int32_t cmd_serve(int32_t sock, cmd_session_t * s)
+{
+    int32_t status;
+    int32_t frame_len;
+    int32_t len;
+    uint32_t pos = 0;
 
+    status = sl_Recv(sock, &s->rx[s->rx_len], CMD_MAX_FRAME - s->rx_len, 0);
+    if(status <= 0)
+        return status;
+    s->rx_len += status;
 
-        if(send_beac_ts==0)
+    while((frame_len = cmd_frame_len(&s->rx[pos], s->rx_len - pos)) > 0)
+    {
+        len = cmd_dispatch(nodeCmds, s, &s->rx[pos], frame_len, s->tx, sizeof(s->tx));
+        pos += frame_len;
+        if(len < 0 || send_all(sock, s->tx, len) < 0)
+            return(-1);
+    }
+    if(frame_len < 0)
+    {
+        UART_PRINT("[nnaji msg] control stream out of step, closing it\n\r");
+        return(-1);
+    }
+
+    /* keep the start of an incomplete request */
+    memmove(s->rx, &s->rx[pos], s->rx_len - pos);
+    s->rx_len -= pos;
+
+    return status;
+}
+
+/*
+ * ======== event loop handlers ========
+ * The test modes below as non-blocking handlers on one event_loop_t, see event_loop_connected() and
+ * event_loop_beacons().
+ */
+
+/* the control connection, binary commands from board_communication/cmd_client.py */
+static void control_tcp_handler(_i16 sd, void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    int32_t status;
+
+    status = cmd_serve(sd, &controlSession);
+    if(status == SL_ERROR_BSD_EAGAIN || status > 0)
+        return;
+
+    /* 0 is an orderly close by the host */
+    UART_PRINT("[nnaji msg] control connection closed (%i)\n\r", status);
+    event_loop_remove_socket(&ctx->loop, sd);
+    sl_Close(sd);
+    ctx->control_sock = -1;
+}
+
+/* the broadcast listener, prints when each broadcast arrived */
+static void broadcast_udp_handler(_i16 sd, void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    uint8_t * Rx_frame = cmdFrame;
+    SlSockAddrIn_t sAddr;
+    SlSocklen_t AddrSize = sizeof(SlSockAddrIn_t);
+    struct timespec cur_time;
+    int32_t numBytes;
+
+    numBytes = sl_RecvFrom(sd, Rx_frame, MAX_RX_PACKET_SIZE - 1, 0, (SlSockAddr_t *)&sAddr, &AddrSize);
+    if(numBytes <= 0)
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &cur_time);
+    Rx_frame[numBytes] = '\0';
+    ctx->broadcasts++;
+    UART_PRINT("[nnaji msg] broadcast %u at %u.%09u: %s\n\r", ctx->broadcasts,
+               (uint32_t)cur_time.tv_sec, (uint32_t)cur_time.tv_nsec, Rx_frame);
+}
+
+/* datagrams filled by the sensor task are posted here and sent from the loop thread */
+static void upload_post_handler(uint32_t bits, void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    int32_t status;
+
+    if(!(bits & EVENT_BIT_UPLOAD) || !sensorTxBusy)
+        return;
+
+    status = sl_SendTo(ctx->upload_sock, sensorTxBuf, sensorTxLen, 0,
+                       (SlSockAddr_t *)&ctx->upload_addr, sizeof(SlSockAddrIn_t));
+    sensorTxBusy = 0;
+    if(status < 0)
+    {
+        ctx->upload_failures++;
+        return;
+    }
+    ctx->uploads++;
+}
+
+/* RF socket handler, drains every queued beacon and keeps the newest TSF */
+static void beacon_rf_handler(_i16 sd, void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    uint8_t * Rx_frame = cmdFrame;
+    frameInfo_t frameInfo;
+    int32_t numBytes;
+
+    while(1)
+    {
+        numBytes = sl_Recv(sd, Rx_frame, MAX_RX_PACKET_SIZE, 0);
+        if(numBytes == SL_ERROR_BSD_EAGAIN)
+            return;
+        if(numBytes < 0)
         {
-            send_beac_ts = send_interval + (frameInfo.timestamp/1000 - (frameInfo.timestamp/1000 % send_interval));
-            UART_PRINT("%u = %u + (%u - (%u %% %u))\n\r", send_beac_ts, send_interval,frameInfo.timestamp/1000,frameInfo.timestamp/1000,
-                       send_interval);
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
+                       SL_SOCKET_ERROR);
+            event_loop_stop(&ctx->loop);
+            return;
         }
 
+        ctx->last_local_us = clock_discipline_local_us();
+        parse_beacon_frame(Rx_frame, &frameInfo, 0);
+        beacon_heard();
+        ctx->last_tsf_us = frameInfo.timestamp;
+        ctx->beacons++;
+        phase_lock_beacon(frameInfo.rxTimestampUs, ctx->last_local_us, frameInfo.tsf);
+    }
+}
+
+/*
+ * event_loop_beacons' sensor sink, keeps the newest accelerometer sample. ts_us is the TSF grid point it was
+ * taken at (see phase_lock.h), the same instant on every board, or 0 before the first beacon.
+ */
+static void phase_locked_sink(const sensor_driver_t * sensor, uint32_t ts_us, const uint8_t * buf, int32_t count)
+{
+    node_ctx_t * ctx = &node_ctx;
+    const sensor_accel_sample_t * accel;
+    struct timespec cur_time;
+    uintptr_t key;
+
+    if(sensor->id != SENSOR_ID_ACCEL)
+        return;
+
+    accel = &((const sensor_accel_sample_t *)buf)[count - 1];
+    clock_gettime(CLOCK_REALTIME, &cur_time);
+
+    key = HwiP_disable();
+    ctx->sample[0] = (int32_t) ts_us;
+    ctx->sample[1] = (int32_t) (cur_time.tv_sec * 1000 + cur_time.tv_nsec / 1000000);
+    ctx->sample[2] = (int32_t) accel->x;
+    ctx->sample[3] = (int32_t) accel->y;
+    ctx->sample[4] = (int32_t) accel->z;
+    ctx->sample_ready = 1;
+    HwiP_restore(key);
+}
+
+/* event_loop_beacons' periodic reading, the newest sample the sensor task took on the TSF grid */
+static void accel_sample_timer(void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    int32_t reading[MAX_ELEM_ARR_SIZE];
+    uintptr_t key;
+
+    if(!ctx->sample_ready)
+        return;
+
+    key = HwiP_disable();
+    memcpy(reading, ctx->sample, sizeof(reading));
+    ctx->sample_ready = 0;
+    HwiP_restore(key);
+
+    if(qFull(&ctx->q))
+    {
+        perf_count(PERF_QUEUE_OVERFLOWS);
+        deque(&ctx->q);
+    }
+    enque(&ctx->q, reading);
+}
 
-        if(frameInfo.timestamp/1000 >= send_beac_ts)
+static void stats_timer(void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    int32_t * reading;
+
+    event_loop_report(&ctx->loop);
+    perf_report();
+    if(controlSession.capturing && ctx->upload_sock >= 0 &&
+       send_perf_dgram(ctx->upload_sock, &ctx->upload_addr) < 0)
+        ctx->upload_failures++;
+    if(ctx->beacon_sock >= 0)
+        phase_lock_report();
+    /* the readings themselves are only printed here, not on every sample tick */
+    if(!qEmpty(&ctx->q))
+    {
+        reading = qBack(&ctx->q);
+        UART_PRINT("[nnaji msg] newest reading: %i,%i,%i,%i,%i\n\r",
+                   reading[0], reading[1], reading[2], reading[3], reading[4]);
+    }
+    UART_PRINT("[nnaji msg] %u broadcasts, %u uploads (%u failed, %u dropped), %u beacons\n\r",
+               ctx->broadcasts, ctx->uploads, ctx->upload_failures, sensorTxDropped, ctx->beacons);
+}
+
+/*
+ * Connected to the AP: serves the TCP control connection (cmd_proto.h), the broadcast listener and the
+ * sensor task's UDP upload from one thread.
+ */
+int32_t event_loop_connected(uint16_t sockPort)
+{
+    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
+    node_ctx_t * ctx = &node_ctx;
+    SlSockAddrIn_t sAddr;
+    int32_t status;
+    _u32 nonBlocking = 1;
+
+    UART_PRINT("\n\rsockPort: %x\n\r",sockPort);
+
+    /* the socket handlers receive into it */
+    if(cmd_frame() == NULL)
+        return(-1);
+
+    memset(ctx, 0, sizeof(node_ctx_t));
+    event_loop_init(&ctx->loop);
+    cmd_session_init(&controlSession, &ctx->loop);
+    ctx->control_sock = -1;
+    ctx->bcast_sock = -1;
+    ctx->upload_sock = -1;
+    ctx->beacon_sock = -1;
+
+    /* control connection to the laptop */
+    sAddr.sin_family = SL_AF_INET;
+    sAddr.sin_port = sl_Htons((unsigned short)sockPort);
+    sAddr.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
+
+    ctx->control_sock = sl_Socket(SL_AF_INET, SL_SOCK_STREAM, TCP_PROTOCOL_FLAGS);
+    ASSERT_ON_ERROR(ctx->control_sock, SL_SOCKET_ERROR);
+    status = sl_Connect(ctx->control_sock, (SlSockAddr_t *)&sAddr, sizeof(SlSockAddrIn_t));
+    ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
+    status = sl_SetSockOpt(ctx->control_sock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonBlocking, sizeof(nonBlocking));
+    ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
+    event_loop_add_socket(&ctx->loop, ctx->control_sock, control_tcp_handler, ctx);
+
+    /* broadcast listener */
+    ctx->bcast_sock = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
+    ASSERT_ON_ERROR(ctx->bcast_sock, SL_SOCKET_ERROR);
+    sAddr.sin_port = sl_Htons(EVENT_BROADCAST_PORT);
+    sAddr.sin_addr.s_addr = SL_INADDR_ANY;
+    status = sl_Bind(ctx->bcast_sock, (SlSockAddr_t *)&sAddr, sizeof(SlSockAddrIn_t));
+    ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
+    event_loop_add_socket(&ctx->loop, ctx->bcast_sock, broadcast_udp_handler, ctx);
+
+    /* sensor upload, same datagrams as stream_sensors_udp(), to the host's upload receiver */
+    ctx->upload_sock = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
+    ASSERT_ON_ERROR(ctx->upload_sock, SL_SOCKET_ERROR);
+    ctx->upload_addr.sin_family = SL_AF_INET;
+    ctx->upload_addr.sin_port = sl_Htons(EVENT_UPLOAD_PORT);
+    ctx->upload_addr.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
+
+    event_loop_set_post_handler(&ctx->loop, upload_post_handler, ctx);
+    event_loop_add_timer(&ctx->loop, EVENT_STATS_PERIOD_US, stats_timer, ctx);
+
+    status = sensor_init_all();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+    status = sensor_stream_reset();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+    sensorTxLoop = &ctx->loop;
+    status = sensor_start_task(stream_sensors_sink);
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+    controlSession.capturing = 1;
+
+    status = event_loop_run(&ctx->loop);
+
+    if(controlSession.capturing)
+        sensor_stop_task();
+    controlSession.capturing = 0;
+    sensorTxLoop = NULL;
+    if(ctx->control_sock >= 0)
+        sl_Close(ctx->control_sock);
+    sl_Close(ctx->bcast_sock);
+    sl_Close(ctx->upload_sock);
+
+    return status;
+}
+
+/*
+ * Disconnected, in transceiver mode: beacon reception and the accelerometer readings on one thread,
+ * the RF socket is only read when sl_Select() reports a frame. The accelerometer itself is sampled by the
+ * sensor task on the AP's TSF grid, every beacon steers it through phase_lock_beacon().
+ */
+int32_t event_loop_beacons()
+{
+    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
+    node_ctx_t * ctx = &node_ctx;
+    int32_t status;
+
+    /* the beacon handler receives into it */
+    if(cmd_frame() == NULL)
+        return(-1);
+
+    memset(ctx, 0, sizeof(node_ctx_t));
+    event_loop_init(&ctx->loop);
+    initQueue(&ctx->q);
+    ctx->control_sock = -1;
+    ctx->bcast_sock = -1;
+    ctx->upload_sock = -1;
+
+    status = sensor_init_all();
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+
+    if(clock_discipline_start() < 0)
+        UART_PRINT("[nnaji msg] no clock discipline, local drift will not be corrected\n\r");
+
+    ctx->beacon_sock = enter_tranceiver_mode(1);
+    ASSERT_ON_ERROR(ctx->beacon_sock, SL_SOCKET_ERROR);
+
+    /* sampling on the sensor task's timer, steered onto the TSF grid by every beacon */
+    phase_lock_start();
+    status = sensor_start_task(phase_locked_sink);
+    ASSERT_ON_ERROR(status, DEVICE_ERROR);
+
+    event_loop_add_socket(&ctx->loop, ctx->beacon_sock, beacon_rf_handler, ctx);
+    event_loop_add_timer(&ctx->loop, (boot_profile_get()->sample_period_us != 0) ?
+                         boot_profile_get()->sample_period_us : EVENT_READING_PERIOD_US, accel_sample_timer, ctx);
+    event_loop_add_timer(&ctx->loop, EVENT_STATS_PERIOD_US, stats_timer, ctx);
+
+    status = event_loop_run(&ctx->loop);
+
+    sensor_stop_task();
+    phase_lock_stop();
+    sl_Close(ctx->beacon_sock);
+
+    return status;
+}
+
+/*
+ * Disconnected, in transceiver mode: follows the beacons of every AP in range across channels 1-11 and
+ * prints the fused reference TSF, which keeps running when the primary AP goes away.
+ */
+int32_t track_multi_ap()
+{
+    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
+    uint32_t channel = 11;
+    _i16 cur_channel = 0;
+    _i16 beaconRxSock;
+    int32_t status;
+    int32_t numBytes;
+    int32_t beac_channel;
+    uint8_t * Rx_frame;
+    frameInfo_t frameInfo;
+    ap_dwell_t dwell;
+    struct SlTimeval_t timeVal;
+    uint32_t now_us;
+    uint32_t next_report_us;
+    int32_t left;
+    uint32_t beacons = 0;
+    uint32_t windows = 0;
+
+    Rx_frame = cmd_frame();
+    if(Rx_frame == NULL)
+        return(-1);
+
+    ap_tracker_init(&ap_tracker, NULL);
+
+    if(clock_discipline_start() < 0)
+        UART_PRINT("[nnaji msg] no clock discipline, local drift will not be corrected\n\r");
+
+    /* every AP's beacons are wanted, so there is no source address rule */
+    status = rx_filter_enable(&anyBeaconFilters);
+    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    boot_phase_mark(BOOT_PHASE_FILTERS);
+
+    /* To use transceiver mode, the device must be set in STA role, be disconnected, and have disabled
+        previous connection policies that might try to automatically connect to an AP. */
+    status = sl_WlanPolicySet(SL_WLAN_POLICY_CONNECTION, SL_WLAN_CONNECTION_POLICY(0, 0, 0, 0), NULL, 0);
+    if( status )
+    {
+        UART_PRINT("[line:%d, error:%d]\n\r", __LINE__, status);
+        return(-1);
+    }
+
+    beaconRxSock = sl_Socket(SL_AF_RF, SL_SOCK_DGRAM, channel);
+    ASSERT_ON_ERROR(beaconRxSock, SL_SOCKET_ERROR);
+
+    now_us = clock_discipline_local_us();
+    next_report_us = now_us + EVENT_STATS_PERIOD_US;
+
+    while(1)
+    {
+        ap_tracker_plan(&ap_tracker, now_us, &dwell);
+
+        if(dwell.channel != cur_channel)
         {
-            // stop transeiver mode
-            // connnect to accept point
-            // connect to tcp socket
-            // send data
-            // re-enable tranceiver mode
-            UART_PRINT("Exiting tranciever mode\n\r");
-            status = sl_Close(beaconRxSock);
-            ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
-
-            UART_PRINT("its been %u ms (AP timestamp: %u ms), time to send time sync data, "
-                    "will connect to AP and send in a few seconds\n\r", send_interval, frameInfo.timestamp/1000);
-            sleep(2);
-
-            status = connectToAP();
+            cur_channel = dwell.channel;
+            status = sl_SetSockOpt(beaconRxSock, SL_SOL_SOCKET, SL_SO_CHANGE_CHANNEL, &cur_channel, sizeof(cur_channel));
             if(status < 0)
             {
-                UART_PRINT("could not connect to AP\n\r");
-                return -1;
+                UART_PRINT("[line:%d, error:%d] %s, channel: %i\n\r", __LINE__, status,
+                           SL_SOCKET_ERROR, cur_channel);
+                break;
             }
+        }
 
-            if(!sAddr.in4.sin_addr.s_addr)
-                sAddr.in4.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
+        /* the radio stays in RX, but the socket is only read inside the window */
+        left = (int32_t)(dwell.open_us - now_us);
+        if(left > 0)
+            usleep(left);
+        windows++;
 
-            /* Get socket descriptor - this would be the
-             * socket descriptor for the TCP session.
-             */
-            tcp_sock = sl_Socket(sa->sa_family, SL_SOCK_STREAM, TCP_PROTOCOL_FLAGS);
-            ASSERT_ON_ERROR(tcp_sock, SL_SOCKET_ERROR);
+        while(1)
+        {
+            now_us = clock_discipline_local_us();
+            left = (int32_t)(dwell.close_us - now_us);
+            if(left <= 0)
+                break;
 
-            status = -1;
+            timeVal.tv_sec = left / 1000000;
+            timeVal.tv_usec = left % 1000000;
+            status = sl_SetSockOpt(beaconRxSock, SL_SOL_SOCKET, SL_SO_RCVTIMEO, (_u8 *)&timeVal, sizeof(timeVal));
+            if(status < 0)
+                break;
 
-            while(status < 0)
+            numBytes = sl_Recv(beaconRxSock, Rx_frame, MAX_RX_PACKET_SIZE, 0);
+            if(numBytes == SL_ERROR_BSD_EAGAIN)
+                break;
+            if(numBytes < 0)
             {
-                /* Calling 'sl_Connect' followed by server's
-                 * 'sl_Accept' would start session with
-                 * the TCP server. */
-                status = sl_Connect(tcp_sock, sa, addrSize);
-                if((status == SL_ERROR_BSD_EALREADY)&& (TRUE == nonBlocking))
-                {
-                    sleep(1);
-                    continue;
-                }
-                else if(status < 0)
-                {
-                    UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-                               SL_SOCKET_ERROR);
-                    sl_Close(tcp_sock);
-                    UART_PRINT("No TCP socket to connect to, terminating program\n");
-                    return(-1);
-                }
+                status = numBytes;
                 break;
             }
 
-            memset(Tx_data, 0, MAX_TX_PACKET_SIZE);
-
-            ts_to_string(timestamps, current_ts_index, Tx_data);
-
-            sent_bytes = 0;
-            bytes_to_send = strlen(Tx_data);
-            while(sent_bytes < bytes_to_send)
-            {
-                if(bytes_to_send - sent_bytes >= bytes_to_send)
-                {
-                    buflen = bytes_to_send;
-                }
-                else
-                {
-                    buflen = bytes_to_send - sent_bytes;
-                }
+            now_us = clock_discipline_local_us();
+            parse_beacon_frame(Rx_frame, &frameInfo, 0);
+            if((frameInfo.frameControl >> 8) != 0x80)
+                continue;
+            beacon_heard();
 
-                status = sl_Send(tcp_sock, &Tx_data, buflen, 0);
-                if(status < 0)
-                {
-                    UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-                               SL_SOCKET_ERROR);
-                    break;
-                }
-                sent_bytes += status;
-            }
+            /* the radio hears neighbouring channels too, the DS parameter set says where the AP really is */
+            beac_channel = ap_tracker_beacon_channel(Rx_frame, numBytes);
+            if(beac_channel < 1 || beac_channel > AP_TRACKER_MAX_CHANNEL)
+                beac_channel = cur_channel;
 
-            status = sl_Close(tcp_sock);
-            ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
-
-            /* After calling sl_WlanDisconnect(),
-             *    we expect WLAN disconnect asynchronous event.
-             * Cleaning the former connection information from
-             * the application control block
-             * is handled in that event handler,
-             * as well as getting the disconnect reason.
-             */
-            sleep(2);
-            status = sl_WlanDisconnect();
-            ASSERT_ON_ERROR(status, WLAN_ERROR);
-
-            UART_PRINT("done sending time sync data and disconnected from AP"
-                    ", will re-enter transceiver mode in a few seconds\n\r");
-            sleep(2);
-            beaconRxSock = enter_tranceiver_mode(0);
-
-            send_beac_ts += send_interval;
-            UART_PRINT("next timestamp to send data at: %u\n\r", send_beac_ts);
+            if(ap_tracker_update(&ap_tracker, &frameInfo, beac_channel, now_us) >= 0)
+                beacons++;
         }
-        else{
-            //UART_PRINT("%u\n\r", frameInfo.timestamp/1000);
-            ;
+
+        if(status < 0)
+        {
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
+                       SL_SOCKET_ERROR);
+            break;
         }
-//        else
-//        {
-//            if(counter % 10000 == 0)
-//            {
-//                UART_PRINT("%u %u\n\r", frameInfo.timestamp,last_beac_ts);
-//                UART_PRINT("%u\n\r", (frameInfo.timestamp-last_beac_ts)/1000);
-//                UART_PRINT("%i %f\n\r\n\r", counter, counter / 60000.0f);
-//            }
-//        }
 
-//        if(last_beac_ts!=-1)
-//        {
-//            counter += (frameInfo.timestamp - last_beac_ts)/1000;
-//        }
-        last_beac_ts = frameInfo.timestamp;
+        if((int32_t)(now_us - next_report_us) >= 0)
+        {
+            UART_PRINT("[nnaji msg] %u beacons in %u windows\n\r", beacons, windows);
+            ap_tracker_report(&ap_tracker, now_us);
+            next_report_us = now_us + EVENT_STATS_PERIOD_US;
+        }
     }
 
-    /* Calling 'close' with the socket descriptor,
-    * once operation is finished. */
-    status = sl_Close(beaconRxSock);
-    ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
+    sl_Close(beaconRxSock);
 
-    return(0);
+    return(-1);
 }
 
-int32_t time_drift_test_l2(){
-    /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
-    uint32_t buflen = MESSAGE_SIZE;
-    uint8_t rcv_msg_buff[buflen];
-    uint32_t channel = 11;
-    uint32_t max_packet_size = 1544;
-    _i16 channels[11] = {1,2,3,4,5,6,7,8,9,10,11};
-    _i16 cur_channel;
-    _i16 numBytes;
-    _i16 status;
-    struct SlTimeval_t timeVal;
-    uint8_t Rx_frame[max_packet_size];
-    uint32_t i=0;
-    uint32_t j=0;
-    uint32_t k=0;
-    _u32 nonBlocking = 1;
-    int32_t hdrOfs = 8;   // proprietary header offset
-    uint32_t timestamp = 0;
-    uint16_t beacInterval;
-    int32_t last_ts = -1;
-    int32_t numBeacons = 100;
-    uint16_t expectedInterval = 0;
-    int32_t time_diffs[numBeacons];
-    frameInfo_t frameInfo;
-    int32_t misses = 0;
-    _i16 beaconRxSock;
+/* sends all of buf, resuming after partial sends, returns 0 or the socket error */
+static int32_t send_all(int32_t sock, uint8_t * buf, int32_t len)
+{
+    int32_t sent_bytes = 0;
+    int32_t status;
 
-//    uint8_t createFilterArgs1[] = " -f FRAME_TYPE -v management -e not_equals -a drop -m L1";
-    uint8_t createFilterArgs1[] = " -f FRAME_TYPE -v management -e not_equals -a event -m L1";
-//    uint8_t createFilterArgs2[] = " -f S_MAC -v 72:BC:10:69:9C:B6 -e not_equals -a drop -m L1";
-//    uint8_t createFilterArgs3[] = " -f S_MAC -v 72:BC:10:69:9C:B6 -e equals -a event -m L1";
-    uint8_t createFilterArgs2[] = " -f S_MAC -v 58:00:e3:43:6b:63 -e not_equals -a drop -m L1";
-//    uint8_t createFilterArgs3[] = " -f S_MAC -v 58:00:e3:43:6b:63 -e equals -a event -m L1";
-    uint8_t enableFilterArgs[] = "";
+    while(sent_bytes < len)
+    {
+        status = sl_Send(sock, &buf[sent_bytes], len - sent_bytes, 0);
+        if(status < 0)
+        {
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status, SL_SOCKET_ERROR);
+            return status;
+        }
+        sent_bytes += status;
+        perf_add(PERF_BYTES_SENT, status);
+    }
 
-    status = cmdCreateFilterCallback(createFilterArgs2);
-    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    return(0);
+}
 
-    status = cmdCreateFilterCallback(createFilterArgs1);
-    ASSERT_ON_ERROR(status, WLAN_ERROR);
+static int32_t lz_send(void * arg, const uint8_t * buf, uint32_t len)
+{
+    return send_all(*(int32_t *)arg, (uint8_t *)buf, len);
+}
 
-//    status = cmdCreateFilterCallback(createFilterArgs2);
-//    ASSERT_ON_ERROR(status, WLAN_ERROR);
+/*
+ * Sends one upload chunk, as "lz,<len>|" and the compressed stream when UPLOAD_COMPRESS is set and an
+ * MEM_POOL_LZ block is free, as is otherwise. Returns 0 or the socket error.
+ */
+static int32_t send_chunk(int32_t sock, uint8_t * buf, int32_t len)
+{
+    uint8_t header[16];
+    lz_state_t * state;
+    uint32_t cycles;
+    int32_t status;
 
-//    status = cmdCreateFilterCallback(createFilterArgs3);
-//    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    if(!UPLOAD_COMPRESS || len > LZ_MAX_INPUT)
+        return send_all(sock, buf, len);
 
-    status = cmdEnableFilterCallback(enableFilterArgs);
-    ASSERT_ON_ERROR(status, WLAN_ERROR);
+    state = mem_pool_alloc(MEM_POOL_LZ);
+    if(state == NULL)
+        return send_all(sock, buf, len);
 
-    timeVal.tv_sec = 2;             // Seconds
-    timeVal.tv_usec = 0;             // Microseconds. 10000 microseconds resolution
+    status = send_all(sock, header, snprintf((char *)header, sizeof(header), "lz,%d|", len));
+    if(status >= 0)
+    {
+        lz_cycles_start();
+        status = lz_compress(state, buf, len, lz_send, &sock);
+        cycles = lz_cycles_elapsed();
+        if(status >= 0)
+            UART_PRINT("[nnaji msg] lz: %d -> %d bytes, %u cycles/KB\n\r", len, status,
+                       (uint32_t)(((uint64_t)cycles * 1024) / (len ? len : 1)));
+    }
+    mem_pool_free(MEM_POOL_LZ, state);
 
-//    memset(rcv_msg_buff, 0, strlen(rcv_msg_buff));
-    memset(Rx_frame, 0, max_packet_size);
+    return (status < 0) ? status : 0;
+}
 
-    UART_PRINT("[nnaji msg] buflen: %i\n\r", buflen);
+/*
+ * Waits for the host's "ack,<highest contiguous seq>[,<seq>...]|" reply, the optional list holds sequence
+ * numbers above the contiguous one that were stored as well. Returns 0 or -1 on a timeout or a bad reply.
+ */
+static int32_t wait_upload_ack(int32_t sock, uint32_t * contiguous, uint32_t * selective, uint32_t * count)
+{
+    uint8_t ack[UPLOAD_ACK_SIZE];
+    SlTimeval_t timeVal;
+    int32_t received = 0;
+    int32_t status;
+    char * next;
+    char * end;
 
-    /* To use transceiver mode, the device must be set in STA role, be disconnected, and have disabled
-        previous connection policies that might try to automatically connect to an AP. */
-    status = sl_WlanPolicySet(SL_WLAN_POLICY_CONNECTION, SL_WLAN_CONNECTION_POLICY(0, 0, 0, 0), NULL, 0);
-    if( status )
+    timeVal.tv_sec = UPLOAD_ACK_TIMEOUT_US / 1000000;
+    timeVal.tv_usec = UPLOAD_ACK_TIMEOUT_US % 1000000;
+    sl_SetSockOpt(sock, SL_SOL_SOCKET, SL_SO_RCVTIMEO, (_u8 *)&timeVal, sizeof(timeVal));
+
+    while(received < UPLOAD_ACK_SIZE - 1 && memchr(ack, '|', received) == NULL)
     {
-        UART_PRINT("[line:%d, error:%d]\n\r", __LINE__, status);
+        status = sl_Recv(sock, &ack[received], UPLOAD_ACK_SIZE - 1 - received, 0);
+        if(status <= 0)
+        {
+            UART_PRINT("[line:%d, error:%d] no upload ack from the host\n\r", __LINE__, status);
+            return(-1);
+        }
+        received += status;
+    }
+    ack[received] = 0;
+
+    if(strncmp((const char *)ack, "ack,", 4) != 0)
         return(-1);
+
+    *contiguous = strtoul((const char *)&ack[4], &end, 10);
+    *count = 0;
+    while(*end == ',' && *count < UPLOAD_SACK_MAX)
+    {
+        next = end + 1;
+        selective[*count] = strtoul(next, &end, 10);
+        if(end == next)
+            break;
+        (*count)++;
     }
-//    status = sl_WlanDisconnect();
-//    if( status )
-//    {
-//        UART_PRINT("[line:%d, error:%d]\n\r", __LINE__, status);
-//        return(-1);
-//    }
 
-    beaconRxSock = sl_Socket(SL_AF_RF, SL_SOCK_DGRAM, channel);
-//    beaconRxSock = sl_Socket(SL_AF_RF, SL_SOCK_RAW, channel);
-    ASSERT_ON_ERROR(beaconRxSock, SL_SOCKET_ERROR);
+    return(0);
+}
 
-//    status = sl_SetSockOpt(beaconRxSock, SL_SOL_SOCKET, SL_SO_RCVTIMEO, (_u8 *)&timeVal, sizeof(timeVal));    // Enable receive timeout
-//    if(status < 0)
-//    {
-//        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-//                   SL_SOCKET_ERROR);
-//        sl_Close(beaconRxSock);
-//        return(-1);
-//    }
+/*
+ * Sends the upload in Tx_data, numbered seq, to the host and waits for its acknowledgement. While older
+ * uploads are waiting in the spill log this one is spilled as well and up to SPILL_REPLAY_MAX + 1 segments
+ * are sent from the log oldest first, so the host's contiguous sequence number keeps moving; Tx_data is
+ * overwritten then. Everything the host acknowledges is removed from the log.
+ * Returns 0 when the upload was acknowledged or is in the spill log, -1 when the caller still has to spill it.
+ */
+static int32_t upload_tx_data(SlSockAddr_t * sa, int32_t addrSize, uint32_t seq)
+{
+    uint32_t selective[UPLOAD_SACK_MAX];
+    uint32_t contiguous = 0;
+    uint32_t count = 0;
+    uint32_t after = 0;
+    uint32_t replay_seq;
+    uint8_t spilled = 0;
+    int32_t tcp_sock;
+    int32_t status;
+    int32_t len;
+    uint32_t i;
+
+    /* Get socket descriptor - this would be the
+     * socket descriptor for the TCP session.
+     */
+    tcp_sock = sl_Socket(sa->sa_family, SL_SOCK_STREAM, TCP_PROTOCOL_FLAGS);
+    if(tcp_sock < 0)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, tcp_sock, SL_SOCKET_ERROR);
+        return(-1);
+    }
 
-    status = sl_SetSockOpt(beaconRxSock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonBlocking, sizeof(nonBlocking));
+    /* Calling 'sl_Connect' followed by server's
+     * 'sl_Accept' would start session with
+     * the TCP server. */
+    while((status = sl_Connect(tcp_sock, sa, addrSize)) == SL_ERROR_BSD_EALREADY)
+    {
+        perf_count(PERF_SEND_RETRIES);
+        sleep(1);
+    }
     if(status < 0)
     {
-        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-                   SL_SOCKET_ERROR);
-        sl_Close(beaconRxSock);
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status, SL_SOCKET_ERROR);
+        UART_PRINT("No TCP socket to connect to\n\r");
+        sl_Close(tcp_sock);
         return(-1);
     }
 
-    while(1)
-//    while(i < numBeacons)
+    if(spill_log_pending() != 0 && spill_log_append(seq, Tx_data, strlen((const char *)Tx_data)) == 0)
     {
-        for(i=0;i<11;i++)
+        spilled = 1;
+        for(i=0;i<SPILL_REPLAY_MAX + 1;i++)
         {
-            cur_channel = channels[i];
-            status = sl_SetSockOpt(beaconRxSock, SL_SOL_SOCKET, SL_SO_CHANGE_CHANNEL, &cur_channel, sizeof(cur_channel));
+            len = spill_log_peek(after, Tx_data, MAX_TX_PACKET_SIZE, &replay_seq);
+            if(len <= 0)
+                break;
+            status = send_chunk(tcp_sock, Tx_data, len);
             if(status < 0)
-            {
-                UART_PRINT("[line:%d, error:%d] %s, channel: %i\n\r", __LINE__, status,
-                           SL_SOCKET_ERROR, cur_channel);
+                break;
+            after = replay_seq;
+            UART_PRINT("[nnaji msg] sent upload %u from the spill log, %d bytes\n\r", replay_seq, len);
+        }
+    }
+    else
+    {
+        status = send_chunk(tcp_sock, Tx_data, strlen((const char *)Tx_data));
+    }
 
-                if(numBytes != SL_ERROR_BSD_EAGAIN)
-                    break;
-            }
+    /* the host only acknowledges once the data is on its disk */
+    if(status >= 0)
+        status = send_all(tcp_sock, (uint8_t *)"end|", 4);
+    if(status >= 0)
+        status = wait_upload_ack(tcp_sock, &contiguous, selective, &count);
+    sl_Close(tcp_sock);
 
-            numBytes = sl_Recv(beaconRxSock, &Rx_frame, max_packet_size, 0);
-            if(numBytes != SL_ERROR_BSD_EAGAIN)
-            {
-                UART_PRINT("[nnaji msg] numBytes from channel %i: %i\n\r", cur_channel, numBytes);
-                if(numBytes < 0)
-                {
-                    UART_PRINT("[line:%d, error:%d] %s, channel: %i\n\r", __LINE__, numBytes,
-                               SL_SOCKET_ERROR, cur_channel);
+    if(status < 0)
+        return spilled ? 0 : -1;
 
-                    break;
-                }
+    spill_log_ack(contiguous, selective, count);
+    if(spilled || seq <= contiguous)
+        return(0);
+    for(i=0;i<count;i++)
+        if(selective[i] == seq)
+            return(0);
 
-                UART_PRINT("first 50 bytes: ");
-                for(j=0;j<50;j++){
-                    UART_PRINT("%x ", Rx_frame[j]);
-                }
-                UART_PRINT("\n\r");
-            }
+    return(-1);
+}
+
+/*
+ * Builds upload seq in Tx_data: a "seq,<seq>,<oldest>|" record, where oldest is the lowest sequence number the
+ * node still holds and everything below it is settled, the readings and the perf record. Returns the length.
+ */
+static int32_t build_upload(ts_capture_t * capture, uint32_t seq)
+{
+    uint32_t oldest = spill_log_oldest_seq();
+    uint32_t count;
+    int32_t len;
+
+    memset(Tx_data, 0, MAX_TX_PACKET_SIZE);
+    len = sprintf((char *)Tx_data, "seq,%u,%u|", seq, (oldest != 0 && oldest < seq) ? oldest : seq);
+
+    /* leave room for the perf record */
+    len += ts_to_string(capture, &Tx_data[len], MAX_TX_PACKET_SIZE - (2 * PERF_SNAPSHOT_SIZE + 8) - len, &count);
+
+    /* running counters ride along with every upload, the host keeps the time series */
+    perf_to_string(&Tx_data[len], MAX_TX_PACKET_SIZE - len);
+
+    /* these readings are either acknowledged or spilled from here on, never sent twice, the ones that did
+     * not fit stay in the capture and go out first in the next upload */
+    if(count < capture->filled)
+        UART_PRINT("[nnaji msg] upload %u full, %u readings wait for the next one\n\r", seq,
+                   capture->filled - count);
+    capture->filled -= count;
+
+    return strlen((const char *)Tx_data);
+}
 
-//            memset(rcv_msg_buff,0,strlen(rcv_msg_buff));
-//            memset(Rx_frame, 0, max_packet_size);
+/*
+ * test_time_beac_sync()'s RF socket handler, records every new beacon's TSF with the local time in ms it was
+ * read at. Lost beacons are marked in the capture so the host does not interpolate straight across them.
+ */
+static void beacon_sync_rf_handler(_i16 sd, void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    ts_capture_t * capture = ctx->capture;
+    uint8_t * Rx_frame = cmdFrame;
+    uint32_t send_interval = boot_profile_get()->upload_interval_ms;
+    frameInfo_t frameInfo;
+    struct timespec cur_time;
+    uint32_t local_us;
+    uint16_t gap;
+    int32_t numBytes;
+
+    while(1)
+    {
+        numBytes = sl_Recv(sd, Rx_frame, MAX_RX_PACKET_SIZE, 0);
+        if(numBytes == SL_ERROR_BSD_EAGAIN)
+            return;
+        if(numBytes < 0)
+        {
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
+                       SL_SOCKET_ERROR);
+            event_loop_stop(&ctx->loop);
+            return;
         }
 
-//        numBytes = sl_Recv(beaconRxSock, &Rx_frame, max_packet_size, 0);
-//        if(numBytes != SL_ERROR_BSD_EAGAIN)
-//        {
-//            if(numBytes < 0)
-//            {
-//                UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
-//                           SL_SOCKET_ERROR);
-//                break;
-//            }
-//
-//            parse_beacon_frame(Rx_frame, &frameInfo, 0);
-//            time_diffs[i] = (frameInfo.timestamp - timestamp)/1000;
-//            i++;
-//            timestamp = frameInfo.timestamp;
-//
-//            if(expectedInterval == 0)
-//            {
-//                expectedInterval = frameInfo.beaconIntervalMs / 1000;
-//            }
-//        }
+        local_us = clock_discipline_local_us();
+        clock_gettime(CLOCK_REALTIME, &cur_time);
+        parse_beacon_frame(Rx_frame, &frameInfo, 0);
+        if(ctx->beacons != 0 && frameInfo.timestamp == ctx->last_tsf_us)
+            continue;
 
+        /* beaconIntervalMs is the interval in TU * 1024, i.e. microseconds */
+        if(frameInfo.beaconIntervalMs != 0)
+            ctx->beacon_interval_us = frameInfo.beaconIntervalMs;
+        gap = 0;
+        if(ctx->beacons != 0)
+            gap = beacon_sched_gap(ctx->last_tsf_us, frameInfo.timestamp, ctx->beacon_interval_us);
+        ctx->last_tsf_us = frameInfo.timestamp;
+        ctx->last_local_us = local_us;
+        ctx->beacons++;
+        beacon_heard();
+
+        if(gap != 0)
+            UART_PRINT("[nnaji msg] %u beacons lost before TSF %u\n\r", gap, frameInfo.timestamp);
+
+        capture->ts[0][capture->next] = frameInfo.timestamp;
+        capture->ts[1][capture->next] = (uint32_t) (cur_time.tv_sec * 1000 + cur_time.tv_nsec / 1000000);
+        capture->gaps[capture->next] = gap;
+        capture->next = (capture->next + 1) % NUM_READINGS;
+        if(capture->filled < NUM_READINGS)
+            capture->filled++;
+
+        /* uploads fall on multiples of the interval in AP time, the same instants on every board */
+        if(ctx->send_beac_ms == 0)
+        {
+            ctx->send_beac_ms = send_interval + (frameInfo.timestamp/1000 - (frameInfo.timestamp/1000 % send_interval));
+            UART_PRINT("[nnaji msg] first upload at AP time %u ms\n\r", ctx->send_beac_ms);
+        }
     }
+}
 
-//    for(i=0;i<numBeacons;i++)
-//    {
-//        if(time_diffs[i] > expectedInterval && i != 0)
-//        {
-//            misses++;
-//        }
-//        UART_PRINT("time diff %i: %i\n\r", i, time_diffs[i]);
-//    }
-//    UART_PRINT("missed beacons: %i\n\r", misses);
+/*
+ * test_time_beac_sync()'s upload check. The AP time is carried forward from the last beacon at the disciplined
+ * rate, so missed beacons don't hold an upload back. A due upload stops the loop, test_time_beac_sync() sends
+ * it between two runs of the loop.
+ */
+static void beacon_sync_timer(void * arg)
+{
+    node_ctx_t * ctx = (node_ctx_t *)arg;
+    uint32_t ap_ms;
 
-    /* Calling 'close' with the socket descriptor,
-    * once operation is finished. */
-    status = sl_Close(beaconRxSock);
+    if(ctx->send_beac_ms == 0)
+        return;
+
+    ap_ms = clock_discipline_predict(ctx->last_local_us, ctx->last_tsf_us, clock_discipline_local_us()) / 1000;
+    if(ap_ms < ctx->send_beac_ms)
+        return;
+
+    ctx->upload_due = 1;
+    event_loop_stop(&ctx->loop);
+}
+
+/*
+ * Leaves transceiver mode, connects to the AP and sends the capture to the host's ENTRY_PORT, spilling it to
+ * flash when it isn't acknowledged, then listens for beacons again. Takes seconds, so it never runs as a
+ * handler. Returns 0, or -1 when the receiver couldn't be restarted.
+ */
+static int32_t beacon_sync_upload(node_ctx_t * ctx, sockAddr_t * sAddr)
+{
+    struct timespec upload_start;
+    struct timespec cur_time;
+    uint32_t upload_seq;
+    int32_t status;
+
+    UART_PRINT("Exiting tranciever mode\n\r");
+    clock_gettime(CLOCK_REALTIME, &upload_start);
+    event_loop_remove_socket(&ctx->loop, ctx->beacon_sock);
+    status = sl_Close(ctx->beacon_sock);
+    ctx->beacon_sock = -1;
     ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
 
+    UART_PRINT("AP timestamp %u ms, time to send time sync data, "
+            "will connect to AP and send in a few seconds\n\r", ctx->send_beac_ms);
+    sleep(2);
+
+    upload_seq = spill_log_next_seq();
+    build_upload(ctx->capture, upload_seq);
+
+    /* an unreachable AP or host no longer ends the capture, the upload waits in flash instead */
+    status = connect_to_ap_attempts(UPLOAD_CONNECT_ATTEMPTS);
+    if(status < 0)
+    {
+        UART_PRINT("could not connect to AP, spilling the upload\n\r");
+    }
+    else
+    {
+        if(!sAddr->in4.sin_addr.s_addr)
+            sAddr->in4.sin_addr.s_addr = sl_Htonl((unsigned int)app_CB.CON_CB.GatewayIP);
+
+        status = upload_tx_data((SlSockAddr_t *)&sAddr->in4, sizeof(SlSockAddrIn6_t), upload_seq);
+    }
+
+    /* not acknowledged, the next connection sends it again */
+    if(status < 0)
+        spill_log_append(upload_seq, Tx_data, strlen((const char *)Tx_data));
+
+    /* the disconnect event handler clears the connection state in app_CB */
+    if(IS_CONNECTED(app_CB.Status))
+    {
+        sleep(2);
+        status = sl_WlanDisconnect();
+        ASSERT_ON_ERROR(status, WLAN_ERROR);
+    }
+
+    UART_PRINT("done sending time sync data and disconnected from AP"
+            ", will re-enter transceiver mode in a few seconds\n\r");
+    sleep(2);
+    ctx->beacon_sock = enter_tranceiver_mode(0);
+    ASSERT_ON_ERROR(ctx->beacon_sock, SL_SOCKET_ERROR);
+    event_loop_add_socket(&ctx->loop, ctx->beacon_sock, beacon_sync_rf_handler, ctx);
+
+    event_loop_report(&ctx->loop);
+    boot_phase_report();
+    mem_pool_report();
+    if(ctx->uploads++ % MEM_STACK_REPORT_UPLOADS == 0)
+        mem_stack_report();
+    spill_log_report();
+
+    clock_gettime(CLOCK_REALTIME, &cur_time);
+    perf_count(PERF_UPLOADS);
+    perf_hist(PERF_UPLOAD_MS, (cur_time.tv_sec - upload_start.tv_sec) * 1000 +
+              (cur_time.tv_nsec - upload_start.tv_nsec) / 1000000);
+
+    ctx->send_beac_ms += boot_profile_get()->upload_interval_ms;
+    UART_PRINT("next timestamp to send data at: %u\n\r", ctx->send_beac_ms);
+
     return(0);
 }
 
-int32_t time_drift_test_l3(uint16_t sockPort){
+/*
+ * Disconnected, in transceiver mode: records the TSF of every beacon with the local time it was heard and
+ * uploads the readings every upload interval of AP time. Beacons are read by a handler on the event loop and
+ * a timer decides when an upload is due.
+ */
+int32_t test_time_beac_sync()
+{
     /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
-    uint32_t buflen = MESSAGE_SIZE;
-    uint8_t rcv_msg_buff[buflen];
-    _i16 sock;
-    uint32_t max_packet_size = 1544;
-    _i16 numBytes;
-    _i16 status;
-    struct SlTimeval_t timeVal;
-    uint8_t Rx_frame[max_packet_size];
-    _u16 broadcast_port = 10012;
-    SlSockAddrIn_t  sAddr;
-    _i16 AddrSize = sizeof(SlSockAddrIn_t);
-    int32_t i;
-
-    timeVal.tv_sec =  30;             // Seconds
-    timeVal.tv_usec = 0;             // Microseconds. 10000 microseconds resolution
-
-    memset(rcv_msg_buff, 0, strlen(rcv_msg_buff));
-    memset(Rx_frame, 0, max_packet_size);
+    node_ctx_t * ctx = &node_ctx;
+    sockAddr_t sAddr;
+    int32_t status;
 
-    UART_PRINT("[nnaji msg] sockPort (for transmitting data to AP): %i\n\r", sockPort);
-    UART_PRINT("[nnaji msg] buflen: %i\n\r", buflen);
+    /* the host's upload receiver, its address is the gateway's once connected */
+    sAddr.in4.sin_family = SL_AF_INET;
+    sAddr.in4.sin_port = sl_Htons((unsigned short)ENTRY_PORT);
+    sAddr.in4.sin_addr.s_addr = 0;
 
-    sock = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
-    ASSERT_ON_ERROR(sock, SL_SOCKET_ERROR);
+    memset(ctx, 0, sizeof(node_ctx_t));
+    event_loop_init(&ctx->loop);
+    ctx->control_sock = -1;
+    ctx->bcast_sock = -1;
+    ctx->upload_sock = -1;
 
-//    status = sl_SetSockOpt(sock, SL_SOL_SOCKET, SL_SO_RCVTIMEO, (_u8 *)&timeVal, sizeof(timeVal));    // Enable receive timeout
-//    if(status < 0)
-//    {
-//        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-//                   SL_SOCKET_ERROR);
-//        sl_Close(sock);
-//        return(-1);
-//    }
+    /* the frame and the capture come from the static pools instead of this task's stack */
+    ctx->capture = mem_pool_alloc(MEM_POOL_CAPTURE);
+    if(cmd_frame() == NULL || ctx->capture == NULL)
+    {
+        UART_PRINT("[nnaji msg] out of pool memory for the beacon capture\n\r");
+        mem_pool_free(MEM_POOL_CAPTURE, ctx->capture);
+        return(-1);
+    }
+    memset(ctx->capture, 0, sizeof(ts_capture_t));
 
-    sAddr.sin_family = SL_AF_INET;
-    sAddr.sin_port = sl_Htons(broadcast_port);
-    sAddr.sin_addr.s_addr = SL_INADDR_ANY;
+    if(clock_discipline_start() < 0)
+        UART_PRINT("[nnaji msg] no clock discipline, local drift will not be corrected\n\r");
 
-    status = sl_Bind(sock, (SlSockAddr_t *)&sAddr, AddrSize);
-    if(status < 0)
+    ctx->beacon_sock = enter_tranceiver_mode(1);
+    if(ctx->beacon_sock < 0)
     {
-        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
-                   SL_SOCKET_ERROR);
-        sl_Close(sock);
+        mem_pool_free(MEM_POOL_CAPTURE, ctx->capture);
         return(-1);
     }
+    event_loop_add_socket(&ctx->loop, ctx->beacon_sock, beacon_sync_rf_handler, ctx);
+    event_loop_add_timer(&ctx->loop, BEACON_SYNC_CHECK_US, beacon_sync_timer, ctx);
 
     while(1)
     {
-        numBytes = sl_RecvFrom(sock, Rx_frame, max_packet_size, 0, (SlSockAddr_t *)&sAddr, (SlSocklen_t*)&AddrSize);
-        UART_PRINT("[nnaji msg] numBytes: %i\n\r", numBytes);
-        if(numBytes < 0)
-        {
-            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
-                       SL_SOCKET_ERROR);
+        ctx->upload_due = 0;
+        status = event_loop_run(&ctx->loop);
+        if(status < 0 || !ctx->upload_due)
             break;
-        }
-
-        UART_PRINT("first 50 bytes: ");
-        for(i=0;i<50;i++){
-            UART_PRINT("%x ", Rx_frame[i]);
-        }
-        UART_PRINT("\n\r");
-
-        UART_PRINT("msg as str: %s\n\r", Rx_frame);
 
-        sleep(1);
+        status = beacon_sync_upload(ctx, &sAddr);
+        if(status < 0)
+            break;
     }
 
-    /* Calling 'close' with the socket descriptor,
-    * once operation is finished. */
-    status = sl_Close(sock);
-    ASSERT_ON_ERROR(status, SL_SOCKET_ERROR);
+    if(ctx->beacon_sock >= 0)
+        sl_Close(ctx->beacon_sock);
+    mem_pool_free(MEM_POOL_CAPTURE, ctx->capture);
+    ctx->capture = NULL;
 
-    return(0);
+    return status;
 }
 
 int32_t parse_beacon_frame(uint8_t * Rx_frame, frameInfo_t * frameInfo, uint8_t printInfo){
@@ -1310,6 +2205,10 @@ int32_t parse_beacon_frame(uint8_t * Rx_frame, frameInfo_t * frameInfo, uint8_t
     int32_t i = 31;     // last byte index of timestamp in beacon frame
     int32_t j;
 
+    /* SlTransceiverRxOverHead_t: rate, channel, rssi, padding, then the receive timestamp in us */
+    frameInfo->rxTimestampUs = (uint32_t)Rx_frame[4] | ((uint32_t)Rx_frame[5] << 8) |
+                               ((uint32_t)Rx_frame[6] << 16) | ((uint32_t)Rx_frame[7] << 24);
+
     frameInfo->frameControl = Rx_frame[hdrOfs+1] | (Rx_frame[hdrOfs] << 8);
     frameInfo->duration = Rx_frame[hdrOfs+3] | (Rx_frame[hdrOfs+2] << 8);
     memcpy(frameInfo->destAddr,&Rx_frame[hdrOfs+4], 6);
@@ -1324,6 +2223,9 @@ int32_t parse_beacon_frame(uint8_t * Rx_frame, frameInfo_t * frameInfo, uint8_t
         timestamp |= Rx_frame[hdrOfs+ i - 4 + j] << (j*8);
 
     frameInfo->timestamp = timestamp;
+    frameInfo->tsf = 0;
+    for(j=7;j>=0;j--)
+        frameInfo->tsf = (frameInfo->tsf << 8) | Rx_frame[hdrOfs+24+j];
     frameInfo->beaconInterval = Rx_frame[hdrOfs+32] | (Rx_frame[hdrOfs+33] << 8); // remember beacon interval is backwards
     frameInfo->beaconIntervalMs = frameInfo->beaconInterval * 1024;
     frameInfo->capabilityInfo = Rx_frame[hdrOfs+35] | (Rx_frame[hdrOfs+34] << 8);
@@ -1375,53 +2277,66 @@ int32_t q_to_string(queue_t * q, uint8_t * buf)
 }
 
 
-int32_t ts_to_string(uint32_t timestamps[][NUM_READINGS], uint32_t current_ts_index, uint8_t * buf)
+/*
+ * Oldest reading first. A reading that follows lost beacons is preceded by a "gap,<beacons lost>|"
+ * record. Stops at the last reading that fits in len bytes, *count is the number of readings written, so the
+ * caller can keep the newer ones for the next upload. Returns the string length.
+ */
+int32_t ts_to_string(const ts_capture_t * capture, uint8_t * buf, uint32_t len, uint32_t * count)
 {
     int32_t i = 0;
+    int32_t j = 0;
     int32_t buf_i = 0;
     uint8_t reading[25]; // max reading to string length is 24: "(4294967296, 4294967296)"
 
-    for(i=current_ts_index; i<NUM_READINGS; i++){
-        sprintf(reading, "%u,%u|", timestamps[0][i], timestamps[1][i]);
-        strcpy(&buf[buf_i], reading);
-        buf_i += strlen(reading);
-    }
-
-    for(i=0; i<current_ts_index; i++){
-        sprintf(reading, "%u,%u|", timestamps[0][i], timestamps[1][i]);
+    buf[0] = 0;
+    for(j=0; j<capture->filled; j++){
+        i = (capture->next + NUM_READINGS - capture->filled + j) % NUM_READINGS;
+        if(buf_i + 2 * sizeof(reading) >= len)
+            break;
+        if(capture->gaps[i] != 0)
+        {
+            sprintf(reading, "gap,%u|", capture->gaps[i]);
+            strcpy(&buf[buf_i], reading);
+            buf_i += strlen(reading);
+        }
+        sprintf(reading, "%u,%u|", capture->ts[0][i], capture->ts[1][i]);
         strcpy(&buf[buf_i], reading);
         buf_i += strlen(reading);
     }
+    *count = j;
 
-
-    return 0;
+    return buf_i;
 }
 
 
 _i16 enter_tranceiver_mode(int32_t first_time)
 {
     /* ALWAYS DECLARE ALL VARIABLES AT TOP OF FUNCTION TO AVOID BUFFER ISSUES */
-    uint32_t channel = 11;
+    uint32_t channel = boot_profile_get()->channel;
+    const uint8_t noMac[6] = {0};
     _i16 status;
     _u32 nonBlocking = 1;
     _i16 Tx_sock;
-    uint8_t enableFilterArgs[] = "";
-
-    if(first_time == 1){
-        uint8_t createFilterArgs1[] = " -f FRAME_TYPE -v management -e not_equals -a drop -m L1";
-        uint8_t createFilterArgs2[] = MAC_FILTER_ARGS;
 
+    /* the filters are only added to the NWP on the first entry, after that this is one enable call */
+    if(first_time == 1)
+    {
+        if(memcmp(boot_profile_get()->beacon_mac, noMac, 6) != 0)
+        {
+            memcpy(beaconProfileRules, beaconRules, sizeof(beaconRules));
+            memcpy(beaconProfileRules[sizeof(beaconRules) / sizeof(beaconRules[0]) - 1].value,
+                   boot_profile_get()->beacon_mac, 6);
+            beaconFilters.rules = beaconProfileRules;
+        }
 
-        status = cmdCreateFilterCallback(createFilterArgs1);
-        ASSERT_ON_ERROR(status, WLAN_ERROR);
-
-        status = cmdCreateFilterCallback(createFilterArgs2);
+        status = rx_filter_build(&beaconFilters);
         ASSERT_ON_ERROR(status, WLAN_ERROR);
     }
 
-
-    status = cmdEnableFilterCallback(enableFilterArgs);
+    status = rx_filter_enable(&beaconFilters);
     ASSERT_ON_ERROR(status, WLAN_ERROR);
+    boot_phase_mark(BOOT_PHASE_FILTERS);
 
 
     /* To use transceiver mode, the device must be set in STA role, be disconnected, and have disabled
@@ -34,9 +34,15 @@
 #define ENTRY_PORT                  10000
 #define BILLION                     1000000000
 #define MESSAGE_SIZE                50
-#define NUM_READINGS                300
+#define UPLOAD_CONNECT_ATTEMPTS     3           /* before an upload goes to the spill log instead */
+#define UPLOAD_ACK_TIMEOUT_US       5000000     /* host reply after "end|", the upload is spilled without it */
+#define UPLOAD_ACK_SIZE             128
+#define UPLOAD_SACK_MAX             8           /* sequence numbers above the contiguous one in one ack */
+#define UPLOAD_COMPRESS             1           /* lz_compress() every upload chunk, see lz_compress.h */
+#define NUM_READINGS                1000        /* beacons kept between uploads, about 100 s */
 #define MAX_RX_PACKET_SIZE          1544
 #define MAX_TX_PACKET_SIZE          30000
+#define EVENT_HEARTBEAT_US          1000000     /* idle keep-alive period in stream_accel_events_udp() */
 
 typedef struct
 {
@@ -47,6 +53,8 @@ typedef struct
     uint8_t bssid[6];
     uint16_t seqCtrl;
     uint32_t timestamp;
+    uint64_t tsf;                               /* the whole 8 byte TSF, for phase_lock.c */
+    uint32_t rxTimestampUs;                     /* network processor receive time, from the RX header */
     uint16_t beaconInterval;
     uint32_t beaconIntervalMs;
     uint16_t capabilityInfo;
@@ -55,25 +63,45 @@ typedef struct
     uint8_t ssid[33];
 }frameInfo_t;
 
+/* beacon / local timestamp ring of test_time_beac_sync(), a MEM_POOL_CAPTURE block */
+typedef struct
+{
+    uint32_t ts[2][NUM_READINGS];               /* beacon TSF in us, local time in ms */
+    uint16_t gaps[NUM_READINGS];                /* beacons lost right before each reading */
+    uint32_t next;
+    uint32_t filled;
+}ts_capture_t;
+
+/* the upload test_time_beac_sync() builds and sends, counted in the mem_pool.c budget */
+extern uint8_t Tx_data[MAX_TX_PACKET_SIZE];
+
 int32_t connectToAP();
 
+int32_t connect_to_ap_attempts(uint32_t max_attempts);
+
 uint16_t get_port_for_data_tx();
 
 int32_t transmit_data_forever_test(uint16_t sockPort);
 
-int32_t time_drift_test(uint16_t sockPort);
+int32_t init_accelerometer();
 
-int32_t time_drift_test_l3(uint16_t sockPort);
+int32_t stream_accel_udp(uint16_t sockPort);
 
-int32_t time_drift_test_l2();
+int32_t stream_accel_events_udp(uint16_t sockPort);
 
-int32_t parse_beacon_frame(uint8_t * Rx_frame, frameInfo_t * frameInfo, uint8_t printInfo);
+int32_t stream_sensors_udp(uint16_t sockPort);
+
+int32_t event_loop_connected(uint16_t sockPort);
+
+int32_t event_loop_beacons();
 
-int32_t tx_accelerometer(uint16_t sockPort);
+int32_t track_multi_ap();
+
+int32_t parse_beacon_frame(uint8_t * Rx_frame, frameInfo_t * frameInfo, uint8_t printInfo);
 
 int32_t q_to_string(queue_t * q, uint8_t * buf);
 
-int32_t ts_to_string(uint32_t timestamps[][NUM_READINGS], uint32_t current_ts_index, uint8_t * buf);
+int32_t ts_to_string(const ts_capture_t * capture, uint8_t * buf, uint32_t len, uint32_t * count);
 
 int32_t test_time_beac_sync();
 
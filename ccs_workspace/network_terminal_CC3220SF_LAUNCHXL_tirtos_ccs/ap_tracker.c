@@ -0,0 +1,384 @@
+/*
+ * ap_tracker.c
+ */
+
+#include <string.h>
+
+#include "network_terminal.h"
+#include "clock_discipline.h"
+#include "ap_tracker.h"
+
+#define AP_SLOT_EMPTY       0
+#define AP_SLOT_USED        1
+#define AP_SLOT_DELETED     2       /* keeps probe chains intact after an AP is dropped */
+
+#define AP_IE_DS_PARAMS     3
+#define AP_HDR_OFS          8       /* proprietary header in front of the 802.11 frame */
+#define AP_IE_OFS           36      /* fixed beacon fields end here */
+
+static uint32_t bssid_hash(const uint8_t * bssid)
+{
+    uint32_t h = 2166136261u;
+    uint8_t i;
+
+    /* FNV-1a */
+    for(i=0;i<6;i++)
+    {
+        h ^= bssid[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* returns the slot holding bssid, inserting it if asked, or -1 */
+static int32_t ap_tracker_find(ap_tracker_t * tr, const uint8_t * bssid, uint8_t insert, uint32_t now_us)
+{
+    uint32_t h = bssid_hash(bssid);
+    int32_t free_slot = -1;
+    int32_t stalest = -1;
+    uint32_t stalest_age = 0;
+    uint32_t n;
+    uint32_t i;
+    ap_entry_t * e;
+
+    for(n=0;n<AP_TRACKER_SLOTS;n++)
+    {
+        i = (h + n) & (AP_TRACKER_SLOTS - 1);
+        e = &tr->slots[i];
+
+        if(e->state == AP_SLOT_USED)
+        {
+            if(memcmp(e->bssid, bssid, 6) == 0)
+                return i;
+            if((int32_t)i != tr->primary && (now_us - e->last_local_us) >= stalest_age)
+            {
+                stalest = i;
+                stalest_age = now_us - e->last_local_us;
+            }
+            continue;
+        }
+
+        if(free_slot < 0)
+            free_slot = i;
+        if(e->state == AP_SLOT_EMPTY)
+            break;
+    }
+
+    if(!insert)
+        return -1;
+
+    /* full table, the AP heard least recently makes room */
+    if(free_slot < 0)
+    {
+        if(stalest < 0)
+            return -1;
+        free_slot = stalest;
+        tr->evictions++;
+        tr->count--;
+    }
+
+    e = &tr->slots[free_slot];
+    memset(e, 0, sizeof(ap_entry_t));
+    memcpy(e->bssid, bssid, 6);
+    e->state = AP_SLOT_USED;
+    tr->count++;
+
+    return free_slot;
+}
+
+/* the AP's TSF at local_us, carried forward from its last beacon at the disciplined local rate */
+static uint32_t ap_tsf_at(const ap_entry_t * e, uint32_t local_us)
+{
+    return e->last_tsf_us + clock_discipline_correct(local_us - e->last_local_us);
+}
+
+/* offsets are differences of 32 bit TSFs, only their value modulo 2^32 us matters */
+static int64_t ofs_wrap_q4(int64_t ofs_q4)
+{
+    return (int64_t)(int32_t)(ofs_q4 >> 4) * 16 + (ofs_q4 & 15);
+}
+
+/*
+ * Replaces a primary that went stale with the fresh AP of lowest BSSID that has a known offset, so every node
+ * that hears the same APs picks the same one. The new primary keeps its offset, so the reference stays on the
+ * old timebase without a step. With no such AP the next one heard becomes the primary and the reference
+ * starts over on its TSF, as after ap_tracker_init().
+ */
+static void ap_tracker_reelect(ap_tracker_t * tr, uint32_t now_us)
+{
+    int32_t best = -1;
+    uint32_t i;
+    ap_entry_t * e;
+
+    tr->slots[tr->primary].state = AP_SLOT_DELETED;
+    tr->count--;
+    tr->primary = -1;
+    tr->primary_fixed = 0;
+    tr->reelections++;
+
+    for(i=0;i<AP_TRACKER_SLOTS;i++)
+    {
+        e = &tr->slots[i];
+        if(e->state != AP_SLOT_USED || !e->rel_valid || (now_us - e->last_local_us) > AP_TRACKER_FRESH_US)
+            continue;
+        if(best < 0 || memcmp(e->bssid, tr->slots[best].bssid, 6) < 0)
+            best = i;
+    }
+
+    if(best < 0)
+    {
+        for(i=0;i<AP_TRACKER_SLOTS;i++)
+            tr->slots[i].rel_valid = 0;
+        UART_PRINT("[nnaji msg] primary AP lost, the next AP heard takes over\n\r");
+        return;
+    }
+
+    e = &tr->slots[best];
+    tr->primary = best;
+    memcpy(tr->primary_bssid, e->bssid, 6);
+    UART_PRINT("[nnaji msg] primary AP lost, %02x:%02x:%02x:%02x:%02x:%02x on channel %u takes over\n\r",
+               e->bssid[0], e->bssid[1], e->bssid[2], e->bssid[3], e->bssid[4], e->bssid[5], e->channel);
+}
+
+static void ap_tracker_purge(ap_tracker_t * tr, uint32_t now_us)
+{
+    uint32_t i;
+    ap_entry_t * e;
+
+    if(tr->primary >= 0 && (now_us - tr->slots[tr->primary].last_local_us) > AP_TRACKER_STALE_US)
+        ap_tracker_reelect(tr, now_us);
+
+    for(i=0;i<AP_TRACKER_SLOTS;i++)
+    {
+        e = &tr->slots[i];
+        if(e->state != AP_SLOT_USED || (int32_t)i == tr->primary)
+            continue;
+        if((now_us - e->last_local_us) > AP_TRACKER_STALE_US)
+        {
+            e->state = AP_SLOT_DELETED;
+            tr->count--;
+        }
+    }
+}
+
+/* primary_bssid may be NULL, then the first AP heard becomes the primary */
+void ap_tracker_init(ap_tracker_t * tr, const uint8_t * primary_bssid)
+{
+    memset(tr, 0, sizeof(ap_tracker_t));
+    tr->primary = -1;
+    tr->scan_channel = 1;
+
+    if(primary_bssid != NULL)
+    {
+        memcpy(tr->primary_bssid, primary_bssid, 6);
+        tr->primary_fixed = 1;
+    }
+}
+
+/* channel from the DS parameter set element of a beacon, -1 if it has none */
+int32_t ap_tracker_beacon_channel(const uint8_t * Rx_frame, int32_t len)
+{
+    int32_t ofs = AP_HDR_OFS + AP_IE_OFS;
+
+    while(ofs + 2 <= len)
+    {
+        if(Rx_frame[ofs] == AP_IE_DS_PARAMS && Rx_frame[ofs+1] == 1 && ofs + 3 <= len)
+            return Rx_frame[ofs+2];
+        ofs += 2 + Rx_frame[ofs+1];
+    }
+
+    return -1;
+}
+
+/* records one beacon, returns the AP's slot or -1 if it couldn't be tracked */
+int32_t ap_tracker_update(ap_tracker_t * tr, const frameInfo_t * frameInfo, uint8_t channel, uint32_t local_us)
+{
+    int32_t slot;
+    int64_t sample_q4;
+    int64_t dev_q4;
+    ap_entry_t * e;
+    ap_entry_t * p;
+
+    slot = ap_tracker_find(tr, frameInfo->bssid, 1, local_us);
+    if(slot < 0)
+        return -1;
+    e = &tr->slots[slot];
+
+    if(tr->primary < 0 && (!tr->primary_fixed || memcmp(frameInfo->bssid, tr->primary_bssid, 6) == 0))
+    {
+        tr->primary = slot;
+        memcpy(tr->primary_bssid, frameInfo->bssid, 6);
+        e->rel_ofs_q4 = 0;
+        UART_PRINT("[nnaji msg] primary AP %02x:%02x:%02x:%02x:%02x:%02x on channel %u\n\r",
+                   e->bssid[0], e->bssid[1], e->bssid[2], e->bssid[3], e->bssid[4], e->bssid[5], channel);
+    }
+
+    if(slot == tr->primary)
+    {
+        /* the primary's jitter is how far its beacons land from where its own last beacon predicts */
+        if(e->beacons > 0)
+        {
+            dev_q4 = (int64_t)(int32_t)(frameInfo->timestamp - ap_tsf_at(e, local_us)) << 4;
+            if(dev_q4 < 0)
+                dev_q4 = -dev_q4;
+            e->jitter_q4 += (int32_t)(dev_q4 - e->jitter_q4) >> AP_TRACKER_OFS_SHIFT;
+        }
+        /* 0 for the first primary, a re-elected one keeps the offset it had to the reference */
+        e->rel_valid = 1;
+    }
+    else if(tr->primary >= 0)
+    {
+        /* learn the offset to the primary only while the primary's prediction is still fresh */
+        p = &tr->slots[tr->primary];
+        if(p->beacons > 0 && (local_us - p->last_local_us) < AP_TRACKER_PAIR_US)
+        {
+            sample_q4 = ofs_wrap_q4(((int64_t)(int32_t)(frameInfo->timestamp - ap_tsf_at(p, local_us)) << 4) +
+                                    p->rel_ofs_q4);
+            if(!e->rel_valid)
+            {
+                e->rel_ofs_q4 = sample_q4;
+                e->jitter_q4 = p->jitter_q4;
+                e->rel_valid = 1;
+            }
+            else
+            {
+                dev_q4 = ofs_wrap_q4(sample_q4 - e->rel_ofs_q4);
+                e->rel_ofs_q4 = ofs_wrap_q4(e->rel_ofs_q4 + (dev_q4 >> AP_TRACKER_OFS_SHIFT));
+                if(dev_q4 < 0)
+                    dev_q4 = -dev_q4;
+                e->jitter_q4 += (int32_t)(dev_q4 - e->jitter_q4) >> AP_TRACKER_OFS_SHIFT;
+            }
+        }
+    }
+
+    e->channel = channel;
+    if(frameInfo->beaconIntervalMs != 0)
+        e->interval_us = frameInfo->beaconIntervalMs;   /* TU * 1024, i.e. microseconds */
+    e->last_tsf_us = frameInfo->timestamp;
+    e->last_local_us = local_us;
+    e->beacons++;
+
+    return slot;
+}
+
+/*
+ * Picks the next receive window: the AP whose next beacon is due soonest, or a scan of the next channel
+ * every AP_TRACKER_SCAN_PERIOD_US (and whenever nothing is tracked) so new APs are found.
+ */
+void ap_tracker_plan(ap_tracker_t * tr, uint32_t now_us, ap_dwell_t * dwell)
+{
+    uint32_t i;
+    uint32_t k;
+    uint32_t next_us;
+    int32_t best = -1;
+    int32_t best_wait = 0;
+    ap_entry_t * e;
+
+    ap_tracker_purge(tr, now_us);
+
+    for(i=0;i<AP_TRACKER_SLOTS;i++)
+    {
+        e = &tr->slots[i];
+        if(e->state != AP_SLOT_USED || e->interval_us == 0)
+            continue;
+
+        k = (now_us - e->last_local_us + AP_TRACKER_GUARD_US) / e->interval_us + 1;
+        next_us = e->last_local_us + k * e->interval_us;
+        if(best < 0 || (int32_t)(next_us - now_us) < best_wait)
+        {
+            best = i;
+            best_wait = (int32_t)(next_us - now_us);
+        }
+    }
+
+    if(best < 0 || (int32_t)(now_us - tr->next_scan_us) >= 0)
+    {
+        dwell->channel = tr->scan_channel;
+        dwell->open_us = now_us;
+        dwell->close_us = now_us + AP_TRACKER_SCAN_DWELL_US;
+        dwell->scan = 1;
+
+        tr->scan_channel = (tr->scan_channel % AP_TRACKER_MAX_CHANNEL) + 1;
+        tr->next_scan_us = now_us + AP_TRACKER_SCAN_PERIOD_US;
+        return;
+    }
+
+    dwell->channel = tr->slots[best].channel;
+    dwell->open_us = now_us + best_wait - AP_TRACKER_GUARD_US;
+    dwell->close_us = now_us + best_wait + AP_TRACKER_GUARD_US;
+    dwell->scan = 0;
+}
+
+/*
+ * Primary TSF at local_us fused from every fresh AP with a known offset. Returns 0 and fills
+ * *ref_tsf_us, or -1 when no AP is fresh. *sources is the number of APs used.
+ */
+int32_t ap_tracker_reference(ap_tracker_t * tr, uint32_t local_us, uint32_t * ref_tsf_us, uint8_t * sources)
+{
+    uint32_t i;
+    uint32_t base = 0;
+    uint32_t pred;
+    uint32_t jitter;
+    int64_t weight;
+    int64_t acc = 0;
+    int64_t wsum = 0;
+    uint8_t n = 0;
+    ap_entry_t * e;
+
+    for(i=0;i<AP_TRACKER_SLOTS;i++)
+    {
+        e = &tr->slots[i];
+        if(e->state != AP_SLOT_USED || !e->rel_valid || (local_us - e->last_local_us) > AP_TRACKER_FRESH_US)
+            continue;
+
+        pred = ap_tsf_at(e, local_us) - (uint32_t)(e->rel_ofs_q4 >> 4);
+        if(n == 0)
+            base = pred;
+
+        /* weight 1 / jitter^2, predictions are averaged as offsets from the first one to stay wrap safe */
+        jitter = e->jitter_q4 >> 4;
+        if(jitter < AP_TRACKER_MIN_JITTER_US)
+            jitter = AP_TRACKER_MIN_JITTER_US;
+        weight = ((int64_t)1 << 30) / ((int64_t)jitter * jitter);
+        if(weight == 0)
+            weight = 1;
+
+        acc += weight * (int32_t)(pred - base);
+        wsum += weight;
+        n++;
+    }
+
+    *sources = n;
+    if(n == 0)
+        return(-1);
+
+    *ref_tsf_us = base + (int32_t)(acc / wsum);
+    return(0);
+}
+
+void ap_tracker_report(ap_tracker_t * tr, uint32_t now_us)
+{
+    uint32_t i;
+    uint32_t ref;
+    uint8_t sources;
+    ap_entry_t * e;
+
+    for(i=0;i<AP_TRACKER_SLOTS;i++)
+    {
+        e = &tr->slots[i];
+        if(e->state != AP_SLOT_USED)
+            continue;
+
+        UART_PRINT("%s%02x:%02x:%02x:%02x:%02x:%02x ch %u: %u beacons, offset %i us, jitter %u us, seen %u ms ago\n\r",
+                   ((int32_t)i == tr->primary) ? "* " : "  ",
+                   e->bssid[0], e->bssid[1], e->bssid[2], e->bssid[3], e->bssid[4], e->bssid[5],
+                   e->channel, e->beacons, e->rel_valid ? (int32_t)(e->rel_ofs_q4 >> 4) : 0,
+                   e->jitter_q4 >> 4, (now_us - e->last_local_us) / 1000);
+    }
+
+    if(ap_tracker_reference(tr, now_us, &ref, &sources) == 0)
+        UART_PRINT("[nnaji msg] reference TSF %u from %u APs, %u tracked, %u evicted, %u primary changes\n\r",
+                   ref, sources, tr->count, tr->evictions, tr->reelections);
+    else
+        UART_PRINT("[nnaji msg] no fresh AP, %u tracked\n\r", tr->count);
+}
@@ -0,0 +1,84 @@
+/*
+ * ap_tracker.h
+ *
+ *  Tracks the beacons of several APs on several channels and fuses them into one time reference.
+ *
+ *  APs live in a small open addressing hash table keyed by BSSID. For each AP the tracker keeps its
+ *  channel, beacon interval, the last (TSF, local time) pair and, once the AP has been heard close in time
+ *  to the primary AP, the offset of its TSF from the primary's TSF with a running jitter estimate.
+ *
+ *  The reference is always the primary AP's TSF. ap_tracker_reference() predicts it from every fresh AP
+ *  (the AP's own TSF carried forward minus its offset to the primary) and averages the predictions
+ *  weighted by inverse jitter, so it keeps going when the primary is lost and gets less noisy with
+ *  every extra AP. A primary not heard for AP_TRACKER_STALE_US, a fixed one included, is replaced by a fresh
+ *  AP with a known offset. The new primary keeps that offset, so the reference stays on the first primary's
+ *  timebase and doesn't step.
+ */
+
+#ifndef AP_TRACKER_H_
+#define AP_TRACKER_H_
+
+#include <stdint.h>
+
+#include "ap_connection.h"
+
+#define AP_TRACKER_SLOTS            16          /* power of 2 */
+#define AP_TRACKER_MAX_CHANNEL      11
+#define AP_TRACKER_FRESH_US         2000000     /* APs heard longer ago than this are not fused */
+#define AP_TRACKER_STALE_US         30000000    /* APs not heard for this long are dropped */
+#define AP_TRACKER_PAIR_US          500000      /* offsets to the primary are learned within this gap */
+#define AP_TRACKER_GUARD_US         8000        /* dwell window around an expected beacon */
+#define AP_TRACKER_SCAN_PERIOD_US   5000000     /* a channel is scanned for new APs this often */
+#define AP_TRACKER_SCAN_DWELL_US    110000      /* just over one default beacon interval */
+#define AP_TRACKER_OFS_SHIFT        3           /* offset and jitter averages over about 8 samples */
+#define AP_TRACKER_MIN_JITTER_US    4           /* floor so one very quiet AP can't take all the weight */
+
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t state;                  /* AP_SLOT_* in ap_tracker.c */
+    uint8_t channel;
+    uint32_t interval_us;
+    uint32_t last_tsf_us;
+    uint32_t last_local_us;
+    int64_t rel_ofs_q4;             /* TSF - reference TSF in us with 4 fraction bits, any 32 bit difference */
+    uint32_t jitter_q4;             /* mean absolute deviation of the offset samples */
+    uint8_t rel_valid;
+    uint32_t beacons;
+}ap_entry_t;
+
+typedef struct
+{
+    ap_entry_t slots[AP_TRACKER_SLOTS];
+    int8_t primary;                 /* slot of the primary AP, -1 until the first beacon */
+    uint8_t primary_bssid[6];
+    uint8_t primary_fixed;          /* primary chosen by the caller instead of the first AP heard */
+    uint8_t count;
+    uint8_t scan_channel;
+    uint32_t next_scan_us;
+    uint32_t evictions;
+    uint32_t reelections;           /* primaries replaced after going stale */
+}ap_tracker_t;
+
+/* one receive window chosen by ap_tracker_plan() */
+typedef struct
+{
+    uint8_t channel;
+    uint32_t open_us;
+    uint32_t close_us;
+    uint8_t scan;
+}ap_dwell_t;
+
+void ap_tracker_init(ap_tracker_t * tr, const uint8_t * primary_bssid);
+
+int32_t ap_tracker_beacon_channel(const uint8_t * Rx_frame, int32_t len);
+
+int32_t ap_tracker_update(ap_tracker_t * tr, const frameInfo_t * frameInfo, uint8_t channel, uint32_t local_us);
+
+void ap_tracker_plan(ap_tracker_t * tr, uint32_t now_us, ap_dwell_t * dwell);
+
+int32_t ap_tracker_reference(ap_tracker_t * tr, uint32_t local_us, uint32_t * ref_tsf_us, uint8_t * sources);
+
+void ap_tracker_report(ap_tracker_t * tr, uint32_t now_us);
+
+#endif /* AP_TRACKER_H_ */
@@ -0,0 +1,200 @@
+/*
+ * beacon_sched.c
+ */
+
+#include "network_terminal.h"
+#include "ap_connection.h"
+#include "beacon_sched.h"
+#include "perf_counters.h"
+#include "clock_discipline.h"
+
+static int32_t set_rcv_timeout(_i16 sock, uint32_t timeout_us)
+{
+    SlTimeval_t timeVal;
+
+    /* a zero timeout blocks for good, what is left of a window can be a few us */
+    if(timeout_us < 1000)
+        timeout_us = 1000;
+
+    timeVal.tv_sec = timeout_us / 1000000;
+    timeVal.tv_usec = timeout_us % 1000000;
+
+    return sl_SetSockOpt(sock, SL_SOL_SOCKET, SL_SO_RCVTIMEO, (_u8 *)&timeVal, sizeof(timeVal));
+}
+
+static void beacon_sched_hit(beacon_sched_t * s, frameInfo_t * frameInfo, uint32_t local_us)
+{
+    /* beaconIntervalMs is the interval in TU * 1024, i.e. microseconds */
+    if(frameInfo->beaconIntervalMs != 0)
+        s->interval_us = frameInfo->beaconIntervalMs;
+
+    s->gap = 0;
+    if(s->hits_total != 0)
+        s->gap = beacon_sched_gap(s->last_tsf_us, frameInfo->timestamp, s->interval_us);
+    if(s->gap != 0)
+    {
+        s->gaps_total++;
+        s->gap_beacons_total += s->gap;
+    }
+
+    s->last_tsf_us = frameInfo->timestamp;
+    s->last_local_us = local_us;
+    s->misses = 0;
+    s->synced = (s->interval_us != 0);
+    s->hits_total++;
+
+    s->guard_us >>= 1;
+    if(s->guard_us < BEACON_GUARD_MIN_US)
+        s->guard_us = BEACON_GUARD_MIN_US;
+}
+
+static void beacon_sched_miss(beacon_sched_t * s)
+{
+    s->misses++;
+    s->misses_total++;
+    perf_count(PERF_BEACONS_MISSED);
+
+    s->guard_us <<= 1;
+    if(s->guard_us > BEACON_GUARD_MAX_US)
+        s->guard_us = BEACON_GUARD_MAX_US;
+
+    if(s->misses >= BEACON_RESYNC_MISSES)
+    {
+        UART_PRINT("[nnaji msg] %u beacons missed in a row, searching again\n\r", s->misses);
+        s->synced = 0;
+    }
+}
+
+void beacon_sched_init(beacon_sched_t * s)
+{
+    memset(s, 0, sizeof(beacon_sched_t));
+    s->guard_us = BEACON_GUARD_START_US;
+}
+
+/* enter_tranceiver_mode() leaves the RF socket non-blocking, the scheduler blocks with a timeout instead */
+int32_t beacon_sched_attach(_i16 sock)
+{
+    _u32 nonBlocking = 0;
+    int32_t status;
+
+    status = sl_SetSockOpt(sock, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonBlocking, sizeof(nonBlocking));
+    if(status < 0)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
+                   SL_SOCKET_ERROR);
+        return(-1);
+    }
+
+    return(0);
+}
+
+/*
+ * Sleeps until the receive window around the next predicted beacon, then waits in it for the beacon.
+ * Returns the frame length with frameInfo filled in when a beacon was heard, 0 on a miss and a
+ * negative SimpleLink error otherwise.
+ */
+int32_t beacon_sched_wait(beacon_sched_t * s, _i16 sock, uint8_t * frame, uint32_t len, frameInfo_t * frameInfo)
+{
+    uint32_t now_us;
+    uint32_t k;
+    uint32_t target_us;
+    uint32_t open_us;
+    uint32_t window_us;
+    uint32_t deadline_us;
+    uint32_t expected_tsf_us = 0;
+    int32_t numBytes;
+    int32_t status;
+
+    now_us = clock_discipline_local_us();
+
+    if(s->synced)
+    {
+        /* first TBTT whose window can still be opened in time */
+        k = (now_us - s->last_local_us + s->guard_us + BEACON_WAKE_LATENCY_US) / s->interval_us + 1;
+        target_us = s->last_local_us + k * s->interval_us;
+        expected_tsf_us = s->last_tsf_us + k * s->interval_us;
+
+        open_us = target_us - s->guard_us;
+        if((int32_t)(open_us - now_us) > 0)
+            usleep(open_us - now_us);
+        window_us = 2 * s->guard_us;
+    }
+    else
+    {
+        window_us = BEACON_SEARCH_US;
+    }
+
+    status = set_rcv_timeout(sock, window_us);
+    if(status < 0)
+        return status;
+
+    now_us = clock_discipline_local_us();
+    deadline_us = now_us + window_us;
+
+    while(1)
+    {
+        numBytes = sl_Recv(sock, frame, len, 0);
+        if(numBytes == SL_ERROR_BSD_EAGAIN)
+        {
+            s->listen_us_total += window_us;
+            beacon_sched_miss(s);
+            return 0;
+        }
+        else if(numBytes < 0)
+        {
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, numBytes,
+                       SL_SOCKET_ERROR);
+            return numBytes;
+        }
+
+        now_us = clock_discipline_local_us();
+        parse_beacon_frame(frame, frameInfo, 0);
+
+        /* beacons that arrived while sleeping are still queued in the socket, skip them */
+        if(s->synced && (int32_t)(frameInfo->timestamp - (expected_tsf_us - s->guard_us)) < 0)
+        {
+            s->stale_total++;
+            if((int32_t)(deadline_us - now_us) > 0)
+            {
+                /* the next receive only gets what is left of the window, not a whole new one */
+                status = set_rcv_timeout(sock, deadline_us - now_us);
+                if(status < 0)
+                    return status;
+                continue;
+            }
+            s->listen_us_total += window_us;
+            beacon_sched_miss(s);
+            return 0;
+        }
+
+        if((int32_t)(deadline_us - now_us) > 0)
+            s->listen_us_total += window_us - (deadline_us - now_us);
+        else
+            s->listen_us_total += window_us;
+        beacon_sched_hit(s, frameInfo, now_us);
+        return numBytes;
+    }
+}
+
+/* number of beacons lost between two heard ones, 0 for consecutive, repeated or out of order TSFs */
+uint16_t beacon_sched_gap(uint32_t last_tsf_us, uint32_t tsf_us, uint32_t interval_us)
+{
+    uint32_t delta = tsf_us - last_tsf_us;
+    uint32_t lost;
+
+    if(interval_us == 0 || (int32_t)delta <= 0 || delta <= interval_us + interval_us / 2)
+        return 0;
+
+    lost = (delta + interval_us / 2) / interval_us - 1;
+    if(lost > 0xFFFF)
+        lost = 0xFFFF;
+
+    return (uint16_t)lost;
+}
+
+void beacon_sched_report(beacon_sched_t * s)
+{
+    UART_PRINT("[nnaji msg] beacons: %u heard, %u missed, %u stale, guard %u us, listened %u ms\n\r",
+               s->hits_total, s->misses_total, s->stale_total, s->guard_us, s->listen_us_total / 1000);
+    UART_PRINT("[nnaji msg] beacon gaps: %u, %u beacons lost in them\n\r", s->gaps_total, s->gap_beacons_total);
+}
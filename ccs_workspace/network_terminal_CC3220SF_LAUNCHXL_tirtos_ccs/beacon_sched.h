@@ -0,0 +1,60 @@
+/*
+ * beacon_sched.h
+ *
+ *  Beacon listening scheduled around the predicted target beacon transmission time (TBTT).
+ *
+ *  The AP sends a beacon every beacon interval, so once one beacon has been heard the next ones are
+ *  expected at last_local + k * interval on the local clock. The task sleeps until guard_us before that
+ *  time and then blocks in sl_Recv with a receive timeout of 2 * guard_us instead of spinning on a
+ *  non-blocking socket. Every hit halves the guard down to BEACON_GUARD_MIN_US, every miss doubles it up
+ *  to BEACON_GUARD_MAX_US, and after BEACON_RESYNC_MISSES misses in a row the schedule is dropped and
+ *  the receiver listens for a whole BEACON_SEARCH_US until a beacon is heard again.
+ *
+ *  Every heard beacon is also checked against the TSF of the previous one: a TSF step of more than
+ *  1.5 intervals means beacons were lost in between (missed windows, a resync or an upload
+ *  with the receiver off), and gap holds how many, so the stream can mark it instead of letting the host
+ *  assume steady progress across it.
+ */
+
+#ifndef BEACON_SCHED_H_
+#define BEACON_SCHED_H_
+
+#include <stdint.h>
+
+#include "ap_connection.h"
+
+#define BEACON_GUARD_MIN_US         4000        /* receive timeouts have millisecond granularity */
+#define BEACON_GUARD_MAX_US         40000
+#define BEACON_GUARD_START_US       16000
+#define BEACON_WAKE_LATENCY_US      1000        /* time needed between waking up and the window opening */
+#define BEACON_RESYNC_MISSES        8
+#define BEACON_SEARCH_US            250000      /* longer than two default 102.4 ms intervals */
+
+typedef struct
+{
+    uint32_t interval_us;
+    uint32_t last_tsf_us;
+    uint32_t last_local_us;
+    uint32_t guard_us;
+    uint16_t misses;                            /* in a row */
+    uint8_t synced;
+    uint32_t hits_total;
+    uint32_t misses_total;
+    uint32_t stale_total;                       /* frames queued from before the window, dropped */
+    uint32_t listen_us_total;                   /* time spent with the receive window open */
+    uint16_t gap;                               /* beacons lost right before the last one heard */
+    uint32_t gaps_total;
+    uint32_t gap_beacons_total;
+}beacon_sched_t;
+
+void beacon_sched_init(beacon_sched_t * s);
+
+int32_t beacon_sched_attach(_i16 sock);
+
+int32_t beacon_sched_wait(beacon_sched_t * s, _i16 sock, uint8_t * frame, uint32_t len, frameInfo_t * frameInfo);
+
+uint16_t beacon_sched_gap(uint32_t last_tsf_us, uint32_t tsf_us, uint32_t interval_us);
+
+void beacon_sched_report(beacon_sched_t * s);
+
+#endif /* BEACON_SCHED_H_ */
@@ -0,0 +1,236 @@
+/*
+ * boot_profile.c
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "network_terminal.h"
+#include "ap_connection.h"
+#include "boot_profile.h"
+
+#define BOOT_DEFAULT_CHANNEL            11
+#define BOOT_DEFAULT_SENSORS            0x01        /* the accelerometer, SENSOR_DEFAULT_MASK in sensor.h */
+#define BOOT_DEFAULT_SAMPLE_PERIOD_US   0           /* every sensor at its driver's default period */
+#define BOOT_DEFAULT_UPLOAD_INTERVAL_MS 30000
+
+static const char * bootPhaseNames[BOOT_PHASE_COUNT] =
+{
+    "sl_Start", "profile", "connected", "filters", "first beacon", "first sample"
+};
+
+static boot_profile_t bootProfile;
+static uint8_t bootProfileLoaded = 0;
+static uint32_t bootPhaseUs[BOOT_PHASE_COUNT];
+static volatile uint8_t bootPhaseSet = 0;
+
+static uint32_t get_u32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+/* CRC-32 (IEEE, reflected), same as zlib.crc32 on the host, also checks the spill log segments */
+uint32_t boot_crc32(const uint8_t * buf, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t i;
+    uint8_t bit;
+
+    for(i=0;i<len;i++)
+    {
+        crc ^= buf[i];
+        for(bit=0;bit<8;bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+
+    return ~crc;
+}
+
+static void boot_profile_defaults(boot_profile_t * p)
+{
+    memset(p, 0, sizeof(boot_profile_t));
+    p->role = BOOT_ROLE_BEACON_SYNC;
+    p->sensors = BOOT_DEFAULT_SENSORS;
+    p->channel = BOOT_DEFAULT_CHANNEL;
+    p->sample_period_us = BOOT_DEFAULT_SAMPLE_PERIOD_US;
+    p->upload_interval_ms = BOOT_DEFAULT_UPLOAD_INTERVAL_MS;
+    strcpy(p->ssid, AP_SSID);
+    strcpy(p->key, AP_KEY);
+}
+
+/*
+ * Reads BOOT_PROFILE_FILE. Returns 0 when the file was used, -1 when it is missing or invalid, in which
+ * case the defaults stay in place. Either way boot_profile_get() is valid afterwards.
+ */
+int32_t boot_profile_load()
+{
+    uint8_t buf[BOOT_PROFILE_SIZE];
+    int32_t fd;
+    int32_t ret;
+    uint32_t token = 0;
+
+    boot_profile_defaults(&bootProfile);
+    bootProfileLoaded = 1;
+
+    fd = sl_FsOpen((const uint8_t *)BOOT_PROFILE_FILE, SL_FS_READ, (_u32 *)&token);
+    if(fd < 0)
+    {
+        UART_PRINT("[nnaji msg] no boot profile, using defaults\n\r");
+        boot_phase_mark(BOOT_PHASE_PROFILE);
+        return(-1);
+    }
+
+    ret = sl_FsRead(fd, 0, buf, BOOT_PROFILE_SIZE);
+    sl_FsClose(fd, NULL, NULL, 0);
+
+    if(ret != BOOT_PROFILE_SIZE || get_u32(&buf[0]) != BOOT_PROFILE_MAGIC || buf[4] != BOOT_PROFILE_VERSION ||
+       get_u32(&buf[124]) != boot_crc32(buf, 124))
+    {
+        UART_PRINT("[nnaji msg] invalid boot profile (read %i bytes), using defaults\n\r", ret);
+        boot_phase_mark(BOOT_PHASE_PROFILE);
+        return(-1);
+    }
+
+    bootProfile.role = buf[5];
+    bootProfile.flags = buf[6];
+    bootProfile.sensors = buf[7];
+    if(buf[8] >= 1 && buf[8] <= 13)
+        bootProfile.channel = buf[8];
+    memcpy(bootProfile.beacon_mac, &buf[9], 6);
+    bootProfile.sample_period_us = get_u32(&buf[16]);
+    if(get_u32(&buf[20]) != 0)
+        bootProfile.upload_interval_ms = get_u32(&buf[20]);
+    if(buf[24] != 0)
+    {
+        memcpy(bootProfile.ssid, &buf[24], sizeof(bootProfile.ssid));
+        memcpy(bootProfile.key, &buf[57], sizeof(bootProfile.key));
+        bootProfile.ssid[sizeof(bootProfile.ssid) - 1] = 0;
+        bootProfile.key[sizeof(bootProfile.key) - 1] = 0;
+    }
+
+    boot_phase_mark(BOOT_PHASE_PROFILE);
+    if(!boot_profile_headless())
+        UART_PRINT("[nnaji msg] boot profile: role %u, sensors 0x%02x, channel %u, AP %s\n\r",
+                   bootProfile.role, bootProfile.sensors, bootProfile.channel, bootProfile.ssid);
+
+    return(0);
+}
+
+const boot_profile_t * boot_profile_get()
+{
+    if(!bootProfileLoaded)
+    {
+        boot_profile_defaults(&bootProfile);
+        bootProfileLoaded = 1;
+    }
+    return &bootProfile;
+}
+
+/*
+ * The setters change the profile in use, boot_profile_get() fills in the defaults first, and
+ * boot_profile_save() makes it the next boot's too.
+ */
+void boot_profile_set_sample_period(uint32_t sample_period_us)
+{
+    boot_profile_get();
+    bootProfile.sample_period_us = sample_period_us;
+}
+
+void boot_profile_set_sensors(uint8_t sensors)
+{
+    boot_profile_get();
+    bootProfile.sensors = sensors;
+}
+
+void boot_profile_set_upload_interval(uint32_t upload_interval_ms)
+{
+    boot_profile_get();
+    bootProfile.upload_interval_ms = upload_interval_ms;
+}
+
+/* writes the profile in use to BOOT_PROFILE_FILE, in the layout boot_profile_load() reads */
+int32_t boot_profile_save()
+{
+    const boot_profile_t * p = boot_profile_get();
+    uint8_t buf[BOOT_PROFILE_SIZE];
+    int32_t fd;
+    int32_t ret;
+    uint32_t token = 0;
+
+    memset(buf, 0, sizeof(buf));
+    put_u32(&buf[0], BOOT_PROFILE_MAGIC);
+    buf[4] = BOOT_PROFILE_VERSION;
+    buf[5] = p->role;
+    buf[6] = p->flags;
+    buf[7] = p->sensors;
+    buf[8] = p->channel;
+    memcpy(&buf[9], p->beacon_mac, 6);
+    put_u32(&buf[16], p->sample_period_us);
+    put_u32(&buf[20], p->upload_interval_ms);
+    memcpy(&buf[24], p->ssid, sizeof(p->ssid));
+    memcpy(&buf[57], p->key, sizeof(p->key));
+    put_u32(&buf[124], boot_crc32(buf, 124));
+
+    fd = sl_FsOpen((const uint8_t *)BOOT_PROFILE_FILE, SL_FS_CREATE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(BOOT_PROFILE_SIZE),
+                   (_u32 *)&token);
+    if(fd < 0)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, fd, DEVICE_ERROR);
+        return(-1);
+    }
+
+    ret = sl_FsWrite(fd, 0, buf, BOOT_PROFILE_SIZE);
+    sl_FsClose(fd, NULL, NULL, 0);
+    if(ret != BOOT_PROFILE_SIZE)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, ret, DEVICE_ERROR);
+        return(-1);
+    }
+
+    UART_PRINT("[nnaji msg] boot profile saved\n\r");
+
+    return(0);
+}
+
+uint8_t boot_profile_headless()
+{
+    return (boot_profile_get()->flags & BOOT_FLAG_HEADLESS) != 0;
+}
+
+/* records the first time a phase is reached, later calls are cheap no-ops. Quiet on a headless node,
+ * boot_phase_report() still has the times */
+void boot_phase_mark(uint8_t phase)
+{
+    struct timespec cur_time;
+
+    if(phase >= BOOT_PHASE_COUNT || (bootPhaseSet & (1 << phase)))
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &cur_time);
+    bootPhaseUs[phase] = ((uint32_t)cur_time.tv_sec * 1000000 + (uint32_t)cur_time.tv_nsec / 1000);
+    bootPhaseSet |= 1 << phase;
+
+    if(!boot_profile_headless())
+        UART_PRINT("[nnaji msg] boot: %s at %u us\n\r", bootPhaseNames[phase], bootPhaseUs[phase]);
+}
+
+void boot_phase_report()
+{
+    uint8_t i;
+
+    for(i=0;i<BOOT_PHASE_COUNT;i++)
+    {
+        if(bootPhaseSet & (1 << i))
+            UART_PRINT("[nnaji msg] boot: %s at %u us\n\r", bootPhaseNames[i], bootPhaseUs[i]);
+        else
+            UART_PRINT("[nnaji msg] boot: %s not reached\n\r", bootPhaseNames[i]);
+    }
+}
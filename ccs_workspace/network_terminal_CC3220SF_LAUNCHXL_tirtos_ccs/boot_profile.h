@@ -0,0 +1,96 @@
+/*
+ * boot_profile.h
+ *
+ *  Boot profile read from the SimpleLink file system, so a board's role, sensors, rates, AP, beacon
+ *  filter and upload schedule are picked per board without rebuilding. Without a valid profile file the
+ *  defaults below reproduce the hard-coded behaviour (test_time_beac_sync() with the banner and menus).
+ *
+ *  The file is BOOT_PROFILE_SIZE bytes, little endian, written by board_communication/boot_profile.py:
+ *      0   u32  magic BOOT_PROFILE_MAGIC
+ *      4   u8   version BOOT_PROFILE_VERSION
+ *      5   u8   role (BOOT_ROLE_*)
+ *      6   u8   flags (BOOT_FLAG_*)
+ *      7   u8   sensors, bit n enables the sensor with id n
+ *      8   u8   transceiver channel
+ *      9   u8   beacon source MAC[6], all zeros keeps the built in one
+ *      15  u8   reserved
+ *      16  u32  sample period in us
+ *      20  u32  upload interval in ms
+ *      24  char AP SSID[33], NUL terminated
+ *      57  char AP key[65], NUL terminated
+ *      122 u16  reserved
+ *      124 u32  CRC-32 of bytes 0 to 123
+ *
+ *  boot_profile_save() writes the profile in use back, so rates and schedules changed over the control
+ *  connection (cmd_proto.h) survive a reboot.
+ *
+ *  Boot phases are timestamped on the local clock, which mainThread zeroes at power-on, so the time from
+ *  power-on to the first beacon and the first sample is printed as each phase is reached.
+ */
+
+#ifndef BOOT_PROFILE_H_
+#define BOOT_PROFILE_H_
+
+#include <stdint.h>
+
+#define BOOT_PROFILE_FILE       "boot_profile.bin"
+#define BOOT_PROFILE_MAGIC      0x46525042      /* "BPRF" */
+#define BOOT_PROFILE_VERSION    1
+#define BOOT_PROFILE_SIZE       128
+
+/* what mainThread runs after sl_Start() */
+#define BOOT_ROLE_TERMINAL              0       /* network terminal command prompt */
+#define BOOT_ROLE_BEACON_SYNC           1       /* test_time_beac_sync() */
+#define BOOT_ROLE_TX_ACCEL              2       /* event_loop_beacons(), kept so saved profiles still boot */
+#define BOOT_ROLE_EVENT_LOOP_BEACONS    3       /* event_loop_beacons() */
+#define BOOT_ROLE_TRACK_MULTI_AP        4       /* track_multi_ap() */
+#define BOOT_ROLE_STREAM_ACCEL          5       /* stream_accel_udp(), connects to the AP first */
+#define BOOT_ROLE_STREAM_EVENTS         6       /* stream_accel_events_udp(), connects to the AP first */
+#define BOOT_ROLE_STREAM_SENSORS        7       /* stream_sensors_udp(), connects to the AP first */
+#define BOOT_ROLE_EVENT_LOOP_CONNECTED  8       /* event_loop_connected(), connects to the AP first */
+
+#define BOOT_FLAG_HEADLESS      0x01            /* no banner, no command menu */
+
+/* boot phases */
+#define BOOT_PHASE_SL_START     0
+#define BOOT_PHASE_PROFILE      1
+#define BOOT_PHASE_CONNECTED    2
+#define BOOT_PHASE_FILTERS      3
+#define BOOT_PHASE_FIRST_BEACON 4
+#define BOOT_PHASE_FIRST_SAMPLE 5
+#define BOOT_PHASE_COUNT        6
+
+typedef struct
+{
+    uint8_t role;
+    uint8_t flags;
+    uint8_t sensors;
+    uint8_t channel;
+    uint8_t beacon_mac[6];
+    uint32_t sample_period_us;
+    uint32_t upload_interval_ms;
+    char ssid[33];
+    char key[65];
+}boot_profile_t;
+
+int32_t boot_profile_load();
+
+const boot_profile_t * boot_profile_get();
+
+void boot_profile_set_sample_period(uint32_t sample_period_us);
+
+void boot_profile_set_sensors(uint8_t sensors);
+
+void boot_profile_set_upload_interval(uint32_t upload_interval_ms);
+
+int32_t boot_profile_save();
+
+uint8_t boot_profile_headless();
+
+uint32_t boot_crc32(const uint8_t * buf, uint32_t len);
+
+void boot_phase_mark(uint8_t phase);
+
+void boot_phase_report();
+
+#endif /* BOOT_PROFILE_H_ */
@@ -0,0 +1,249 @@
+/*
+ * clock_discipline.c
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include <ti/drivers/Capture.h>
+#include <ti/drivers/I2C.h>
+#include <ti/drivers/Timer.h>
+#include <ti/drivers/dpl/ClockP.h>
+#include <ti/drivers/dpl/HwiP.h>
+
+#include "ti_drivers_config.h"
+#include "uart_term.h"
+#include "sensor.h"
+#include "clock_discipline.h"
+
+static Capture_Handle disciplineCapture = NULL;
+
+/* written by the capture callback only */
+static uint32_t windowCounts;
+static uint32_t windowEdges;
+static volatile int32_t ppbQ8;              /* rate estimate in ppb with 8 fraction bits, > 0 is a fast local clock */
+static volatile uint32_t lastWindowCounts;
+static volatile uint32_t windows;
+static volatile uint32_t rejectedWindows;
+
+/* local time, the system clock count carried into whole us */
+static Timer_Handle localTimer = NULL;
+static ClockP_Handle localGuard = NULL;
+static uint32_t localLastCounts;
+static uint32_t localRemCounts;
+static uint32_t localUs;
+
+/* reads the count often enough that it can't wrap between two reads */
+static void clock_discipline_local_guard(uintptr_t arg)
+{
+    clock_discipline_local_us();
+}
+
+/*
+ * Starts local time on CONFIG_TIMER_LOCAL, call once at boot before anything is timed. Local time falls back to
+ * CLOCK_REALTIME, uncorrected, if the timer can't be started.
+ */
+int32_t clock_discipline_local_start()
+{
+    Timer_Params timerParams;
+    ClockP_Params clockParams;
+    uint32_t guard_ticks;
+
+    if(localTimer != NULL)
+        return(0);
+
+    Timer_init();
+    Timer_Params_init(&timerParams);
+    timerParams.period = 0xFFFFFFFF;
+    timerParams.periodUnits = Timer_PERIOD_COUNTS;
+    timerParams.timerMode = Timer_FREE_RUNNING;
+
+    localTimer = Timer_open(CONFIG_TIMER_LOCAL, &timerParams);
+    if(localTimer == NULL || Timer_start(localTimer) == Timer_STATUS_ERROR)
+    {
+        UART_PRINT("[nnaji msg] could not start the local clock, local time is not disciplined\n\r");
+        if(localTimer != NULL)
+            Timer_close(localTimer);
+        localTimer = NULL;
+        return(-1);
+    }
+    localLastCounts = Timer_getCount(localTimer);
+    localRemCounts = 0;
+    localUs = 0;
+
+    guard_ticks = CLOCK_DISCIPLINE_LOCAL_GUARD_US / ClockP_getSystemTickPeriod();
+    ClockP_Params_init(&clockParams);
+    clockParams.period = guard_ticks;
+    clockParams.startFlag = true;
+    localGuard = ClockP_create(clock_discipline_local_guard, guard_ticks, &clockParams);
+    if(localGuard == NULL)
+    {
+        UART_PRINT("[nnaji msg] could not start the local clock guard\n\r");
+        return(-1);
+    }
+
+    return(0);
+}
+
+/* local time in us on the system clock, the one the capture measures, wraps every 71 minutes */
+uint32_t clock_discipline_local_us()
+{
+    struct timespec cur_time;
+    uint32_t counts;
+    uint32_t now_us;
+    uintptr_t key;
+
+    if(localTimer == NULL)
+    {
+        clock_gettime(CLOCK_REALTIME, &cur_time);
+        return ((uint32_t)cur_time.tv_sec * 1000000 + (uint32_t)cur_time.tv_nsec / 1000);
+    }
+
+    /* the CC32XX timer driver counts up */
+    key = HwiP_disable();
+    counts = Timer_getCount(localTimer);
+    localRemCounts += counts - localLastCounts;
+    localLastCounts = counts;
+    localUs += localRemCounts / CLOCK_DISCIPLINE_COUNTS_PER_US;
+    localRemCounts %= CLOCK_DISCIPLINE_COUNTS_PER_US;
+    now_us = localUs;
+    HwiP_restore(key);
+
+    return now_us;
+}
+
+/*
+ * Runs once per SQW edge with the system clock counts since the previous edge. Every
+ * CLOCK_DISCIPLINE_EDGES edges the summed counts are one DS3231 second of local time.
+ */
+static void clock_discipline_callback(Capture_Handle handle, uint32_t interval, int_fast16_t status)
+{
+    int64_t err_ppb;
+
+    if(status != Capture_STATUS_SUCCESS)
+    {
+        /* a missed edge spoils the window, start over */
+        windowCounts = 0;
+        windowEdges = 0;
+        return;
+    }
+
+    windowCounts += interval;
+    if(++windowEdges < CLOCK_DISCIPLINE_EDGES)
+        return;
+
+    /* (counts - f) / f in ppb, with f = 80 MHz that is (counts - f) * 25 / 2 */
+    err_ppb = (((int64_t)windowCounts - CLOCK_DISCIPLINE_SYSCLK_HZ) * 25) / 2;
+    lastWindowCounts = windowCounts;
+    windowCounts = 0;
+    windowEdges = 0;
+
+    if(err_ppb > CLOCK_DISCIPLINE_MAX_PPB || err_ppb < -CLOCK_DISCIPLINE_MAX_PPB)
+    {
+        rejectedWindows++;
+        return;
+    }
+
+    if(windows == 0)
+        ppbQ8 = (int32_t)err_ppb << 8;
+    else
+        ppbQ8 += (((int32_t)err_ppb << 8) - ppbQ8) >> CLOCK_DISCIPLINE_AVG_SHIFT;
+    windows++;
+}
+
+int32_t clock_discipline_start()
+{
+    Capture_Params params;
+    I2C_Transaction i2cTransaction;
+    uint8_t txBuffer[2] = { DS3231_CONTROL_REG, DS3231_CONTROL_SQW_1024HZ };
+
+    if(disciplineCapture != NULL)
+        return(0);
+
+    if(sensor_i2c() == NULL)
+    {
+        UART_PRINT("Error Initializing I2C\n\r");
+        return(-1);
+    }
+
+    i2cTransaction.slaveAddress = DS3231_ADDR;
+    i2cTransaction.writeBuf = txBuffer;
+    i2cTransaction.writeCount = 2;
+    i2cTransaction.readBuf = NULL;
+    i2cTransaction.readCount = 0;
+    if(!I2C_transfer(sensor_i2c(), &i2cTransaction))
+    {
+        UART_PRINT("[nnaji msg] could not enable the DS3231 square wave\n\r");
+        return(-1);
+    }
+
+    windowCounts = 0;
+    windowEdges = 0;
+    ppbQ8 = 0;
+    windows = 0;
+    rejectedWindows = 0;
+
+    Capture_init();
+    Capture_Params_init(&params);
+    params.mode = Capture_RISING_EDGE;
+    params.periodUnit = Capture_PERIOD_COUNTS;
+    params.callbackFxn = clock_discipline_callback;
+
+    disciplineCapture = Capture_open(CONFIG_CAPTURE_0, &params);
+    if(disciplineCapture == NULL || Capture_start(disciplineCapture) == Capture_STATUS_ERROR)
+    {
+        UART_PRINT("[nnaji msg] could not start the clock discipline capture\n\r");
+        clock_discipline_stop();
+        return(-1);
+    }
+
+    return(0);
+}
+
+void clock_discipline_stop()
+{
+    if(disciplineCapture == NULL)
+        return;
+
+    Capture_stop(disciplineCapture);
+    Capture_close(disciplineCapture);
+    disciplineCapture = NULL;
+}
+
+uint8_t clock_discipline_locked()
+{
+    return (windows >= CLOCK_DISCIPLINE_LOCK_WINDOWS);
+}
+
+/* current rate error of the local clock, 0 until locked or when local time isn't on the system clock */
+int32_t clock_discipline_ppb()
+{
+    if(!clock_discipline_locked() || localTimer == NULL)
+        return 0;
+    return ppbQ8 >> 8;
+}
+
+/* converts an interval measured with the local clock into reference (DS3231) time */
+uint32_t clock_discipline_correct(uint32_t local_elapsed_us)
+{
+    int64_t correction;
+
+    correction = ((int64_t)local_elapsed_us * clock_discipline_ppb()) / 1000000000;
+    return (uint32_t)((int64_t)local_elapsed_us - correction);
+}
+
+/*
+ * Carries a reference timestamp forward. anchor_local_us and anchor_ref_us were taken at the same
+ * instant (e.g. a beacon's reception time and its TSF), returns the reference time at local_us.
+ */
+uint32_t clock_discipline_predict(uint32_t anchor_local_us, uint32_t anchor_ref_us, uint32_t local_us)
+{
+    return anchor_ref_us + clock_discipline_correct(local_us - anchor_local_us);
+}
+
+void clock_discipline_report()
+{
+    UART_PRINT("[nnaji msg] clock discipline: %i ppb over %u windows (%u rejected), last window %u counts%s\n\r",
+               clock_discipline_ppb(), windows, rejectedWindows, lastWindowCounts,
+               clock_discipline_locked() ? "" : ", not locked");
+}
@@ -0,0 +1,55 @@
+/*
+ * clock_discipline.h
+ *
+ *  Measures the rate error of the CC3220 system clock against the DS3231 TCXO (+-2 ppm) and corrects
+ *  local time intervals with it, so a local timestamp can be carried forward from the last beacon
+ *  without waiting for the next one.
+ *
+ *  The DS3231 SQW pin is set to 1.024 kHz and wired to the CONFIG_CAPTURE_0 input, P61 on boosterpack pin 5
+ *  (see common.syscfg). The capture timer is 24 bits wide (about 0.2 s at 80 MHz), too short to time a 1 Hz
+ *  edge directly, so the intervals of CLOCK_DISCIPLINE_EDGES edges are summed instead. The sum telescopes to
+ *  the number of system clock counts in exactly one DS3231 second, giving 0.0125 ppm resolution per window.
+ *
+ *  The correction only holds for intervals timed with that same clock. CLOCK_REALTIME runs from the 32.768 kHz
+ *  RTC on the CC32xx, so local time is read with clock_discipline_local_us() instead, a free-running 32 bit
+ *  count of the system clock on CONFIG_TIMER_LOCAL. Every timestamp handed to clock_discipline_correct(),
+ *  clock_discipline_predict(), the AP tracker or the phase lock must come from it.
+ */
+
+#ifndef CLOCK_DISCIPLINE_H_
+#define CLOCK_DISCIPLINE_H_
+
+#include <stdint.h>
+
+#define CLOCK_DISCIPLINE_SYSCLK_HZ      80000000
+#define CLOCK_DISCIPLINE_EDGES          1024        /* SQW edges per one second window */
+#define CLOCK_DISCIPLINE_MAX_PPB        200000      /* windows further off than 200 ppm are dropped */
+#define CLOCK_DISCIPLINE_AVG_SHIFT      3           /* rate estimate averages about 8 windows */
+#define CLOCK_DISCIPLINE_LOCK_WINDOWS   4           /* windows before the estimate is used */
+#define CLOCK_DISCIPLINE_COUNTS_PER_US  (CLOCK_DISCIPLINE_SYSCLK_HZ / 1000000)
+#define CLOCK_DISCIPLINE_LOCAL_GUARD_US 10000000    /* the local count wraps every 53 s, it is read at least this often */
+
+/* DS3231 control register, INTCN = 0 and RS = 01 puts a 1.024 kHz square wave on SQW */
+#define DS3231_ADDR                     0x68
+#define DS3231_CONTROL_REG              0x0E
+#define DS3231_CONTROL_SQW_1024HZ       0x08
+
+int32_t clock_discipline_local_start();
+
+uint32_t clock_discipline_local_us();
+
+int32_t clock_discipline_start();
+
+void clock_discipline_stop();
+
+uint8_t clock_discipline_locked();
+
+int32_t clock_discipline_ppb();
+
+uint32_t clock_discipline_correct(uint32_t local_elapsed_us);
+
+uint32_t clock_discipline_predict(uint32_t anchor_local_us, uint32_t anchor_ref_us, uint32_t local_us);
+
+void clock_discipline_report();
+
+#endif /* CLOCK_DISCIPLINE_H_ */
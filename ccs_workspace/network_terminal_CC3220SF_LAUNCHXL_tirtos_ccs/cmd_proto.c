@@ -0,0 +1,174 @@
+/*
+ * cmd_proto.c
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cmd_proto.h"
+
+static uint16_t get_u16(const uint8_t * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put_u16(uint8_t * p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+/*
+ * Length of the frame at the start of buf once all of it is there, 0 while more bytes are needed, -1 when
+ * buf does not start with a frame (the stream is out of step and the connection should be dropped).
+ */
+int32_t cmd_frame_len(const uint8_t * buf, uint32_t len)
+{
+    uint32_t frame_len;
+
+    if(len >= 2 && get_u16(buf) != CMD_MAGIC)
+        return(-1);
+    if(len < CMD_HEADER_SIZE)
+        return(0);
+
+    frame_len = CMD_HEADER_SIZE + get_u16(&buf[6]);
+    if(frame_len > CMD_MAX_FRAME)
+        return(-1);
+
+    return (len >= frame_len) ? (int32_t)frame_len : 0;
+}
+
+/*
+ * Runs the handler of the request frame in frame (len bytes, see cmd_frame_len()) from table, which has
+ * CMD_OP_COUNT entries, NULL for opcodes this mode does not serve. The response goes to out, returns its
+ * length or -1 when out cannot hold a header.
+ */
+int32_t cmd_dispatch(const cmd_handler_fn * table, void * ctx, const uint8_t * frame, uint32_t len,
+                     uint8_t * out, uint32_t out_size)
+{
+    cmd_request_t req;
+    cmd_reply_t reply;
+    uint8_t status;
+
+    if(out_size < CMD_HEADER_SIZE)
+        return(-1);
+
+    req.opcode = frame[2];
+    req.id = get_u16(&frame[4]);
+    req.args = &frame[CMD_HEADER_SIZE];
+    req.args_len = len - CMD_HEADER_SIZE;
+
+    reply.buf = out;
+    reply.len = CMD_HEADER_SIZE;
+    reply.size = out_size;
+    reply.overflow = 0;
+
+    if(req.opcode >= CMD_OP_COUNT || table[req.opcode] == NULL)
+        status = CMD_STATUS_BAD_OPCODE;
+    else
+        status = table[req.opcode](ctx, &req, &reply);
+
+    /* a handler that failed half way leaves no partial arguments behind */
+    if(status != CMD_STATUS_OK || reply.overflow)
+    {
+        reply.len = CMD_HEADER_SIZE;
+        if(status == CMD_STATUS_OK)
+            status = CMD_STATUS_FAILED;
+    }
+
+    put_u16(&out[0], CMD_MAGIC);
+    out[2] = req.opcode | CMD_RESPONSE;
+    out[3] = status;
+    put_u16(&out[4], req.id);
+    put_u16(&out[6], reply.len - CMD_HEADER_SIZE);
+
+    return reply.len;
+}
+
+/* finds the argument of the given type, returns its length and points value at it, or -1 */
+int32_t cmd_arg(const cmd_request_t * req, uint8_t type, const uint8_t ** value)
+{
+    uint32_t pos = 0;
+    uint16_t len;
+
+    while(pos + CMD_TLV_HEADER_SIZE <= req->args_len)
+    {
+        len = get_u16(&req->args[pos + 1]);
+        if(pos + CMD_TLV_HEADER_SIZE + len > req->args_len)
+            return(-1);
+        if(req->args[pos] == type)
+        {
+            *value = &req->args[pos + CMD_TLV_HEADER_SIZE];
+            return len;
+        }
+        pos += CMD_TLV_HEADER_SIZE + len;
+    }
+
+    return(-1);
+}
+
+/* 0 and the value, or -1 when the argument is missing or not one byte */
+int32_t cmd_arg_u8(const cmd_request_t * req, uint8_t type, uint8_t * value)
+{
+    const uint8_t * p;
+
+    if(cmd_arg(req, type, &p) != 1)
+        return(-1);
+    *value = p[0];
+
+    return(0);
+}
+
+int32_t cmd_arg_u32(const cmd_request_t * req, uint8_t type, uint32_t * value)
+{
+    const uint8_t * p;
+
+    if(cmd_arg(req, type, &p) != 4)
+        return(-1);
+    *value = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+
+    return(0);
+}
+
+/* appends an argument header and returns where its len value bytes go, NULL (and a failed reply) when full */
+uint8_t * cmd_reply_reserve(cmd_reply_t * reply, uint8_t type, uint16_t len)
+{
+    uint8_t * p;
+
+    if(reply->len + CMD_TLV_HEADER_SIZE + len > reply->size)
+    {
+        reply->overflow = 1;
+        return NULL;
+    }
+
+    p = &reply->buf[reply->len];
+    p[0] = type;
+    put_u16(&p[1], len);
+    reply->len += CMD_TLV_HEADER_SIZE + len;
+
+    return &p[CMD_TLV_HEADER_SIZE];
+}
+
+void cmd_reply_u8(cmd_reply_t * reply, uint8_t type, uint8_t value)
+{
+    uint8_t * p = cmd_reply_reserve(reply, type, 1);
+
+    if(p != NULL)
+        p[0] = value;
+}
+
+void cmd_reply_u32(cmd_reply_t * reply, uint8_t type, uint32_t value)
+{
+    uint8_t * p = cmd_reply_reserve(reply, type, 4);
+
+    if(p != NULL)
+        put_u32(p, value);
+}
@@ -0,0 +1,105 @@
+/*
+ * cmd_proto.h
+ *
+ *  Binary command protocol of the control connection, replacing the "get_time" / "start_counting" text
+ *  commands and their replies padded to MESSAGE_SIZE. Requests and responses are the same frame, little
+ *  endian:
+ *      0   u16  magic CMD_MAGIC
+ *      2   u8   opcode, a response has CMD_RESPONSE set
+ *      3   u8   status, 0 in a request, CMD_STATUS_* in a response
+ *      4   u16  request id, chosen by the host and echoed in the response
+ *      6   u16  length of the arguments
+ *      8   arguments, each u8 type (CMD_TLV_*), u16 length, value
+ *
+ *  The header holds the frame length, so frames are cut from the TCP stream without padding or
+ *  delimiters. Opcodes follow the order of CMD_OPCODES, so only ever append to it. A request is dispatched
+ *  through a table of handlers indexed by its opcode, one bounds check and one indirect call whatever the
+ *  command, and the arguments a handler reads are found by type in the few bytes after the header.
+ *
+ *  board_communication/cmd_client.py is the host side.
+ */
+
+#ifndef CMD_PROTO_H_
+#define CMD_PROTO_H_
+
+#include <stdint.h>
+
+#define CMD_MAGIC               0x4443      /* "CD" */
+#define CMD_HEADER_SIZE         8
+#define CMD_TLV_HEADER_SIZE     3
+#define CMD_MAX_FRAME           512
+#define CMD_RESPONSE            0x80
+
+/* name, arguments -> response arguments */
+#define CMD_OPCODES(X)                                                                              \
+    X(TIME_START)       /* -> TIME_SEC, TIME_NSEC of the new reference, was "start_counting" */    \
+    X(TIME_PROBE)       /* -> TIME_SEC, TIME_NSEC since TIME_START and LOCAL_US, was "get_time" */ \
+    X(CAPTURE_START)    /* start the sensor task */                                                 \
+    X(CAPTURE_STOP)                                                                                 \
+    X(SET_RATES)        /* [SAMPLE_PERIOD_US] [SENSORS] [PERSIST] -> the values in use */           \
+    X(SET_UPLOAD)       /* UPLOAD_INTERVAL_MS [PERSIST] -> the value in use */                      \
+    X(GET_COUNTERS)     /* -> PERF, a perf_snapshot() */
+
+#define CMD_OP_ID(name)         CMD_OP_##name,
+
+enum
+{
+    CMD_OP_NONE,
+    CMD_OPCODES(CMD_OP_ID)
+    CMD_OP_COUNT
+};
+
+/* argument types */
+#define CMD_TLV_TIME_SEC            0x01    /* u32 */
+#define CMD_TLV_TIME_NSEC           0x02    /* u32 */
+#define CMD_TLV_LOCAL_US            0x03    /* u32 */
+#define CMD_TLV_SAMPLE_PERIOD_US    0x04    /* u32 */
+#define CMD_TLV_SENSORS             0x05    /* u8, bit n enables the sensor with id n */
+#define CMD_TLV_UPLOAD_INTERVAL_MS  0x06    /* u32 */
+#define CMD_TLV_PERSIST             0x07    /* u8, 1 writes the boot profile so the change survives a reboot */
+#define CMD_TLV_PERF                0x08    /* perf snapshot, see perf_counters.h */
+
+/* response status */
+#define CMD_STATUS_OK           0
+#define CMD_STATUS_BAD_OPCODE   1
+#define CMD_STATUS_BAD_ARGS     2
+#define CMD_STATUS_BAD_STATE    3           /* not possible in the current mode */
+#define CMD_STATUS_FAILED       4
+
+typedef struct
+{
+    uint8_t opcode;
+    uint16_t id;
+    const uint8_t * args;
+    uint16_t args_len;
+}cmd_request_t;
+
+typedef struct
+{
+    uint8_t * buf;                          /* the response frame, arguments are appended after the header */
+    uint32_t len;
+    uint32_t size;
+    uint8_t overflow;
+}cmd_reply_t;
+
+/* returns a CMD_STATUS_* */
+typedef uint8_t (*cmd_handler_fn)(void * ctx, const cmd_request_t * req, cmd_reply_t * reply);
+
+int32_t cmd_frame_len(const uint8_t * buf, uint32_t len);
+
+int32_t cmd_dispatch(const cmd_handler_fn * table, void * ctx, const uint8_t * frame, uint32_t len,
+                     uint8_t * out, uint32_t out_size);
+
+int32_t cmd_arg(const cmd_request_t * req, uint8_t type, const uint8_t ** value);
+
+int32_t cmd_arg_u8(const cmd_request_t * req, uint8_t type, uint8_t * value);
+
+int32_t cmd_arg_u32(const cmd_request_t * req, uint8_t type, uint32_t * value);
+
+uint8_t * cmd_reply_reserve(cmd_reply_t * reply, uint8_t type, uint16_t len);
+
+void cmd_reply_u8(cmd_reply_t * reply, uint8_t type, uint8_t value);
+
+void cmd_reply_u32(cmd_reply_t * reply, uint8_t type, uint32_t value);
+
+#endif /* CMD_PROTO_H_ */
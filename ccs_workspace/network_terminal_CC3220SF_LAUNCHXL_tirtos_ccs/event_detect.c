@@ -0,0 +1,112 @@
+/*
+ * event_detect.c
+ */
+
+#include <string.h>
+
+#include "event_detect.h"
+
+#define EVENT_FRAC_BITS     8
+
+/* avg moves 1/2^shift of the way towards in, both in the same fixed-point scale */
+static uint64_t ewma(uint64_t avg, uint64_t in, uint8_t shift)
+{
+    if(in > avg)
+        return avg + ((in - avg) >> shift);
+    return avg - ((avg - in) >> shift);
+}
+
+void event_detect_init(event_detect_t * ed)
+{
+    memset(ed, 0, sizeof(event_detect_t));
+    ed->warmup = EVENT_WARMUP_SAMPLES;
+}
+
+/*
+ * Feeds one accelerometer sample to the detector and returns EVENT_IDLE, EVENT_START, EVENT_ACTIVE or
+ * EVENT_END. On EVENT_START the sample is the newest entry of the pre-trigger history, drain it with
+ * event_detect_pop_history(). On EVENT_ACTIVE and EVENT_END the sample belongs to the event and should be
+ * uploaded by the caller directly.
+ */
+int32_t event_detect_push(event_detect_t * ed, uint32_t ts_us, int16_t x, int16_t y, int16_t z)
+{
+    uint64_t mag2;
+    uint64_t dev;
+    uint64_t on_level;
+    uint64_t off_level;
+    event_sample_t * slot;
+
+    mag2 = ((uint64_t)((int32_t)x * x) + (uint64_t)((int32_t)y * y) + (uint64_t)((int32_t)z * z)) << EVENT_FRAC_BITS;
+
+    if(ed->active)
+    {
+        /* baseline and lta stay frozen for the length of the event */
+        dev = (mag2 > ed->baseline) ? (mag2 - ed->baseline) : (ed->baseline - mag2);
+        ed->sta = ewma(ed->sta, dev, EVENT_STA_SHIFT);
+        ed->event_samples++;
+
+        off_level = (ed->lta * EVENT_OFF_RATIO) >> EVENT_RATIO_SHIFT;
+        if(ed->sta > off_level)
+        {
+            ed->post_left = EVENT_POSTTRIG_SAMPLES;
+            return EVENT_ACTIVE;
+        }
+
+        if(--ed->post_left > 0)
+            return EVENT_ACTIVE;
+
+        ed->active = 0;
+        ed->hist_count = 0;
+        return EVENT_END;
+    }
+
+    /* keep the last EVENT_PRETRIG_SAMPLES samples, oldest overwritten first */
+    slot = &ed->hist[ed->hist_head];
+    slot->ts_us = ts_us;
+    slot->x = x;
+    slot->y = y;
+    slot->z = z;
+    ed->hist_head = (ed->hist_head + 1) % EVENT_PRETRIG_SAMPLES;
+    if(ed->hist_count < EVENT_PRETRIG_SAMPLES)
+        ed->hist_count++;
+
+    if(ed->warmup == EVENT_WARMUP_SAMPLES)
+        ed->baseline = mag2;
+    ed->baseline = ewma(ed->baseline, mag2, EVENT_BASE_SHIFT);
+
+    dev = (mag2 > ed->baseline) ? (mag2 - ed->baseline) : (ed->baseline - mag2);
+    ed->sta = ewma(ed->sta, dev, EVENT_STA_SHIFT);
+    ed->lta = ewma(ed->lta, dev, EVENT_LTA_SHIFT);
+
+    if(ed->warmup > 0)
+    {
+        ed->warmup--;
+        return EVENT_IDLE;
+    }
+
+    on_level = (ed->lta * EVENT_ON_RATIO) >> EVENT_RATIO_SHIFT;
+    if(ed->sta > on_level && ed->sta > ((uint64_t)EVENT_MIN_STA << EVENT_FRAC_BITS))
+    {
+        ed->active = 1;
+        ed->post_left = EVENT_POSTTRIG_SAMPLES;
+        ed->event_samples = 0;
+        return EVENT_START;
+    }
+
+    return EVENT_IDLE;
+}
+
+/* copies out the oldest pre-trigger sample, returns 0 once the history is empty */
+int32_t event_detect_pop_history(event_detect_t * ed, event_sample_t * out)
+{
+    uint16_t tail;
+
+    if(ed->hist_count == 0)
+        return 0;
+
+    tail = (ed->hist_head + EVENT_PRETRIG_SAMPLES - ed->hist_count) % EVENT_PRETRIG_SAMPLES;
+    *out = ed->hist[tail];
+    ed->hist_count--;
+
+    return 1;
+}
@@ -0,0 +1,77 @@
+/*
+ * event_detect.h
+ *
+ *  STA/LTA activity detector on the accelerometer squared magnitude. All arithmetic is integer,
+ *  per sample it costs three multiplies for |a|^2 and a handful of shifts for the averages.
+ *
+ *  dev = | |a|^2 - baseline |     baseline tracks gravity (and slow orientation changes)
+ *  sta = short term average of dev, lta = long term average of dev
+ *
+ *  An event starts when sta > EVENT_ON_RATIO * lta and sta > EVENT_MIN_STA, and ends
+ *  EVENT_POSTTRIG_SAMPLES after sta drops below EVENT_OFF_RATIO * lta. The baseline and lta are frozen
+ *  while an event is active so a long burst of activity doesn't raise its own threshold.
+ *
+ *  While idle every sample goes into a pre-trigger ring so the upload of an event can start
+ *  EVENT_PRETRIG_SAMPLES before the trigger.
+ */
+
+#ifndef EVENT_DETECT_H_
+#define EVENT_DETECT_H_
+
+#include <stdint.h>
+
+#define EVENT_PRETRIG_SAMPLES   256         /* 256 ms of context at the 1 kHz stream rate */
+#define EVENT_POSTTRIG_SAMPLES  512
+#define EVENT_WARMUP_SAMPLES    2048        /* no triggers until the averages have settled */
+
+/* averages are exponential, each shift is log2 of the time constant in samples */
+#define EVENT_BASE_SHIFT        12
+#define EVENT_LTA_SHIFT         10
+#define EVENT_STA_SHIFT         4
+
+/* ratios are Q3, so 32 is 4.0 */
+#define EVENT_RATIO_SHIFT       3
+#define EVENT_ON_RATIO          32
+#define EVENT_OFF_RATIO         12
+
+/* floor on sta in squared raw counts, at 64 LSB/g (BMA222E, 2g range) 256 is roughly a 0.03 g wobble */
+#define EVENT_MIN_STA           256
+
+/* values returned by event_detect_push() */
+#define EVENT_IDLE              0
+#define EVENT_START             1
+#define EVENT_ACTIVE            2
+#define EVENT_END               3
+
+typedef struct
+{
+    uint32_t ts_us;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+}event_sample_t;
+
+typedef struct
+{
+    /* averages carry 8 fraction bits */
+    uint64_t baseline;
+    uint64_t lta;
+    uint64_t sta;
+    uint32_t warmup;
+    uint32_t event_samples;
+    uint16_t post_left;
+    uint8_t active;
+
+    /* pre-trigger history */
+    event_sample_t hist[EVENT_PRETRIG_SAMPLES];
+    uint16_t hist_head;
+    uint16_t hist_count;
+}event_detect_t;
+
+void event_detect_init(event_detect_t * ed);
+
+int32_t event_detect_push(event_detect_t * ed, uint32_t ts_us, int16_t x, int16_t y, int16_t z);
+
+int32_t event_detect_pop_history(event_detect_t * ed, event_sample_t * out);
+
+#endif /* EVENT_DETECT_H_ */
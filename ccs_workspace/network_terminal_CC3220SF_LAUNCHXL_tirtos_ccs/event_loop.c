@@ -0,0 +1,300 @@
+/*
+ * event_loop.c
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <ti/drivers/dpl/HwiP.h>
+
+#include "uart_term.h"
+#include "event_loop.h"
+#include "clock_discipline.h"
+
+void event_loop_init(event_loop_t * el)
+{
+    memset(el, 0, sizeof(event_loop_t));
+    el->wake_sd = -1;
+}
+
+static void event_loop_wake_addr(SlSockAddrIn_t * sAddr)
+{
+    sAddr->sin_family = SL_AF_INET;
+    sAddr->sin_port = sl_Htons(EVENT_LOOP_WAKE_PORT);
+    sAddr->sin_addr.s_addr = sl_Htonl(SL_IPV4_VAL(127,0,0,1));
+}
+
+/* the loopback socket posts wake sl_Select() with, without it posts wait for the next EVENT_LOOP_MAX_WAIT_US */
+static void event_loop_open_wake(event_loop_t * el)
+{
+    SlSockAddrIn_t sAddr;
+    _u32 nonBlocking = 1;
+    _i16 sd;
+
+    sd = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
+    if(sd < 0)
+    {
+        UART_PRINT("[nnaji msg] no event loop wake socket (%i), posts are polled\n\r", sd);
+        return;
+    }
+
+    event_loop_wake_addr(&sAddr);
+    sAddr.sin_addr.s_addr = SL_INADDR_ANY;
+    if(sl_Bind(sd, (SlSockAddr_t *)&sAddr, sizeof(SlSockAddrIn_t)) < 0 ||
+       sl_SetSockOpt(sd, SL_SOL_SOCKET, SL_SO_NONBLOCKING, &nonBlocking, sizeof(nonBlocking)) < 0)
+    {
+        UART_PRINT("[nnaji msg] no event loop wake socket, posts are polled\n\r");
+        sl_Close(sd);
+        return;
+    }
+
+    el->wake_pending = 0;
+    el->wake_sd = sd;
+}
+
+static void event_loop_close_wake(event_loop_t * el)
+{
+    _i16 sd = el->wake_sd;
+
+    el->wake_sd = -1;
+    if(sd >= 0)
+        sl_Close(sd);
+}
+
+/* called when sl_Select() reports the wake socket, the posted bits are taken at the top of the loop */
+static void event_loop_drain_wake(event_loop_t * el)
+{
+    uint8_t buf[4];
+
+    el->wake_pending = 0;
+    while(sl_Recv(el->wake_sd, buf, sizeof(buf), 0) > 0)
+        ;
+}
+
+int32_t event_loop_add_socket(event_loop_t * el, _i16 sd, event_sock_fn fn, void * arg)
+{
+    if(sd < 0 || fn == NULL || el->nsocks >= EVENT_LOOP_MAX_SOCKETS)
+        return(-1);
+
+    el->socks[el->nsocks].sd = sd;
+    el->socks[el->nsocks].fn = fn;
+    el->socks[el->nsocks].arg = arg;
+    el->nsocks++;
+
+    return(0);
+}
+
+/* safe to call from a socket handler, e.g. when its peer closed the connection */
+int32_t event_loop_remove_socket(event_loop_t * el, _i16 sd)
+{
+    uint8_t i;
+
+    for(i=0;i<el->nsocks;i++)
+    {
+        if(el->socks[i].sd != sd)
+            continue;
+
+        el->nsocks--;
+        memmove(&el->socks[i], &el->socks[i+1], (el->nsocks - i) * sizeof(event_sock_t));
+        return(0);
+    }
+
+    return(-1);
+}
+
+/* returns the timer index, the first expiry is one period from now */
+int32_t event_loop_add_timer(event_loop_t * el, uint32_t period_us, event_timer_fn fn, void * arg)
+{
+    if(period_us == 0 || fn == NULL || el->ntimers >= EVENT_LOOP_MAX_TIMERS)
+        return(-1);
+
+    el->timers[el->ntimers].period_us = period_us;
+    el->timers[el->ntimers].next_us = clock_discipline_local_us() + period_us;
+    el->timers[el->ntimers].fn = fn;
+    el->timers[el->ntimers].arg = arg;
+
+    return el->ntimers++;
+}
+
+void event_loop_set_post_handler(event_loop_t * el, event_post_fn fn, void * arg)
+{
+    el->post_fn = fn;
+    el->post_arg = arg;
+}
+
+/*
+ * Callable from any task or interrupt, bits accumulate until the loop hands them to the post handler. The
+ * first post from a task since the loop last woke up sends it a wake datagram.
+ */
+void event_loop_post(event_loop_t * el, uint32_t bits)
+{
+    SlSockAddrIn_t sAddr;
+    uintptr_t key;
+    uint8_t wake;
+    _i16 sd;
+
+    key = HwiP_disable();
+    el->posted |= bits;
+    sd = el->wake_sd;
+    wake = (sd >= 0 && !el->wake_pending && !HwiP_inISR());
+    if(wake)
+        el->wake_pending = 1;
+    HwiP_restore(key);
+
+    if(!wake)
+        return;
+
+    event_loop_wake_addr(&sAddr);
+    if(sl_SendTo(sd, &wake, 1, 0, (SlSockAddr_t *)&sAddr, sizeof(SlSockAddrIn_t)) < 0)
+        el->wake_pending = 0;
+}
+
+void event_loop_stop(event_loop_t * el)
+{
+    el->running = 0;
+}
+
+static uint32_t event_loop_take_posted(event_loop_t * el)
+{
+    uintptr_t key;
+    uint32_t bits;
+
+    key = HwiP_disable();
+    bits = el->posted;
+    el->posted = 0;
+    HwiP_restore(key);
+
+    return bits;
+}
+
+/* runs due timers and returns the time until the next one, capped at EVENT_LOOP_MAX_WAIT_US */
+static uint32_t event_loop_run_timers(event_loop_t * el)
+{
+    uint8_t i;
+    uint32_t now_us;
+    uint32_t wait_us = EVENT_LOOP_MAX_WAIT_US;
+    int32_t left;
+    event_timer_t * t;
+
+    now_us = clock_discipline_local_us();
+
+    for(i=0;i<el->ntimers;i++)
+    {
+        t = &el->timers[i];
+        if((int32_t)(now_us - t->next_us) >= 0)
+        {
+            /* keep the phase unless a whole period was missed, then restart from now */
+            t->next_us += t->period_us;
+            if((int32_t)(now_us - t->next_us) >= 0)
+                t->next_us = now_us + t->period_us;
+
+            el->timer_events++;
+            t->fn(t->arg);
+            now_us = clock_discipline_local_us();
+        }
+
+        left = (int32_t)(t->next_us - now_us);
+        if(left < 0)
+            left = 0;
+        if((uint32_t)left < wait_us)
+            wait_us = left;
+    }
+
+    return wait_us;
+}
+
+int32_t event_loop_run(event_loop_t * el)
+{
+    uint8_t i;
+    uint32_t wait_us;
+    uint32_t bits;
+    _i16 nfds;
+    int32_t status;
+    SlFdSet_t readSet;
+    struct SlTimeval_t timeVal;
+    event_sock_t ready[EVENT_LOOP_MAX_SOCKETS];
+    uint8_t nready;
+
+    el->running = 1;
+    event_loop_open_wake(el);
+
+    while(el->running)
+    {
+        el->iterations++;
+
+        wait_us = event_loop_run_timers(el);
+
+        bits = event_loop_take_posted(el);
+        if(bits && el->post_fn != NULL)
+        {
+            el->posts++;
+            el->post_fn(bits, el->post_arg);
+            /* a posted event may have more work behind it, look at sockets without blocking */
+            wait_us = 0;
+        }
+
+        if(el->nsocks == 0 && el->wake_sd < 0)
+        {
+            if(wait_us > 0)
+                usleep(wait_us);
+            continue;
+        }
+
+        SL_SOCKET_FD_ZERO(&readSet);
+        nfds = 0;
+        for(i=0;i<el->nsocks;i++)
+        {
+            SL_SOCKET_FD_SET(el->socks[i].sd, &readSet);
+            if(el->socks[i].sd >= nfds)
+                nfds = el->socks[i].sd + 1;
+        }
+        if(el->wake_sd >= 0)
+        {
+            SL_SOCKET_FD_SET(el->wake_sd, &readSet);
+            if(el->wake_sd >= nfds)
+                nfds = el->wake_sd + 1;
+        }
+
+        timeVal.tv_sec = 0;
+        timeVal.tv_usec = wait_us;
+
+        status = sl_Select(nfds, &readSet, NULL, NULL, &timeVal);
+        if(status < 0)
+        {
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, status,
+                       SL_SOCKET_ERROR);
+            el->running = 0;
+            event_loop_close_wake(el);
+            return(-1);
+        }
+        if(status == 0)
+            continue;
+
+        if(el->wake_sd >= 0 && SL_SOCKET_FD_ISSET(el->wake_sd, &readSet))
+            event_loop_drain_wake(el);
+
+        /* handlers may remove sockets, so collect the ready ones first */
+        nready = 0;
+        for(i=0;i<el->nsocks;i++)
+        {
+            if(SL_SOCKET_FD_ISSET(el->socks[i].sd, &readSet))
+                ready[nready++] = el->socks[i];
+        }
+
+        for(i=0;i<nready;i++)
+        {
+            el->socket_events++;
+            ready[i].fn(ready[i].sd, ready[i].arg);
+        }
+    }
+
+    event_loop_close_wake(el);
+
+    return(0);
+}
+
+void event_loop_report(event_loop_t * el)
+{
+    UART_PRINT("[nnaji msg] event loop: %u iterations, %u socket, %u timer and %u posted events\n\r",
+               el->iterations, el->socket_events, el->timer_events, el->posts);
+}
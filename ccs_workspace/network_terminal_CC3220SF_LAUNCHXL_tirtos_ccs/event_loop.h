@@ -0,0 +1,87 @@
+/*
+ * event_loop.h
+ *
+ *  Single threaded event loop. One sl_Select() waits on every registered socket, bounded by the next
+ *  software timer deadline, so sockets, timers and event bits posted from other tasks or interrupts are
+ *  all served from one thread without busy waiting.
+ *
+ *  A post from a task sends one datagram to the loop's own loopback socket, which wakes sl_Select() right
+ *  away. Posts from interrupts can't touch the network, and neither can any post when the wake socket
+ *  couldn't be opened; those bits wait for the next wake-up, which is at most EVENT_LOOP_MAX_WAIT_US away.
+ *
+ *  Handlers run on the loop thread and must not block, a socket handler is only called when its
+ *  socket is readable so one sl_Recv() in it returns immediately.
+ */
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <stdint.h>
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+#define EVENT_LOOP_MAX_SOCKETS      6
+#define EVENT_LOOP_MAX_TIMERS       4
+#define EVENT_LOOP_MAX_WAIT_US      10000       /* latency bound of a post that couldn't wake the loop */
+#define EVENT_LOOP_WAKE_PORT        10020       /* loopback port of the wake socket */
+
+typedef void (*event_sock_fn)(_i16 sd, void * arg);
+typedef void (*event_timer_fn)(void * arg);
+typedef void (*event_post_fn)(uint32_t bits, void * arg);
+
+typedef struct
+{
+    _i16 sd;
+    event_sock_fn fn;
+    void * arg;
+}event_sock_t;
+
+typedef struct
+{
+    uint32_t period_us;
+    uint32_t next_us;
+    event_timer_fn fn;
+    void * arg;
+}event_timer_t;
+
+typedef struct
+{
+    event_sock_t socks[EVENT_LOOP_MAX_SOCKETS];
+    uint8_t nsocks;
+    event_timer_t timers[EVENT_LOOP_MAX_TIMERS];
+    uint8_t ntimers;
+
+    volatile uint32_t posted;
+    event_post_fn post_fn;
+    void * post_arg;
+    _i16 wake_sd;                       /* -1 when posts can't wake the loop */
+    volatile uint8_t wake_pending;      /* a wake datagram is on its way, later posts needn't send another */
+
+    volatile uint8_t running;
+
+    /* counters */
+    uint32_t iterations;
+    uint32_t socket_events;
+    uint32_t timer_events;
+    uint32_t posts;
+}event_loop_t;
+
+void event_loop_init(event_loop_t * el);
+
+int32_t event_loop_add_socket(event_loop_t * el, _i16 sd, event_sock_fn fn, void * arg);
+
+int32_t event_loop_remove_socket(event_loop_t * el, _i16 sd);
+
+int32_t event_loop_add_timer(event_loop_t * el, uint32_t period_us, event_timer_fn fn, void * arg);
+
+void event_loop_set_post_handler(event_loop_t * el, event_post_fn fn, void * arg);
+
+void event_loop_post(event_loop_t * el, uint32_t bits);
+
+void event_loop_stop(event_loop_t * el);
+
+int32_t event_loop_run(event_loop_t * el);
+
+void event_loop_report(event_loop_t * el);
+
+#endif /* EVENT_LOOP_H_ */
@@ -0,0 +1,116 @@
+/*
+ * loadcell_dsp.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "loadcell_dsp.h"
+
+/*
+ * Least squares low-pass for the decimate-by-2 stage, passband to 0.15 fs with the CIC droop (R = 16) inverted,
+ * stopband from 0.3 fs at about -70 dB. Droop is within a few hundredths of a dB of this for any R >= 8.
+ * Make sure this matches FIR_COEFS in util/loadcell_dsp.py.
+ */
+static const int32_t fir_coefs[LC_FIR_TAPS] =
+{
+    11, 18, -38, -93, 55, 284, 26, -626, -379, 1080, 1304, -1462, -3481, 1072, 10695, 15836,
+    10695, 1072, -3481, -1462, 1304, 1080, -379, -626, 26, 284, 55, -93, -38, 18, 11
+};
+
+int32_t loadcell_dsp_init(loadcell_dsp_t * dsp, uint8_t log2_decim, uint8_t out_bits)
+{
+    if(log2_decim < LC_CIC_MIN_LOG2_DECIM || log2_decim > LC_CIC_MAX_LOG2_DECIM)
+        return -1;
+    if(out_bits != 16 && out_bits != 24)
+        return -1;
+
+    memset(dsp, 0, sizeof(loadcell_dsp_t));
+    dsp->log2_decim = log2_decim;
+    dsp->cic_decim = 1 << log2_decim;
+    dsp->out_bits = out_bits;
+
+    /* remove the Q15 coefficient scale and the R^N CIC gain, keeping (out_bits - LC_INPUT_BITS) fraction bits */
+    dsp->out_shift = LC_FIR_COEF_SHIFT + LC_CIC_STAGES * log2_decim - (out_bits - LC_INPUT_BITS);
+
+    return 0;
+}
+
+/*
+ * Feeds one (ADC_1 - ADC_0) raw code difference through the chain. Returns 1 and writes *out when a decimated
+ * output is ready, 0 otherwise. Costs 3 adds per input and 31 multiply-accumulates per output.
+ */
+int32_t loadcell_dsp_push(loadcell_dsp_t * dsp, int32_t diff, int32_t * out)
+{
+    int32_t i;
+    int32_t k;
+    uint32_t v;
+    uint32_t prev;
+    int64_t acc;
+    int64_t max_out;
+
+    /* integrators run at the input rate */
+    dsp->integ[0] += (uint32_t)diff;
+    for(i=1;i<LC_CIC_STAGES;i++)
+        dsp->integ[i] += dsp->integ[i-1];
+
+    if(++dsp->cic_phase < dsp->cic_decim)
+        return 0;
+    dsp->cic_phase = 0;
+
+    /* combs run at the decimated rate */
+    v = dsp->integ[LC_CIC_STAGES-1];
+    for(i=0;i<LC_CIC_STAGES;i++)
+    {
+        prev = dsp->comb[i];
+        dsp->comb[i] = v;
+        v = v - prev;
+    }
+
+    dsp->fir_hist[dsp->fir_idx] = (int32_t)v;
+    dsp->fir_idx = (dsp->fir_idx + 1) % LC_FIR_TAPS;
+
+    if(++dsp->fir_phase < LC_FIR_DECIM)
+        return 0;
+    dsp->fir_phase = 0;
+
+    /* fir_idx now points at the oldest sample, coefficient 0 goes with the newest */
+    acc = 0;
+    k = dsp->fir_idx;
+    for(i=LC_FIR_TAPS-1;i>=0;i--)
+    {
+        acc += (int64_t)fir_coefs[i] * dsp->fir_hist[k];
+        k = (k + 1) % LC_FIR_TAPS;
+    }
+
+    /* round half up, then saturate to the output width */
+    acc = (acc + ((int64_t)1 << (dsp->out_shift - 1))) >> dsp->out_shift;
+    max_out = ((int64_t)1 << (dsp->out_bits - 1)) - 1;
+    if(acc > max_out)
+        acc = max_out;
+    else if(acc < -max_out - 1)
+        acc = -max_out - 1;
+
+    *out = (int32_t)acc;
+    return 1;
+}
+
+/* packs an output value little endian into 2 or 3 bytes, returns the number of bytes written */
+int32_t loadcell_dsp_pack(int32_t value, uint8_t out_bits, uint8_t * buf)
+{
+    buf[0] = (uint8_t)(value);
+    buf[1] = (uint8_t)(value >> 8);
+    if(out_bits == 16)
+        return 2;
+    buf[2] = (uint8_t)(value >> 16);
+    return 3;
+}
+
+/*
+ * Group delay of the chain, from the input that completes an output back to the input it is centered on:
+ * N * (R - 1) / 2 inputs for the CIC and (taps - 1) / 2 CIC outputs of R inputs each for the FIR.
+ */
+uint32_t loadcell_dsp_delay_us(const loadcell_dsp_t * dsp, uint32_t input_period_us)
+{
+    return (LC_CIC_STAGES * (dsp->cic_decim - 1) + (LC_FIR_TAPS - 1) * dsp->cic_decim) * input_period_us / 2;
+}
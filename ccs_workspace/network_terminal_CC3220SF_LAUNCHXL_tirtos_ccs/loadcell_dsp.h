@@ -0,0 +1,51 @@
+/*
+ * loadcell_dsp.h
+ *
+ *  Fixed-point decimation chain for the load cell differential signal:
+ *
+ *      (ADC_1 - ADC_0) raw codes --> 3 stage CIC, decimate by R --> 31 tap FIR, decimate by 2 --> 16/24 bit out
+ *
+ *  The output is the differential reading in ADC codes with (out_bits - LC_INPUT_BITS) fractional bits, so one
+ *  output LSB is 1/8 code at 16 bits and 1/2048 code at 24 bits. The output rate is the ADC pair rate / (2 * R).
+ *  The load cell sensor driver runs it on every read and uploads the packed outputs, adcsinglechannel.c prints
+ *  them.
+ *
+ *  util/loadcell_dsp.py is the host reference implementation of this exact arithmetic; keep the two in sync.
+ */
+
+#ifndef LOADCELL_DSP_H_
+#define LOADCELL_DSP_H_
+
+#include <stdint.h>
+
+#define LC_INPUT_BITS           13      /* difference of two 12 bit conversions, signed */
+#define LC_CIC_STAGES           3
+#define LC_CIC_MIN_LOG2_DECIM   1
+#define LC_CIC_MAX_LOG2_DECIM   6       /* 13 + 3 * 6 = 31 bits, the CIC output still fits an int32 */
+#define LC_FIR_TAPS             31
+#define LC_FIR_DECIM            2
+#define LC_FIR_COEF_SHIFT       15      /* coefficients are Q15 and sum to 1.0 */
+
+typedef struct
+{
+    uint32_t integ[LC_CIC_STAGES];      /* integrators wrap modulo 2^32, the combs undo the wrap */
+    uint32_t comb[LC_CIC_STAGES];
+    int32_t fir_hist[LC_FIR_TAPS];
+    uint16_t cic_decim;
+    uint16_t cic_phase;
+    uint8_t log2_decim;
+    uint8_t fir_idx;
+    uint8_t fir_phase;
+    uint8_t out_bits;
+    uint8_t out_shift;
+}loadcell_dsp_t;
+
+int32_t loadcell_dsp_init(loadcell_dsp_t * dsp, uint8_t log2_decim, uint8_t out_bits);
+
+int32_t loadcell_dsp_push(loadcell_dsp_t * dsp, int32_t diff, int32_t * out);
+
+int32_t loadcell_dsp_pack(int32_t value, uint8_t out_bits, uint8_t * buf);
+
+uint32_t loadcell_dsp_delay_us(const loadcell_dsp_t * dsp, uint32_t input_period_us);
+
+#endif /* LOADCELL_DSP_H_ */
@@ -0,0 +1,134 @@
+/*
+ * lz_compress.c
+ */
+
+#include <string.h>
+
+#include "lz_compress.h"
+
+/* Cortex-M4 cycle counter, for the cycles per KB figure printed after every compressed upload */
+#define LZ_DEMCR                (*(volatile uint32_t *)0xE000EDFC)
+#define LZ_DWT_CTRL             (*(volatile uint32_t *)0xE0001000)
+#define LZ_DWT_CYCCNT           (*(volatile uint32_t *)0xE0001004)
+
+static uint32_t lzCyclesStart;
+
+static uint32_t lz_hash(const uint8_t * p)
+{
+    return ((((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static int32_t lz_flush(lz_state_t * state, lz_write_fn write, void * arg)
+{
+    int32_t status = 0;
+
+    if(state->out_len != 0)
+        status = write(arg, state->out, state->out_len);
+    state->total += state->out_len;
+    state->out_len = 0;
+
+    return status;
+}
+
+/*
+ * Compresses len bytes of in, handing the stream to write in pieces of up to LZ_OUT_SIZE bytes. Returns the
+ * compressed length, or the write callback's error, or -1 when the input is too long.
+ */
+int32_t lz_compress(lz_state_t * state, const uint8_t * in, uint32_t len, lz_write_fn write, void * arg)
+{
+    uint32_t pos = 0;
+    uint32_t ctrl_pos = 0;
+    uint32_t item = 0;
+    uint32_t cand;
+    uint32_t offset = 0;
+    uint32_t best_len;
+    uint32_t max_len;
+    uint32_t h;
+    uint32_t i;
+    int32_t status;
+
+    if(len > LZ_MAX_INPUT)
+        return(-1);
+
+    memset(state->table, 0, sizeof(state->table));
+    state->out_len = 0;
+    state->total = 0;
+
+    while(1)
+    {
+        /* a group is a control byte and up to 8 two byte items, it never straddles a flush */
+        if(item == 0)
+        {
+            if(state->out_len + 17 > LZ_OUT_SIZE)
+            {
+                status = lz_flush(state, write, arg);
+                if(status < 0)
+                    return status;
+            }
+            ctrl_pos = state->out_len++;
+            state->out[ctrl_pos] = 0;
+        }
+
+        if(pos >= len)
+        {
+            /* end of stream marker, a match with offset 0 */
+            state->out[ctrl_pos] |= 1 << item;
+            state->out[state->out_len++] = 0;
+            state->out[state->out_len++] = 0;
+            break;
+        }
+
+        best_len = 0;
+        if(pos + LZ_MIN_MATCH <= len)
+        {
+            h = lz_hash(&in[pos]);
+            cand = state->table[h];
+            state->table[h] = pos + 1;
+
+            if(cand != 0 && pos - (cand - 1) <= LZ_MAX_OFFSET)
+            {
+                cand--;
+                max_len = (len - pos < LZ_MAX_MATCH) ? len - pos : LZ_MAX_MATCH;
+                while(best_len < max_len && in[cand + best_len] == in[pos + best_len])
+                    best_len++;
+                offset = pos - cand;
+            }
+        }
+
+        if(best_len >= LZ_MIN_MATCH)
+        {
+            state->out[ctrl_pos] |= 1 << item;
+            state->out[state->out_len++] = ((offset >> 8) << 4) | (best_len - LZ_MIN_MATCH);
+            state->out[state->out_len++] = offset & 0xFF;
+
+            /* the positions inside the match can start later matches too */
+            for(i=1;i<best_len && pos + i + LZ_MIN_MATCH <= len;i++)
+                state->table[lz_hash(&in[pos + i])] = pos + i + 1;
+            pos += best_len;
+        }
+        else
+        {
+            state->out[state->out_len++] = in[pos++];
+        }
+
+        item = (item + 1) & 7;
+    }
+
+    status = lz_flush(state, write, arg);
+    if(status < 0)
+        return status;
+
+    return state->total;
+}
+
+void lz_cycles_start()
+{
+    LZ_DEMCR |= (1 << 24);                      /* TRCENA */
+    LZ_DWT_CTRL |= 1;                           /* CYCCNTENA */
+    lzCyclesStart = LZ_DWT_CYCCNT;
+}
+
+uint32_t lz_cycles_elapsed()
+{
+    return LZ_DWT_CYCCNT - lzCyclesStart;
+}
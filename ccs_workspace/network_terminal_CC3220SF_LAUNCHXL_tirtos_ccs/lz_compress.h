@@ -0,0 +1,49 @@
+/*
+ * lz_compress.h
+ *
+ *  Small LZSS compressor for upload payloads. The input has to be in RAM as a whole (it is Tx_data or a
+ *  spill log segment read into it) and serves as the window, so the only state is a hash table of the last
+ *  position of every 3 byte prefix and a small output buffer that is handed to a write callback whenever it
+ *  fills. Both sit in one MEM_POOL_LZ block.
+ *
+ *  Stream format, decoded by board_communication/lz.py:
+ *      a control byte, then up to 8 items, bit i of the control byte (LSB first) tells item i's type
+ *      0: one literal byte
+ *      1: a match, 2 bytes: offset bits 11..8 in the high nibble and (length - LZ_MIN_MATCH) in the low nibble
+ *         of the first byte, offset bits 7..0 in the second; it copies length bytes starting offset bytes back
+ *      a match with offset 0 ends the stream
+ *
+ *  On the wire a compressed upload chunk is "lz,<uncompressed length>|" followed by the stream.
+ */
+
+#ifndef LZ_COMPRESS_H_
+#define LZ_COMPRESS_H_
+
+#include <stdint.h>
+
+#define LZ_MIN_MATCH            3
+#define LZ_MAX_MATCH            (LZ_MIN_MATCH + 15)
+#define LZ_MAX_OFFSET           4095
+#define LZ_HASH_BITS            10
+#define LZ_HASH_SIZE            (1 << LZ_HASH_BITS)
+#define LZ_OUT_SIZE             512
+#define LZ_MAX_INPUT            65535           /* positions are kept in 16 bits */
+
+typedef struct
+{
+    uint16_t table[LZ_HASH_SIZE];               /* last position + 1 of each hashed prefix, 0 for none */
+    uint8_t out[LZ_OUT_SIZE];
+    uint32_t out_len;
+    uint32_t total;
+}lz_state_t;
+
+/* returns 0 or a negative error, which aborts the compression */
+typedef int32_t (*lz_write_fn)(void * arg, const uint8_t * buf, uint32_t len);
+
+int32_t lz_compress(lz_state_t * state, const uint8_t * in, uint32_t len, lz_write_fn write, void * arg);
+
+void lz_cycles_start();
+
+uint32_t lz_cycles_elapsed();
+
+#endif /* LZ_COMPRESS_H_ */
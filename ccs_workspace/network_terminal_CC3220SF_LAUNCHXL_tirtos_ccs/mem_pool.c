@@ -0,0 +1,196 @@
+/*
+ * mem_pool.c
+ */
+
+#include <stddef.h>
+
+#include <xdc/std.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/drivers/dpl/HwiP.h>
+
+#include "uart_term.h"
+#include "network_terminal.h"
+#include "ap_connection.h"
+#include "lz_compress.h"
+#include "mem_pool.h"
+
+#define MEM_POOL_NONE           0xFF
+#define MEM_POOL_USED           0xFE            /* free list link of a block that is handed out */
+
+/* name, block size in bytes, number of blocks (at most MEM_POOL_USED), in the order of the ids in mem_pool.h */
+#define MEM_POOLS(X)                                                                    \
+    X(NET_FRAME,    MAX_RX_PACKET_SIZE,         1)  /* the command thread's receive frame */ \
+    X(CAPTURE,      sizeof(ts_capture_t),       1)                                      \
+    X(LOG,          MEM_LOG_BLOCK_SIZE,         4)                                      \
+    X(LZ,           sizeof(lz_state_t),         1)
+
+/* name, buffer: the big buffers that are not pool blocks */
+#define MEM_FIXED(X)                                                                    \
+    X(TX_DATA,      Tx_data)                    /* the upload being built */            \
+    X(APP_DATA,     app_CB.gDataBuffer)         /* the SDK socket commands' buffer */
+
+#define MEM_POOL_BUDGET_BYTES   49152
+
+#define MEM_POOL_BYTES(name, size, count)   + ((((size) + 3) & ~3) * (count))
+#define MEM_FIXED_BYTES(name, buf)          + sizeof(buf)
+#define MEM_POOL_TOTAL_BYTES                (0 MEM_POOLS(MEM_POOL_BYTES) MEM_FIXED(MEM_FIXED_BYTES))
+
+/* fails to compile when the pools and fixed buffers grow past the budget */
+typedef char mem_pool_budget_check[(MEM_POOL_TOTAL_BYTES <= MEM_POOL_BUDGET_BYTES) ? 1 : -1];
+
+/* and when a pool id in mem_pool.h has no entry in MEM_POOLS, or the other way around */
+#define MEM_POOL_ENTRY_COUNT(name, size, count)     + 1
+typedef char mem_pool_count_check[((0 MEM_POOLS(MEM_POOL_ENTRY_COUNT)) == MEM_POOL_COUNT) ? 1 : -1];
+
+typedef struct
+{
+    const char * name;
+    uint8_t * mem;
+    uint8_t * next;                             /* free list, next[i] follows block i */
+    uint32_t block_size;
+    uint8_t count;
+    uint8_t head;
+    uint8_t in_use;
+    uint8_t high;
+    uint32_t failures;
+}mem_pool_t;
+
+typedef struct
+{
+    const char * name;
+    uint32_t size;
+}mem_fixed_t;
+
+/* word aligned storage and free list links of every pool */
+#define MEM_POOL_STORAGE(name, size, count)                                             \
+    static uint32_t memPool##name[((((size) + 3) & ~3) * (count)) / 4];                 \
+    static uint8_t memPoolNext##name[count];
+
+MEM_POOLS(MEM_POOL_STORAGE)
+
+#define MEM_POOL_ENTRY(name, size, count)                                               \
+    [MEM_POOL_##name] = { #name, (uint8_t *)memPool##name, memPoolNext##name, ((size) + 3) & ~3, count, 0, 0, 0, 0 },
+
+static mem_pool_t memPools[MEM_POOL_COUNT] = { MEM_POOLS(MEM_POOL_ENTRY) };
+
+#define MEM_FIXED_ENTRY(name, buf)          { #name, sizeof(buf) },
+
+static const mem_fixed_t memFixed[] = { MEM_FIXED(MEM_FIXED_ENTRY) };
+
+static uint8_t memPoolReady = 0;
+
+void mem_pool_init()
+{
+    uint8_t i;
+    uint8_t j;
+
+    for(i=0;i<MEM_POOL_COUNT;i++)
+    {
+        for(j=0;j<memPools[i].count;j++)
+            memPools[i].next[j] = (j + 1 < memPools[i].count) ? j + 1 : MEM_POOL_NONE;
+        memPools[i].head = 0;
+        memPools[i].in_use = 0;
+    }
+    memPoolReady = 1;
+}
+
+/* returns NULL when the pool is empty, callers keep a fallback or report the failure */
+void * mem_pool_alloc(uint8_t pool)
+{
+    uintptr_t key;
+    mem_pool_t * p;
+    uint8_t block;
+
+    if(pool >= MEM_POOL_COUNT || !memPoolReady)
+        return NULL;
+    p = &memPools[pool];
+
+    key = HwiP_disable();
+    block = p->head;
+    if(block == MEM_POOL_NONE)
+    {
+        p->failures++;
+        HwiP_restore(key);
+        return NULL;
+    }
+    p->head = p->next[block];
+    p->next[block] = MEM_POOL_USED;
+    p->in_use++;
+    if(p->in_use > p->high)
+        p->high = p->in_use;
+    HwiP_restore(key);
+
+    return &p->mem[block * p->block_size];
+}
+
+void mem_pool_free(uint8_t pool, void * block)
+{
+    uintptr_t key;
+    mem_pool_t * p;
+    uint32_t ofs;
+    uint8_t idx;
+
+    if(pool >= MEM_POOL_COUNT || block == NULL)
+        return;
+    p = &memPools[pool];
+
+    ofs = (uint8_t *)block - p->mem;
+    if(ofs >= p->block_size * p->count || ofs % p->block_size != 0)
+    {
+        UART_PRINT("[nnaji msg] mem pool %s: bad free %p\n\r", p->name, block);
+        return;
+    }
+
+    idx = ofs / p->block_size;
+    key = HwiP_disable();
+    if(p->next[idx] != MEM_POOL_USED)
+    {
+        HwiP_restore(key);
+        UART_PRINT("[nnaji msg] mem pool %s: double free %p\n\r", p->name, block);
+        return;
+    }
+    p->next[idx] = p->head;
+    p->head = idx;
+    p->in_use--;
+    HwiP_restore(key);
+}
+
+uint32_t mem_pool_block_size(uint8_t pool)
+{
+    if(pool >= MEM_POOL_COUNT)
+        return 0;
+    return memPools[pool].block_size;
+}
+
+void mem_pool_report()
+{
+    uint8_t i;
+
+    UART_PRINT("[nnaji msg] mem pools: %u of %u bytes budgeted\n\r", (uint32_t)MEM_POOL_TOTAL_BYTES,
+               MEM_POOL_BUDGET_BYTES);
+    for(i=0;i<sizeof(memFixed)/sizeof(memFixed[0]);i++)
+        UART_PRINT("[nnaji msg] mem fixed %s: %u bytes\n\r", memFixed[i].name, memFixed[i].size);
+    for(i=0;i<MEM_POOL_COUNT;i++)
+        UART_PRINT("[nnaji msg] mem pool %s: %u x %u bytes, %u in use, %u max, %u failed\n\r", memPools[i].name,
+                   memPools[i].count, memPools[i].block_size, memPools[i].in_use, memPools[i].high,
+                   memPools[i].failures);
+}
+
+/* stack high water marks, the kernel fills every stack with a known pattern and Task_stat() scans it */
+void mem_stack_report()
+{
+    Task_Handle task;
+    Task_Stat stat;
+    Hwi_StackInfo hwiInfo;
+
+    for(task = Task_Object_first(); task != NULL; task = Task_Object_next(task))
+    {
+        Task_stat(task, &stat);
+        UART_PRINT("[nnaji msg] stack %p (priority %i): %u of %u bytes used\n\r", task, stat.priority, stat.used,
+                   stat.stackSize);
+    }
+
+    Hwi_getStackInfo(&hwiInfo, TRUE);
+    UART_PRINT("[nnaji msg] stack hwi: %u of %u bytes used\n\r", hwiInfo.hwiStackPeak, hwiInfo.hwiStackSize);
+}
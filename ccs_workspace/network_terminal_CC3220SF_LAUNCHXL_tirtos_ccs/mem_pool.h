@@ -0,0 +1,46 @@
+/*
+ * mem_pool.h
+ *
+ *  Compile time memory budget. Every large buffer the node needs is a block of one of the named pools below,
+ *  allocated statically, so the RAM they take is fixed at link time, shows up in the map file and is checked
+ *  against MEM_POOL_BUDGET_BYTES (mem_pool.c) when compiling instead of failing at run time. The few big buffers
+ *  that stay plain globals, like Tx_data, are listed next to the pools and count against the same budget.
+ *  Blocks are handed out by a fixed block allocator (constant time, interrupt safe, no fragmentation) instead
+ *  of malloc and of large arrays on the task stacks. Freeing a block twice, or one the pool never handed out,
+ *  is reported and ignored.
+ *
+ *  mem_pool_report() prints the use and high water mark of every pool, mem_stack_report() the high water mark
+ *  of every task stack and of the interrupt stack, which is what THREADSTACKSIZE and the pool counts in
+ *  mem_pool.c should be sized with.
+ */
+
+#ifndef MEM_POOL_H_
+#define MEM_POOL_H_
+
+#include <stdint.h>
+
+#define MEM_LOG_BLOCK_SIZE      256             /* Report() lines, longer ones fall back to the heap */
+
+/* pool ids, mem_pool.c sizes every one of them in its MEM_POOLS table */
+enum
+{
+    MEM_POOL_NET_FRAME,                         /* 802.11 frames from the RF socket */
+    MEM_POOL_CAPTURE,                           /* beacon timestamps between uploads */
+    MEM_POOL_LOG,                               /* Report() format buffers */
+    MEM_POOL_LZ,                                /* upload compressor state */
+    MEM_POOL_COUNT
+};
+
+void mem_pool_init();
+
+void * mem_pool_alloc(uint8_t pool);
+
+void mem_pool_free(uint8_t pool, void * block);
+
+uint32_t mem_pool_block_size(uint8_t pool);
+
+void mem_pool_report();
+
+void mem_stack_report();
+
+#endif /* MEM_POOL_H_ */
@@ -67,6 +67,11 @@
 
 /* custom header files */
 #include "ap_connection.h"
+#include "boot_profile.h"
+#include "sensor.h"
+#include "clock_discipline.h"
+#include "mem_pool.h"
+#include "spill_log.h"
 
 /* Application defines */
 #define SIX_BYTES_SIZE_MAC_ADDRESS  (17)
@@ -1792,6 +1797,8 @@ void * mainThread(void *arg)
     pthread_attr_t      pAttrs_spawn;
     struct sched_param  priParam;
     struct timespec     ts = {0};
+    const boot_profile_t * profile;
+    uint16_t            portForTX = 0;
 
     /* for on-board accelerometer */
     I2C_Handle      i2c;
@@ -1808,6 +1815,9 @@ void * mainThread(void *arg)
     /* Init Application variables */
     RetVal = initAppVariables();
 
+    /* static buffer pools, before anything prints */
+    mem_pool_init();
+
     /* Init Terminal UART */
     InitTerm();
 
@@ -1866,6 +1876,21 @@ void * mainThread(void *arg)
 
     /* sl_Start returns on success the role that device started on */
     app_CB.Role = RetVal;
+    boot_phase_mark(BOOT_PHASE_SL_START);
+
+    /* local time on the system clock, before anything takes a timestamp the discipline corrects */
+    clock_discipline_local_start();
+
+    /* role, sensors, rates, AP and filters for this board, defaults when there is no profile file */
+    boot_profile_load();
+    profile = boot_profile_get();
+    sensor_set_mask(profile->sensors);
+    if(sensor_set_period(profile->sensors, profile->sample_period_us) != 0)
+        UART_PRINT("[nnaji msg] sample period %u us is not a multiple of %u us, sensors keep their defaults\n\r",
+                   profile->sample_period_us, SENSOR_TICK_US);
+
+    /* uploads that could not be delivered before the last reset are replayed on the next connection */
+    spill_log_init();
 
     /* disable the soft-roaming */
     cmdSoftRoamingDisablecallback(NULL);
@@ -1878,19 +1903,27 @@ void * mainThread(void *arg)
         UART_PRINT("sl_NetAppMDNSUnRegisterService failed - %d\n\r",RetVal);
         return(NULL);
     }
-    /* Output device information to the UART terminal */
-    RetVal = DisplayAppBanner(APPLICATION_NAME, APPLICATION_VERSION);
-
-    if(RetVal < 0)
+    /* the banner and the command table take a while at 115200 baud, headless boards skip them */
+    if(!boot_profile_headless())
     {
-        /* Handle Error */
-        UART_PRINT(
-            "Network Terminal - Unable to retrieve device information \n\r");
-        return(NULL);
-    }
+        /* Output device information to the UART terminal */
+        RetVal = DisplayAppBanner(APPLICATION_NAME, APPLICATION_VERSION);
 
-    /* Display Network Terminal API commands */
-    showAvailableCmd();
+        if(RetVal < 0)
+        {
+            /* Handle Error */
+            UART_PRINT(
+                "Network Terminal - Unable to retrieve device information \n\r");
+            return(NULL);
+        }
+
+        /* Display Network Terminal API commands */
+        showAvailableCmd();
+
+        /* RAM budget and stack use so far, test_time_beac_sync() repeats them after its uploads */
+        mem_pool_report();
+        mem_stack_report();
+    }
 
     //////////////////
 //    struct timespec ts2;
@@ -1934,20 +1967,62 @@ void * mainThread(void *arg)
     /* test transmitting packets continuously to AP */
 //    transmit_data_forever_test(portForTX);
 
-    /* test time drift */
-//    time_drift_test(portForTX);
-//    time_drift_test_l3(portForTX);
-//    time_drift_test_l2();
+    /* stream accelerometer samples in batched UDP datagrams to AP */
+//    stream_accel_udp(portForTX);
+//    stream_accel_events_udp(portForTX);
 
-    //tx_accelerometer(0);
+    /* sample every sensor in the boot profile's mask from one timer driven task */
+//    stream_sensors_udp(portForTX);
 
-    test_time_beac_sync();
+    /* serve the control, broadcast and upload sockets (connected) or beacons and sampling (transceiver
+     * mode) from one event loop instead of one blocking test at a time */
+//    event_loop_connected(portForTX);
+//    event_loop_beacons();
+//    track_multi_ap();
 
-    /*
-     * Calling UART handling method which serves as the application main loop.
-     * Note that this function doesn't return.
-     */
-    //RetVal = cmd_prompt(NULL);
+    /* the modes that upload over UDP / TCP need the AP connection and a port first */
+    if(profile->role >= BOOT_ROLE_STREAM_ACCEL)
+    {
+        if(connectToAP() < 0)
+        {
+            UART_PRINT("Exiting Program");
+            return(NULL);
+        }
+        portForTX = get_port_for_data_tx();
+    }
+
+    switch(profile->role)
+    {
+    case BOOT_ROLE_BEACON_SYNC:
+        test_time_beac_sync();
+        break;
+    case BOOT_ROLE_TX_ACCEL:
+    case BOOT_ROLE_EVENT_LOOP_BEACONS:
+        event_loop_beacons();
+        break;
+    case BOOT_ROLE_TRACK_MULTI_AP:
+        track_multi_ap();
+        break;
+    case BOOT_ROLE_STREAM_ACCEL:
+        stream_accel_udp(portForTX);
+        break;
+    case BOOT_ROLE_STREAM_EVENTS:
+        stream_accel_events_udp(portForTX);
+        break;
+    case BOOT_ROLE_STREAM_SENSORS:
+        stream_sensors_udp(portForTX);
+        break;
+    case BOOT_ROLE_EVENT_LOOP_CONNECTED:
+        event_loop_connected(portForTX);
+        break;
+    default:
+        /*
+         * Calling UART handling method which serves as the application main loop.
+         * Note that this function doesn't return.
+         */
+        RetVal = cmd_prompt(NULL);
+        break;
+    }
 
     UART_PRINT("Exiting Program");
 
@@ -0,0 +1,159 @@
+/*
+ * perf_counters.c
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <xdc/std.h>
+#include <xdc/runtime/Memory.h>
+#include <ti/drivers/dpl/HwiP.h>
+
+#include "uart_term.h"
+#include "perf_counters.h"
+
+#define PERF_NAME(name)     #name,
+
+static const char * perfCounterNames[PERF_COUNTER_COUNT] = { PERF_COUNTERS(PERF_NAME) };
+static const char * perfHistNames[PERF_HIST_COUNT] = { PERF_HISTOGRAMS(PERF_NAME) };
+
+static uint32_t perfCounters[PERF_COUNTER_COUNT];
+static uint32_t perfHists[PERF_HIST_COUNT][PERF_HIST_BUCKETS];
+
+static void put_u16(uint8_t * p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+/* safe from any task or interrupt */
+void perf_count(uint8_t id)
+{
+    perf_add(id, 1);
+}
+
+void perf_add(uint8_t id, uint32_t n)
+{
+    uintptr_t key;
+
+    if(id >= PERF_COUNTER_COUNT)
+        return;
+
+    key = HwiP_disable();
+    perfCounters[id] += n;
+    HwiP_restore(key);
+}
+
+void perf_hist(uint8_t id, uint32_t value)
+{
+    uintptr_t key;
+    uint8_t bucket = 0;
+
+    if(id >= PERF_HIST_COUNT)
+        return;
+
+    while(value != 0 && bucket < PERF_HIST_BUCKETS - 1)
+    {
+        value >>= 1;
+        bucket++;
+    }
+
+    key = HwiP_disable();
+    perfHists[id][bucket]++;
+    HwiP_restore(key);
+}
+
+uint32_t perf_get(uint8_t id)
+{
+    if(id >= PERF_COUNTER_COUNT)
+        return 0;
+    return perfCounters[id];
+}
+
+/* writes the binary snapshot, returns its size or -1 if buf is too small */
+int32_t perf_snapshot(uint8_t * buf, uint32_t len)
+{
+    uintptr_t key;
+    uint32_t i;
+    uint32_t j;
+    uint32_t ofs = 16;
+    struct timespec cur_time;
+    Memory_Stats stats;
+
+    if(len < PERF_SNAPSHOT_SIZE)
+        return(-1);
+
+    clock_gettime(CLOCK_REALTIME, &cur_time);
+    Memory_getStats(NULL, &stats);
+
+    put_u16(&buf[0], PERF_MAGIC);
+    buf[2] = PERF_VERSION;
+    buf[3] = PERF_COUNTER_COUNT;
+    buf[4] = PERF_HIST_COUNT;
+    buf[5] = PERF_HIST_BUCKETS;
+    put_u16(&buf[6], 0);
+    put_u32(&buf[8], (uint32_t)cur_time.tv_sec * 1000 + (uint32_t)cur_time.tv_nsec / 1000000);
+    put_u32(&buf[12], stats.totalFreeSize);
+
+    /* one consistent copy, the counters keep moving while it is written out */
+    key = HwiP_disable();
+    for(i=0;i<PERF_COUNTER_COUNT;i++, ofs+=4)
+        put_u32(&buf[ofs], perfCounters[i]);
+    for(i=0;i<PERF_HIST_COUNT;i++)
+        for(j=0;j<PERF_HIST_BUCKETS;j++, ofs+=4)
+            put_u32(&buf[ofs], perfHists[i][j]);
+    HwiP_restore(key);
+
+    return PERF_SNAPSHOT_SIZE;
+}
+
+/* writes "perf,<hex snapshot>|" for the text uploads, returns its length or -1 if buf is too small */
+int32_t perf_to_string(uint8_t * buf, uint32_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint8_t snapshot[PERF_SNAPSHOT_SIZE];
+    uint32_t i;
+    uint32_t n;
+
+    if(len < 5 + 2 * PERF_SNAPSHOT_SIZE + 2)
+        return(-1);
+
+    perf_snapshot(snapshot, sizeof(snapshot));
+
+    memcpy(buf, "perf,", 5);
+    n = 5;
+    for(i=0;i<PERF_SNAPSHOT_SIZE;i++)
+    {
+        buf[n++] = hex[snapshot[i] >> 4];
+        buf[n++] = hex[snapshot[i] & 0x0F];
+    }
+    buf[n++] = '|';
+    buf[n] = 0;
+
+    return n;
+}
+
+void perf_report()
+{
+    uint32_t i;
+    uint32_t j;
+
+    for(i=0;i<PERF_COUNTER_COUNT;i++)
+        UART_PRINT("[nnaji msg] perf %s: %u\n\r", perfCounterNames[i], perfCounters[i]);
+
+    for(i=0;i<PERF_HIST_COUNT;i++)
+    {
+        UART_PRINT("[nnaji msg] perf %s:", perfHistNames[i]);
+        for(j=0;j<PERF_HIST_BUCKETS;j++)
+            UART_PRINT(" %u", perfHists[i][j]);
+        UART_PRINT("\n\r");
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * perf_counters.h
+ *
+ *  Counters and log2 histograms of what a node did between uploads. The lists below are the only place
+ *  a counter is declared, they expand into the ids, the storage and the names, and their order is the
+ *  snapshot layout, so only ever append to them and bump PERF_VERSION when changing them.
+ *
+ *  Snapshot, little endian, PERF_SNAPSHOT_SIZE bytes:
+ *      0   u16  magic PERF_MAGIC
+ *      2   u8   version PERF_VERSION
+ *      3   u8   number of counters
+ *      4   u8   number of histograms
+ *      5   u8   buckets per histogram
+ *      6   u16  reserved
+ *      8   u32  uptime in ms
+ *      12  u32  free heap in bytes
+ *      16  u32  counters[], in PERF_COUNTERS order
+ *      ..  u32  histograms[][PERF_HIST_BUCKETS], in PERF_HISTOGRAMS order
+ *
+ *  Bucket 0 counts values of 0, bucket n counts values in [2^(n-1), 2^n), the last bucket everything above.
+ *  It reaches the host as "perf,<hex>|" in the text uploads, in GET_COUNTERS responses, and as a datagram of
+ *  its own on the sensor upload sockets. board_communication/perf_counters.py decodes it.
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stdint.h>
+
+#define PERF_MAGIC          0x4650      /* "PF" */
+#define PERF_VERSION        4
+#define PERF_HIST_BUCKETS   16
+
+#define PERF_COUNTERS(X)    \
+    X(BEACONS_RX)           \
+    X(BEACONS_MISSED)       \
+    X(RECV_EAGAIN)          \
+    X(QUEUE_OVERFLOWS)      \
+    X(CONNECT_ATTEMPTS)     \
+    X(CONNECT_FAILURES)     \
+    X(SEND_RETRIES)         \
+    X(BYTES_SENT)           \
+    X(UPLOADS)              \
+    X(SAMPLES_DROPPED)      \
+    X(PHASE_STEPS)          \
+    X(PHASE_OUTLIERS)
+
+#define PERF_HISTOGRAMS(X)  \
+    X(UPLOAD_MS)            \
+    X(CONNECT_MS)           \
+    X(SAMPLE_JITTER_US)     \
+    X(PHASE_ERROR_US)
+
+#define PERF_ID(name)       PERF_##name,
+
+enum
+{
+    PERF_COUNTERS(PERF_ID)
+    PERF_COUNTER_COUNT
+};
+
+enum
+{
+    PERF_HISTOGRAMS(PERF_ID)
+    PERF_HIST_COUNT
+};
+
+#define PERF_SNAPSHOT_SIZE  (16 + 4 * PERF_COUNTER_COUNT + 4 * PERF_HIST_COUNT * PERF_HIST_BUCKETS)
+
+void perf_count(uint8_t id);
+
+void perf_add(uint8_t id, uint32_t n);
+
+void perf_hist(uint8_t id, uint32_t value);
+
+uint32_t perf_get(uint8_t id);
+
+int32_t perf_snapshot(uint8_t * buf, uint32_t len);
+
+int32_t perf_to_string(uint8_t * buf, uint32_t len);
+
+void perf_report();
+
+#endif /* PERF_COUNTERS_H_ */
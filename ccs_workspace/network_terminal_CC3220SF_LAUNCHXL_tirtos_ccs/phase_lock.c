@@ -0,0 +1,255 @@
+/*
+ * phase_lock.c
+ */
+
+#include <stdint.h>
+
+#include <ti/drivers/dpl/HwiP.h>
+
+#include "uart_term.h"
+#include "sensor.h"
+#include "clock_discipline.h"
+#include "perf_counters.h"
+#include "phase_lock.h"
+
+#define PHASE_LOCK_NOMINAL_COUNTS   ((CLOCK_DISCIPLINE_SYSCLK_HZ / 1000000) * SENSOR_TICK_US)
+
+/* the newest beacon, written by the beacon receiver and taken by the sensor task on its next tick */
+static volatile uint8_t beaconPending;
+static uint32_t beaconLocalUs;
+static uint64_t beaconTsfUs;
+
+/* beacon receiver only, local time - network processor receive time, smallest of the current and last window */
+static uint8_t offsetValid;
+static uint32_t offsetLastMin;
+static uint32_t offsetCurMin;
+static uint32_t offsetCount;
+
+/* sensor task only */
+static uint8_t acquired;
+static uint64_t gridIndex;                  /* of the tick being serviced, its TSF is gridIndex * SENSOR_TICK_US */
+static uint32_t lastUpdateUs;
+static int64_t integPpb;
+static int32_t ratePpb;                     /* > 0 shortens the tick */
+static uint32_t periodQ16;                  /* tick period in timer counts, 16 fraction bits */
+static uint32_t ditherQ16;
+static uint32_t lastCounts;
+static uint32_t lockedUpdates;
+static int32_t errAvgQ4;                    /* averaged phase error in us, 4 fraction bits */
+static uint32_t outlierRun;
+
+/* statistics */
+static uint32_t updates;
+static uint32_t steps;
+static uint32_t outliers;
+static int32_t lastErrorUs;
+static uint32_t maxLockedErrorUs;
+
+static int64_t phase_lock_clamp(int64_t value, int64_t limit)
+{
+    if(value > limit)
+        return limit;
+    if(value < -limit)
+        return -limit;
+    return value;
+}
+
+/* puts the tick being serviced on the grid point nearest to tsf_us, the sensor task renumbers it */
+static void phase_lock_step(uint64_t tsf_us)
+{
+    gridIndex = (tsf_us + SENSOR_TICK_US / 2) / SENSOR_TICK_US;
+    sensor_set_tick((uint32_t)gridIndex);
+    acquired = 1;
+    lockedUpdates = 0;
+    errAvgQ4 = 0;
+    outlierRun = 0;
+    steps++;
+    perf_count(PERF_PHASE_STEPS);
+}
+
+/* one servo update on the tick at local_us, anchored at the newest beacon */
+static void phase_lock_update(uint32_t anchor_local_us, uint64_t anchor_tsf_us, uint32_t local_us)
+{
+    uint64_t tsf_us;
+    int64_t err_us = 0;
+    uint32_t dt_us;
+    uint32_t abs_err_us;
+    uint32_t abs_avg_us;
+
+    /* the beacon can be stamped a little after the tick that services it */
+    if((int32_t)(local_us - anchor_local_us) >= 0)
+        tsf_us = anchor_tsf_us + clock_discipline_correct(local_us - anchor_local_us);
+    else
+        tsf_us = anchor_tsf_us - clock_discipline_correct(anchor_local_us - local_us);
+
+    if(acquired)
+    {
+        err_us = (int64_t)(tsf_us - gridIndex * SENSOR_TICK_US);
+
+        /* a lone late or misattributed beacon must not move the grid */
+        if(err_us > PHASE_LOCK_GATE_US || err_us < -PHASE_LOCK_GATE_US)
+        {
+            outliers++;
+            perf_count(PERF_PHASE_OUTLIERS);
+            if(++outlierRun < PHASE_LOCK_STEP_CONFIRM)
+                return;
+        }
+        outlierRun = 0;
+    }
+    if(!acquired || err_us > SENSOR_TICK_US / 2 || err_us < -(SENSOR_TICK_US / 2))
+    {
+        if(!acquired)
+            lastUpdateUs = local_us;
+        phase_lock_step(tsf_us);
+        err_us = (int64_t)(tsf_us - gridIndex * SENSOR_TICK_US);
+    }
+
+    dt_us = local_us - lastUpdateUs;
+    if(dt_us > PHASE_LOCK_MAX_DT_US)
+        dt_us = PHASE_LOCK_MAX_DT_US;
+    lastUpdateUs = local_us;
+
+    /* Kp = 1 / tau and Ki = Kp^2 / 4 for critical damping, in ppb per us of phase error */
+    integPpb += (err_us * 1000000000 * dt_us) / (4 * (int64_t)PHASE_LOCK_TAU_US * PHASE_LOCK_TAU_US);
+    integPpb = phase_lock_clamp(integPpb, PHASE_LOCK_MAX_PPB);
+    ratePpb = (int32_t)phase_lock_clamp((err_us * 1000000000) / PHASE_LOCK_TAU_US + integPpb, PHASE_LOCK_MAX_PPB);
+    periodQ16 = (uint32_t)(((int64_t)PHASE_LOCK_NOMINAL_COUNTS << 16) -
+                           (((int64_t)PHASE_LOCK_NOMINAL_COUNTS * ratePpb) << 16) / 1000000000);
+
+    abs_err_us = (err_us < 0) ? -err_us : err_us;
+    lastErrorUs = (int32_t)err_us;
+    updates++;
+    perf_hist(PERF_PHASE_ERROR_US, abs_err_us);
+
+    errAvgQ4 += (((int32_t)err_us << 4) - errAvgQ4) >> PHASE_LOCK_AVG_SHIFT;
+    abs_avg_us = ((errAvgQ4 < 0) ? -errAvgQ4 : errAvgQ4) >> 4;
+    if(abs_avg_us > PHASE_LOCK_LOCKED_US)
+        lockedUpdates = 0;
+    else if(lockedUpdates < PHASE_LOCK_LOCK_UPDATES)
+        lockedUpdates++;
+    else if(abs_avg_us > maxLockedErrorUs)
+        maxLockedErrorUs = abs_avg_us;
+}
+
+/*
+ * The sensor task's timestamp hook, runs once per tick: services a pending beacon, sets the period of the
+ * following ticks and returns this tick's grid TSF, 0 until the first beacon.
+ */
+static uint32_t phase_lock_tick()
+{
+    uint32_t local_us = clock_discipline_local_us();
+    uint32_t anchor_local_us;
+    uint64_t anchor_tsf_us;
+    uint32_t counts;
+    uintptr_t key;
+
+    if(acquired)
+        gridIndex++;
+
+    if(beaconPending)
+    {
+        key = HwiP_disable();
+        anchor_local_us = beaconLocalUs;
+        anchor_tsf_us = beaconTsfUs;
+        beaconPending = 0;
+        HwiP_restore(key);
+
+        phase_lock_update(anchor_local_us, anchor_tsf_us, local_us);
+    }
+
+    if(!acquired)
+        return(0);
+
+    /* whole counts, the fraction is carried over to the next ticks */
+    ditherQ16 += periodQ16 & 0xFFFF;
+    counts = (periodQ16 >> 16) + (ditherQ16 >> 16);
+    ditherQ16 &= 0xFFFF;
+    if(counts != lastCounts)
+    {
+        sensor_set_tick_counts(counts);
+        lastCounts = counts;
+    }
+
+    return (uint32_t)(gridIndex * SENSOR_TICK_US);
+}
+
+/* installs the servo as the sensor task's timestamp hook, call before sensor_start_task() */
+void phase_lock_start()
+{
+    beaconPending = 0;
+    acquired = 0;
+    gridIndex = 0;
+    integPpb = 0;
+    ratePpb = 0;
+    periodQ16 = (uint32_t)PHASE_LOCK_NOMINAL_COUNTS << 16;
+    ditherQ16 = 0;
+    lastCounts = PHASE_LOCK_NOMINAL_COUNTS;
+    lockedUpdates = 0;
+    errAvgQ4 = 0;
+    outlierRun = 0;
+    offsetValid = 0;
+    offsetCount = 0;
+    updates = 0;
+    steps = 0;
+    outliers = 0;
+    lastErrorUs = 0;
+    maxLockedErrorUs = 0;
+
+    sensor_set_timestamp_hook(phase_lock_tick);
+}
+
+void phase_lock_stop()
+{
+    sensor_set_timestamp_hook(NULL);
+    sensor_set_tick_counts(PHASE_LOCK_NOMINAL_COUNTS);
+}
+
+/*
+ * Called for every heard beacon with the network processor's receive time from the RX header, the local time
+ * it was read at and its whole TSF. Only called from one task.
+ */
+void phase_lock_beacon(uint32_t rx_us, uint32_t local_us, uint64_t tsf_us)
+{
+    uint32_t offset = local_us - rx_us;
+    uintptr_t key;
+
+    /* the read delay only adds, so the smallest offset is the closest to the true one */
+    if(!offsetValid)
+    {
+        offsetLastMin = offset;
+        offsetCurMin = offset;
+        offsetCount = 0;
+        offsetValid = 1;
+    }
+    if((int32_t)(offset - offsetCurMin) < 0)
+        offsetCurMin = offset;
+    if(++offsetCount >= PHASE_LOCK_OFFSET_WINDOW)
+    {
+        /* forget old minimums so the two clocks may drift apart slowly */
+        offsetLastMin = offsetCurMin;
+        offsetCurMin = offset;
+        offsetCount = 0;
+    }
+    if((int32_t)(offsetCurMin - offsetLastMin) < 0)
+        offset = offsetCurMin;
+    else
+        offset = offsetLastMin;
+
+    key = HwiP_disable();
+    beaconLocalUs = rx_us + offset;
+    beaconTsfUs = tsf_us;
+    beaconPending = 1;
+    HwiP_restore(key);
+}
+
+uint8_t phase_lock_locked()
+{
+    return (lockedUpdates >= PHASE_LOCK_LOCK_UPDATES);
+}
+
+void phase_lock_report()
+{
+    UART_PRINT("[nnaji msg] phase lock: error %i us (average %i), rate %i ppb, %u updates, %u steps, "
+               "%u outliers, %u us max locked error%s\n\r", lastErrorUs, errAvgQ4 >> 4, ratePpb, updates, steps,
+               outliers, maxLockedErrorUs, phase_lock_locked() ? "" : ", not locked");
+}
@@ -0,0 +1,52 @@
+/*
+ * phase_lock.h
+ *
+ *  Locks the sensor task's tick to the AP's TSF, so tick k of every board in range happens at
+ *  TSF = k * SENSOR_TICK_US and a sensor read every n ticks samples at the same instants on every board.
+ *  Samples are then stamped with their grid TSF and the host can compare boards without resampling.
+ *
+ *  Each heard beacon gives the TSF at a local time. That time comes from the network processor's receive
+ *  timestamp in the frame's RX header, not from when the event loop got around to reading the frame, which
+ *  is up to milliseconds later. The network processor's clock is mapped to the local one with the smallest
+ *  offset (read time - receive time) seen over the last one to two PHASE_LOCK_OFFSET_WINDOWs of beacons,
+ *  the offset of the beacon read with the least delay; what remains is a near constant latency that is the
+ *  same on every board. On the next tick the sensor task carries it forward to the tick
+ *  (clock_discipline_correct()), the difference to the tick's grid TSF is the phase error, and a PI servo
+ *  turns it into a rate correction of the tick period, with a time constant of PHASE_LOCK_TAU_US and
+ *  critical damping. The timer period only has whole 12.5 ns counts (50 ppm of a 250 us tick), so the
+ *  fractional part is dithered over successive ticks. The integral term ends up holding the rate
+ *  difference between the local clock and the AP, the proportional term removes the phase error.
+ *
+ *  An update with an error beyond PHASE_LOCK_GATE_US is counted as an outlier and skipped, unless
+ *  PHASE_LOCK_STEP_CONFIRM of them come in a row. The first beacon, and a confirmed error beyond half a
+ *  tick (a TSF jump, a different AP, a long outage), puts the tick on the nearest grid point instead of
+ *  slewing to it and renumbers it, which is counted as a step. The phase error of every update goes to the
+ *  PHASE_ERROR_US perf histogram, so the lock test uses its average.
+ */
+
+#ifndef PHASE_LOCK_H_
+#define PHASE_LOCK_H_
+
+#include <stdint.h>
+
+#define PHASE_LOCK_TAU_US           2000000     /* servo time constant */
+#define PHASE_LOCK_MAX_PPB          200000      /* rate corrections are clamped to 200 ppm */
+#define PHASE_LOCK_MAX_DT_US        1000000     /* integration step after missed beacons */
+#define PHASE_LOCK_AVG_SHIFT        3           /* the lock test uses the error averaged over about 8 beacons */
+#define PHASE_LOCK_LOCKED_US        10          /* averaged phase error of a locked update */
+#define PHASE_LOCK_LOCK_UPDATES     8           /* locked updates in a row before phase_lock_locked() */
+#define PHASE_LOCK_OFFSET_WINDOW    128         /* beacons per receive time offset window */
+#define PHASE_LOCK_GATE_US          100         /* errors beyond this are outliers */
+#define PHASE_LOCK_STEP_CONFIRM     4           /* outliers in a row that are taken as a real phase jump */
+
+void phase_lock_start();
+
+void phase_lock_stop();
+
+void phase_lock_beacon(uint32_t rx_us, uint32_t local_us, uint64_t tsf_us);
+
+uint8_t phase_lock_locked();
+
+void phase_lock_report();
+
+#endif /* PHASE_LOCK_H_ */
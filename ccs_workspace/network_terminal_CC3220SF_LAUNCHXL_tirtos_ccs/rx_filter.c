@@ -0,0 +1,129 @@
+/*
+ * rx_filter.c
+ */
+
+#include <string.h>
+
+#include "network_terminal.h"
+#include "rx_filter.h"
+
+/* same encodings ParseCreateFilterCmd() uses */
+#define RX_FILTER_FRAME_TYPE_MASK       0x0C
+#define RX_FILTER_FRAME_SUBTYPE_MASK    0xF0
+#define RX_FILTER_EVENT_USER_ID         1
+
+static int32_t rx_filter_add(rx_filter_set_t * set, uint8_t i)
+{
+    const rx_filter_rule_t * r = &set->rules[i];
+    SlWlanRxFilterRuleType_t ruleType = SL_WLAN_RX_FILTER_HEADER;
+    SlWlanRxFilterFlags_u flags;
+    SlWlanRxFilterRule_u rule;
+    SlWlanRxFilterTrigger_t trigger;
+    SlWlanRxFilterAction_t action;
+    int32_t ret;
+
+    memset(&rule, 0, sizeof(rule));
+    memset(&trigger, 0, sizeof(trigger));
+    memset(&action, 0, sizeof(action));
+
+    /* values are compared as binary numbers */
+    flags = SL_WLAN_RX_FILTER_BINARY;
+
+    rule.Header.CompareFunc = r->compare;
+
+    switch(r->field)
+    {
+    case RX_FILTER_FIELD_FRAME_TYPE:
+        rule.Header.Field = SL_WLAN_RX_FILTER_HFIELD_FRAME_TYPE;
+        rule.Header.Args.Value.Frametype[0] = r->value[0] | RX_FILTER_FRAME_TYPE_MASK;
+        break;
+    case RX_FILTER_FIELD_FRAME_SUBTYPE:
+        rule.Header.Field = SL_WLAN_RX_FILTER_HFIELD_FRAME_SUBTYPE;
+        rule.Header.Args.Mask[0] = RX_FILTER_FRAME_SUBTYPE_MASK;
+        rule.Header.Args.Value.FrameSubtype[0] = r->value[0] & RX_FILTER_FRAME_SUBTYPE_MASK;
+        break;
+    case RX_FILTER_FIELD_S_MAC:
+        rule.Header.Field = SL_WLAN_RX_FILTER_HFIELD_MAC_SRC_ADDR;
+        memset(rule.Header.Args.Mask, 0xFF, SL_WLAN_BSSID_LENGTH);
+        memcpy(rule.Header.Args.Value.Mac[0], r->value, SL_WLAN_BSSID_LENGTH);
+        break;
+    case RX_FILTER_FIELD_BSSID:
+        rule.Header.Field = SL_WLAN_RX_FILTER_HFIELD_BSSID;
+        memset(rule.Header.Args.Mask, 0xFF, SL_WLAN_BSSID_LENGTH);
+        memcpy(rule.Header.Args.Value.Bssid[0], r->value, SL_WLAN_BSSID_LENGTH);
+        break;
+    default:
+        UART_PRINT("[nnaji msg] rx filter rule %u has an unknown field %u\n\r", i, r->field);
+        return(-1);
+    }
+
+    /* the '-m L1' trigger: transceiver role, not connected */
+    trigger.ConnectionState = SL_WLAN_RX_FILTER_STATE_STA_NOT_CONNECTED;
+    trigger.Role = SL_WLAN_RX_FILTER_ROLE_TRANCIEVER;
+    trigger.Counter = SL_WLAN_RX_FILTER_NO_TRIGGER_COUNTER;
+    if(r->parent != RX_FILTER_NO_PARENT)
+    {
+        if(r->parent < 0 || r->parent >= i)
+        {
+            UART_PRINT("[nnaji msg] rx filter rule %u must come after its parent\n\r", i);
+            return(-1);
+        }
+        trigger.ParentFilterID = set->ids[r->parent];
+    }
+
+    action.Type = r->action;
+    if(r->action == SL_WLAN_RX_FILTER_ACTION_EVENT_TO_HOST)
+        action.UserId = RX_FILTER_EVENT_USER_ID;
+
+    ret = sl_WlanRxFilterAdd(ruleType, flags, &rule, &trigger, &action, &set->ids[i]);
+    ASSERT_ON_ERROR(ret, WLAN_ERROR);
+
+    return(0);
+}
+
+/* adds the set's rules to the NWP the first time it's called, the filters stay until the NWP restarts */
+int32_t rx_filter_build(rx_filter_set_t * set)
+{
+    uint8_t i;
+    SlWlanRxFilterID_t id;
+
+    if(set->created)
+        return(0);
+
+    if(set->count > RX_FILTER_MAX_RULES)
+        return(-1);
+
+    memset(&set->bitmap, 0, sizeof(set->bitmap));
+
+    for(i=0;i<set->count;i++)
+    {
+        if(rx_filter_add(set, i) < 0)
+            return(-1);
+
+        id = set->ids[i];
+        set->bitmap.FilterBitmap[id / 8] |= 1 << (id % 8);
+    }
+
+    set->created = 1;
+
+    return(0);
+}
+
+/* enables exactly this set's filters, any other filter is disabled */
+int32_t rx_filter_enable(rx_filter_set_t * set)
+{
+    int32_t ret;
+
+    if(!set->created)
+    {
+        ret = rx_filter_build(set);
+        if(ret < 0)
+            return(-1);
+    }
+
+    ret = sl_WlanSet(SL_WLAN_RX_FILTERS_ID, SL_WLAN_RX_FILTER_STATE,
+                     sizeof(SlWlanRxFilterOperationCommandBuff_t), (uint8_t *)&set->bitmap);
+    ASSERT_ON_ERROR(ret, WLAN_ERROR);
+
+    return(0);
+}
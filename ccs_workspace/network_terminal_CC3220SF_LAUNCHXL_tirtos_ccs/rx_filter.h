@@ -0,0 +1,69 @@
+/*
+ * rx_filter.h
+ *
+ *  Transceiver mode RX filters built straight from a table of rules instead of command line strings.
+ *
+ *  rx_filter_build() adds every rule of a set to the NWP once with sl_WlanRxFilterAdd() and keeps the
+ *  filter IDs, later calls are no-ops. rx_filter_enable() then switches the NWP to exactly that set with
+ *  one sl_WlanSet(), so re-entering transceiver mode never goes back through the command parser.
+ *
+ *  Rules are evaluated like the NWP does: a rule with a parent is only looked at when its parent rule
+ *  matched. RX_FILTER_BEACONS_ONLY() is the usual pair for keeping nothing but beacons.
+ */
+
+#ifndef RX_FILTER_H_
+#define RX_FILTER_H_
+
+#include <stdint.h>
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+#define RX_FILTER_MAX_RULES         8
+#define RX_FILTER_NO_PARENT         (-1)
+
+/* header field a rule compares */
+#define RX_FILTER_FIELD_FRAME_TYPE      0
+#define RX_FILTER_FIELD_FRAME_SUBTYPE   1
+#define RX_FILTER_FIELD_S_MAC           2
+#define RX_FILTER_FIELD_BSSID           3
+
+#define RX_FILTER_TYPE_MANAGEMENT       0
+#define RX_FILTER_TYPE_CONTROL          1
+#define RX_FILTER_TYPE_DATA             2
+#define RX_FILTER_SUBTYPE_BEACON        0x80
+
+typedef struct
+{
+    uint8_t field;                  /* RX_FILTER_FIELD_* */
+    uint8_t compare;                /* SL_WLAN_RX_FILTER_CMP_FUNC_* */
+    uint8_t action;                 /* SL_WLAN_RX_FILTER_ACTION_* */
+    int8_t parent;                  /* index of the parent rule in the same table, or RX_FILTER_NO_PARENT */
+    uint8_t value[6];               /* frame type, subtype byte or MAC address */
+}rx_filter_rule_t;
+
+typedef struct
+{
+    const rx_filter_rule_t * rules;
+    uint8_t count;
+    uint8_t created;
+    SlWlanRxFilterID_t ids[RX_FILTER_MAX_RULES];
+    SlWlanRxFilterOperationCommandBuff_t bitmap;
+}rx_filter_set_t;
+
+/* static initializer, e.g. static rx_filter_set_t filters = RX_FILTER_SET(rules); */
+#define RX_FILTER_SET(table)        { (table), sizeof(table) / sizeof((table)[0]) }
+
+/* drops everything that isn't a management frame, then every management frame that isn't a beacon */
+#define RX_FILTER_BEACONS_ONLY(first) \
+    { RX_FILTER_FIELD_FRAME_TYPE, SL_WLAN_RX_FILTER_CMP_FUNC_NOT_EQUAL_TO, SL_WLAN_RX_FILTER_ACTION_DROP, \
+      RX_FILTER_NO_PARENT, { RX_FILTER_TYPE_MANAGEMENT } }, \
+    { RX_FILTER_FIELD_FRAME_TYPE, SL_WLAN_RX_FILTER_CMP_FUNC_EQUAL, SL_WLAN_RX_FILTER_ACTION_NULL, \
+      RX_FILTER_NO_PARENT, { RX_FILTER_TYPE_MANAGEMENT } }, \
+    { RX_FILTER_FIELD_FRAME_SUBTYPE, SL_WLAN_RX_FILTER_CMP_FUNC_NOT_EQUAL_TO, SL_WLAN_RX_FILTER_ACTION_DROP, \
+      (first) + 1, { RX_FILTER_SUBTYPE_BEACON } }
+
+int32_t rx_filter_build(rx_filter_set_t * set);
+
+int32_t rx_filter_enable(rx_filter_set_t * set);
+
+#endif /* RX_FILTER_H_ */
@@ -0,0 +1,405 @@
+/*
+ * sensor.c
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <ti/drivers/Timer.h>
+#include <xdc/std.h>
+#include <xdc/runtime/Timestamp.h>
+#include <xdc/runtime/Types.h>
+
+#include "ti_drivers_config.h"
+#include "uart_term.h"
+#include "sensor.h"
+#include "boot_profile.h"
+#include "perf_counters.h"
+#include "clock_discipline.h"
+
+/* every sensor this image can sample, in this order on a shared tick, the mask picks the ones in use */
+static const sensor_driver_t * const sensor_table[] =
+{
+    &sensor_bma222e,
+    &sensor_loadcell,
+    &sensor_ds3231,
+};
+
+#define SENSOR_TABLE_LEN    (sizeof(sensor_table) / sizeof(sensor_table[0]))
+
+/* one read, handed from the sampling task to the processing task */
+typedef struct
+{
+    const sensor_driver_t * sensor;
+    uint32_t ts_us;
+    int32_t count;
+    uint8_t buf[SENSOR_MAX_BATCH * SENSOR_MAX_SAMPLE_SIZE];
+}sensor_block_t;
+
+static I2C_Handle sensorI2c = NULL;
+static Timer_Handle sensorTimer = NULL;
+static sem_t sensorTickSem;
+static sem_t sensorBlockSem;
+static uint8_t sensorSemsCreated = 0;              /* created on the first start and kept */
+static pthread_t sensorThreads[2];                 /* processing, sampling */
+static uint8_t sensorThreadsCreated = 0;
+static volatile uint32_t sensorTimerTicks;
+static volatile uint8_t sensorRunning;
+static uint32_t sensorTick;                        /* serviced ticks, sampling task only */
+static uint32_t sensorTickOffset;                  /* tick number - sensorTick, see sensor_set_tick() */
+static uint32_t sensorOverruns;
+static uint32_t sensorDropped;
+static sensor_sink_fn sensorSink;
+static sensor_timestamp_fn sensorTimestamp;
+
+/* single producer, single consumer ring, only the sampling task moves head and only the processing task tail */
+static sensor_block_t sensorBlocks[SENSOR_BLOCKS];
+static volatile uint32_t sensorBlockHead;
+static volatile uint32_t sensorBlockTail;
+static uint8_t sensorMask = SENSOR_DEFAULT_MASK;   /* bit n enables the sensor with id n */
+static volatile uint32_t sensorPeriodUs[SENSOR_ID_COUNT];  /* by id, 0 for the driver's default */
+
+/* local time, the clock the beacon timestamps and LOCAL_US are read with */
+static uint32_t sensor_default_timestamp()
+{
+    return clock_discipline_local_us();
+}
+
+static void sensor_timer_callback(Timer_Handle handle, int_fast16_t status)
+{
+    sensorTimerTicks++;
+    sem_post(&sensorTickSem);
+}
+
+/* the BMA222E and the DS3231 share the LaunchPad I2C bus, it is opened once here */
+I2C_Handle sensor_i2c()
+{
+    I2C_Params i2cParams;
+
+    if(sensorI2c != NULL)
+        return sensorI2c;
+
+    I2C_init();
+
+    I2C_Params_init(&i2cParams);
+    i2cParams.bitRate = I2C_400kHz;
+    i2cParams.transferMode = I2C_MODE_BLOCKING;
+    i2cParams.transferCallbackFxn = NULL;
+    sensorI2c = I2C_open(CONFIG_I2C_BMA222E, &i2cParams);
+
+    return sensorI2c;
+}
+
+uint32_t sensor_count()
+{
+    return SENSOR_TABLE_LEN;
+}
+
+const sensor_driver_t * sensor_get(uint32_t index)
+{
+    if(index >= SENSOR_TABLE_LEN)
+        return NULL;
+    return sensor_table[index];
+}
+
+/* sensors left out of the mask are neither initialized nor sampled */
+void sensor_set_mask(uint8_t mask)
+{
+    sensorMask = mask;
+}
+
+/*
+ * Sampling period of every sensor in the mask, 0 restores the drivers' defaults. Returns -1 and changes
+ * nothing when the period is not a multiple of SENSOR_TICK_US. The sampling task picks it up on the next
+ * tick, the stream modes read it once when they start.
+ */
+int32_t sensor_set_period(uint8_t mask, uint32_t period_us)
+{
+    uint32_t id;
+
+    if(period_us % SENSOR_TICK_US != 0)
+        return(-1);
+
+    for(id=0;id<SENSOR_ID_COUNT;id++)
+    {
+        if(mask & (1 << id))
+            sensorPeriodUs[id] = period_us;
+    }
+
+    return(0);
+}
+
+uint32_t sensor_period(const sensor_driver_t * sensor)
+{
+    if(sensor->id < SENSOR_ID_COUNT && sensorPeriodUs[sensor->id] != 0)
+        return sensorPeriodUs[sensor->id];
+    return sensor->default_period_us;
+}
+
+int32_t sensor_init_all()
+{
+    uint32_t i;
+
+    for(i=0;i<SENSOR_TABLE_LEN;i++)
+    {
+        if(!(sensorMask & (1 << sensor_table[i]->id)))
+            continue;
+
+        if(sensor_table[i]->default_period_us % SENSOR_TICK_US != 0 || sensor_table[i]->id >= SENSOR_ID_COUNT ||
+           sensor_table[i]->sample_size > SENSOR_MAX_SAMPLE_SIZE)
+        {
+            UART_PRINT("[nnaji msg] bad table entry for sensor %s\n\r", sensor_table[i]->name);
+            return(-1);
+        }
+
+        if(sensor_table[i]->init() != 0)
+        {
+            UART_PRINT("[nnaji msg] failed to initialize sensor %s\n\r", sensor_table[i]->name);
+            return(-1);
+        }
+
+        UART_PRINT("[nnaji msg] sensor %s every %u us\n\r", sensor_table[i]->name, sensor_period(sensor_table[i]));
+    }
+
+    return(0);
+}
+
+void sensor_set_timestamp_hook(sensor_timestamp_fn fn)
+{
+    sensorTimestamp = (fn != NULL) ? fn : sensor_default_timestamp;
+}
+
+uint32_t sensor_overruns()
+{
+    return sensorOverruns;
+}
+
+/*
+ * Renumbers the tick being serviced, sensors are read on ticks that are a multiple of their divider. Only
+ * called from the timestamp hook, phase_lock.c numbers ticks by their TSF so boards read on the same ticks.
+ */
+void sensor_set_tick(uint32_t tick)
+{
+    sensorTickOffset = tick - sensorTick;
+}
+
+/* period of the following ticks in timer counts, for phase_lock.c */
+int32_t sensor_set_tick_counts(uint32_t counts)
+{
+    if(sensorTimer == NULL)
+        return(-1);
+    return (Timer_setPeriod(sensorTimer, Timer_PERIOD_COUNTS, counts) == Timer_STATUS_SUCCESS) ? 0 : -1;
+}
+
+/* reads lost because the processing task had not freed a block yet */
+uint32_t sensor_dropped()
+{
+    return sensorDropped;
+}
+
+/*
+ * Waits for timer ticks and reads whichever sensors are due into free blocks, nothing else happens here.
+ * A tick that arrives while the previous one is still being serviced is counted as an overrun but still
+ * serviced, so no sensor loses its schedule. The time between two serviced ticks is compared to
+ * SENSOR_TICK_US with the hi-res Timestamp clock and the difference goes to PERF_SAMPLE_JITTER_US.
+ */
+static void * sensor_task(void * arg0)
+{
+    uint32_t i;
+    uint32_t ts_us;
+    uint32_t divider;
+    uint32_t now;
+    uint32_t last = 0;
+    uint32_t period_us;
+    uint32_t ticks_per_us;
+    Types_FreqHz freq;
+    sensor_block_t * block;
+    const sensor_driver_t * sensor;
+
+    Timestamp_getFreq(&freq);
+    ticks_per_us = freq.lo / 1000000;
+
+    while(1)
+    {
+        sem_wait(&sensorTickSem);
+        /* the wake up of sensor_stop_task() is not a tick, nothing is read after it */
+        if(!sensorRunning)
+            break;
+        sensorTick++;
+
+        now = Timestamp_get32();
+        if((int32_t)(sensorTimerTicks - sensorTick) > 0)
+        {
+            sensorOverruns++;
+        }
+        else if(sensorTick > 1)
+        {
+            period_us = (now - last) / ticks_per_us;
+            perf_hist(PERF_SAMPLE_JITTER_US, (period_us > SENSOR_TICK_US) ? period_us - SENSOR_TICK_US :
+                      SENSOR_TICK_US - period_us);
+        }
+        last = now;
+
+        ts_us = sensorTimestamp();
+
+        for(i=0;i<SENSOR_TABLE_LEN;i++)
+        {
+            sensor = sensor_table[i];
+            divider = sensor_period(sensor) / SENSOR_TICK_US;
+            if((sensorTick + sensorTickOffset) % divider != 0 || !(sensorMask & (1 << sensor->id)))
+                continue;
+
+            if(sensorBlockHead - sensorBlockTail >= SENSOR_BLOCKS)
+            {
+                sensorDropped++;
+                perf_count(PERF_SAMPLES_DROPPED);
+                continue;
+            }
+
+            block = &sensorBlocks[sensorBlockHead % SENSOR_BLOCKS];
+            block->count = sensor->read(block->buf, SENSOR_MAX_BATCH);
+            if(block->count > 0)
+            {
+                block->sensor = sensor;
+                block->ts_us = ts_us;
+                sensorBlockHead++;
+                sem_post(&sensorBlockSem);
+            }
+        }
+    }
+
+    return(NULL);
+}
+
+/* runs the sink on every block the sampling task filled, at SENSOR_PROC_PRIORITY */
+static void * sensor_proc_task(void * arg0)
+{
+    sensor_block_t * block;
+
+    while(1)
+    {
+        sem_wait(&sensorBlockSem);
+        if(sensorBlockTail == sensorBlockHead)
+        {
+            if(!sensorRunning)
+                break;
+            continue;
+        }
+
+        block = &sensorBlocks[sensorBlockTail % SENSOR_BLOCKS];
+        boot_phase_mark(BOOT_PHASE_FIRST_SAMPLE);
+        sensorSink(block->sensor, block->ts_us, block->buf, block->count);
+        sensorBlockTail++;
+    }
+
+    return(NULL);
+}
+
+/* joinable, sensor_stop_task() waits for it to return */
+static int32_t sensor_create_task(pthread_t * thread, void * (*fn)(void *), int32_t priority, uint32_t stack_size)
+{
+    pthread_attr_t pAttrs;
+    struct sched_param priParam;
+    int32_t status;
+
+    pthread_attr_init(&pAttrs);
+    priParam.sched_priority = priority;
+    status = pthread_attr_setschedparam(&pAttrs, &priParam);
+    status |= pthread_attr_setstacksize(&pAttrs, stack_size);
+    status |= pthread_attr_setdetachstate(&pAttrs, PTHREAD_CREATE_JOINABLE);
+    if(status == 0)
+        status = pthread_create(thread, &pAttrs, fn, NULL);
+
+    return status;
+}
+
+int32_t sensor_start_task(sensor_sink_fn sink)
+{
+    Timer_Params timerParams;
+
+    if(sink == NULL || sensorRunning || sensorThreadsCreated != 0)
+        return(-1);
+
+    sensorSink = sink;
+    if(sensorTimestamp == NULL)
+        sensorTimestamp = sensor_default_timestamp;
+
+    sensorTimerTicks = 0;
+    sensorTick = 0;
+    sensorTickOffset = 0;
+    sensorOverruns = 0;
+    sensorDropped = 0;
+    sensorBlockHead = 0;
+    sensorBlockTail = 0;
+    if(!sensorSemsCreated)
+    {
+        if(sem_init(&sensorTickSem, 0, 0) != 0 || sem_init(&sensorBlockSem, 0, 0) != 0)
+        {
+            UART_PRINT("[nnaji msg] error creating the sensor semaphores\n\r");
+            return(-1);
+        }
+        sensorSemsCreated = 1;
+    }
+
+    /* ticks and the stop wake ups the last run left behind */
+    while(sem_trywait(&sensorTickSem) == 0);
+    while(sem_trywait(&sensorBlockSem) == 0);
+
+    sensorRunning = 1;
+
+    /* the consumer first, so the first block never waits for it */
+    if(sensor_create_task(&sensorThreads[0], sensor_proc_task, SENSOR_PROC_PRIORITY, SENSOR_PROC_STACK_SIZE) == 0)
+        sensorThreadsCreated |= 0x01;
+    if(sensorThreadsCreated != 0 &&
+       sensor_create_task(&sensorThreads[1], sensor_task, SENSOR_TASK_PRIORITY, SENSOR_TASK_STACK_SIZE) == 0)
+        sensorThreadsCreated |= 0x02;
+    if(sensorThreadsCreated != 0x03)
+    {
+        UART_PRINT("[nnaji msg] error creating the sensor tasks\n\r");
+        sensor_stop_task();
+        return(-1);
+    }
+
+    Timer_init();
+    Timer_Params_init(&timerParams);
+    timerParams.period = SENSOR_TICK_US;
+    timerParams.periodUnits = Timer_PERIOD_US;
+    timerParams.timerMode = Timer_CONTINUOUS_CALLBACK;
+    timerParams.timerCallback = sensor_timer_callback;
+
+    sensorTimer = Timer_open(CONFIG_TIMER_0, &timerParams);
+    if(sensorTimer == NULL || Timer_start(sensorTimer) == Timer_STATUS_ERROR)
+    {
+        UART_PRINT("[nnaji msg] error starting the sensor timer\n\r");
+        sensor_stop_task();
+        return(-1);
+    }
+
+    return(0);
+}
+
+/* returns once both tasks have exited, the processing task finishes the blocks already read first */
+void sensor_stop_task()
+{
+    sensorRunning = 0;
+
+    if(sensorTimer != NULL)
+    {
+        Timer_stop(sensorTimer);
+        Timer_close(sensorTimer);
+        sensorTimer = NULL;
+    }
+
+    if(!sensorSemsCreated)
+        return;
+
+    /* wake each task so it sees sensorRunning cleared, the sampling task first so its last block is handed over */
+    sem_post(&sensorTickSem);
+    if(sensorThreadsCreated & 0x02)
+        pthread_join(sensorThreads[1], NULL);
+    sem_post(&sensorBlockSem);
+    if(sensorThreadsCreated & 0x01)
+        pthread_join(sensorThreads[0], NULL);
+    sensorThreadsCreated = 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * sensor.h
+ *
+ *  One table of sensor drivers sampled by a single task. A hardware timer ticks every SENSOR_TICK_US,
+ *  each tick the task reads every sensor whose period is due and hands the samples to a sink callback
+ *  with one timestamp per tick, so sensors sampled on the same tick share the same time.
+ *
+ *  Sampling and processing are two tasks. The sampling task runs above the SimpleLink spawn task and only
+ *  reads the sensors into one of SENSOR_BLOCKS preallocated blocks; the sink runs in the processing task
+ *  below it, so neither NWP events nor the sink's formatting and network work can delay a sample. When
+ *  every block is still waiting for the processing task the read is dropped and counted instead of
+ *  blocking. The period jitter of the sampling task goes to the SAMPLE_JITTER_US perf histogram, which the
+ *  sensor upload modes send to the host every few seconds along with the samples.
+ *
+ *  The timestamp hook may renumber the ticks and change their period, phase_lock.c does both to put the
+ *  ticks of every board on the AP's TSF grid.
+ *
+ *  Every driver is built into the image. The sensor mask, from the boot profile or SET_RATES, picks the
+ *  ones a board samples, so one image runs on the wrist, on the base, or on a board carrying both. Each
+ *  sensor samples at its driver's default period until sensor_set_period() changes it.
+ */
+
+#ifndef SENSOR_H_
+#define SENSOR_H_
+
+#include <stdint.h>
+
+#include <ti/drivers/I2C.h>
+
+#define SENSOR_TICK_US          250         /* every sensor period is a multiple of this */
+#define SENSOR_MAX_BATCH        16          /* most samples a driver may return from one read */
+#define SENSOR_MAX_SAMPLE_SIZE  8           /* bytes */
+#define SENSOR_TASK_PRIORITY    10          /* sampling, above sl_Task at SPAWN_TASK_PRIORITY (9) */
+#define SENSOR_TASK_STACK_SIZE  2048
+#define SENSOR_PROC_PRIORITY    3           /* the sink, above mainThread and the network tasks that consume samples */
+#define SENSOR_PROC_STACK_SIZE  2048
+#define SENSOR_BLOCKS           8           /* reads in flight between the two tasks, a power of 2 */
+
+/* sensor ids, also used as the sensor field by consumers that multiplex several sensors */
+#define SENSOR_ID_ACCEL         0
+#define SENSOR_ID_LOADCELL      1
+#define SENSOR_ID_RTC           2
+#define SENSOR_ID_COUNT         3
+
+#define SENSOR_DEFAULT_MASK     (1 << SENSOR_ID_ACCEL)  /* the wrist, without a boot profile */
+
+/*
+ * The load cell driver reads the ADC pair every period and feeds the difference through loadcell_dsp.c, a read
+ * returns a sample only for the one in SENSOR_LOADCELL_DECIM reads that completes a decimated output.
+ */
+#define SENSOR_LOADCELL_LOG2_DECIM  4       /* CIC R = 16, 62.5 Hz out of the 2 kHz default */
+#define SENSOR_LOADCELL_OUT_BITS    24      /* 16 or 24 */
+#define SENSOR_LOADCELL_DECIM       (2 << SENSOR_LOADCELL_LOG2_DECIM)
+
+typedef struct
+{
+    const char * name;
+    uint8_t id;
+    uint8_t sample_size;                    /* bytes per sample written by read() */
+    uint32_t default_period_us;             /* multiple of SENSOR_TICK_US */
+
+    /* returns 0 on success, -1 on error */
+    int32_t (*init)(void);
+
+    /* reads up to max_samples samples into buf, oldest first, returns the number read or -1 on error */
+    int32_t (*read)(uint8_t * buf, uint32_t max_samples);
+}sensor_driver_t;
+
+/* returns the current time in us, called once per tick from the sampling task */
+typedef uint32_t (*sensor_timestamp_fn)(void);
+
+/*
+ * Called from the processing task for every successful read. ts_us is the tick time and belongs to the
+ * newest sample, sample i of count was taken at ts_us - (count - 1 - i) * sensor_period(sensor).
+ */
+typedef void (*sensor_sink_fn)(const sensor_driver_t * sensor, uint32_t ts_us, const uint8_t * buf, int32_t count);
+
+/* sample layouts, all little endian as they sit in memory */
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+}sensor_accel_sample_t;
+
+typedef struct
+{
+    uint8_t value[SENSOR_LOADCELL_OUT_BITS / 8];    /* loadcell_dsp_pack() of the decimated difference */
+}sensor_loadcell_sample_t;
+
+typedef struct
+{
+    uint32_t seconds_of_day;
+}sensor_rtc_sample_t;
+
+/* drivers, defined in sensor_drivers.c */
+extern const sensor_driver_t sensor_bma222e;
+extern const sensor_driver_t sensor_loadcell;
+extern const sensor_driver_t sensor_ds3231;
+
+uint32_t sensor_loadcell_delay_us();
+
+I2C_Handle sensor_i2c();
+
+uint32_t sensor_count();
+
+const sensor_driver_t * sensor_get(uint32_t index);
+
+void sensor_set_mask(uint8_t mask);
+
+int32_t sensor_set_period(uint8_t mask, uint32_t period_us);
+
+uint32_t sensor_period(const sensor_driver_t * sensor);
+
+int32_t sensor_init_all();
+
+void sensor_set_timestamp_hook(sensor_timestamp_fn fn);
+
+void sensor_set_tick(uint32_t tick);
+
+int32_t sensor_set_tick_counts(uint32_t counts);
+
+int32_t sensor_start_task(sensor_sink_fn sink);
+
+void sensor_stop_task();
+
+uint32_t sensor_overruns();
+
+uint32_t sensor_dropped();
+
+#endif /* SENSOR_H_ */
@@ -0,0 +1,214 @@
+/*
+ * sensor_drivers.c
+ *
+ *  Driver table entries for the BMA222E accelerometer, the load cell ADC pair and the DS3231 RTC.
+ *  Reads are synchronous and short, they run on the sensor task between timer ticks.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <ti/drivers/ADC.h>
+#include <ti/drivers/I2C.h>
+#include <ti/sail/bma2x2/bma2x2.h>
+
+#include "ti_drivers_config.h"
+#include "uart_term.h"
+#include "sensor.h"
+#include "clock_discipline.h"
+#include "loadcell_dsp.h"
+
+#define DS3231_SECONDS_REG      0x00
+
+extern s32 bma2x2_data_readout_template(I2C_Handle i2cHndl);
+
+/* ------------------------------- BMA222E accelerometer ------------------------------- */
+
+static int32_t bma222e_init()
+{
+    I2C_Handle i2c = sensor_i2c();
+
+    if(i2c == NULL)
+    {
+        UART_PRINT("Error Initializing I2C\n\r");
+        return(-1);
+    }
+
+    /* the bosch readout template leaves the bma222e in normal mode */
+    if(BMA2x2_INIT_VALUE != bma2x2_data_readout_template(i2c))
+    {
+        UART_PRINT("Error Initializing bma222e\n\r");
+        return(-1);
+    }
+
+    return(0);
+}
+
+static int32_t bma222e_read(uint8_t * buf, uint32_t max_samples)
+{
+    struct bma2x2_accel_data accel;
+    sensor_accel_sample_t sample;
+
+    if(max_samples < 1)
+        return(0);
+
+    if(BMA2x2_INIT_VALUE != bma2x2_read_accel_xyz(&accel))
+        return(-1);
+
+    sample.x = accel.x;
+    sample.y = accel.y;
+    sample.z = accel.z;
+    memcpy(buf, &sample, sizeof(sample));
+
+    return(1);
+}
+
+const sensor_driver_t sensor_bma222e =
+{
+    .name = "bma222e",
+    .id = SENSOR_ID_ACCEL,
+    .sample_size = sizeof(sensor_accel_sample_t),
+    .default_period_us = 1000,
+    .init = bma222e_init,
+    .read = bma222e_read,
+};
+
+/* ------------------------------- load cell ADC pair ------------------------------- */
+
+static ADC_Handle loadcellAdc0 = NULL;
+static ADC_Handle loadcellAdc1 = NULL;
+static loadcell_dsp_t loadcellDsp;
+
+static int32_t loadcell_init()
+{
+    ADC_Params params;
+
+    ADC_init();
+    ADC_Params_init(&params);
+
+    /* opened on the first capture and kept, a second ADC_open() of the same channel fails */
+    if(loadcellAdc0 == NULL)
+        loadcellAdc0 = ADC_open(CONFIG_ADC_0, &params);
+    if(loadcellAdc1 == NULL)
+        loadcellAdc1 = ADC_open(CONFIG_ADC_1, &params);
+    if(loadcellAdc0 == NULL || loadcellAdc1 == NULL)
+    {
+        UART_PRINT("Error initializing the load cell ADCs\n\r");
+        return(-1);
+    }
+
+    /* every capture starts the decimator from a clean state */
+    return loadcell_dsp_init(&loadcellDsp, SENSOR_LOADCELL_LOG2_DECIM, SENSOR_LOADCELL_OUT_BITS);
+}
+
+/* one ADC pair per read, a decimated sample every SENSOR_LOADCELL_DECIM reads */
+static int32_t loadcell_read(uint8_t * buf, uint32_t max_samples)
+{
+    uint16_t adc0;
+    uint16_t adc1;
+    int32_t out;
+
+    if(max_samples < 1)
+        return(0);
+
+    if(ADC_convert(loadcellAdc0, &adc0) != ADC_STATUS_SUCCESS ||
+       ADC_convert(loadcellAdc1, &adc1) != ADC_STATUS_SUCCESS)
+        return(-1);
+
+    /* same differential reading adcsinglechannel.c feeds to the decimator */
+    if(!loadcell_dsp_push(&loadcellDsp, (int32_t)adc1 - (int32_t)adc0, &out))
+        return(0);
+
+    loadcell_dsp_pack(out, SENSOR_LOADCELL_OUT_BITS, buf);
+    return(1);
+}
+
+/* how long before its read a load cell sample's input is centered, at the load cell period in use */
+uint32_t sensor_loadcell_delay_us()
+{
+    return loadcell_dsp_delay_us(&loadcellDsp, sensor_period(&sensor_loadcell));
+}
+
+const sensor_driver_t sensor_loadcell =
+{
+    .name = "loadcell",
+    .id = SENSOR_ID_LOADCELL,
+    .sample_size = sizeof(sensor_loadcell_sample_t),
+    .default_period_us = 500,
+    .init = loadcell_init,
+    .read = loadcell_read,
+};
+
+/* ------------------------------- DS3231 RTC ------------------------------- */
+
+static uint32_t bcd_to_bin(uint8_t bcd)
+{
+    return ((bcd >> 4) * 10) + (bcd & 0x0F);
+}
+
+static int32_t ds3231_transfer(uint8_t * rxBuffer, uint8_t rxCount)
+{
+    I2C_Transaction i2cTransaction;
+    uint8_t txBuffer[1] = { DS3231_SECONDS_REG };
+
+    i2cTransaction.slaveAddress = DS3231_ADDR;
+    i2cTransaction.writeBuf = txBuffer;
+    i2cTransaction.writeCount = 1;
+    i2cTransaction.readBuf = rxBuffer;
+    i2cTransaction.readCount = rxCount;
+
+    if(!I2C_transfer(sensor_i2c(), &i2cTransaction))
+        return(-1);
+
+    return(0);
+}
+
+static int32_t ds3231_init()
+{
+    uint8_t rxBuffer[1];
+
+    if(sensor_i2c() == NULL)
+    {
+        UART_PRINT("Error Initializing I2C\n\r");
+        return(-1);
+    }
+
+    /* probe the seconds register, same detection spimaster.c does */
+    if(ds3231_transfer(rxBuffer, 1) != 0)
+    {
+        UART_PRINT("Failed to detect the DS3231 at 0x%x\n\r", DS3231_ADDR);
+        return(-1);
+    }
+
+    return(0);
+}
+
+static int32_t ds3231_read(uint8_t * buf, uint32_t max_samples)
+{
+    uint8_t rxBuffer[3];
+    sensor_rtc_sample_t sample;
+
+    if(max_samples < 1)
+        return(0);
+
+    /* seconds, minutes, hours in BCD, 24 hour mode */
+    if(ds3231_transfer(rxBuffer, 3) != 0)
+        return(-1);
+
+    sample.seconds_of_day = bcd_to_bin(rxBuffer[0] & 0x7F) +
+                            bcd_to_bin(rxBuffer[1] & 0x7F) * 60 +
+                            bcd_to_bin(rxBuffer[2] & 0x3F) * 3600;
+    memcpy(buf, &sample, sizeof(sample));
+
+    return(1);
+}
+
+const sensor_driver_t sensor_ds3231 =
+{
+    .name = "ds3231",
+    .id = SENSOR_ID_RTC,
+    .sample_size = sizeof(sensor_rtc_sample_t),
+    .default_period_us = 1000000,
+    .init = ds3231_init,
+    .read = ds3231_read,
+};
@@ -0,0 +1,327 @@
+/*
+ * spill_log.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "network_terminal.h"
+#include "boot_profile.h"
+#include "spill_log.h"
+
+static uint32_t spillSeq[SPILL_SEGMENTS];      /* sequence number held by each slot, 0 when empty */
+static uint32_t spillNextSeq = 1;
+static uint32_t spillLeaseEnd = 0;              /* first sequence number not covered by SPILL_SEQ_FILE */
+static uint8_t spillNextSlot = 0;
+static uint32_t spillWritten = 0;
+static uint32_t spillAcked = 0;
+static uint32_t spillDropped = 0;
+static uint32_t spillCorrupt = 0;
+
+static uint32_t get_u32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static void spill_name(uint8_t slot, char * name)
+{
+    sprintf(name, "spill_%u.bin", slot);
+}
+
+static void spill_delete(uint8_t slot)
+{
+    char name[16];
+
+    spill_name(slot, name);
+    sl_FsDel((const uint8_t *)name, 0);
+    spillSeq[slot] = 0;
+}
+
+/* slot holding the lowest sequence number above after, -1 when there is none */
+static int32_t spill_oldest_slot(uint32_t after)
+{
+    int32_t oldest = -1;
+    uint8_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+        if(spillSeq[i] > after && (oldest < 0 || spillSeq[i] < spillSeq[oldest]))
+            oldest = i;
+
+    return oldest;
+}
+
+/*
+ * slot for the next segment: the first free one from spillNextSlot on, so the slots still take turns, and the
+ * one holding the oldest segment only when every slot holds unacknowledged data
+ */
+static uint8_t spill_free_slot()
+{
+    uint8_t slot;
+    uint8_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+    {
+        slot = (spillNextSlot + i) % SPILL_SEGMENTS;
+        if(spillSeq[slot] == 0)
+            return slot;
+    }
+
+    return (uint8_t)spill_oldest_slot(0);
+}
+
+static uint32_t spill_read_lease()
+{
+    uint8_t value[4];
+    int32_t fd;
+    int32_t ret;
+    uint32_t token = 0;
+
+    fd = sl_FsOpen((const uint8_t *)SPILL_SEQ_FILE, SL_FS_READ, (_u32 *)&token);
+    if(fd < 0)
+        return 0;
+
+    ret = sl_FsRead(fd, 0, value, sizeof(value));
+    sl_FsClose(fd, NULL, NULL, 0);
+
+    return (ret == sizeof(value)) ? get_u32(value) : 0;
+}
+
+static int32_t spill_write_lease(uint32_t lease_end)
+{
+    uint8_t value[4];
+    int32_t fd;
+    int32_t ret;
+    uint32_t token = 0;
+
+    put_u32(value, lease_end);
+    fd = sl_FsOpen((const uint8_t *)SPILL_SEQ_FILE, SL_FS_CREATE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(sizeof(value)),
+                   (_u32 *)&token);
+    if(fd < 0)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, fd, DEVICE_ERROR);
+        return(-1);
+    }
+
+    ret = sl_FsWrite(fd, 0, value, sizeof(value));
+    sl_FsClose(fd, NULL, NULL, 0);
+    if(ret != sizeof(value))
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, ret, DEVICE_ERROR);
+        return(-1);
+    }
+
+    return(0);
+}
+
+/* rebuilds the log from the segment files left in flash, returns the number of pending segments */
+int32_t spill_log_init()
+{
+    uint8_t header[SPILL_HEADER_SIZE];
+    char name[16];
+    int32_t fd;
+    int32_t ret;
+    uint32_t token = 0;
+    uint32_t newest = 0;
+    uint8_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+    {
+        spillSeq[i] = 0;
+        spill_name(i, name);
+        fd = sl_FsOpen((const uint8_t *)name, SL_FS_READ, (_u32 *)&token);
+        if(fd < 0)
+            continue;
+
+        ret = sl_FsRead(fd, 0, header, SPILL_HEADER_SIZE);
+        sl_FsClose(fd, NULL, NULL, 0);
+        if(ret != SPILL_HEADER_SIZE || get_u32(&header[0]) != SPILL_MAGIC || get_u32(&header[4]) == 0)
+        {
+            spillCorrupt++;
+            spill_delete(i);
+            continue;
+        }
+
+        spillSeq[i] = get_u32(&header[4]);
+        if(spillSeq[i] >= newest)
+        {
+            newest = spillSeq[i];
+            spillNextSlot = (i + 1) % SPILL_SEGMENTS;
+        }
+    }
+    /* never hand out a number that may have been used before the reset */
+    spillNextSeq = spill_read_lease();
+    if(spillNextSeq <= newest)
+        spillNextSeq = newest + 1;
+    spillLeaseEnd = 0;
+
+    if(spill_log_pending() != 0)
+        UART_PRINT("[nnaji msg] spill log: %u segments waiting to be sent\n\r", spill_log_pending());
+
+    return spill_log_pending();
+}
+
+/* sequence number for the next upload, renews the lease in SPILL_SEQ_FILE when it runs out */
+uint32_t spill_log_next_seq()
+{
+    if(spillNextSeq >= spillLeaseEnd)
+    {
+        spillLeaseEnd = spillNextSeq + SPILL_SEQ_LEASE;
+        spill_write_lease(spillLeaseEnd);
+    }
+
+    return spillNextSeq++;
+}
+
+/* lowest sequence number still waiting for an acknowledgement, 0 when the log is empty */
+uint32_t spill_log_oldest_seq()
+{
+    int32_t slot = spill_oldest_slot(0);
+
+    return (slot < 0) ? 0 : spillSeq[slot];
+}
+
+/* writes one upload chunk to a free slot, returns 0 or -1 if the file system refused it */
+int32_t spill_log_append(uint32_t seq, const uint8_t * data, uint32_t len)
+{
+    uint8_t header[SPILL_HEADER_SIZE];
+    char name[16];
+    int32_t fd;
+    int32_t ret;
+    uint32_t token = 0;
+    uint8_t slot = spill_free_slot();
+
+    if(len > SPILL_SEGMENT_SIZE - SPILL_HEADER_SIZE)
+        len = SPILL_SEGMENT_SIZE - SPILL_HEADER_SIZE;
+
+    /* a full log loses its oldest segment */
+    if(spillSeq[slot] != 0)
+    {
+        spillDropped++;
+        UART_PRINT("[nnaji msg] spill log full, dropping segment %u\n\r", spillSeq[slot]);
+    }
+
+    put_u32(&header[0], SPILL_MAGIC);
+    put_u32(&header[4], seq);
+    put_u32(&header[8], len);
+    put_u32(&header[12], boot_crc32(data, len));
+
+    spill_name(slot, name);
+    fd = sl_FsOpen((const uint8_t *)name, SL_FS_CREATE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(SPILL_SEGMENT_SIZE),
+                   (_u32 *)&token);
+    if(fd < 0)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, fd, DEVICE_ERROR);
+        return(-1);
+    }
+
+    ret = sl_FsWrite(fd, 0, header, SPILL_HEADER_SIZE);
+    if(ret == SPILL_HEADER_SIZE)
+        ret = sl_FsWrite(fd, SPILL_HEADER_SIZE, (uint8_t *)data, len);
+    sl_FsClose(fd, NULL, NULL, 0);
+    if(ret != (int32_t)len)
+    {
+        UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, ret, DEVICE_ERROR);
+        spill_delete(slot);
+        return(-1);
+    }
+
+    spillSeq[slot] = seq;
+    spillNextSlot = (slot + 1) % SPILL_SEGMENTS;
+    spillWritten++;
+
+    return(0);
+}
+
+uint32_t spill_log_pending()
+{
+    uint32_t pending = 0;
+    uint8_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+        if(spillSeq[i] != 0)
+            pending++;
+
+    return pending;
+}
+
+/*
+ * Reads the payload of the oldest segment with a sequence number above after into buf and its sequence number
+ * into seq. Returns the payload length, 0 when there is no such segment and -1 on a read error. Corrupt
+ * segments are dropped on the way, the next one is returned instead.
+ */
+int32_t spill_log_peek(uint32_t after, uint8_t * buf, uint32_t len, uint32_t * seq)
+{
+    uint8_t header[SPILL_HEADER_SIZE];
+    char name[16];
+    int32_t fd;
+    int32_t ret;
+    int32_t slot;
+    uint32_t payload;
+    uint32_t token = 0;
+
+    while((slot = spill_oldest_slot(after)) >= 0)
+    {
+        spill_name(slot, name);
+        fd = sl_FsOpen((const uint8_t *)name, SL_FS_READ, (_u32 *)&token);
+        if(fd < 0)
+        {
+            UART_PRINT("[line:%d, error:%d] %s\n\r", __LINE__, fd, DEVICE_ERROR);
+            return(-1);
+        }
+
+        ret = sl_FsRead(fd, 0, header, SPILL_HEADER_SIZE);
+        payload = get_u32(&header[8]);
+        if(ret == SPILL_HEADER_SIZE && payload <= len)
+            ret = sl_FsRead(fd, SPILL_HEADER_SIZE, buf, payload);
+        sl_FsClose(fd, NULL, NULL, 0);
+
+        if(payload <= len && ret == (int32_t)payload && get_u32(&header[0]) == SPILL_MAGIC && get_u32(&header[12]) == boot_crc32(buf, payload))
+        {
+            *seq = spillSeq[slot];
+            return payload;
+        }
+
+        UART_PRINT("[nnaji msg] spill log: segment %u is corrupt, dropping it\n\r", spillSeq[slot]);
+        spillCorrupt++;
+        spill_delete(slot);
+    }
+
+    return 0;
+}
+
+/* deletes every segment up to and including contiguous, and the ones listed in selective */
+void spill_log_ack(uint32_t contiguous, const uint32_t * selective, uint32_t count)
+{
+    uint32_t j;
+    uint8_t i;
+
+    for(i=0;i<SPILL_SEGMENTS;i++)
+    {
+        if(spillSeq[i] == 0)
+            continue;
+
+        for(j=0;j<count;j++)
+            if(selective[j] == spillSeq[i])
+                break;
+
+        if(spillSeq[i] <= contiguous || j < count)
+        {
+            spill_delete(i);
+            spillAcked++;
+        }
+    }
+}
+
+void spill_log_report()
+{
+    UART_PRINT("[nnaji msg] spill log: %u pending, %u written, %u acknowledged, %u dropped, %u corrupt, next seq %u\n\r",
+               spill_log_pending(), spillWritten, spillAcked, spillDropped, spillCorrupt, spillNextSeq);
+}
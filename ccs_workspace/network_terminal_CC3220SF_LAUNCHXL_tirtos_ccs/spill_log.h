@@ -0,0 +1,56 @@
+/*
+ * spill_log.h
+ *
+ *  Store and forward log in the SimpleLink serial flash file system for uploads the host has not acknowledged.
+ *  Every upload carries a sequence number from spill_log_next_seq(). When the AP can't be reached, or the host
+ *  does not acknowledge the upload, the whole upload chunk is written to one segment file instead of being lost.
+ *  On the next connections the segments are sent again, oldest first and at most SPILL_REPLAY_MAX per
+ *  connection, and they are only deleted once the host acknowledged their sequence number.
+ *
+ *  There are SPILL_SEGMENTS segment files. A new segment goes to the next free slot after the last one written,
+ *  so every slot takes about the same share of erase cycles, and each one is written once, in one go, and
+ *  deleted once it was acknowledged; nothing is ever rewritten in place. Only when every slot holds
+ *  unacknowledged data is the oldest one overwritten and counted as dropped. Each segment starts with a header:
+ *      0   u32  magic SPILL_MAGIC
+ *      4   u32  upload sequence number, increasing, 0 is never used
+ *      8   u32  payload length
+ *      12  u32  CRC-32 of the payload
+ *  so the log is rebuilt from the files alone after a reset.
+ *
+ *  Sequence numbers keep increasing across resets. They are leased from SPILL_SEQ_FILE SPILL_SEQ_LEASE at a
+ *  time, so the file is written once per SPILL_SEQ_LEASE uploads; a reset skips the rest of the lease, which
+ *  the host sees as a range that was never sent.
+ */
+
+#ifndef SPILL_LOG_H_
+#define SPILL_LOG_H_
+
+#include <stdint.h>
+
+#include "ap_connection.h"
+
+#define SPILL_MAGIC             0x4C495053      /* "SPIL" */
+#define SPILL_SEGMENTS          8
+#define SPILL_HEADER_SIZE       16
+#define SPILL_SEGMENT_SIZE      (SPILL_HEADER_SIZE + MAX_TX_PACKET_SIZE)
+#define SPILL_REPLAY_MAX        2               /* backlog segments sent per connection */
+#define SPILL_SEQ_FILE          "spill_seq.bin"
+#define SPILL_SEQ_LEASE         64
+
+int32_t spill_log_init();
+
+uint32_t spill_log_next_seq();
+
+uint32_t spill_log_oldest_seq();
+
+int32_t spill_log_append(uint32_t seq, const uint8_t * data, uint32_t len);
+
+uint32_t spill_log_pending();
+
+int32_t spill_log_peek(uint32_t after, uint8_t * buf, uint32_t len, uint32_t * seq);
+
+void spill_log_ack(uint32_t contiguous, const uint32_t * selective, uint32_t count);
+
+void spill_log_report();
+
+#endif /* SPILL_LOG_H_ */
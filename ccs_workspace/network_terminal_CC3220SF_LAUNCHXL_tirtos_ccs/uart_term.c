@@ -40,6 +40,7 @@
 #include <string.h>
 
 #include "uart_term.h"
+#include "mem_pool.h"
 
 extern int vsnprintf(char * s,
                      size_t n,
@@ -149,9 +150,25 @@ int Report(const char *pcFormat,
     int iRet = 0;
     char        *pcBuff;
     char        *pcTemp;
-    int iSize = 256;
+    int iSize = 2 * MEM_LOG_BLOCK_SIZE;
     va_list list;
 
+    /* most lines fit in a log pool block, only longer ones (or all blocks busy) go to the heap */
+    pcBuff = (char*)mem_pool_alloc(MEM_POOL_LOG);
+    if(pcBuff != NULL)
+    {
+        va_start(list,pcFormat);
+        iRet = vsnprintf(pcBuff, MEM_LOG_BLOCK_SIZE, pcFormat, list);
+        va_end(list);
+        if((iRet > -1) && (iRet < MEM_LOG_BLOCK_SIZE))
+        {
+            Message(pcBuff);
+            mem_pool_free(MEM_POOL_LOG, pcBuff);
+            return(iRet);
+        }
+        mem_pool_free(MEM_POOL_LOG, pcBuff);
+    }
+
     pcBuff = (char*)malloc(iSize);
     if(pcBuff == NULL)
     {
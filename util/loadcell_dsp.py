@@ -0,0 +1,82 @@
+import sys
+
+import numpy as np
+
+# make sure these match loadcell_dsp.h / loadcell_dsp.c in the cc3220sf network terminal code
+INPUT_BITS = 13
+CIC_STAGES = 3
+FIR_DECIM = 2
+FIR_COEF_SHIFT = 15
+FIR_COEFS = np.array([11, 18, -38, -93, 55, 284, 26, -626, -379, 1080, 1304, -1462, -3481, 1072, 10695, 15836,
+                      10695, 1072, -3481, -1462, 1304, 1080, -379, -626, 26, 284, 55, -93, -38, 18, 11],
+                     dtype=np.int64)
+
+
+def loadcell_dsp(diffs, log2_decim=4, out_bits=24):
+    """
+    Host reference of the firmware CIC + FIR decimator, bit exact with loadcell_dsp_push() when started from the same
+    (zeroed) state.
+
+    :param diffs: (array like) raw (ADC_1 - ADC_0) code differences, one per ADC pair conversion
+    :param log2_decim: (int) log2 of the CIC decimation factor R
+    :param out_bits: (int) 16 or 24
+    :return: (np.ndarray) int64 decimated outputs, one per 2 * R inputs
+    """
+    decim = 1 << log2_decim
+    out_shift = FIR_COEF_SHIFT + CIC_STAGES * log2_decim - (out_bits - INPUT_BITS)
+
+    # integrators wrap modulo 2^32 exactly like the uint32_t ones on the board
+    v = np.asarray(diffs, dtype=np.int64).astype(np.uint32)
+    for _ in range(CIC_STAGES):
+        v = np.cumsum(v, dtype=np.uint32)
+
+    v = v[decim - 1::decim]
+    for _ in range(CIC_STAGES):
+        v = v - np.concatenate(([np.uint32(0)], v[:-1]))
+    v = v.view(np.int32).astype(np.int64)
+
+    # the firmware produces an output after every FIR_DECIM-th CIC output
+    acc = np.convolve(v, FIR_COEFS)[:len(v)][FIR_DECIM - 1::FIR_DECIM]
+    out = (acc + (1 << (out_shift - 1))) >> out_shift
+    max_out = (1 << (out_bits - 1)) - 1
+    return np.clip(out, -max_out - 1, max_out)
+
+
+def check_bit_exact(capture_path, log2_decim=4, out_bits=24):
+    """
+    Compares a board capture against the reference. The capture is the UART output of adcsinglechannel built with
+    LOADCELL_DSP_DUMP defined: lines "raw,<diff>" for every input and "out,<value>" for every output.
+
+    :param capture_path: (str) path to the saved UART log
+    :return: (bool) True if every output matches
+    """
+    raw = []
+    board_out = []
+    with open(capture_path) as f:
+        for line in f:
+            fields = line.strip().split(',')
+            if len(fields) != 2:
+                continue
+            if fields[0] == 'raw':
+                raw.append(int(fields[1]))
+            elif fields[0] == 'out':
+                board_out.append(int(fields[1]))
+
+    ref_out = loadcell_dsp(raw, log2_decim=log2_decim, out_bits=out_bits)
+    n = min(len(ref_out), len(board_out))
+    mismatches = np.flatnonzero(ref_out[:n] != np.asarray(board_out[:n], dtype=np.int64))
+    print(f'{len(raw)} inputs, {len(board_out)} board outputs, {len(ref_out)} reference outputs, '
+          f'{len(mismatches)} mismatches')
+    if len(mismatches) > 0:
+        i = mismatches[0]
+        print(f'first mismatch at output {i}: board={board_out[i]} reference={ref_out[i]}')
+    return len(mismatches) == 0 and len(board_out) > 0
+
+
+if __name__ == "__main__":
+    # usage: python loadcell_dsp.py <uart capture> [log2_decim] [out_bits]
+    args = sys.argv[1:]
+    ok = check_bit_exact(args[0],
+                         log2_decim=int(args[1]) if len(args) > 1 else 4,
+                         out_bits=int(args[2]) if len(args) > 2 else 24)
+    sys.exit(0 if ok else 1)
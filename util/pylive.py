@@ -1,3 +1,5 @@
+import time
+
 import matplotlib.pyplot as plt
 import numpy as np
 
@@ -71,3 +73,158 @@ def live_plotter_xy(x_vecs, y_vecs, lines, line_count, x_label='test x', y_label
     plt.pause(pause_time)
 
     return lines
+
+
+def min_max_decimate(t, y, t_start, t_end, bins):
+    """
+    Reduces a time ordered trace to at most 2 points per bin (the bin minimum and maximum), which draws exactly the
+    same envelope as the full trace once a bin is one pixel wide.
+
+    :param t: (np.ndarray) sample times, ascending
+    :param y: (np.ndarray) sample values
+    :param t_start: (float) left edge of the view
+    :param t_end: (float) right edge of the view
+    :param bins: (int) number of bins, normally the axes width in pixels
+    :return: (tuple) (x, y) arrays of at most 2 * bins points
+    """
+    lo = np.searchsorted(t, t_start, side='left')
+    t = t[lo:]
+    y = y[lo:]
+    if len(t) <= 2 * bins:
+        return t, y
+
+    edges = np.linspace(t_start, t_end, bins + 1)
+    starts = np.unique(np.searchsorted(t, edges[:-1], side='left'))
+    starts = starts[starts < len(t)]
+    mins = np.minimum.reduceat(y, starts)
+    maxs = np.maximum.reduceat(y, starts)
+
+    x_out = np.repeat(t[starts], 2)
+    y_out = np.empty(2 * len(starts), dtype=y.dtype)
+    y_out[0::2] = mins
+    y_out[1::2] = maxs
+    return x_out, y_out
+
+
+# newest samples DecimatingLivePlot measures a ring's rate over when it isn't given
+RATE_ESTIMATE_SAMPLES = 256
+
+
+class DecimatingLivePlot:
+    """
+    Fixed frame rate live plot over a set of SampleRings. Each frame pulls a min/max-per-pixel view of the last
+    window_s seconds from every ring and redraws only the lines with blitting; axes, labels and ticks are drawn once.
+    The x axis is time relative to the newest sample so its limits never change between frames.
+    """
+
+    def __init__(self, rings, channel_labels, window_s=5.0, fps=20, x_label='time (s)', title='', y_ranges=None,
+                 max_samples=None, rates=None):
+        """
+        :param rings: (list) SampleRing per board
+        :param channel_labels: (list) list of y labels per board, one per ring channel
+        :param window_s: (float) length of the visible time window in seconds
+        :param fps: (float) frames per second
+        :param x_label: (str) shared x label
+        :param title: (str) figure title
+        :param y_ranges: (list) list of (min, max) per board channel, None to autoscale when a trace leaves the view
+        :param max_samples: (int) most samples pulled from a ring per frame, defaults to 90% of its capacity
+        :param rates: (list) samples/s per ring, None to estimate it from the newest samples every frame
+        """
+        self.rings = rings
+        self.window_s = window_s
+        self.frame_period = 1.0 / fps
+        self.y_ranges = y_ranges
+        self.max_samples = max_samples
+        self.rates = rates
+        self.lines = []
+        self.background = None
+
+        line_count = sum(len(labels) for labels in channel_labels)
+        plt.ion()
+        self.fig, axs = plt.subplots(line_count, sharex=True, sharey=False, figsize=(13, 6), squeeze=False)
+        self.axs = axs[:, 0]
+        self.fig.text(0.5, 0.04, x_label, ha='center', fontsize='x-large')
+        self.fig.suptitle(title, fontsize='xx-large', fontweight='bold')
+
+        k = 0
+        for labels in channel_labels:
+            for label in labels:
+                ax = self.axs[k]
+                line, = ax.plot([], [], 'r-', alpha=0.8, animated=True)
+                ax.set_ylabel(label)
+                ax.set_xlim(-window_s, 0)
+                if y_ranges is not None:
+                    ax.set_ylim(y_ranges[k][0], y_ranges[k][1])
+                self.lines.append(line)
+                k += 1
+
+        self.fig.canvas.mpl_connect('draw_event', self._on_draw)
+        plt.show(block=False)
+        self.fig.canvas.draw()
+
+    def _on_draw(self, event):
+        # a full redraw (first frame, resize, rescale) invalidates the cached background
+        self.background = self.fig.canvas.copy_from_bbox(self.fig.bbox)
+
+    def _window_samples(self, i, ring):
+        """
+        Number of samples that cover window_s at the ring's rate, with some margin for jitter, so a frame copies only
+        what it draws instead of most of the ring.
+        """
+        limit = self.max_samples if self.max_samples is not None else int(ring.capacity * 0.9)
+        if self.rates is not None:
+            rate = self.rates[i]
+        else:
+            t, _ = ring.latest(RATE_ESTIMATE_SAMPLES)
+            if len(t) < 2 or t[-1] <= t[0]:
+                return min(limit, RATE_ESTIMATE_SAMPLES)
+            rate = (len(t) - 1) / (t[-1] - t[0])
+        return min(limit, int(self.window_s * rate * 1.1) + 2)
+
+    def draw_frame(self):
+        if self.background is None:
+            self.fig.canvas.draw()
+
+        rescale = False
+        k = 0
+        for i, ring in enumerate(self.rings):
+            t, y = ring.latest(self._window_samples(i, ring))
+            t_now = t[-1] if len(t) > 0 else 0.0
+            for c in range(ring.channels):
+                line = self.lines[k]
+                bins = max(1, int(line.axes.bbox.width))
+                x_dec, y_dec = min_max_decimate(t, y[:, c], t_now - self.window_s, t_now, bins)
+                line.set_data(x_dec - t_now, y_dec)
+
+                if self.y_ranges is None and len(y_dec) > 0:
+                    y_min, y_max = line.axes.get_ylim()
+                    lo, hi = float(np.min(y_dec)), float(np.max(y_dec))
+                    if lo < y_min or hi > y_max:
+                        pad = 0.1 * (hi - lo) if hi > lo else 1.0
+                        line.axes.set_ylim(lo - pad, hi + pad)
+                        rescale = True
+                k += 1
+
+        if rescale:
+            self.fig.canvas.draw()
+
+        self.fig.canvas.restore_region(self.background)
+        for line in self.lines:
+            line.axes.draw_artist(line)
+        self.fig.canvas.blit(self.fig.bbox)
+        self.fig.canvas.flush_events()
+
+    def run(self, stop_flag=None):
+        """
+        Draws frames at the configured rate until the window is closed or stop_flag (threading.Event) is set.
+        """
+        next_frame = time.monotonic()
+        while plt.fignum_exists(self.fig.number) and (stop_flag is None or not stop_flag.is_set()):
+            self.draw_frame()
+            next_frame += self.frame_period
+            delay = next_frame - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            else:
+                # running behind, drop the missed frames instead of trying to catch up
+                next_frame = time.monotonic()
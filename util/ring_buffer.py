@@ -0,0 +1,59 @@
+import numpy as np
+
+
+class SampleRing:
+    """
+    Preallocated ring buffer of time stamped multi-channel samples. One receive thread writes whole batches with
+    write(), any number of readers take chronological copies with latest(). Nothing is allocated per sample, so the
+    receive path costs the same at any sample rate.
+    """
+
+    def __init__(self, capacity, channels):
+        """
+        :param capacity: (int) number of samples kept before the oldest ones are overwritten
+        :param channels: (int) number of values stored per sample
+        """
+        self.capacity = capacity
+        self.channels = channels
+        self.t = np.zeros(capacity, dtype=np.float64)
+        self.y = np.zeros((capacity, channels), dtype=np.float32)
+        # total number of samples ever written, only advanced by the writer once a batch is in place
+        self.count = 0
+
+    def write(self, t, y):
+        """
+        :param t: (np.ndarray) sample times, shape (n,)
+        :param y: (np.ndarray) sample values, shape (n, channels)
+        """
+        n = len(t)
+        if n == 0:
+            return
+        if n > self.capacity:
+            t = t[-self.capacity:]
+            y = y[-self.capacity:]
+            n = self.capacity
+
+        start = self.count % self.capacity
+        first = min(n, self.capacity - start)
+        self.t[start:start + first] = t[:first]
+        self.y[start:start + first] = y[:first]
+        if first < n:
+            self.t[:n - first] = t[first:]
+            self.y[:n - first] = y[first:]
+        self.count += n
+
+    def latest(self, n=None):
+        """
+        Copies the newest n samples in chronological order. Readers should ask for noticeably less than capacity, the
+        writer may be overwriting the oldest slots while the copy is taken.
+
+        :param n: (int) number of samples, defaults to everything currently held
+        :return: (tuple) (t, y) copies of shape (m,) and (m, channels), m <= n
+        """
+        count = self.count
+        held = min(count, self.capacity)
+        n = held if n is None else min(n, held)
+        end = count % self.capacity
+        idx = (np.arange(end - n, end)) % self.capacity
+        return self.t[idx], self.y[idx]
+